@@ -0,0 +1,54 @@
+/*
+ * bench.h: Helpers shared by the kernel benches
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vdr/tools.h>
+
+// The options every kernel bench takes, for getopt() and the usage text
+#define BENCH_OPTIONS "t:qh"
+#define BENCH_USAGE   "  -t MS     time per case (default: 200)\n" \
+                      "  -q        correctness only, no timing\n"
+#define BENCH_TIMEMS  200
+
+static inline uint64_t NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Deterministic, so a failing case can be reproduced
+static uint32_t seed = 1;
+
+static inline uint32_t Random(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static int failed = 0;
+
+// The result column of a case, counts it if it failed
+static inline const char *Verdict(bool Ok)
+{
+  if (!Ok)
+    failed++;
+  return Ok ? "ok" : "FAIL";
+}
+
+// Reports the failed cases and returns the exit code
+static inline int Failed(const char *Reason)
+{
+  if (failed)
+    printf("%d case(s) %s\n", failed, Reason);
+  return failed ? 1 : 0;
+}
+
+#endif // __BENCH_H
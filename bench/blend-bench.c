@@ -0,0 +1,377 @@
+/*
+ * blend-bench.c: Correctness test and benchmark for the OSD blend kernel
+ *
+ * Blends synthetic OSD patterns into synthetic frames of every supported
+ * layout at SD/HD/UHD size, compares the result against a floating point
+ * reference blend and reports ns/pixel. Exits with 1 if any case is outside
+ * the tolerance, so a faster kernel can be checked before it replaces the
+ * current one.
+ *
+ * Usage: gstblend-bench [-t MS] [-s SD|HD|UHD] [-q]
+ */
+
+#include <math.h>
+#include <string.h>
+#include "../gstblend.h"
+#include "bench.h"
+
+#define TOLERANCE_RGB  1  // max. difference to the reference per byte
+#define TOLERANCE_YUV  2  // integer vs. float matrix adds one more step
+
+// --- Helpers ---------------------------------------------------------------
+
+static inline int Clamp(double v)
+{
+  int i = (int)floor(v + 0.5);
+  return i < 0 ? 0 : i > 255 ? 255 : i;
+}
+
+// --- Frames ----------------------------------------------------------------
+
+// YV12 has no blend format of its own, cGstOsdProvider::ApplyOsdOverlay()
+// hands it to the kernel as I420 with the chroma planes swapped
+#define LAYOUT_YV12 bfCount
+
+static const char *LayoutName(int Layout)
+{
+  return Layout == LAYOUT_YV12 ? "YV12" : GstBlendFormatName(Layout);
+}
+
+struct tSize {
+  const char *name;
+  int width;
+  int height;
+};
+
+static const tSize Sizes[] = {
+  { "SD",  720,  576  },
+  { "HD",  1920, 1080 },
+  { "UHD", 3840, 2160 },
+};
+
+class cFrame {
+public:
+  int layout;         // eGstBlendFormat or LAYOUT_YV12
+  tGstBlendFrame f;   // as the kernel gets it
+  uint8_t *plane[3];  // in memory order, as GStreamer maps them
+  int pitch[3];
+  uint8_t *mem;
+  int size[3];
+
+  cFrame(int Layout, int Width, int Height)
+  {
+    int Format = Layout == LAYOUT_YV12 ? bfI420 : Layout;
+    layout = Layout;
+    memset(&f, 0, sizeof(f));
+    f.format = Format;
+    f.width = Width;
+    f.height = Height;
+    f.bt709 = Height > 576;
+    // Padded strides, so stride handling errors show up
+    int planes = 1;
+    if (Format == bfNV12) {
+      planes = 2;
+      f.stride[0] = f.stride[1] = Width + 64;
+      size[0] = f.stride[0] * Height;
+      size[1] = f.stride[1] * ((Height + 1) / 2);
+    }
+    else if (Format == bfI420) {
+      planes = 3;
+      f.stride[0] = Width + 64;
+      f.stride[1] = f.stride[2] = (Width + 1) / 2 + 32;
+      if (Layout == LAYOUT_YV12)
+        f.stride[2] += 16; // a different stride for U shows mixed up planes
+      size[0] = f.stride[0] * Height;
+      size[1] = f.stride[1] * ((Height + 1) / 2);
+      size[2] = f.stride[2] * ((Height + 1) / 2);
+    }
+    else {
+      f.stride[0] = Width * 4 + 64;
+      size[0] = f.stride[0] * Height;
+    }
+    int total = 0;
+    for (int i = 0; i < planes; i++)
+      total += size[i];
+    for (int i = planes; i < 3; i++)
+      size[i] = 0;
+    mem = (uint8_t *)malloc(total);
+    for (int i = 0, offset = 0; i < planes; offset += size[i++])
+      f.data[i] = mem + offset;
+    for (int i = 0; i < 3; i++) {
+      plane[i] = f.data[i];
+      pitch[i] = f.stride[i];
+    }
+    if (Layout == LAYOUT_YV12) {
+      // V before U, swapped like in ApplyOsdOverlay()
+      f.data[1] = plane[2];
+      f.stride[1] = pitch[2];
+      f.data[2] = plane[1];
+      f.stride[2] = pitch[1];
+    }
+  }
+  ~cFrame() { free(mem); }
+  int Total(void) const { return size[0] + size[1] + size[2]; }
+  void Fill(void)
+  {
+    for (int i = 0; i < Total(); i++)
+      mem[i] = Random();
+  }
+  void CopyFrom(const cFrame &Frame) { memcpy(mem, Frame.mem, Total()); }
+};
+
+// --- OSD patterns ----------------------------------------------------------
+
+enum ePattern { ptTransparent, ptOpaque, ptText, ptPartial, ptRandom, ptCount };
+
+static const char *PatternNames[ptCount] = { "transparent", "opaque", "text", "partial", "random" };
+
+static void DrawGlyph(uint32_t *Osd, int Stride, int X, int Y, uint32_t Strokes)
+{
+  // 16x24 cell with up to 4 anti-aliased strokes, edges at half alpha
+  for (int y = 0; y < 24; y++) {
+    for (int x = 0; x < 16; x++) {
+      int a = 0;
+      if ((Strokes & 1) && x >= 3 && x <= 7)                   // left bar
+        a = max(a, (x == 3 || x == 7) ? 0x80 : 0xFF);
+      if ((Strokes & 2) && x >= 9 && x <= 13)                  // right bar
+        a = max(a, (x == 9 || x == 13) ? 0x80 : 0xFF);
+      if ((Strokes & 4) && y >= 10 && y <= 13 && x >= 3 && x <= 13) // middle bar
+        a = max(a, (y == 10 || y == 13) ? 0x60 : 0xFF);
+      int d = abs((x - 3) * 2 - y);                             // diagonal
+      if ((Strokes & 8) && d <= 2 && x >= 3 && x <= 13)
+        a = max(a, d == 2 ? 0x40 : d == 1 ? 0xC0 : 0xFF);
+      if (a) {
+        // White text over the (already drawn) background
+        uint32_t bg = Osd[(Y + y) * Stride + X + x];
+        int ba = bg >> 24;
+        int oa = a + ba * (255 - a) / 255;
+        int c = oa ? (255 * a + (bg & 0xFF) * ba * (255 - a) / 255) / oa : 0;
+        Osd[(Y + y) * Stride + X + x] = (oa << 24) | (c << 16) | (c << 8) | c;
+      }
+    }
+  }
+}
+
+static void FillRect(uint32_t *Osd, int Stride, int X1, int Y1, int X2, int Y2, uint32_t Color)
+{
+  for (int y = Y1; y < Y2; y++) {
+    for (int x = X1; x < X2; x++)
+      Osd[y * Stride + x] = Color;
+  }
+}
+
+static void MakeOsd(uint32_t *Osd, int Width, int Height, int Pattern)
+{
+  memset(Osd, 0, Width * Height * sizeof(uint32_t));
+  switch (Pattern) {
+    case ptOpaque:
+      for (int y = 0; y < Height; y++) {
+        for (int x = 0; x < Width; x++)
+          Osd[y * Width + x] = 0xFF000000 | ((x * 255 / Width) << 16) | ((y * 255 / Height) << 8) | (Random() & 0xFF);
+      }
+      break;
+    case ptText: {
+      // Menu like: translucent background with lines of anti-aliased text
+      int x1 = Width / 10, x2 = Width - Width / 10;
+      int y1 = Height / 10, y2 = Height - Height / 10;
+      FillRect(Osd, Width, x1, y1, x2, y2, 0xB0102030);
+      for (int y = y1 + 8; y + 24 <= y2; y += 32) {
+        for (int x = x1 + 8; x + 16 <= x2; x += 16)
+          DrawGlyph(Osd, Width, x, y, Random() & 0x0F);
+      }
+      break;
+    }
+    case ptPartial: {
+      // Progress bar, starts on odd coordinates to hit partial chroma blocks
+      int x1 = Width / 4 + 1, x2 = Width * 3 / 4 - 1;
+      int y1 = Height * 8 / 10 + 1, y2 = y1 + Height / 20;
+      FillRect(Osd, Width, x1, y1, x2, y2, 0x80000000);
+      FillRect(Osd, Width, x1 + 3, y1 + 3, x1 + (x2 - x1) / 3, y2 - 3, 0xE0E0A000);
+      break;
+    }
+    case ptRandom:
+      for (int i = 0; i < Width * Height; i++)
+        Osd[i] = (Random() << 8) ^ Random();
+      break;
+    default:
+      break;
+  }
+}
+
+// --- Reference blend -------------------------------------------------------
+
+struct tRefMatrix {
+  double y[3];
+  double u[3];
+  double v[3];
+};
+
+// Studio range, exact coefficients
+static const tRefMatrix RefBt601 = { { 65.481, 128.553, 24.966 }, { -37.797, -74.203, 112.0 }, { 112.0, -93.786, -18.214 } };
+static const tRefMatrix RefBt709 = { { 46.559, 156.629, 15.812 }, { -25.664, -86.336, 112.0 }, { 112.0, -101.730, -10.270 } };
+
+static double RefComp(const double *k, uint32_t c, double offset)
+{
+  return offset + (k[0] * ((c >> 16) & 0xFF) + k[1] * ((c >> 8) & 0xFF) + k[2] * (c & 0xFF)) / 255.0;
+}
+
+static uint8_t RefMix(uint8_t v, double o, double a)
+{
+  return Clamp(v + (o - v) * a / 255.0);
+}
+
+static void ReferenceBlend(cFrame &Frame, const uint32_t *Osd)
+{
+  tGstBlendFrame &f = Frame.f;
+  if (f.format == bfNV12 || f.format == bfI420) {
+    const tRefMatrix &m = f.bt709 ? RefBt709 : RefBt601;
+    for (int y = 0; y < f.height; y++) {
+      for (int x = 0; x < f.width; x++) {
+        uint32_t c = Osd[y * f.width + x];
+        uint8_t *p = f.data[0] + y * f.stride[0] + x;
+        *p = RefMix(*p, RefComp(m.y, c, 16), c >> 24);
+      }
+    }
+    for (int cy = 0; cy < (f.height + 1) / 2; cy++) {
+      for (int cx = 0; cx < (f.width + 1) / 2; cx++) {
+        double sa = 0, su = 0, sv = 0;
+        int n = 0;
+        for (int y = cy * 2; y < min(cy * 2 + 2, f.height); y++) {
+          for (int x = cx * 2; x < min(cx * 2 + 2, f.width); x++) {
+            uint32_t c = Osd[y * f.width + x];
+            double a = c >> 24;
+            sa += a;
+            su += a * RefComp(m.u, c, 128);
+            sv += a * RefComp(m.v, c, 128);
+            n++;
+          }
+        }
+        if (sa == 0)
+          continue;
+        uint8_t *u, *v;
+        if (f.format == bfNV12) {
+          u = f.data[1] + cy * f.stride[1] + cx * 2;
+          v = u + 1;
+        }
+        else {
+          // The planes as they are in memory, not as the kernel got them
+          int iu = Frame.layout == LAYOUT_YV12 ? 2 : 1;
+          int iv = 3 - iu;
+          u = Frame.plane[iu] + cy * Frame.pitch[iu] + cx;
+          v = Frame.plane[iv] + cy * Frame.pitch[iv] + cx;
+        }
+        *u = RefMix(*u, su / sa, sa / n);
+        *v = RefMix(*v, sv / sa, sa / n);
+      }
+    }
+    return;
+  }
+
+  int r = 0, g = 0, b = 0;
+  switch (f.format) {
+    case bfBGRA: r = 2; g = 1; b = 0; break;
+    case bfRGBA: r = 0; g = 1; b = 2; break;
+    case bfARGB: r = 1; g = 2; b = 3; break;
+    case bfABGR: r = 3; g = 2; b = 1; break;
+  }
+  for (int y = 0; y < f.height; y++) {
+    for (int x = 0; x < f.width; x++) {
+      uint32_t c = Osd[y * f.width + x];
+      double a = c >> 24;
+      uint8_t *p = f.data[0] + y * f.stride[0] + x * 4;
+      p[r] = RefMix(p[r], (c >> 16) & 0xFF, a);
+      p[g] = RefMix(p[g], (c >> 8) & 0xFF, a);
+      p[b] = RefMix(p[b], c & 0xFF, a);
+    }
+  }
+}
+
+static int MaxDiff(const cFrame &a, const cFrame &b)
+{
+  // Covers the padding as well, it must stay untouched
+  int diff = 0;
+  for (int i = 0; i < a.Total(); i++)
+    diff = max(diff, abs(a.mem[i] - b.mem[i]));
+  return diff;
+}
+
+// --- Main ------------------------------------------------------------------
+
+static void Usage(void)
+{
+  printf("Usage: gstblend-bench [options]\n"
+         BENCH_USAGE
+         "  -s SIZE   only SD, HD or UHD\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int timeMs = BENCH_TIMEMS;
+  const char *onlySize = NULL;
+
+  int c;
+  while ((c = getopt(argc, argv, BENCH_OPTIONS "s:")) != -1) {
+    switch (c) {
+      case 't': timeMs = max(atoi(optarg), 1); break;
+      case 's': onlySize = optarg; break;
+      case 'q': timeMs = 0; break;
+      default:  Usage(); return 2;
+    }
+  }
+
+  static const int Layouts[] = { bfBGRA, bfRGBA, bfARGB, bfABGR, bfNV12, bfI420, LAYOUT_YV12 };
+
+  printf("%-5s %-4s %-12s %10s %8s %6s\n", "Size", "Fmt", "Pattern", "ns/pixel", "maxdiff", "result");
+  for (unsigned s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++) {
+    const tSize &size = Sizes[s];
+    if (onlySize && strcasecmp(onlySize, size.name))
+      continue;
+    uint32_t *osd = (uint32_t *)malloc(size.width * size.height * sizeof(uint32_t));
+    for (unsigned i = 0; i < sizeof(Layouts) / sizeof(Layouts[0]); i++) {
+      int layout = Layouts[i];
+      cFrame source(layout, size.width, size.height);
+      cFrame result(layout, size.width, size.height);
+      cFrame reference(layout, size.width, size.height);
+      int format = result.f.format;
+      for (int p = 0; p < ptCount; p++) {
+        seed = 1 + p;
+        source.Fill();
+        MakeOsd(osd, size.width, size.height, p);
+
+        // Correctness, the kernel gets the visible bounds like in
+        // cGstOsdProvider::ApplyOsdOverlay()
+        tGstBlendRect rect;
+        result.CopyFrom(source);
+        if (GstBlendBounds(osd, size.width, size.width, size.height, rect))
+          GstBlendOsd(result.f, osd, size.width, rect);
+        reference.CopyFrom(source);
+        ReferenceBlend(reference, osd);
+        int diff = MaxDiff(result, reference);
+        int tolerance = (format == bfNV12 || format == bfI420) ? TOLERANCE_YUV : TOLERANCE_RGB;
+        bool ok = diff <= tolerance;
+
+        // Speed of the per frame blend, the bounds scan only runs when the
+        // OSD changes and is not timed
+        double nsPerPixel = 0;
+        if (timeMs) {
+          uint64_t start = NowNs();
+          uint64_t end = start + uint64_t(timeMs) * 1000000;
+          int iterations = 0;
+          uint64_t now;
+          do {
+            GstBlendOsd(result.f, osd, size.width, rect);
+            iterations++;
+            now = NowNs();
+          } while (now < end || iterations < 3);
+          nsPerPixel = double(now - start) / iterations / (size.width * size.height);
+        }
+
+        printf("%-5s %-4s %-12s %10.3f %8d %6s\n", size.name, LayoutName(layout),
+               PatternNames[p], nsPerPixel, diff, Verdict(ok));
+      }
+    }
+    free(osd);
+  }
+
+  return Failed("outside the tolerance");
+}
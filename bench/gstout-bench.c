@@ -0,0 +1,438 @@
+/*
+ * gstout-bench.c: Headless benchmark for the GStreamer output engine
+ *
+ * Replays TS recordings through cGstOutput::PlayTs() and reports throughput,
+ * PlayTs() latency, ring buffer fill, CPU time per thread and allocations
+ * per video frame. Used to catch regressions in the feed path.
+ *
+ * Usage: gstout-bench [options] FILE|RECORDING...
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vdr/remux.h>
+#include "../gstconfig.h"
+#include "../gstoutput.h"
+
+#define BENCH_MAXFILES    1024
+#define BENCH_MAXTHREADS  128
+#define LATENCY_BUCKETS   65536 // 1 us resolution, above goes to the last bucket
+#define SAMPLE_MS         100   // ring fill sampling interval
+#define STALL_SLEEP_MS    1     // wait when PlayTs() did not accept anything
+#define DRAIN_TIMEOUT_MS  5000
+#define BENCH_SETUP_TIMEOUT 30000 // ms for GStreamer init and the pipeline build
+
+// --- Allocation counter ----------------------------------------------------
+
+// Interposes the libc allocator, so allocations in GLib and GStreamer are
+// counted as well (posix_memalign and g_slice are not counted)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static volatile uint64_t allocations = 0;
+
+void *malloc(size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+}
+
+static uint64_t Allocations(void)
+{
+  return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+// --- Helpers ---------------------------------------------------------------
+
+static uint64_t NowUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t PcrUs(const uchar *p)
+{
+  // 33 bit base at 90 kHz, the 27 MHz extension is ignored
+  if (!(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10))
+    return -1;
+  int64_t base = (int64_t(p[6]) << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+  return base * 100 / 9;
+}
+
+// --- cLatencyHistogram -----------------------------------------------------
+
+class cLatencyHistogram {
+private:
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t maxUs;
+public:
+  cLatencyHistogram(void) { memset(buckets, 0, sizeof(buckets)); count = maxUs = 0; }
+  void Add(uint64_t Us)
+  {
+    buckets[min(Us, uint64_t(LATENCY_BUCKETS - 1))]++;
+    count++;
+    maxUs = max(maxUs, Us);
+  }
+  uint64_t Percentile(int P) const
+  {
+    uint64_t limit = (count * P + 99) / 100;
+    uint64_t sum = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      sum += buckets[i];
+      if (sum >= limit && sum)
+        return i;
+    }
+    return 0;
+  }
+  uint64_t Count(void) const { return count; }
+  uint64_t Max(void) const { return maxUs; }
+};
+
+// --- Thread CPU time -------------------------------------------------------
+
+struct tThreadCpu {
+  int tid;
+  char name[32];
+  uint64_t ticks;
+};
+
+static int ReadThreadCpu(tThreadCpu *Threads, int Max)
+{
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir)
+    return 0;
+  int n = 0;
+  struct dirent *e;
+  while (n < Max && (e = readdir(dir)) != NULL) {
+    if (e->d_name[0] == '.')
+      continue;
+    char path[64];
+    char buf[512];
+    snprintf(path, sizeof(path), "/proc/self/task/%s/stat", e->d_name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      continue;
+    int r = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (r <= 0)
+      continue;
+    buf[r] = 0;
+    // "tid (comm) state ..." - comm may contain spaces
+    char *lp = strchr(buf, '(');
+    char *rp = strrchr(buf, ')');
+    if (!lp || !rp)
+      continue;
+    tThreadCpu *t = &Threads[n];
+    t->tid = atoi(buf);
+    int len = min(int(rp - lp - 1), int(sizeof(t->name)) - 1);
+    memcpy(t->name, lp + 1, len);
+    t->name[len] = 0;
+    // utime and stime are fields 14 and 15, counted from the state field (3)
+    unsigned long utime = 0, stime = 0;
+    if (sscanf(rp + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+      continue;
+    t->ticks = utime + stime;
+    n++;
+  }
+  closedir(dir);
+  return n;
+}
+
+// --- File list -------------------------------------------------------------
+
+static char *files[BENCH_MAXFILES];
+static int numFiles = 0;
+
+static int TsFilter(const struct dirent *e)
+{
+  int len = strlen(e->d_name);
+  return len > 3 && !strcmp(e->d_name + len - 3, ".ts");
+}
+
+static bool AddPath(const char *Path)
+{
+  struct stat st;
+  if (stat(Path, &st) < 0) {
+    fprintf(stderr, "%s: %s\n", Path, strerror(errno));
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    if (numFiles < BENCH_MAXFILES)
+      files[numFiles++] = strdup(Path);
+    return true;
+  }
+  // VDR recording directory, 00001.ts, 00002.ts...
+  struct dirent **list;
+  int n = scandir(Path, &list, TsFilter, alphasort);
+  for (int i = 0; i < n; i++) {
+    if (numFiles < BENCH_MAXFILES)
+      files[numFiles++] = strdup(*cString::sprintf("%s/%s", Path, list[i]->d_name));
+    free(list[i]);
+  }
+  free(list);
+  return n > 0;
+}
+
+// --- Benchmark -------------------------------------------------------------
+
+struct tBenchStats {
+  uint64_t bytes;
+  uint64_t calls;
+  uint64_t stalls;
+  uint64_t fillSamples;
+  uint64_t fillSum[2];
+  int fillMax[2];
+  uint64_t lastSample;
+};
+
+static cLatencyHistogram latency;
+
+static void SampleFill(cGstOutput *Output, tBenchStats &Stats)
+{
+  uint64_t now = cTimeMs::Now();
+  if (now - Stats.lastSample < SAMPLE_MS)
+    return;
+  Stats.lastSample = now;
+  Stats.fillSamples++;
+  for (int v = 0; v < 2; v++) {
+    int fill = Output->BufferFill(v);
+    Stats.fillSum[v] += fill;
+    Stats.fillMax[v] = max(Stats.fillMax[v], fill);
+  }
+}
+
+static bool PlayFile(cGstOutput *Output, const char *FileName, int Packets, bool Realtime, tBenchStats &Stats)
+{
+  int fd = open(FileName, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", FileName, strerror(errno));
+    return false;
+  }
+
+  int size = Packets * TS_SIZE;
+  uchar *data = (uchar *)__libc_malloc(size);
+  int64_t firstPcr = -1;
+  uint64_t start = 0;
+  int length = 0;
+
+  for (;;) {
+    int r = read(fd, data + length, size - length);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0 && length < TS_SIZE)
+      break;
+    if (r > 0)
+      length += r;
+
+    if (Realtime) {
+      // Pace by the first PCR in this chunk
+      for (int i = 0; i + TS_SIZE <= length; i += TS_SIZE) {
+        int64_t pcr = PcrUs(data + i);
+        if (pcr < 0)
+          continue;
+        uint64_t now = NowUs();
+        if (firstPcr < 0 || pcr < firstPcr || pcr - firstPcr > int64_t(now - start) + 10000000) {
+          // Start or discontinuity
+          firstPcr = pcr;
+          start = now;
+        }
+        else if (pcr - firstPcr > int64_t(now - start))
+          usleep(pcr - firstPcr - (now - start));
+        break;
+      }
+    }
+
+    int done = 0;
+    while (length - done >= TS_SIZE) {
+      uint64_t t = NowUs();
+      int played = Output->PlayTs(data + done, (length - done) / TS_SIZE * TS_SIZE);
+      latency.Add(NowUs() - t);
+      Stats.calls++;
+      SampleFill(Output, Stats);
+      if (played <= 0) {
+        Stats.stalls++;
+        cCondWait::SleepMs(STALL_SLEEP_MS);
+        continue;
+      }
+      done += played;
+      Stats.bytes += played;
+    }
+    memmove(data, data + done, length - done);
+    length -= done;
+    if (r <= 0)
+      break;
+  }
+
+  free(data);
+  close(fd);
+  return true;
+}
+
+static void Usage(void)
+{
+  printf("Usage: gstout-bench [options] FILE|RECORDING...\n"
+         "  -a SINK   audio sink (default: \"fakesink sync=false\")\n"
+         "  -v SINK   video sink (default: \"fakesink sync=false\")\n"
+         "  -s DESC   encoder branch behind the video decoder, e.g. \"x264enc ! fakesink\"\n"
+         "  -d        enable hardware decoding\n"
+         "  -i        disable deinterlacing\n"
+         "  -r        replay in real time (paced by PCR) instead of max. speed\n"
+         "  -l N      number of loops (default: 1)\n"
+         "  -c N      TS packets per PlayTs() call (default: 100)\n"
+         "  -t MS     target latency (default: %d)\n"
+         "  -z        clear before each file like a channel switch, file N is channel N\n"
+         "  -V        verbose (GStreamer output log)\n",
+         GstoutConfig.targetLatency);
+}
+
+int main(int argc, char *argv[])
+{
+  int loops = 1;
+  int packets = 100;
+  bool realtime = false;
+  bool zap = false;
+
+  strn0cpy(GstoutConfig.audioSink, "fakesink sync=false", sizeof(GstoutConfig.audioSink));
+  strn0cpy(GstoutConfig.videoSink, "fakesink sync=false", sizeof(GstoutConfig.videoSink));
+  GstoutConfig.useHardwareDecoding = false;
+
+  int c;
+  while ((c = getopt(argc, argv, "a:v:s:dirl:c:t:zVh")) != -1) {
+    switch (c) {
+      case 'a': strn0cpy(GstoutConfig.audioSink, optarg, sizeof(GstoutConfig.audioSink)); break;
+      case 'v': strn0cpy(GstoutConfig.videoSink, optarg, sizeof(GstoutConfig.videoSink)); break;
+      case 's': strn0cpy(GstoutConfig.videoStream, optarg, sizeof(GstoutConfig.videoStream)); break;
+      case 'd': GstoutConfig.useHardwareDecoding = true; break;
+      case 'i': GstoutConfig.deinterlace = false; break;
+      case 'r': realtime = true; break;
+      case 'l': loops = max(atoi(optarg), 1); break;
+      case 'c': packets = max(atoi(optarg), 1); break;
+      case 't': GstoutConfig.targetLatency = max(atoi(optarg), 100); break;
+      case 'z': zap = true; break;
+      case 'V': SysLogLevel = 3; break;
+      default:  Usage(); return 2;
+    }
+  }
+  for (int i = optind; i < argc; i++)
+    AddPath(argv[i]);
+  if (!numFiles) {
+    Usage();
+    return 2;
+  }
+
+  cGstOutput *output = new cGstOutput();
+  output->Initialize();
+  output->SetReplay(!realtime);
+  uint64_t setupStart = NowUs();
+  output->Start();
+  if (!output->WaitReady(BENCH_SETUP_TIMEOUT)) {
+    fprintf(stderr, "gstout-bench: failed to initialize the output\n");
+    return 1;
+  }
+  printf("Setup: %.1f ms until the pipelines were playing\n", (NowUs() - setupStart) / 1000.0);
+
+  tBenchStats stats;
+  memset(&stats, 0, sizeof(stats));
+  tThreadCpu cpuStart[BENCH_MAXTHREADS];
+  int numStart = ReadThreadCpu(cpuStart, BENCH_MAXTHREADS);
+  uint64_t allocStart = Allocations();
+  uint64_t start = NowUs();
+
+  for (int l = 0; l < loops; l++) {
+    for (int i = 0; i < numFiles; i++) {
+      if (zap) {
+        output->PlayTs(NULL, 0);
+        output->Clear();
+        output->SetChannel(i + 1);
+      }
+      PlayFile(output, files[i], packets, realtime, stats);
+    }
+  }
+
+  // Let the pipelines drain what is still buffered
+  uint64_t feedEnd = NowUs();
+  uint64_t drainStart = cTimeMs::Now();
+  while (output->BufferFill(true) || output->BufferFill(false)) {
+    if (cTimeMs::Now() - drainStart > DRAIN_TIMEOUT_MS)
+      break;
+    SampleFill(output, stats);
+    cCondWait::SleepMs(10);
+  }
+  uint64_t end = NowUs();
+
+  uint64_t allocs = Allocations() - allocStart;
+  tThreadCpu cpuEnd[BENCH_MAXTHREADS];
+  int numEnd = ReadThreadCpu(cpuEnd, BENCH_MAXTHREADS);
+
+  double feedSecs = (feedEnd - start) / 1e6;
+  double totalSecs = (end - start) / 1e6;
+  uint64_t frames = output->PesCount(true);
+
+  printf("Files:        %d x %d loop(s), %d packets per call, %s\n", numFiles, loops, packets, realtime ? "real time" : "max. speed");
+  printf("Data:         %.1f MB in %.2f s (%.2f s with drain)\n", stats.bytes / 1e6, feedSecs, totalSecs);
+  printf("Throughput:   %.2f Mbit/s\n", feedSecs > 0 ? stats.bytes * 8 / feedSecs / 1e6 : 0.0);
+  printf("PES packets:  %llu video, %llu audio\n", (unsigned long long)frames, (unsigned long long)output->PesCount(false));
+  printf("PlayTs:       %llu calls, %llu stalls, p50 %llu us, p95 %llu us, p99 %llu us, max %llu us\n",
+         (unsigned long long)stats.calls, (unsigned long long)stats.stalls,
+         (unsigned long long)latency.Percentile(50), (unsigned long long)latency.Percentile(95),
+         (unsigned long long)latency.Percentile(99), (unsigned long long)latency.Max());
+  for (int v = 1; v >= 0; v--) {
+    printf("Ring fill:    %s avg %llu%%, max %d%%\n", v ? "video" : "audio",
+           stats.fillSamples ? (unsigned long long)(stats.fillSum[v] / stats.fillSamples) : 0ULL, stats.fillMax[v]);
+  }
+  printf("Allocations:  %llu total, %.1f per video frame\n", (unsigned long long)allocs, frames ? double(allocs) / frames : 0.0);
+
+  // CPU per thread (stage), threads that ended during the run are not listed
+  long hz = sysconf(_SC_CLK_TCK);
+  printf("CPU:\n");
+  for (int i = 0; i < numEnd; i++) {
+    uint64_t ticks = cpuEnd[i].ticks;
+    for (int j = 0; j < numStart; j++) {
+      if (cpuStart[j].tid == cpuEnd[i].tid) {
+        ticks -= cpuStart[j].ticks;
+        break;
+      }
+    }
+    if (!ticks)
+      continue;
+    double secs = double(ticks) / hz;
+    printf("  %-16s %7.2f s  %5.1f%%\n", cpuEnd[i].tid == getpid() ? "feed (PlayTs)" : cpuEnd[i].name, secs, secs * 100 / totalSecs);
+  }
+
+  printf("%s\n", *output->GetStatistics());
+  printf("%s\n", *output->GetLatency());
+  if (zap)
+    printf("%s\n", *output->GetZapHistory());
+
+  output->Stop();
+  delete output;
+  for (int i = 0; i < numFiles; i++)
+    free(files[i]);
+  return 0;
+}
@@ -0,0 +1,392 @@
+/*
+ * index-bench.c: Correctness test and benchmark for the keyframe index
+ *
+ * Compares GstFindStartCode() against a byte by byte reference at every
+ * alignment of the data (start codes inside a 16 byte block, straddling two
+ * blocks and in the last bytes where the vector loop hands over to the
+ * scalar tail), then feeds PES packets with MPEG-2, H.264 and H.265 pictures
+ * to cGstKeyIndex and checks which are random access points, whether they
+ * are closed and carry their parameter sets. Reports GB/s of the scanner.
+ * Exits with 1 if any case fails.
+ *
+ * Usage: gstindex-bench [-t MS] [-q]
+ */
+
+#include <string.h>
+#include "../gstconfig.h"
+#include "../gstindex.h"
+#include "bench.h"
+
+#define SCAN_MAXLENGTH 96    // all lengths up to this, six vector blocks
+#define SCAN_LARGE     4096  // start codes at the block boundaries of this
+#define SPEED_LENGTH   65536 // bytes per call in the timing
+
+// --- Start code scanner ----------------------------------------------------
+
+static int ReferenceFindStartCode(const uchar *Data, int Length)
+{
+  for (int i = 0; i + 2 < Length; i++) {
+    if (Data[i] == 0 && Data[i + 1] == 0 && Data[i + 2] == 1)
+      return i;
+  }
+  return -1;
+}
+
+// Bytes without a start code, Dense ones made mostly of 00 and 01 so every
+// partial prefix and near miss (00 00 00 01, 00 01, 00 00 02) comes up
+static void Fill(uchar *Data, int Length, bool Dense)
+{
+  for (int i = 0; i < Length; i++) {
+    uint32_t r = Random();
+    Data[i] = Dense ? (r & 3) == 3 ? uchar(r >> 8) : uchar(r & 1) : uchar(2 + (r >> 8) % 254);
+    if (i >= 2 && Data[i] == 1 && Data[i - 1] == 0 && Data[i - 2] == 0)
+      Data[i] = 2;
+  }
+}
+
+// Runs the scanner on Data at every alignment of a 16 byte aligned buffer
+// and counts the results that differ from the reference
+static int Compare(const uchar *Data, int Length, uchar *Buffer)
+{
+  int expected = ReferenceFindStartCode(Data, Length);
+  int errors = 0;
+  for (int a = 0; a < 16; a++) {
+    memcpy(Buffer + a, Data, Length);
+    int found = GstFindStartCode(Buffer + a, Length);
+    if (found != expected) {
+      if (!errors)
+        printf("  length %d, alignment %d: found %d, expected %d\n", Length, a, found, expected);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+static void Result(const char *Case, int Tests, int Errors)
+{
+  printf("%-28s %8d %8d %6s\n", Case, Tests, Errors, Verdict(!Errors));
+}
+
+static void ScannerPlaced(bool Dense)
+{
+  // One start code at each position of each length, plus a second one
+  // behind it so the first must win
+  uchar data[SCAN_MAXLENGTH];
+  uchar *buffer = (uchar *)aligned_alloc(16, SCAN_MAXLENGTH + 16);
+  int tests = 0;
+  int errors = 0;
+  for (int length = 0; length <= SCAN_MAXLENGTH; length++) {
+    for (int pos = -1; pos + 3 <= length; pos++) {
+      Fill(data, length, Dense);
+      if (pos >= 0) {
+        data[pos] = 0;
+        data[pos + 1] = 0;
+        data[pos + 2] = 1;
+        if (pos + 6 <= length)
+          memcpy(data + length - 3, "\x00\x00\x01", 3);
+      }
+      errors += Compare(data, length, buffer);
+      tests += 16;
+    }
+  }
+  free(buffer);
+  Result(Dense ? "placed, dense" : "placed, sparse", tests, errors);
+}
+
+static void ScannerTruncated(void)
+{
+  // A prefix cut off by the end of the data is no start code
+  uchar data[SCAN_MAXLENGTH];
+  uchar *buffer = (uchar *)aligned_alloc(16, SCAN_MAXLENGTH + 16);
+  int tests = 0;
+  int errors = 0;
+  for (int length = 1; length <= SCAN_MAXLENGTH; length++) {
+    for (int cut = 1; cut <= 2 && cut <= length; cut++) {
+      Fill(data, length, false);
+      memcpy(data + length - cut, "\x00\x00", cut);
+      errors += Compare(data, length, buffer);
+      tests += 16;
+    }
+  }
+  free(buffer);
+  Result("truncated at the end", tests, errors);
+}
+
+static void ScannerBoundaries(void)
+{
+  // Start codes at the start and in the last three bytes of each 16 byte
+  // block (the last two straddle into the next one), and at every position
+  // of the last 18 bytes, which the vector loop leaves to the scalar tail
+  uchar *data = (uchar *)malloc(SCAN_LARGE);
+  uchar *buffer = (uchar *)aligned_alloc(16, SCAN_LARGE + 16);
+  int tests = 0;
+  int errors = 0;
+  for (int pos = 0; pos + 3 <= SCAN_LARGE; pos++) {
+    if (pos % 16 < 13 && pos < SCAN_LARGE - 18 && pos % 16 != 0)
+      continue;
+    Fill(data, SCAN_LARGE, false);
+    memcpy(data + pos, "\x00\x00\x01", 3);
+    errors += Compare(data, SCAN_LARGE, buffer);
+    tests += 16;
+  }
+  free(data);
+  free(buffer);
+  Result("block boundaries, 4 KB", tests, errors);
+}
+
+static void ScannerRandom(void)
+{
+  // Dense noise with the start codes it happens to form
+  uchar *data = (uchar *)malloc(SCAN_LARGE);
+  uchar *buffer = (uchar *)aligned_alloc(16, SCAN_LARGE + 16);
+  int tests = 0;
+  int errors = 0;
+  for (int i = 0; i < 2000; i++) {
+    int length = Random() % SCAN_LARGE;
+    for (int j = 0; j < length; j++) {
+      uint32_t r = Random();
+      data[j] = (r & 7) == 7 ? uchar(r >> 8) : uchar((r >> 3) & 1) * ((r >> 4) & 1);
+    }
+    errors += Compare(data, length, buffer);
+    tests += 16;
+  }
+  free(data);
+  free(buffer);
+  Result("random", tests, errors);
+}
+
+// --- Key index -------------------------------------------------------------
+
+// Payloads of PES packets, MPEG-2: sequence header (B3), sequence extension
+// (B5), user data (B2), GOP (B8, closed_gop in bit 6 of its fourth byte),
+// picture header (00, coding type in bits 3-5 of its second byte: 1 I, 2 P,
+// 3 B), slice (01)
+static const uchar Mpeg2IClosed[] = {
+  0, 0, 1, 0xB3, 0x2D, 0x02, 0x40, 0x33, 0xFF, 0xFF, 0xE0, 0x18,
+  0, 0, 1, 0xB5, 0x14, 0x8A, 0x00, 0x01, 0x00, 0x00,
+  0, 0, 1, 0xB8, 0x00, 0x08, 0x00, 0x40,
+  0, 0, 1, 0x00, 0x00, 0x0F, 0xFF, 0xF8 };
+static const uchar Mpeg2IOpen[] = {
+  0, 0, 1, 0xB3, 0x2D, 0x02, 0x40, 0x33, 0xFF, 0xFF, 0xE0, 0x18,
+  0, 0, 1, 0xB8, 0x00, 0x08, 0x00, 0x00,
+  0, 0, 1, 0x00, 0x00, 0x0F, 0xFF, 0xF8 };
+static const uchar Mpeg2IAlone[] = {
+  0, 0, 1, 0x00, 0x00, 0x0F, 0xFF, 0xF8 };
+// 20 bytes of user data put the picture header past the first 16 bytes
+static const uchar Mpeg2IUserData[] = {
+  0, 0, 1, 0xB3, 0x2D, 0x02, 0x40, 0x33, 0xFF, 0xFF, 0xE0, 0x18,
+  0, 0, 1, 0xB2, 0x47, 0x41, 0x39, 0x34, 0x03, 0xD4, 0xFF, 0xFC, 0x80, 0x80,
+                 0xFD, 0x80, 0x80, 0xFA, 0x00, 0x00, 0xFA, 0x00, 0x00, 0xFF,
+  0, 0, 1, 0x00, 0x00, 0x0F, 0xFF, 0xF8 };
+static const uchar Mpeg2P[] = {
+  0, 0, 1, 0x00, 0x00, 0x50, 0xFF, 0xF8 };
+static const uchar Mpeg2B[] = {
+  0, 0, 1, 0x00, 0x00, 0x98, 0xFF, 0xF8 };
+static const uchar Mpeg2Slice[] = {
+  0, 0, 1, 0xB3, 0x2D, 0x02, 0x40, 0x33, 0xFF, 0xFF, 0xE0, 0x18,
+  0, 0, 1, 0x01, 0x13, 0xF8, 0x7D, 0x29 };
+
+// H.264: AUD (09), SEI (06), SPS (67), PPS (68), IDR slice (65), non-IDR
+// slice (41, 01) with first_mb_in_slice 0 and slice_type 7 or 2 (I), 5 (P)
+// and 6 (B) as Exp-Golomb codes
+static const uchar H264Idr[] = {
+  0, 0, 0, 1, 0x09, 0xF0,
+  0, 0, 1, 0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40,
+  0, 0, 1, 0x68, 0xEB, 0xE3, 0xCB, 0x22,
+  0, 0, 1, 0x65, 0x88, 0x84, 0x00, 0x33 };
+static const uchar H264IdrSei[] = {
+  0, 0, 0, 1, 0x09, 0xF0,
+  0, 0, 1, 0x06, 0x05, 0x10, 0xB2, 0x3F, 0x45, 0xE0, 0x28, 0x11, 0xE3, 0x4D,
+                 0x93, 0x15, 0x51, 0x8A, 0xCA, 0xA1, 0x77, 0x3C, 0xE4, 0x80,
+  0, 0, 1, 0x65, 0x88, 0x84, 0x00, 0x33 };
+static const uchar H264ISlice7[] = {
+  0, 0, 0, 1, 0x09, 0x10,
+  0, 0, 1, 0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40,
+  0, 0, 1, 0x68, 0xEB, 0xE3, 0xCB, 0x22,
+  0, 0, 1, 0x41, 0x88, 0x84, 0x00, 0x33 };
+static const uchar H264ISlice2[] = {
+  0, 0, 0, 1, 0x09, 0x10,
+  0, 0, 1, 0x41, 0xB0, 0x84, 0x00, 0x33 };
+static const uchar H264PSlice[] = {
+  0, 0, 0, 1, 0x09, 0x30,
+  0, 0, 1, 0x41, 0x9A, 0x84, 0x00, 0x33 };
+static const uchar H264BSlice[] = {
+  0, 0, 0, 1, 0x09, 0x50,
+  0, 0, 1, 0x01, 0x9E, 0x84, 0x00, 0x33 };
+
+// H.265: two byte NAL header with the type in bits 1-6 of the first, AUD
+// (35), VPS (32), SPS (33), PPS (34), prefix SEI (39), IDR_W_RADL (19), CRA
+// (21), BLA_W_LP (16), TRAIL_R (1)
+static const uchar H265Idr[] = {
+  0, 0, 0, 1, 0x46, 0x01, 0x10,
+  0, 0, 1, 0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF,
+  0, 0, 1, 0x42, 0x01, 0x01, 0x01, 0x60, 0x00,
+  0, 0, 1, 0x44, 0x01, 0xC1, 0x72, 0xB4,
+  0, 0, 1, 0x26, 0x01, 0xAF, 0x08, 0x40 };
+static const uchar H265Cra[] = {
+  0, 0, 0, 1, 0x46, 0x01, 0x10,
+  0, 0, 1, 0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF,
+  0, 0, 1, 0x42, 0x01, 0x01, 0x01, 0x60, 0x00,
+  0, 0, 1, 0x44, 0x01, 0xC1, 0x72, 0xB4,
+  0, 0, 1, 0x2A, 0x01, 0xAF, 0x08, 0x40 };
+static const uchar H265CraSei[] = {
+  0, 0, 0, 1, 0x46, 0x01, 0x10,
+  0, 0, 1, 0x4E, 0x01, 0x89, 0x18, 0x3A, 0x98, 0x75, 0x30, 0x1D, 0x4C, 0x0B,
+                       0xB8, 0x7D, 0x00, 0x3D, 0x09, 0x40, 0x00, 0x1F, 0x40, 0x80,
+  0, 0, 1, 0x2A, 0x01, 0xAF, 0x08, 0x40 };
+static const uchar H265Bla[] = {
+  0, 0, 0, 1, 0x46, 0x01, 0x10,
+  0, 0, 1, 0x20, 0x01, 0xAF, 0x08, 0x40 };
+static const uchar H265Trail[] = {
+  0, 0, 0, 1, 0x46, 0x01, 0x30,
+  0, 0, 1, 0x02, 0x01, 0xD0, 0x08, 0x40 };
+
+struct tScanCase {
+  const char *name;
+  int codec;
+  bool key;
+  bool closed;
+  bool params;
+  int paramsLength; // bytes of parameter sets kept, 0 if none
+  const uchar *payload;
+  int length;
+};
+
+#define PAYLOAD(a) a, sizeof(a)
+
+static const tScanCase ScanCases[] = {
+  { "MPEG-2 I, closed GOP",      gcMpeg2, true,  true,  true,  12 + 10,    PAYLOAD(Mpeg2IClosed) },
+  { "MPEG-2 I, open GOP",        gcMpeg2, true,  false, true,  12,         PAYLOAD(Mpeg2IOpen) },
+  { "MPEG-2 I, no sequence",     gcMpeg2, true,  false, false, 0,          PAYLOAD(Mpeg2IAlone) },
+  { "MPEG-2 I, after user data", gcMpeg2, true,  false, true,  12,         PAYLOAD(Mpeg2IUserData) },
+  { "MPEG-2 P",                  gcMpeg2, false, false, false, 0,          PAYLOAD(Mpeg2P) },
+  { "MPEG-2 B",                  gcMpeg2, false, false, false, 0,          PAYLOAD(Mpeg2B) },
+  { "MPEG-2 slice, no picture",  gcMpeg2, false, false, false, 0,          PAYLOAD(Mpeg2Slice) },
+  { "H.264 IDR",                 gcH264,  true,  true,  true,  10 + 8,     PAYLOAD(H264Idr) },
+  { "H.264 IDR, after SEI",      gcH264,  true,  true,  false, 0,          PAYLOAD(H264IdrSei) },
+  { "H.264 I slice (7)",         gcH264,  true,  false, true,  10 + 8,     PAYLOAD(H264ISlice7) },
+  { "H.264 I slice (2)",         gcH264,  true,  false, false, 0,          PAYLOAD(H264ISlice2) },
+  { "H.264 P slice",             gcH264,  false, false, false, 0,          PAYLOAD(H264PSlice) },
+  { "H.264 B slice",             gcH264,  false, false, false, 0,          PAYLOAD(H264BSlice) },
+  { "H.265 IDR",                 gcH265,  true,  true,  true,  9 + 9 + 8,  PAYLOAD(H265Idr) },
+  { "H.265 CRA",                 gcH265,  true,  false, true,  9 + 9 + 8,  PAYLOAD(H265Cra) },
+  { "H.265 CRA, after SEI",      gcH265,  true,  false, false, 0,          PAYLOAD(H265CraSei) },
+  { "H.265 BLA",                 gcH265,  true,  false, false, 0,          PAYLOAD(H265Bla) },
+  { "H.265 TRAIL_R",             gcH265,  false, false, false, 0,          PAYLOAD(H265Trail) },
+};
+
+// A video PES packet with a PTS, Stuffing bytes in the header move the
+// payload to each alignment
+static int BuildPes(uchar *Pes, const uchar *Payload, int Length, int Stuffing)
+{
+  int header = 5 + Stuffing;
+  int size = 3 + header + Length;
+  uchar head[] = { 0, 0, 1, 0xE0, uchar(size >> 8), uchar(size), 0x80, 0x80, uchar(header),
+                   0x21, 0x00, 0x01, 0x00, 0x01 };
+  memcpy(Pes, head, sizeof(head));
+  memset(Pes + sizeof(head), 0xFF, Stuffing);
+  memcpy(Pes + sizeof(head) + Stuffing, Payload, Length);
+  return sizeof(head) + Stuffing + Length;
+}
+
+static void IndexCase(const tScanCase &Case)
+{
+  uchar pes[256];
+  int errors = 0;
+  for (int stuffing = 0; stuffing < 16; stuffing++) {
+    int length = BuildPes(pes, Case.payload, Case.length, stuffing);
+    cGstKeyIndex index;
+    index.Put(pes, length);
+    int params = 0;
+    index.TakeParams(params);
+    bool ok = index.Codec() == Case.codec
+           && (index.ToKey(true) == 0) == Case.key
+           && (index.ToKey(false) == 0) == (Case.key && Case.params)
+           && index.KeyClosed() == Case.closed
+           && index.KeyParams() == Case.params
+           && params == Case.paramsLength;
+    if (!ok) {
+      if (!errors)
+        printf("  stuffing %d: codec %d, key %d, closed %d, params %d, %d bytes kept\n",
+               stuffing, index.Codec(), index.ToKey(true) == 0, index.KeyClosed(), index.KeyParams(), params);
+      errors++;
+    }
+  }
+  printf("%-28s %3s %6s %6s %6s\n", Case.name, Case.key ? "yes" : "no", Case.closed ? "yes" : "no",
+         Case.params ? "yes" : "no", Verdict(!errors));
+}
+
+// --- Speed -----------------------------------------------------------------
+
+// GB/s of Scanner through noise without a start code
+static double Speed(int (*Scanner)(const uchar *, int), int TimeMs)
+{
+  uchar *data = (uchar *)aligned_alloc(16, SPEED_LENGTH);
+  Fill(data, SPEED_LENGTH, false);
+  // Zeros as often as in compressed video
+  for (int i = 0; i < SPEED_LENGTH; i += 1 + Random() % 64) {
+    data[i] = 0;
+    if (i + 2 < SPEED_LENGTH && data[i + 2] == 1)
+      data[i + 2] = 2;
+  }
+  volatile int sink = 0;
+  uint64_t iterations = 0;
+  uint64_t start = NowNs();
+  uint64_t now;
+  do {
+    for (int i = 0; i < 16; i++)
+      sink += Scanner(data, SPEED_LENGTH);
+    iterations += 16;
+    now = NowNs();
+  } while (now - start < uint64_t(TimeMs) * 1000000);
+  free(data);
+  return double(iterations) * SPEED_LENGTH / (now - start);
+}
+
+// --- Main ------------------------------------------------------------------
+
+static void Usage(void)
+{
+  printf("Usage: gstindex-bench [options]\n"
+         BENCH_USAGE);
+}
+
+int main(int argc, char *argv[])
+{
+  int timeMs = BENCH_TIMEMS;
+
+  int c;
+  while ((c = getopt(argc, argv, BENCH_OPTIONS)) != -1) {
+    switch (c) {
+      case 't': timeMs = max(atoi(optarg), 1); break;
+      case 'q': timeMs = 0; break;
+      default:  Usage(); return 2;
+    }
+  }
+
+#if defined(__SSE2__)
+  printf("GstFindStartCode: SSE2\n\n");
+#elif defined(__ARM_NEON)
+  printf("GstFindStartCode: NEON\n\n");
+#else
+  printf("GstFindStartCode: scalar\n\n");
+#endif
+  printf("%-28s %8s %8s %6s\n", "Scanner", "Tests", "Errors", "result");
+  ScannerPlaced(false);
+  ScannerPlaced(true);
+  ScannerTruncated();
+  ScannerBoundaries();
+  ScannerRandom();
+
+  printf("\n%-28s %3s %6s %6s %6s\n", "Index", "Key", "Closed", "Params", "result");
+  for (unsigned i = 0; i < sizeof(ScanCases) / sizeof(ScanCases[0]); i++)
+    IndexCase(ScanCases[i]);
+
+  if (timeMs) {
+    printf("\n%-28s %9s\n", "Speed", "GB/s");
+    printf("%-28s %9.2f\n", "GstFindStartCode", Speed(GstFindStartCode, timeMs));
+    printf("%-28s %9.2f\n", "reference", Speed(ReferenceFindStartCode, timeMs));
+  }
+
+  return Failed("failed");
+}
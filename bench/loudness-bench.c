@@ -0,0 +1,316 @@
+/*
+ * loudness-bench.c: Correctness test and benchmark for the loudness kernel
+ *
+ * Checks the measurement against the EBU Tech 3341 calibration (a 1 kHz
+ * sine at -23 dBFS in both stereo channels reads -23 LUFS) and against a
+ * double precision direct form reference for 1 to 8 channels, then checks
+ * that normalization reaches the target, that a boost never clips and that
+ * compression lowers loud passages. Reports ns/sample of Process(). Exits
+ * with 1 if any case is outside the tolerance.
+ *
+ * Usage: gstloudness-bench [-t MS] [-q]
+ */
+
+#include <math.h>
+#include <string.h>
+#include "../gstloudness.h"
+#include "bench.h"
+
+#define TOLERANCE_CAL 0.1   // LU, EBU Tech 3341
+#define TOLERANCE_REF 0.02  // LU, float vs. double filters
+#define TOLERANCE_NORM 1.0  // LU from the target after settling
+#define FEED_FRAMES   1000  // not a multiple of the 10 ms chunks
+
+// --- Helpers ---------------------------------------------------------------
+
+// -1..1
+static float Noise(void)
+{
+  return (Random() & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+class cSignal {
+public:
+  float *data;
+  int frames;
+  int channels;
+  int rate;
+
+  cSignal(int Rate, int Channels, double Seconds)
+  {
+    rate = Rate;
+    channels = Channels;
+    frames = int(Rate * Seconds);
+    data = (float *)calloc(size_t(frames) * channels, sizeof(float));
+  }
+  ~cSignal() { free(data); }
+  // Sine of Amplitude in the channels of Mask, from From to To seconds
+  void Sine(double Hz, double Amplitude, unsigned Mask, double From, double To)
+  {
+    for (int f = int(From * rate); f < min(int(To * rate), frames); f++) {
+      float v = float(Amplitude * sin(2 * M_PI * Hz * f / rate));
+      for (int c = 0; c < channels; c++) {
+        if (Mask & (1 << c))
+          data[f * channels + c] = v;
+      }
+    }
+  }
+  // Band limited noise of Amplitude, different in each channel
+  void Noise(double Amplitude, double From, double To)
+  {
+    float last[GSTLOUDNESS_MAXCHANNELS] = { 0 };
+    for (int f = int(From * rate); f < min(int(To * rate), frames); f++) {
+      for (int c = 0; c < channels; c++) {
+        last[c] = last[c] * 0.7f + ::Noise() * 0.3f;
+        data[f * channels + c] = float(Amplitude) * last[c];
+      }
+    }
+  }
+  float Peak(int From = 0) const
+  {
+    float peak = 0;
+    for (int i = From * channels; i < frames * channels; i++)
+      peak = max(peak, fabsf(data[i]));
+    return peak;
+  }
+};
+
+static void Feed(cGstLoudness &Loudness, cSignal &Signal)
+{
+  for (int f = 0; f < Signal.frames; f += FEED_FRAMES)
+    Loudness.Process(Signal.data + f * Signal.channels, min(FEED_FRAMES, Signal.frames - f));
+}
+
+// --- Reference meter -------------------------------------------------------
+
+// BS.1770 in double precision and direct form I, momentary loudness of the
+// last block and gated loudness of the last 10 s like the kernel
+static void ReferenceLoudness(const cSignal &Signal, int From, double &Momentary, double &Integrated)
+{
+  int rate = Signal.rate;
+  double k = tan(M_PI * 1681.974450955533 / rate);
+  double q = 0.7071752369554196;
+  double vh = pow(10.0, 3.999843853973347 / 20);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / q + k * k;
+  double b[3] = { (vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0 };
+  double a[2] = { 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0 };
+  k = tan(M_PI * 38.13547087602444 / rate);
+  q = 0.5003270373238773;
+  a0 = 1 + k / q + k * k;
+  double c[2] = { 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0 };
+
+  int step = rate / 10;
+  int numSteps = (Signal.frames - From) / step;
+  double *steps = (double *)calloc(numSteps, sizeof(double));
+  for (int ch = 0; ch < Signal.channels; ch++) {
+    double w = 1;
+    if (Signal.channels == 6 || Signal.channels == 8)
+      w = ch == 3 ? 0 : ch > 3 ? 1.41 : 1;
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0, u1 = 0, u2 = 0;
+    for (int f = From; f < From + numSteps * step; f++) {
+      double x = Signal.data[f * Signal.channels + ch];
+      double y = b[0] * x + b[1] * x1 + b[2] * x2 - a[0] * y1 - a[1] * y2;
+      double u = y - 2 * y1 + y2 - c[0] * u1 - c[1] * u2;
+      x2 = x1; x1 = x;
+      y2 = y1; y1 = y;
+      u2 = u1; u1 = u;
+      steps[(f - From) / step] += w * u * u / step;
+    }
+  }
+
+  int numBlocks = max(numSteps - 3, 0);
+  double *blocks = (double *)calloc(numBlocks + 1, sizeof(double));
+  for (int i = 0; i < numBlocks; i++)
+    blocks[i] = (steps[i] + steps[i + 1] + steps[i + 2] + steps[i + 3]) / 4;
+  Momentary = numBlocks ? -0.691 + 10 * log10(blocks[numBlocks - 1]) : -99;
+
+  int first = max(numBlocks - GSTLOUDNESS_WINDOW, 0);
+  double sum = 0;
+  int n = 0;
+  for (int i = first; i < numBlocks; i++) {
+    if (-0.691 + 10 * log10(blocks[i]) > -70) {
+      sum += blocks[i];
+      n++;
+    }
+  }
+  Integrated = -99;
+  if (n) {
+    double gate = -0.691 + 10 * log10(sum / n) - 10;
+    sum = 0;
+    n = 0;
+    for (int i = first; i < numBlocks; i++) {
+      if (-0.691 + 10 * log10(blocks[i]) > gate && -0.691 + 10 * log10(blocks[i]) > -70) {
+        sum += blocks[i];
+        n++;
+      }
+    }
+    Integrated = -0.691 + 10 * log10(sum / n);
+  }
+  free(blocks);
+  free(steps);
+}
+
+// --- Cases -----------------------------------------------------------------
+
+static void Report(const char *Case, int Rate, int Channels, double Value, double Expected, double Tolerance)
+{
+  double diff = Value - Expected;
+  printf("%-24s %6d %3d %9.3f %9.3f %7.3f %6s\n", Case, Rate, Channels, Value, Expected, diff, Verdict(fabs(diff) <= Tolerance));
+}
+
+static void Calibration(int Rate, int Channels)
+{
+  // Tech 3341 case 1 and 2, front left and right only
+  for (int level = -23; level >= -33; level -= 10) {
+    cSignal signal(Rate, Channels, 20);
+    signal.Sine(997, pow(10.0, level / 20.0), Channels == 1 ? 1 : 3, 0, 20);
+    cGstLoudness loudness;
+    loudness.SetParams(true, -23, dcOff);
+    loudness.Setup(Rate, Channels);
+    Feed(loudness, signal);
+    // Mono is one channel of the stereo case, 3 dB less
+    char name[32];
+    snprintf(name, sizeof(name), "sine %d dBFS", level);
+    Report(name, Rate, Channels, loudness.Integrated(), Channels == 1 ? level - 3.01 : level, TOLERANCE_CAL);
+  }
+}
+
+static void Reference(int Rate, int Channels)
+{
+  // Loud noise, a gap that the gate has to drop and a quieter passage
+  cSignal signal(Rate, Channels, 12);
+  signal.Noise(0.5, 0, 4);
+  signal.Noise(0.1, 7, 12);
+  cSignal copy(Rate, Channels, 12);
+  memcpy(copy.data, signal.data, size_t(signal.frames) * Channels * sizeof(float));
+  cGstLoudness loudness;
+  loudness.SetParams(true, -23, dcOff);
+  loudness.Setup(Rate, Channels);
+  Feed(loudness, signal);
+  double momentary, integrated;
+  ReferenceLoudness(copy, 0, momentary, integrated);
+  Report("noise momentary", Rate, Channels, loudness.Momentary(), momentary, TOLERANCE_REF);
+  Report("noise gated", Rate, Channels, loudness.Integrated(), integrated, TOLERANCE_REF);
+}
+
+static void Normalization(int Rate, int Channels, double Amplitude)
+{
+  // Settles within 20 s from any start, the output is measured at the end
+  cSignal signal(Rate, Channels, 30);
+  signal.Noise(Amplitude, 0, 30);
+  float inputPeak = signal.Peak();
+  cGstLoudness loudness;
+  loudness.SetParams(true, -23, dcOff);
+  loudness.Setup(Rate, Channels);
+  Feed(loudness, signal);
+  double momentary, integrated;
+  ReferenceLoudness(signal, Rate * 20, momentary, integrated);
+  char name[32];
+  snprintf(name, sizeof(name), "normalize from %.0f dB", 20 * log10(Amplitude));
+  Report(name, Rate, Channels, integrated, -23, TOLERANCE_NORM);
+  // A boost stays below the ceiling, a cut below the input
+  Report("peak below limit", Rate, Channels, min(signal.Peak(), 1.0f), min(signal.Peak(), max(inputPeak, 0.944f)), 0);
+}
+
+static void Limiter(const char *Case, int Rate, int Channels, double Noise, double Burst)
+{
+  // Quiet noise that gets a boost, with a short burst every 2 seconds that
+  // has to be limited without lookahead. A burst below the ceiling clips as
+  // well once it is boosted.
+  cSignal signal(Rate, Channels, 30);
+  signal.Noise(Noise, 0, 30);
+  for (int s = 1; s < 30; s += 2)
+    signal.Sine(997, Burst, 3, s, s + 0.02);
+  cGstLoudness loudness;
+  loudness.SetParams(true, -14, dcOff);
+  loudness.Setup(Rate, Channels);
+  Feed(loudness, signal);
+  float peak = signal.Peak(Rate * 20);
+  Report(Case, Rate, Channels, peak, min(peak, 0.944f), 0);
+}
+
+static void Compression(int Rate, int Channels, int Mode, double Reduction)
+{
+  // 5 s at the target, then 5 s at +12 LU
+  cSignal signal(Rate, Channels, 10);
+  signal.Sine(997, pow(10.0, -23 / 20.0), 3, 0, 5);
+  signal.Sine(997, pow(10.0, -11 / 20.0), 3, 5, 10);
+  cGstLoudness loudness;
+  loudness.SetParams(false, -23, Mode);
+  loudness.Setup(Rate, Channels);
+  Feed(loudness, signal);
+  double momentary, integrated;
+  ReferenceLoudness(signal, Rate * 8, momentary, integrated);
+  Report(Mode == dcLight ? "light compression" : "heavy compression", Rate, Channels, momentary, -11 - Reduction, 0.5);
+}
+
+static double Speed(int Rate, int Channels, int TimeMs)
+{
+  cSignal signal(Rate, Channels, 1);
+  signal.Noise(0.3, 0, 1);
+  cGstLoudness loudness;
+  loudness.SetParams(true, -23, dcLight);
+  loudness.Setup(Rate, Channels);
+  uint64_t start = NowNs();
+  uint64_t end = start + uint64_t(TimeMs) * 1000000;
+  int iterations = 0;
+  uint64_t now;
+  do {
+    // Typical decoder buffers, one AC-3 frame
+    for (int f = 0; f + 1536 <= signal.frames; f += 1536)
+      loudness.Process(signal.data + f * Channels, 1536);
+    iterations++;
+    now = NowNs();
+  } while (now < end || iterations < 3);
+  return double(now - start) / iterations / (signal.frames / 1536 * 1536 * Channels);
+}
+
+// --- Main ------------------------------------------------------------------
+
+static void Usage(void)
+{
+  printf("Usage: gstloudness-bench [options]\n"
+         BENCH_USAGE);
+}
+
+int main(int argc, char *argv[])
+{
+  int timeMs = BENCH_TIMEMS;
+
+  int c;
+  while ((c = getopt(argc, argv, BENCH_OPTIONS)) != -1) {
+    switch (c) {
+      case 't': timeMs = max(atoi(optarg), 1); break;
+      case 'q': timeMs = 0; break;
+      default:  Usage(); return 2;
+    }
+  }
+
+  printf("%-24s %6s %3s %9s %9s %7s %6s\n", "Case", "Rate", "Ch", "Value", "Expected", "Diff", "result");
+  static const int Rates[] = { 48000, 44100 };
+  static const int Channels[] = { 1, 2, 3, 6, 8 };
+  for (unsigned r = 0; r < sizeof(Rates) / sizeof(Rates[0]); r++) {
+    Calibration(Rates[r], 2);
+    Calibration(Rates[r], 6);
+  }
+  Calibration(48000, 1);
+  for (unsigned i = 0; i < sizeof(Channels) / sizeof(Channels[0]); i++) {
+    seed = 1 + i;
+    Reference(48000, Channels[i]);
+  }
+  Normalization(48000, 2, 0.1);
+  Normalization(48000, 6, 0.9);
+  Limiter("peak limited", 48000, 2, 0.02, 0.8);
+  Limiter("peak limited, boosted", 48000, 2, 0.05, 0.5);
+  Compression(48000, 2, dcLight, (12 - 4) * 0.5);
+  Compression(48000, 2, dcHeavy, 12 * 0.75);
+
+  if (timeMs) {
+    printf("\n%-24s %6s %3s %9s\n", "Process", "Rate", "Ch", "ns/sample");
+    for (unsigned i = 0; i < sizeof(Channels) / sizeof(Channels[0]); i++)
+      printf("%-24s %6d %3d %9.3f\n", "", 48000, Channels[i], Speed(48000, Channels[i], timeMs));
+  }
+
+  return Failed("outside the tolerance");
+}
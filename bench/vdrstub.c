@@ -0,0 +1,544 @@
+/*
+ * vdrstub.c: Minimal VDR runtime for the standalone benchmark
+ *
+ * Provides the out-of-line VDR symbols used by the output engine, so it can
+ * be linked without a running VDR. Only the VDR headers are needed to build.
+ *
+ * The thread and ring buffer code follows VDR's thread.c and ringbuffer.c
+ * (margin, Get() returning at least margin bytes, Clear() from the consumer
+ * side, detached threads that Cancel() waits for and then cancels), so the
+ * bench sees the same timing as the plugin. What differs:
+ * - no I/O throttle (SetIoThrottle(), cIoThrottle)
+ * - no cRingBufferLinear::Read() and no overflow reports
+ * - the buffer usage log of statistics buffers goes to stderr
+ * - no thread priorities, cThread::SetDescription() or locking of cThreads
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vdr/ringbuffer.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+// --- Logging ---------------------------------------------------------------
+
+int SysLogLevel = 1;
+
+void syslog_with_tid(int priority, const char *format, ...)
+{
+  static const char *Prefix[] = { "EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG" };
+  char buf[512];
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  fprintf(stderr, "%s: %s\n", Prefix[LOG_PRI(priority)], buf);
+}
+
+// --- Tools -----------------------------------------------------------------
+
+bool startswith(const char *s, const char *p)
+{
+  while (*p) {
+    if (*p++ != *s++)
+      return false;
+  }
+  return true;
+}
+
+char *strn0cpy(char *dest, const char *src, size_t n)
+{
+  char *s = dest;
+  for ( ; --n && (*dest = *src) != 0; dest++, src++)
+    ;
+  *dest = 0;
+  return s;
+}
+
+cString TimeString(time_t t)
+{
+  char buffer[8];
+  struct tm tm_r;
+  tm *tm = localtime_r(&t, &tm_r);
+  strftime(buffer, sizeof(buffer), "%R", tm);
+  return buffer;
+}
+
+uint64_t cTimeMs::Now(void)
+{
+  struct timespec tp;
+  if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0)
+    return (uint64_t(tp.tv_sec)) * 1000 + tp.tv_nsec / 1000000;
+  return 0;
+}
+
+cString::cString(const char *S, bool TakePointer)
+{
+  s = TakePointer ? (char *)S : S ? strdup(S) : NULL;
+}
+
+cString::cString(const cString &String)
+{
+  s = String.s ? strdup(String.s) : NULL;
+}
+
+cString::~cString()
+{
+  free(s);
+}
+
+cString &cString::operator=(const cString &String)
+{
+  if (this == &String)
+    return *this;
+  free(s);
+  s = String.s ? strdup(String.s) : NULL;
+  return *this;
+}
+
+cString &cString::operator=(const char *String)
+{
+  if (s == String)
+    return *this;
+  free(s);
+  s = String ? strdup(String) : NULL;
+  return *this;
+}
+
+cString cString::sprintf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  char *buffer;
+  if (!fmt || vasprintf(&buffer, fmt, ap) < 0)
+    buffer = strdup("???");
+  va_end(ap);
+  return cString(buffer, true);
+}
+
+cString cString::vsprintf(const char *fmt, va_list &ap)
+{
+  char *buffer;
+  if (!fmt || vasprintf(&buffer, fmt, ap) < 0)
+    buffer = strdup("???");
+  return cString(buffer, true);
+}
+
+// --- Threads ---------------------------------------------------------------
+
+cMutex::cMutex(void)
+{
+  locked = 0;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+cMutex::~cMutex()
+{
+  pthread_mutex_destroy(&mutex);
+}
+
+void cMutex::Lock(void)
+{
+  pthread_mutex_lock(&mutex);
+  locked++;
+}
+
+void cMutex::Unlock(void)
+{
+  locked--;
+  pthread_mutex_unlock(&mutex);
+}
+
+cMutexLock::cMutexLock(cMutex *Mutex)
+{
+  mutex = NULL;
+  locked = false;
+  Lock(Mutex);
+}
+
+cMutexLock::~cMutexLock()
+{
+  if (mutex && locked)
+    mutex->Unlock();
+}
+
+bool cMutexLock::Lock(cMutex *Mutex)
+{
+  if (Mutex && !mutex) {
+    mutex = Mutex;
+    Mutex->Lock();
+    locked = true;
+    return true;
+  }
+  return false;
+}
+
+static bool GetAbsTime(struct timespec *Abstime, int MillisecondsFromNow)
+{
+  struct timeval now;
+  if (gettimeofday(&now, NULL) == 0) {
+    now.tv_sec  += MillisecondsFromNow / 1000;
+    now.tv_usec += (MillisecondsFromNow % 1000) * 1000;
+    if (now.tv_usec >= 1000000) {
+      now.tv_sec++;
+      now.tv_usec -= 1000000;
+    }
+    Abstime->tv_sec = now.tv_sec;
+    Abstime->tv_nsec = now.tv_usec * 1000;
+    return true;
+  }
+  return false;
+}
+
+cCondWait::cCondWait(void)
+{
+  signaled = false;
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+}
+
+cCondWait::~cCondWait()
+{
+  pthread_cond_broadcast(&cond);
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+}
+
+void cCondWait::SleepMs(int TimeoutMs)
+{
+  cCondWait w;
+  w.Wait(max(TimeoutMs, 3)); // making sure the time is >2ms to avoid a possible busy wait
+}
+
+bool cCondWait::Wait(int TimeoutMs)
+{
+  pthread_mutex_lock(&mutex);
+  if (!signaled) {
+    if (TimeoutMs) {
+      struct timespec abstime;
+      if (GetAbsTime(&abstime, TimeoutMs)) {
+        while (!signaled) {
+          if (pthread_cond_timedwait(&cond, &mutex, &abstime) == ETIMEDOUT)
+            break;
+        }
+      }
+    }
+    else
+      pthread_cond_wait(&cond, &mutex);
+  }
+  bool r = signaled;
+  signaled = false;
+  pthread_mutex_unlock(&mutex);
+  return r;
+}
+
+void cCondWait::Signal(void)
+{
+  pthread_mutex_lock(&mutex);
+  signaled = true;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+cThread::cThread(const char *Description, bool LowPriority)
+{
+  active = running = false;
+  childTid = 0;
+  childThreadId = 0;
+  description = Description ? strdup(Description) : NULL;
+  lowPriority = LowPriority;
+}
+
+cThread::~cThread()
+{
+  Cancel(); // just in case the derived class didn't call it
+  free(description);
+}
+
+tThreadId cThread::ThreadId(void)
+{
+  return syscall(__NR_gettid);
+}
+
+void *cThread::StartThread(cThread *Thread)
+{
+  Thread->childThreadId = ThreadId();
+  if (Thread->description) {
+    // Thread names show up in the per stage CPU report
+    char name[16];
+    strn0cpy(name, Thread->description, sizeof(name));
+    pthread_setname_np(pthread_self(), name);
+  }
+  Thread->Action();
+  Thread->running = false;
+  Thread->active = false;
+  return NULL;
+}
+
+#define THREAD_STOP_TIMEOUT  3000 // ms to wait for a thread to stop before newly starting it
+#define THREAD_STOP_SLEEP      30 // ms to sleep while waiting for a thread to stop
+
+bool cThread::Start(void)
+{
+  if (!running) {
+    if (active) {
+      // Wait until the previous incarnation of this thread has completely ended
+      // before starting it newly:
+      uint64_t start = cTimeMs::Now();
+      while (!running && active && cTimeMs::Now() - start < THREAD_STOP_TIMEOUT)
+        cCondWait::SleepMs(THREAD_STOP_SLEEP);
+    }
+    if (!active) {
+      active = running = true;
+      if (pthread_create(&childTid, NULL, (void *(*)(void *))&StartThread, (void *)this) == 0) {
+        pthread_detach(childTid); // auto-reap
+      }
+      else {
+        esyslog("ERROR: can't start thread %s: %s", description ? description : "", strerror(errno));
+        active = running = false;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool cThread::Active(void)
+{
+  if (active) {
+    // A thread that was killed behind our back still counts as active until
+    // pthread_kill() tells otherwise
+    int err;
+    if ((err = pthread_kill(childTid, 0)) != 0) {
+      if (err != ESRCH)
+        esyslog("ERROR: pthread_kill: %s", strerror(err));
+      childTid = 0;
+      active = running = false;
+    }
+    else
+      return true;
+  }
+  return false;
+}
+
+void cThread::Cancel(int WaitSeconds)
+{
+  running = false;
+  if (active && WaitSeconds > -1) {
+    if (WaitSeconds > 0) {
+      for (time_t t0 = time(NULL) + WaitSeconds; time(NULL) < t0; ) {
+        if (!Active())
+          return;
+        cCondWait::SleepMs(10);
+      }
+      esyslog("ERROR: %s thread %d won't end (waited %d seconds) - canceling it...", description ? description : "", childThreadId, WaitSeconds);
+    }
+    pthread_cancel(childTid);
+    childTid = 0;
+    active = false;
+  }
+}
+
+// --- Ring buffer -----------------------------------------------------------
+
+#define PERCENTAGEDELTA     10
+#define PERCENTAGETHRESHOLD 70
+
+cRingBuffer::cRingBuffer(int Size, bool Statistics)
+{
+  size = Size;
+  statistics = Statistics;
+  getThreadTid = 0;
+  maxFill = 0;
+  lastPercent = 0;
+  putTimeout = getTimeout = 0;
+  lastOverflowReport = 0;
+  overflowCount = overflowBytes = 0;
+  ioThrottle = NULL;
+}
+
+cRingBuffer::~cRingBuffer()
+{
+}
+
+void cRingBuffer::UpdatePercentage(int Fill)
+{
+  if (Fill > maxFill)
+    maxFill = Fill;
+  int percent = Fill * 100 / (Size() - 1) / PERCENTAGEDELTA * PERCENTAGEDELTA; // clamp down to nearest quantum
+  if (percent != lastPercent) {
+    if ((percent >= PERCENTAGETHRESHOLD && percent > lastPercent) || (percent < PERCENTAGETHRESHOLD && lastPercent >= PERCENTAGETHRESHOLD)) {
+      dsyslog("buffer usage: %d%% (tid=%d)", percent, getThreadTid);
+      lastPercent = percent;
+    }
+  }
+}
+
+void cRingBuffer::WaitForPut(void)
+{
+  if (putTimeout)
+    readyForPut.Wait(putTimeout);
+}
+
+void cRingBuffer::WaitForGet(void)
+{
+  if (getTimeout)
+    readyForGet.Wait(getTimeout);
+}
+
+void cRingBuffer::EnablePut(void)
+{
+  if (putTimeout && Free() > Size() / 10)
+    readyForPut.Signal();
+}
+
+void cRingBuffer::EnableGet(void)
+{
+  if (getTimeout && Available() > Size() / 10)
+    readyForGet.Signal();
+}
+
+void cRingBuffer::SetTimeouts(int PutTimeout, int GetTimeout)
+{
+  putTimeout = PutTimeout;
+  getTimeout = GetTimeout;
+}
+
+cRingBufferLinear::cRingBufferLinear(int Size, int Margin, bool Statistics, const char *Description)
+:cRingBuffer(Size, Statistics)
+{
+  description = Description ? strdup(Description) : NULL;
+  tail = head = margin = Margin;
+  gotten = 0;
+  buffer = NULL;
+  if (Size > 1) { // 'Size - 1' must not be 0!
+    if (Margin <= Size / 2) {
+      buffer = (uchar *)malloc(Size);
+      if (!buffer)
+        esyslog("ERROR: can't allocate ring buffer (size=%d)", Size);
+      Clear();
+    }
+    else
+      esyslog("ERROR: invalid margin for ring buffer (%d > %d)", Margin, Size / 2);
+  }
+  else
+    esyslog("ERROR: invalid size for ring buffer (%d)", Size);
+}
+
+cRingBufferLinear::~cRingBufferLinear()
+{
+  free(buffer);
+  free(description);
+}
+
+int cRingBufferLinear::DataReady(const uchar *Data, int Count)
+{
+  return Count >= margin ? Count : 0;
+}
+
+int cRingBufferLinear::Available(void)
+{
+  int diff = head - tail;
+  return (diff >= 0) ? diff : Size() + diff - margin;
+}
+
+void cRingBufferLinear::Clear(void)
+{
+  // Only the consumer moves the tail, so this is safe while Put() runs
+  int Head = head;
+  tail = Head;
+  maxFill = 0;
+  EnablePut();
+}
+
+int cRingBufferLinear::Put(const uchar *Data, int Count)
+{
+  if (Count > 0) {
+    int Tail = tail;
+    int rest = Size() - head;
+    int diff = Tail - head;
+    int free = ((Tail < margin) ? rest : (diff > 0) ? diff : Size() + diff - margin) - 1;
+    if (statistics) {
+      int fill = Size() - free - 1 + Count;
+      if (fill >= Size())
+        fill = Size() - 1;
+      UpdatePercentage(fill);
+    }
+    if (free > 0) {
+      if (free < Count)
+        Count = free;
+      if (Count >= rest) {
+        memcpy(buffer + head, Data, rest);
+        if (Count - rest)
+          memcpy(buffer + margin, Data + rest, Count - rest);
+        head = margin + Count - rest;
+      }
+      else {
+        memcpy(buffer + head, Data, Count);
+        head += Count;
+      }
+    }
+    else
+      Count = 0;
+    EnableGet();
+    if (Count == 0)
+      WaitForPut();
+  }
+  return Count;
+}
+
+uchar *cRingBufferLinear::Get(int &Count)
+{
+  int Head = head;
+  if (getThreadTid <= 0)
+    getThreadTid = cThread::ThreadId();
+  int rest = Size() - tail;
+  if (rest < margin && Head < tail) {
+    // Less than margin bytes before the end, they are copied in front of
+    // the start so Get() returns at least margin contiguous bytes
+    int t = margin - rest;
+    memcpy(buffer + t, buffer + tail, rest);
+    tail = t;
+    rest = Head - tail;
+  }
+  int diff = Head - tail;
+  int cont = (diff >= 0) ? diff : Size() + diff - margin;
+  if (cont > rest)
+    cont = rest;
+  uchar *p = buffer + tail;
+  if ((cont = DataReady(p, cont)) > 0) {
+    Count = gotten = cont;
+    return p;
+  }
+  WaitForGet();
+  return NULL;
+}
+
+void cRingBufferLinear::Del(int Count)
+{
+  if (Count > gotten) {
+    esyslog("ERROR: invalid Count in cRingBufferLinear::Del: %d (limited to %d)", Count, gotten);
+    Count = gotten;
+  }
+  if (Count > 0) {
+    int Tail = tail;
+    Tail += Count;
+    gotten -= Count;
+    if (Tail >= Size())
+      Tail = margin;
+    tail = Tail;
+    EnablePut();
+  }
+}
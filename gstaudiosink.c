@@ -0,0 +1,192 @@
+/*
+ * gstaudiosink.c: Audio sink buffering and clock slaving
+ */
+
+#include "gstaudiosink.h"
+#include "gstconfig.h"
+
+#define AUDIO_WINDOW_MS      1000  // late buffers are counted per window
+#define AUDIO_UNDERRUN_LIMIT 2     // late buffers per window that mean the sink ran dry
+#define AUDIO_HOLD_MS        3000  // settling time after a clear or a new sink
+#define AUDIO_PROBE_SECS     30    // clean seconds after which a profile is kept
+
+// Smallest first, latency-time at most half of buffer-time
+static const tGstAudioSinkTiming AutoProfiles[] = {
+  { 40, 10 },
+  { 60, 10 },
+  { 100, 20 },
+  { 150, 25 },
+  { 200, 25 },
+  { 400, 50 },
+};
+
+#define AUTO_PROFILES int(sizeof(AutoProfiles) / sizeof(AutoProfiles[0]))
+
+// --- cGstAudioSinkTuner ----------------------------------------------------
+
+cGstAudioSinkTuner::cGstAudioSinkTuner(void)
+{
+  mode = -1;
+  bufferMs = latencyMs = 0;
+  slaveMethod = asSkew;
+  driftMs = 0;
+  provideClock = true;
+  level = 0;
+  stable = false;
+  buffers = 0;
+  late = 0;
+  underruns = 0;
+  cleanSeconds = 0;
+  windowStart = cTimeMs::Now();
+  holdUntil = 0;
+}
+
+void cGstAudioSinkTuner::Setup(void)
+{
+  if (GstoutConfig.audioSinkLatency != mode) {
+    level = 0;
+    stable = false;
+    cleanSeconds = 0;
+  }
+  mode = GstoutConfig.audioSinkLatency;
+  bufferMs = GstoutConfig.audioBufferTime;
+  latencyMs = GstoutConfig.audioLatencyTime;
+  slaveMethod = GstoutConfig.audioSlaveMethod;
+  driftMs = GstoutConfig.audioDriftTolerance;
+  provideClock = GstoutConfig.audioProvideClock;
+  Hold();
+}
+
+bool cGstAudioSinkTuner::Changed(void) const
+{
+  if (GstoutConfig.audioSinkLatency != mode || GstoutConfig.audioSlaveMethod != slaveMethod ||
+      GstoutConfig.audioDriftTolerance != driftMs || GstoutConfig.audioProvideClock != provideClock)
+    return true;
+  return mode == alManual && (GstoutConfig.audioBufferTime != bufferMs || GstoutConfig.audioLatencyTime != latencyMs);
+}
+
+void cGstAudioSinkTuner::Hold(void)
+{
+  holdUntil = cTimeMs::Now() + AUDIO_HOLD_MS;
+}
+
+void cGstAudioSinkTuner::Report(bool Underrun)
+{
+  g_atomic_int_inc(&buffers);
+  if (Underrun)
+    g_atomic_int_inc(&late);
+}
+
+bool cGstAudioSinkTuner::Tick(void)
+{
+  uint64_t now = cTimeMs::Now();
+  if (now - windowStart < AUDIO_WINDOW_MS)
+    return false;
+  windowStart = now;
+
+  int passed = g_atomic_int_get(&buffers);
+  g_atomic_int_add(&buffers, -passed);
+  int count = g_atomic_int_get(&late);
+  g_atomic_int_add(&late, -count);
+  if (now < holdUntil || !passed)
+    return false;
+  underruns += count;
+
+  if (mode != alAuto || stable)
+    return false;
+  if (count == 0) {
+    if (++cleanSeconds >= AUDIO_PROBE_SECS) {
+      stable = true;
+      isyslog("gstout: Audio sink stable with buffer %d ms, period %d ms", AutoProfiles[level].bufferMs, AutoProfiles[level].latencyMs);
+    }
+    return false;
+  }
+  cleanSeconds = 0;
+  if (count < AUDIO_UNDERRUN_LIMIT)
+    return false;
+  if (level == AUTO_PROFILES - 1) {
+    stable = true;
+    isyslog("gstout: Audio sink still runs dry with buffer %d ms, keeping it", AutoProfiles[level].bufferMs);
+    return false;
+  }
+  level++;
+  isyslog("gstout: Audio sink ran dry (%d late buffers/s), trying buffer %d ms, period %d ms", count, AutoProfiles[level].bufferMs, AutoProfiles[level].latencyMs);
+  return true;
+}
+
+tGstAudioSinkTiming cGstAudioSinkTuner::Timing(void) const
+{
+  tGstAudioSinkTiming timing = { 0, 0 };
+  if (mode == alManual) {
+    timing.bufferMs = bufferMs;
+    timing.latencyMs = min(latencyMs, bufferMs / 2);
+  }
+  else if (mode == alAuto)
+    timing = AutoProfiles[level];
+  return timing;
+}
+
+bool cGstAudioSinkTuner::Configure(GstElement *Element) const
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS(Element);
+  if (!g_object_class_find_property(klass, "buffer-time") || !g_object_class_find_property(klass, "slave-method"))
+    return false;
+
+  // Read when the sink acquires its ring buffer, so a new timing needs a
+  // new sink (or a pipeline in NULL)
+  tGstAudioSinkTiming timing = Timing();
+  if (timing.bufferMs > 0) {
+    g_object_set(G_OBJECT(Element),
+                 "buffer-time", (gint64)timing.bufferMs * 1000,
+                 "latency-time", (gint64)max(timing.latencyMs, 1) * 1000,
+                 NULL);
+  }
+  g_object_set(G_OBJECT(Element),
+               "slave-method", slaveMethod,
+               "drift-tolerance", (gint64)driftMs * 1000,
+               "provide-clock", (gboolean)provideClock,
+               NULL);
+
+  if (timing.bufferMs > 0)
+    dsyslog("gstout: Audio sink %s: buffer %d ms, period %d ms, %s slaving, drift tolerance %d ms%s", GST_OBJECT_NAME(Element),
+            timing.bufferMs, timing.latencyMs, SlaveMethodName(slaveMethod), driftMs, provideClock ? "" : ", no clock");
+  else
+    dsyslog("gstout: Audio sink %s: default buffer, %s slaving, drift tolerance %d ms%s", GST_OBJECT_NAME(Element),
+            SlaveMethodName(slaveMethod), driftMs, provideClock ? "" : ", no clock");
+  return true;
+}
+
+void cGstAudioSinkTuner::ConfigureSink(GstElement *Sink) const
+{
+  if (Configure(Sink) || !GST_IS_BIN(Sink))
+    return;
+
+  // Auto sinks create theirs on the way to READY, they are configured from
+  // the pipeline's deep-element-added
+  GstIterator *it = gst_bin_iterate_recurse(GST_BIN(Sink));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+    Configure(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+cString cGstAudioSinkTuner::Status(void) const
+{
+  tGstAudioSinkTiming timing = Timing();
+  cString buffer = timing.bufferMs > 0 ? cString::sprintf("buffer %d ms, period %d ms", timing.bufferMs, timing.latencyMs) : cString("default buffer");
+  cString probe = mode == alAuto ? cString::sprintf(" (auto %d/%d, %s)", level + 1, AUTO_PROFILES, stable ? "stable" : "probing") : cString("");
+  return cString::sprintf("Sink: %s%s, %s slaving, %llu underruns", *buffer, *probe, SlaveMethodName(slaveMethod), (unsigned long long)underruns);
+}
+
+const char *cGstAudioSinkTuner::SlaveMethodName(int Method)
+{
+  switch (Method) {
+    case asResample: return "resample";
+    case asSkew:     return "skew";
+    case asNone:     return "no";
+    default:         return "unknown";
+  }
+}
@@ -0,0 +1,83 @@
+/*
+ * gstaudiosink.h: Audio sink buffering and clock slaving
+ */
+
+#ifndef __GSTAUDIOSINK_H
+#define __GSTAUDIOSINK_H
+
+#include <vdr/tools.h>
+#include <gst/gst.h>
+
+struct tGstAudioSinkTiming {
+  int bufferMs;   // buffer-time, 0 = the sink's default
+  int latencyMs;  // latency-time, the period the sink writes in
+};
+
+// --- cGstAudioSinkTuner ----------------------------------------------------
+
+// Sets buffer-time, latency-time and the clock slaving of GstAudioBaseSink
+// based sinks (also inside a sink bin or an auto sink) from the setup.
+//
+// In auto mode the sink starts with the smallest profile and moves to the
+// next larger one whenever it runs dry, that is a buffer reaches it after
+// its time to be played while the queue in front of it still held data (an
+// empty queue means the input stalled, which a larger sink buffer does not
+// cure). The first profile that plays for a while without an underrun is
+// kept until the plugin is restarted or the mode is changed.
+//
+// Report() is called from the streaming thread, everything else from the
+// output thread under the output's mutex.
+
+class cGstAudioSinkTuner {
+private:
+  // Settings from the setup, taken over by Setup()
+  int mode;
+  int bufferMs;
+  int latencyMs;
+  int slaveMethod;
+  int driftMs;
+  bool provideClock;
+
+  int level;       // auto profile
+  bool stable;
+  gint buffers;    // reported in the current window
+  gint late;
+  uint64_t underruns;
+  int cleanSeconds;
+  uint64_t windowStart;
+  uint64_t holdUntil;
+
+public:
+  cGstAudioSinkTuner(void);
+
+  // Takes over the setup, a new mode starts probing again
+  void Setup(void);
+
+  // True if the setup differs from what the sink was configured with
+  bool Changed(void) const;
+
+  // Late buffers are not counted for a while after a clear or a new sink
+  void Hold(void);
+
+  // Called for each buffer on its way to the sink, Underrun if it was late
+  // although the queue had data
+  void Report(bool Underrun);
+
+  // Called periodically, returns true if the sink has to be replaced with
+  // a larger profile
+  bool Tick(void);
+
+  tGstAudioSinkTiming Timing(void) const;
+
+  // Configures Element if it is an audio base sink
+  bool Configure(GstElement *Element) const;
+  // Configures Sink or the audio base sinks in it
+  void ConfigureSink(GstElement *Sink) const;
+
+  uint64_t Underruns(void) const { return underruns; }
+  cString Status(void) const;
+
+  static const char *SlaveMethodName(int Method);
+};
+
+#endif // __GSTAUDIOSINK_H
@@ -0,0 +1,214 @@
+/*
+ * gstblend.c: OSD blending into raw video frames
+ */
+
+#include "gstblend.h"
+#include <vdr/tools.h>
+
+// --- Helpers ---------------------------------------------------------------
+
+// v + (o - v) * a / 255, rounded
+static inline uint8_t Mix(int v, int o, int a)
+{
+  int t = (o - v) * a + 128;
+  return v + ((t + (t >> 8)) >> 8);
+}
+
+// Studio range RGB to YUV in 8 bit fixed point, the chroma rows sum up to 0
+// so gray stays neutral
+struct tYuvMatrix {
+  int y[3];
+  int u[3];
+  int v[3];
+};
+
+static const tYuvMatrix Bt601 = { { 66, 129, 25 }, { -38, -74, 112 }, { 112, -94, -18 } };
+static const tYuvMatrix Bt709 = { { 47, 157, 16 }, { -26, -86, 112 }, { 112, -102, -10 } };
+
+static inline int RgbY(const tYuvMatrix &m, uint32_t c)
+{
+  int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+  return ((m.y[0] * r + m.y[1] * g + m.y[2] * b + 128) >> 8) + 16;
+}
+
+static inline int RgbU(const tYuvMatrix &m, uint32_t c)
+{
+  int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+  return ((m.u[0] * r + m.u[1] * g + m.u[2] * b + 128) >> 8) + 128;
+}
+
+static inline int RgbV(const tYuvMatrix &m, uint32_t c)
+{
+  int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+  return ((m.v[0] * r + m.v[1] * g + m.v[2] * b + 128) >> 8) + 128;
+}
+
+static bool ClipRect(const tGstBlendFrame &Frame, const tGstBlendRect &Rect, int &x1, int &y1, int &x2, int &y2)
+{
+  x1 = max(Rect.x, 0);
+  y1 = max(Rect.y, 0);
+  x2 = min(Rect.x + Rect.width, Frame.width);
+  y2 = min(Rect.y + Rect.height, Frame.height);
+  return x1 < x2 && y1 < y2;
+}
+
+// --- Packed RGB ------------------------------------------------------------
+
+static void BlendPacked(tGstBlendFrame &Frame, const uint32_t *Osd, int Stride, int x1, int y1, int x2, int y2)
+{
+  // Byte offsets of R, G and B in a frame pixel
+  int r, g, b;
+  switch (Frame.format) {
+    case bfBGRA: r = 2; g = 1; b = 0; break;
+    case bfRGBA: r = 0; g = 1; b = 2; break;
+    case bfARGB: r = 1; g = 2; b = 3; break;
+    default:     r = 3; g = 2; b = 1; break; // bfABGR
+  }
+
+  for (int y = y1; y < y2; y++) {
+    const uint32_t *s = Osd + y * Stride;
+    uint8_t *d = Frame.data[0] + y * Frame.stride[0];
+    for (int x = x1; x < x2; x++) {
+      uint32_t c = s[x];
+      int a = c >> 24;
+      if (!a)
+        continue;
+      uint8_t *p = d + x * 4;
+      if (a == 0xFF) {
+        p[r] = c >> 16;
+        p[g] = c >> 8;
+        p[b] = c;
+      }
+      else {
+        p[r] = Mix(p[r], (c >> 16) & 0xFF, a);
+        p[g] = Mix(p[g], (c >> 8) & 0xFF, a);
+        p[b] = Mix(p[b], c & 0xFF, a);
+      }
+    }
+  }
+}
+
+// --- Planar YUV 4:2:0 ------------------------------------------------------
+
+static void BlendLuma(tGstBlendFrame &Frame, const tYuvMatrix &m, const uint32_t *Osd, int Stride, int x1, int y1, int x2, int y2)
+{
+  for (int y = y1; y < y2; y++) {
+    const uint32_t *s = Osd + y * Stride;
+    uint8_t *d = Frame.data[0] + y * Frame.stride[0];
+    for (int x = x1; x < x2; x++) {
+      uint32_t c = s[x];
+      int a = c >> 24;
+      if (a)
+        d[x] = a == 0xFF ? RgbY(m, c) : Mix(d[x], RgbY(m, c), a);
+    }
+  }
+}
+
+static void BlendChroma(tGstBlendFrame &Frame, const tYuvMatrix &m, const uint32_t *Osd, int Stride, int x1, int y1, int x2, int y2)
+{
+  // Each chroma sample covers 2x2 luma pixels. The OSD chroma is the alpha
+  // weighted mean of the block, blended with the block's mean alpha. Blocks
+  // on the edge of the rect are always taken as a whole.
+  bool nv12 = Frame.format == bfNV12;
+  for (int cy = y1 / 2; cy < (y2 + 1) / 2; cy++) {
+    uint8_t *du = Frame.data[1] + cy * Frame.stride[1];
+    uint8_t *dv = nv12 ? du + 1 : Frame.data[2] + cy * Frame.stride[2];
+    int step = nv12 ? 2 : 1;
+    int ya = cy * 2;
+    int yb = min(ya + 2, Frame.height);
+    for (int cx = x1 / 2; cx < (x2 + 1) / 2; cx++) {
+      int xa = cx * 2;
+      int xb = min(xa + 2, Frame.width);
+      int n = (xb - xa) * (yb - ya);
+      int sa = 0, su = 0, sv = 0;
+      for (int y = ya; y < yb; y++) {
+        const uint32_t *s = Osd + y * Stride;
+        for (int x = xa; x < xb; x++) {
+          uint32_t c = s[x];
+          int a = c >> 24;
+          if (a) {
+            sa += a;
+            su += a * RgbU(m, c);
+            sv += a * RgbV(m, c);
+          }
+        }
+      }
+      if (!sa)
+        continue;
+      int a = (sa + n / 2) / n;
+      int i = cx * step;
+      du[i] = Mix(du[i], (su + sa / 2) / sa, a);
+      dv[i] = Mix(dv[i], (sv + sa / 2) / sa, a);
+    }
+  }
+}
+
+// --- Public functions ------------------------------------------------------
+
+bool GstBlendBounds(const uint32_t *Osd, int Stride, int Width, int Height, tGstBlendRect &Rect)
+{
+  int x1 = Width, y1 = Height, x2 = -1, y2 = -1;
+  for (int y = 0; y < Height; y++) {
+    const uint32_t *s = Osd + y * Stride;
+    int first = -1, last = -1;
+    for (int x = 0; x < Width; x++) {
+      if (s[x] >> 24) {
+        first = x;
+        break;
+      }
+    }
+    if (first < 0)
+      continue;
+    for (int x = Width - 1; x >= first; x--) {
+      if (s[x] >> 24) {
+        last = x;
+        break;
+      }
+    }
+    x1 = min(x1, first);
+    x2 = max(x2, last);
+    if (y1 > y)
+      y1 = y;
+    y2 = y;
+  }
+  if (y2 < 0) {
+    Rect.x = Rect.y = Rect.width = Rect.height = 0;
+    return false;
+  }
+  Rect.x = x1;
+  Rect.y = y1;
+  Rect.width = x2 - x1 + 1;
+  Rect.height = y2 - y1 + 1;
+  return true;
+}
+
+void GstBlendOsd(tGstBlendFrame &Frame, const uint32_t *Osd, int Stride, const tGstBlendRect &Rect)
+{
+  int x1, y1, x2, y2;
+  if (!Osd || !ClipRect(Frame, Rect, x1, y1, x2, y2))
+    return;
+
+  switch (Frame.format) {
+    case bfBGRA:
+    case bfRGBA:
+    case bfARGB:
+    case bfABGR:
+      BlendPacked(Frame, Osd, Stride, x1, y1, x2, y2);
+      break;
+    case bfNV12:
+    case bfI420: {
+      const tYuvMatrix &m = Frame.bt709 ? Bt709 : Bt601;
+      BlendLuma(Frame, m, Osd, Stride, x1, y1, x2, y2);
+      BlendChroma(Frame, m, Osd, Stride, x1, y1, x2, y2);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+const char *GstBlendFormatName(int Format)
+{
+  static const char *Names[bfCount] = { "BGRA", "RGBA", "ARGB", "ABGR", "NV12", "I420" };
+  return (Format >= 0 && Format < bfCount) ? Names[Format] : "unknown";
+}
@@ -0,0 +1,44 @@
+/*
+ * gstblend.h: OSD blending into raw video frames
+ */
+
+#ifndef __GSTBLEND_H
+#define __GSTBLEND_H
+
+#include <stdint.h>
+
+// Video frame layouts the OSD can be blended into. The packed formats are
+// named by their byte order in memory, the alpha/padding byte of the frame
+// is left untouched.
+enum eGstBlendFormat { bfBGRA, bfRGBA, bfARGB, bfABGR, bfNV12, bfI420, bfCount };
+
+struct tGstBlendFrame {
+  int format;         // eGstBlendFormat
+  int width;
+  int height;
+  bool bt709;         // YUV matrix, BT.601 otherwise
+  uint8_t *data[3];   // planes (Y, U/UV, V)
+  int stride[3];      // bytes per line
+};
+
+struct tGstBlendRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+// Bounding box of the non-transparent pixels of an OSD given as tColor
+// (0xAARRGGBB, not premultiplied) with Stride pixels per line. Returns
+// false if the OSD is fully transparent.
+bool GstBlendBounds(const uint32_t *Osd, int Stride, int Width, int Height, tGstBlendRect &Rect);
+
+// Blends Rect of the OSD into the frame at the same position. The OSD must
+// cover the whole frame (Frame.width/height may be reduced to the OSD size).
+// The rect is clipped to the frame, luma/RGB pixels outside of it are not
+// touched, chroma samples on its edge include the neighbouring pixels.
+void GstBlendOsd(tGstBlendFrame &Frame, const uint32_t *Osd, int Stride, const tGstBlendRect &Rect);
+
+const char *GstBlendFormatName(int Format);
+
+#endif // __GSTBLEND_H
@@ -0,0 +1,202 @@
+/*
+ * gstbranch.c: Secondary decoder branches fed from a ring buffer
+ */
+
+#include "gstbranch.h"
+#include <gst/app/gstappsrc.h>
+
+// --- cGstBranch ------------------------------------------------------------
+
+cGstBranch::cGstBranch(int RingSize)
+{
+  ring = new cRingBufferLinear(RingSize, 0, false);
+  requestPad = NULL;
+  needData = 0;
+  feeding = 0;
+  lost = 0;
+  pushed = 0;
+  bin = NULL;
+  source = NULL;
+  decoder = NULL;
+  converter = NULL;
+}
+
+cGstBranch::~cGstBranch()
+{
+  // Unlinked and the bin stopped by now
+  if (requestPad)
+    gst_object_unref(requestPad);
+  delete ring;
+}
+
+bool cGstBranch::CreateInput(const char *BinName, GstElement *Converter, int SlabSize, int PoolSize, int AppsrcSize)
+{
+  if (!pool.Setup(SlabSize, PoolSize)) {
+    if (Converter)
+      gst_object_unref(Converter);
+    return false;
+  }
+
+  source = gst_element_factory_make("appsrc", NULL);
+  decoder = gst_element_factory_make("decodebin", NULL);
+  converter = Converter;
+
+  if (!source || !decoder || !converter) {
+    esyslog("gstout: Failed to create the input of %s", *description);
+    GstElement *elements[] = { source, decoder, converter };
+    for (unsigned int i = 0; i < sizeof(elements) / sizeof(elements[0]); i++) {
+      if (elements[i])
+        gst_object_unref(elements[i]);
+    }
+    source = decoder = converter = NULL;
+    return false;
+  }
+
+  g_object_set(G_OBJECT(source),
+               "stream-type", GST_APP_STREAM_TYPE_STREAM,
+               "format", GST_FORMAT_TIME,
+               "is-live", TRUE,
+               "max-bytes", (guint64)AppsrcSize,
+               "min-percent", 50,
+               NULL);
+
+  bin = gst_bin_new(BinName);
+  gst_bin_add_many(GST_BIN(bin), source, decoder, converter, NULL);
+  if (!gst_element_link(source, decoder)) {
+    esyslog("gstout: Failed to link the input of %s", *description);
+    gst_object_unref(bin);
+    bin = NULL;
+    source = decoder = converter = NULL;
+    return false;
+  }
+
+  g_signal_connect(source, "need-data", G_CALLBACK(NeedDataCallback), this);
+  g_signal_connect(source, "enough-data", G_CALLBACK(EnoughDataCallback), this);
+  g_signal_connect(decoder, "pad-added", G_CALLBACK(PadAddedCallback), this);
+  return true;
+}
+
+void cGstBranch::AddSrcPad(GstElement *Last)
+{
+  GstPad *pad = gst_element_get_static_pad(Last, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, OffsetProbe, this, NULL);
+  gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+  gst_object_unref(pad);
+}
+
+void cGstBranch::Put(const uchar *Data, int Length)
+{
+  // Whole packets only, a partial one would be garbage for the decoder
+  if (ring->Free() < Length) {
+    g_atomic_int_inc(&lost);
+    return;
+  }
+  ring->Put(Data, Length);
+}
+
+void cGstBranch::Feed(void)
+{
+  // The ring has a single consumer, the output thread and appsrc's
+  // need-data take turns
+  if (!source || !g_atomic_int_compare_and_exchange(&feeding, 0, 1))
+    return;
+
+  while (g_atomic_int_get(&needData)) {
+    int count = 0;
+    uchar *data = ring->Get(count);
+    if (!data || count <= 0)
+      break;
+
+    GstBuffer *buffer = pool.Get(data, count);
+    if (!buffer)
+      break;
+    count = gst_buffer_get_size(buffer);
+
+    GstFlowReturn ret;
+    g_signal_emit_by_name(source, "push-buffer", buffer, &ret);
+    gst_buffer_unref(buffer);
+    ring->Del(count);
+    pushed += count;
+
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  g_atomic_int_set(&feeding, 0);
+}
+
+void cGstBranch::NeedDataCallback(GstElement *source, guint size, gpointer data)
+{
+  cGstBranch *self = (cGstBranch *)data;
+  g_atomic_int_set(&self->needData, 1);
+  self->Feed();
+}
+
+void cGstBranch::EnoughDataCallback(GstElement *source, gpointer data)
+{
+  cGstBranch *self = (cGstBranch *)data;
+  g_atomic_int_set(&self->needData, 0);
+}
+
+void cGstBranch::PadAddedCallback(GstElement *element, GstPad *pad, gpointer data)
+{
+  cGstBranch *self = (cGstBranch *)data;
+
+  GstPad *sinkPad = gst_element_get_static_pad(self->converter, "sink");
+  if (!gst_pad_is_linked(sinkPad) && GST_PAD_LINK_FAILED(gst_pad_link(pad, sinkPad)))
+    esyslog("gstout: Failed to link the decoder of %s", *self->description);
+  gst_object_unref(sinkPad);
+}
+
+GstPadProbeReturn cGstBranch::OffsetProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstBranch *self = (cGstBranch *)data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  return self->Align(pad, buffer) ? GST_PAD_PROBE_REMOVE : GST_PAD_PROBE_OK;
+}
+
+bool cGstBranch::Link(GstElement *Element)
+{
+  if (requestPad)
+    return true;
+
+#if GST_CHECK_VERSION(1, 20, 0)
+  requestPad = gst_element_request_pad_simple(Element, "sink_%u");
+#else
+  requestPad = gst_element_get_request_pad(Element, "sink_%u");
+#endif
+  if (!requestPad) {
+    esyslog("gstout: No pad on %s for %s", GST_OBJECT_NAME(Element), *description);
+    return false;
+  }
+
+  GstPad *pad = gst_element_get_static_pad(bin, "src");
+  bool ok = GST_PAD_LINK_SUCCESSFUL(gst_pad_link(pad, requestPad));
+  gst_object_unref(pad);
+  if (!ok) {
+    esyslog("gstout: Failed to link %s to %s", *description, GST_OBJECT_NAME(Element));
+    Unlink(Element);
+  }
+  return ok;
+}
+
+void cGstBranch::Unlink(GstElement *Element)
+{
+  if (!requestPad)
+    return;
+
+  GstPad *pad = gst_element_get_static_pad(bin, "src");
+  gst_pad_unlink(pad, requestPad);
+  gst_object_unref(pad);
+  gst_element_release_request_pad(Element, requestPad);
+  gst_object_unref(requestPad);
+  requestPad = NULL;
+}
+
+cString cGstBranch::BufferStatus(void)
+{
+  return cString::sprintf("Buffer: %d KB, %llu KB pushed, %d lost",
+                          ring->Available() / 1024,
+                          (unsigned long long)pushed / 1024,
+                          g_atomic_int_get(&lost));
+}
@@ -0,0 +1,73 @@
+/*
+ * gstbranch.h: Secondary decoder branches fed from a ring buffer
+ */
+
+#ifndef __GSTBRANCH_H
+#define __GSTBRANCH_H
+
+#include <vdr/tools.h>
+#include <vdr/ringbuffer.h>
+#include <gst/gst.h>
+#include "gstpool.h"
+
+// --- cGstBranch ------------------------------------------------------------
+
+// A bin of appsrc ! decodebin ! converter ... whose ghost src pad is linked
+// to a request pad of a mixer or selector in a running pipeline. PES
+// packets come from another thread through a ring buffer with a single
+// producer and a single consumer, so neither side takes a lock. Derived
+// classes build the rest of the bin and move the branch's timestamps onto
+// the pipeline's running time in Align().
+
+class cGstBranch {
+private:
+  cRingBufferLinear *ring;
+  cGstInputPool pool;
+  GstPad *requestPad;
+  gint needData;
+  gint feeding;
+  gint lost;
+  uint64_t pushed;
+
+  static void NeedDataCallback(GstElement *source, guint size, gpointer data);
+  static void EnoughDataCallback(GstElement *source, gpointer data);
+  static void PadAddedCallback(GstElement *element, GstPad *pad, gpointer data);
+  static GstPadProbeReturn OffsetProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+protected:
+  cString description;   // for the log, "PiP channel 3"
+  GstElement *bin;
+  GstElement *source;
+  GstElement *decoder;
+  GstElement *converter; // linked to the decoder's src pad
+
+  // Creates the bin with appsrc, decodebin and Converter. Converter is
+  // taken over, also if this fails.
+  bool CreateInput(const char *BinName, GstElement *Converter, int SlabSize, int PoolSize, int AppsrcSize);
+  // Ghosts the src pad of Last as the bin's src pad
+  void AddSrcPad(GstElement *Last);
+  // Called with the buffers leaving the bin until it returns true
+  virtual bool Align(GstPad *Pad, GstBuffer *Buffer) = 0;
+
+public:
+  cGstBranch(int RingSize);
+  virtual ~cGstBranch();
+
+  GstElement *Bin(void) { return bin; }
+
+  // Drops the packet if the ring is full
+  void Put(const uchar *Data, int Length);
+
+  // Pushes what is buffered while appsrc wants data, from any thread
+  void Feed(void);
+
+  // Request pad of Element, the caller holds the owning output's mutex
+  bool Link(GstElement *Element);
+  void Unlink(GstElement *Element);
+  GstPad *RequestPad(void) { return requestPad; }
+
+  // "Buffer: 12 KB, 345 KB pushed, 0 lost"
+  cString BufferStatus(void);
+};
+
+#endif // __GSTBRANCH_H
@@ -0,0 +1,79 @@
+/*
+ * gstconfig.c: Configuration of the GStreamer output plugin
+ */
+
+#include "gstconfig.h"
+#include <vdr/tools.h>
+
+// Global configuration
+cGstoutConfig GstoutConfig;
+
+// --- cGstoutConfig ---------------------------------------------------------
+
+cGstoutConfig::cGstoutConfig(void)
+{
+  audioDevice = 0;
+  videoDevice = 0;
+  useHardwareDecoding = true;
+  deinterlace = true;
+  deinterlaceMethod = dmAuto;
+  targetLatency = 800;
+  syncMinLatency = 100;
+  inputPoolSize = 0;
+  strcpy(audioSink, "autoaudiosink");
+  strcpy(videoSink, "autovideosink");
+  *videoStream = 0;
+  strcpy(pipMixer, "compositor");
+  timeshiftSize = 0;
+  audioTracks = 2;
+  radioMode = true;
+  subtitles = false;
+  audioSinkLatency = alDefault;
+  audioBufferTime = 200;
+  audioLatencyTime = 10;
+  audioSlaveMethod = asSkew;
+  audioDriftTolerance = 40;
+  audioProvideClock = true;
+  audioLoudness = false;
+  audioLoudnessTarget = -23;
+  audioCompression = dcOff;
+  *timeshiftDir = 0;
+  osdBlending = true;
+  decoderMode = gdAuto;
+  zapLogLevel = zlDebug;
+  zapFirstPicture = false;
+  *metrics = 0;
+  for (int i = 0; i < gcCount; i++) {
+    decoder[i].threading = gtAuto;
+    decoder[i].threads = 0;
+    decoder[i].outputCorrupt = false;
+    decoder[i].skipFrame = 0;
+    decoder[i].qos = true;
+  }
+}
+
+const char *cGstoutConfig::CodecName(int Codec)
+{
+  static const char *Names[gcCount] = { "Mpeg2", "H264", "H265" };
+  return (Codec >= 0 && Codec < gcCount) ? Names[Codec] : NULL;
+}
+
+bool cGstoutConfig::ParseDecoder(const char *Name, const char *Value)
+{
+  // Per codec keys, e.g. "H264Threading", "H265Threads"
+  for (int i = 0; i < gcCount; i++) {
+    const char *codec = CodecName(i);
+    const char *param = startswith(Name, codec) ? Name + strlen(codec) : NULL;
+    if (!param)
+      continue;
+    if      (!strcasecmp(param, "Threading"))     decoder[i].threading = constrain(atoi(Value), int(gtAuto), int(gtSlice));
+    else if (!strcasecmp(param, "Threads"))       decoder[i].threads = constrain(atoi(Value), 0, 16);
+    else if (!strcasecmp(param, "OutputCorrupt")) decoder[i].outputCorrupt = atoi(Value);
+    else if (!strcasecmp(param, "SkipFrame"))     decoder[i].skipFrame = constrain(atoi(Value), 0, 5);
+    else if (!strcasecmp(param, "Qos"))           decoder[i].qos = atoi(Value);
+    else
+      return false;
+    return true;
+  }
+  return false;
+}
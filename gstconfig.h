@@ -0,0 +1,83 @@
+/*
+ * gstconfig.h: Configuration of the GStreamer output plugin
+ */
+
+#ifndef __GSTCONFIG_H
+#define __GSTCONFIG_H
+
+// Video codecs with individual decoder tuning
+enum eGstCodec { gcMpeg2, gcH264, gcH265, gcCount };
+
+// Decoder threading (values match avdec's thread-type flags)
+enum eGstThreading { gtAuto, gtFrame, gtSlice };
+
+// Decoder mode
+enum eGstDecoderMode { gdLowLatency, gdThroughput, gdAuto };
+
+// Logging of channel switch timelines
+enum eGstZapLogLevel { zlOff, zlInfo, zlDebug, zlCount };
+
+// Deinterlacer method
+enum eGstDeinterlaceMethod { dmAuto, dmLinear, dmGreedyH, dmYadif, dmVaapi, dmGl, dmCount };
+
+// Buffer and period size of the audio sink
+enum eGstAudioSinkLatency { alDefault, alManual, alAuto, alCount };
+
+// Clock slaving of the audio sink (values match GstAudioBaseSinkSlaveMethod)
+enum eGstAudioSlaveMethod { asResample, asSkew, asNone, asCount };
+
+// Dynamic range compression of the audio
+enum eGstCompression { dcOff, dcLight, dcHeavy, dcCount };
+
+struct tGstDecoderTuning {
+  int threading;     // eGstThreading, gtAuto = by decoder mode
+  int threads;       // 0 = auto
+  int outputCorrupt;
+  int skipFrame;     // avdec skip-frame: 0 nothing, 1 B-frames, 2 IDCT, 5 all
+  int qos;
+};
+
+// Plugin configuration
+class cGstoutConfig {
+public:
+  int audioDevice;
+  int videoDevice;
+  bool useHardwareDecoding;
+  bool deinterlace;
+  int deinterlaceMethod;
+  int targetLatency;
+  int syncMinLatency;
+  int inputPoolSize;  // MB, 0 = sized from the target latency
+  char audioSink[256];
+  char videoSink[256];
+  char videoStream[256]; // encoder branch behind the video decoder, "" = off
+  char pipMixer[32];     // compositor for picture in picture and mosaic
+  int timeshiftSize;     // MB, 0 = off
+  int audioTracks;       // audio tracks decoded at the same time
+  bool subtitles;        // show the first subtitle stream of a channel
+  bool radioMode;        // video pipeline in NULL while a channel has no video
+  int audioSinkLatency;  // eGstAudioSinkLatency
+  int audioBufferTime;   // ms, sink buffer-time with alManual
+  int audioLatencyTime;  // ms, sink latency-time (period) with alManual
+  int audioSlaveMethod;  // eGstAudioSlaveMethod
+  int audioDriftTolerance; // ms
+  bool audioProvideClock;
+  bool audioLoudness;    // normalize the loudness to audioLoudnessTarget
+  int audioLoudnessTarget; // LUFS
+  int audioCompression;  // eGstCompression
+  char timeshiftDir[256];
+  bool osdBlending;
+  int decoderMode;
+  int zapLogLevel;
+  bool zapFirstPicture;  // decode from the first picture after a zap
+  char metrics[256];  // metrics endpoint, "" = off
+  tGstDecoderTuning decoder[gcCount];
+  
+  cGstoutConfig(void);
+  bool ParseDecoder(const char *Name, const char *Value);
+  static const char *CodecName(int Codec);
+};
+
+extern cGstoutConfig GstoutConfig;
+
+#endif // __GSTCONFIG_H
@@ -0,0 +1,403 @@
+/*
+ * gstdemux.c: TS demultiplexer for GStreamer output
+ */
+
+#include "gstdemux.h"
+#include "gstconfig.h"
+#include <vdr/remux.h>
+
+#define PES_ALLOC_STEP  KILOBYTE(64)
+
+// --- cGstPesBuffer ---------------------------------------------------------
+
+cGstPesBuffer::cGstPesBuffer(void)
+{
+  data = NULL;
+  length = 0;
+  size = 0;
+}
+
+cGstPesBuffer::~cGstPesBuffer()
+{
+  free(data);
+}
+
+bool cGstPesBuffer::Append(const uchar *Data, int Length)
+{
+  if (length + Length > size) {
+    int newSize = (length + Length + PES_ALLOC_STEP - 1) / PES_ALLOC_STEP * PES_ALLOC_STEP;
+    if (newSize > GSTDEMUX_MAXPES)
+      return false;
+    uchar *p = (uchar *)realloc(data, newSize);
+    if (!p)
+      return false;
+    data = p;
+    size = newSize;
+  }
+  memcpy(data + length, Data, Length);
+  length += Length;
+  return true;
+}
+
+void cGstPesBuffer::Swap(cGstPesBuffer &Other)
+{
+  uchar *d = data;
+  int l = length;
+  int s = size;
+  data = Other.data;
+  length = Other.length;
+  size = Other.size;
+  Other.data = d;
+  Other.length = l;
+  Other.size = s;
+}
+
+// --- cGstTsDemux -----------------------------------------------------------
+
+cGstTsDemux::cGstTsDemux(void)
+{
+  sectionLength = 0;
+  sectionPid = -1;
+  pmtPid = -1;
+  pmtVersion = -1;
+  videoPid = 0;
+  videoCodec = -1;
+  numAudio = 0;
+  audioVersion = 0;
+  audioMask = 1;
+  numSubtitles = 0;
+  subtitleVersion = 0;
+  subtitlePid = 0;
+  readyVideo = false;
+  readyTrack = 0;
+  pesCount[0] = pesCount[1] = 0;
+}
+
+void cGstTsDemux::Clear(void)
+{
+  sectionLength = 0;
+  videoPes.Clear();
+  for (int i = 0; i < GSTDEMUX_MAXAUDIO; i++)
+    audioPes[i].Clear();
+  subtitlePes.Clear();
+  ready.Clear();
+  // Re-parse the next PMT, the new channel may use the same PID and version
+  pmtVersion = -1;
+}
+
+int cGstTsDemux::StreamCodec(int StreamType)
+{
+  return StreamType == 0x1B ? gcH264 : StreamType == 0x24 ? gcH265 : gcMpeg2;
+}
+
+const char *cGstTsDemux::AudioName(int StreamType)
+{
+  switch (StreamType) {
+    case 0x03:
+    case 0x04: return "MPEG";
+    case 0x0F:
+    case 0x7C: return "AAC";
+    case 0x11: return "LATM";
+    case 0x81:
+    case 0x6A: return "AC-3";
+    case 0x7A: return "E-AC-3";
+    case 0x7B: return "DTS";
+    default:   return "unknown";
+  }
+}
+
+void cGstTsDemux::SetAudioMask(uint32_t Mask)
+{
+  for (int i = 0; i < GSTDEMUX_MAXAUDIO; i++) {
+    if (!(Mask & (1 << i)))
+      audioPes[i].Clear();
+  }
+  audioMask = Mask;
+}
+
+void cGstTsDemux::SetSubtitle(int Index)
+{
+  int pid = (Index >= 0 && Index < numSubtitles) ? subtitles[Index].pid : 0;
+  if (pid != subtitlePid)
+    subtitlePes.Clear();
+  subtitlePid = pid;
+}
+
+void cGstTsDemux::SetVideoPid(int Pid, int StreamType)
+{
+  if (Pid != videoPid)
+    videoPes.Clear();
+  videoPid = Pid;
+  videoCodec = Pid ? StreamCodec(StreamType) : -1;
+}
+
+bool cGstTsDemux::PutTs(const uchar *Data, bool VideoOnly)
+{
+  if (ready.Length())
+    return false;
+
+  if (TsError(Data))
+    return true;
+
+  int pid = TsPid(Data);
+  if (pid == PATPID || pid == pmtPid)
+    PutSection(Data);
+  else if (pid == videoPid && videoPid)
+    PutPes(videoPes, Data, true);
+  else if (pid == subtitlePid && subtitlePid && !VideoOnly)
+    PutPes(subtitlePes, Data, false, GSTDEMUX_SUBTITLE);
+  else if (!VideoOnly) {
+    for (int i = 0; i < numAudio; i++) {
+      if (pid == audio[i].pid) {
+        if (audioMask & (1 << i))
+          PutPes(audioPes[i], Data, false, i);
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+const uchar *cGstTsDemux::GetPes(int &Length, bool &Video)
+{
+  Length = ready.Length();
+  Video = readyVideo;
+  return Length ? ready.Data() : NULL;
+}
+
+void cGstTsDemux::DelPes(void)
+{
+  ready.Clear();
+}
+
+void cGstTsDemux::PutPes(cGstPesBuffer &Pes, const uchar *Data, bool Video, int Track)
+{
+  if (!TsHasPayload(Data) || TsIsScrambled(Data))
+    return;
+
+  int offset = TsPayloadOffset(Data);
+  if (offset >= TS_SIZE)
+    return;
+
+  if (TsPayloadStart(Data)) {
+    if (Pes.Length()) {
+      // The previous packet is complete
+      ready.Swap(Pes);
+      readyVideo = Video;
+      readyTrack = Track;
+      pesCount[Video]++;
+    }
+    Pes.Clear();
+  }
+  else if (!Pes.Length())
+    return; // wait for the start of the next PES packet
+
+  if (!Pes.Append(Data + offset, TS_SIZE - offset)) {
+    esyslog("gstout: PES packet on PID %d too large, dropped", TsPid(Data));
+    Pes.Clear();
+  }
+  
+  // A subtitle has to be shown in time, not with the next one seconds later
+  if (Track == GSTDEMUX_SUBTITLE && !ready.Length() && Pes.Length() >= 6) {
+    const uchar *p = Pes.Data();
+    int length = 6 + ((p[4] << 8) | p[5]);
+    if (length > 6 && Pes.Length() >= length) {
+      ready.Swap(Pes);
+      readyVideo = false;
+      readyTrack = Track;
+      Pes.Clear();
+    }
+  }
+}
+
+void cGstTsDemux::AddSubtitle(int Pid, int Type, int Page, bool HearingImpaired, const uchar *Language)
+{
+  if (numSubtitles >= GSTDEMUX_MAXSUBS)
+    return;
+  tGstSubtitleStream &s = subtitles[numSubtitles++];
+  s.pid = Pid;
+  s.type = Type;
+  s.page = Page;
+  s.hearingImpaired = HearingImpaired;
+  memcpy(s.language, Language, 3);
+  s.language[3] = 0;
+}
+
+void cGstTsDemux::PutSection(const uchar *Data)
+{
+  int offset = TsPayloadOffset(Data);
+  if (!TsHasPayload(Data) || offset >= TS_SIZE)
+    return;
+
+  int pid = TsPid(Data);
+  const uchar *p = Data + offset;
+  int length = TS_SIZE - offset;
+
+  if (TsPayloadStart(Data)) {
+    int pointer = p[0] + 1;
+    if (pointer >= length)
+      return;
+    p += pointer;
+    length -= pointer;
+    sectionLength = 0;
+    sectionPid = pid;
+  }
+  else if (!sectionLength || pid != sectionPid)
+    return;
+
+  length = min(length, int(sizeof(section)) - sectionLength);
+  memcpy(section + sectionLength, p, length);
+  sectionLength += length;
+
+  if (sectionLength >= 3) {
+    int total = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+    if (sectionLength >= total || sectionLength == int(sizeof(section))) {
+      if (section[0] == 0x00 && pid == PATPID)
+        ParsePat(section, min(total, sectionLength));
+      else if (section[0] == 0x02 && pid == pmtPid)
+        ParsePmt(section, min(total, sectionLength));
+      sectionLength = 0;
+    }
+  }
+}
+
+void cGstTsDemux::ParsePat(const uchar *Data, int Length)
+{
+  // 8 byte header, 4 byte entries, 4 byte CRC
+  for (int i = 8; i + 4 <= Length - 4; i += 4) {
+    int program = (Data[i] << 8) | Data[i + 1];
+    int pid = ((Data[i + 2] & 0x1F) << 8) | Data[i + 3];
+    if (program) {
+      if (pid != pmtPid) {
+        dsyslog("gstout: PAT: program %d, PMT PID %d", program, pid);
+        pmtPid = pid;
+        pmtVersion = -1;
+      }
+      break;
+    }
+  }
+}
+
+void cGstTsDemux::ParsePmt(const uchar *Data, int Length)
+{
+  if (Length < 16)
+    return;
+
+  int version = (Data[5] >> 1) & 0x1F;
+  if (version == pmtVersion)
+    return;
+  pmtVersion = version;
+
+  int oldVideoPid = videoPid;
+  tGstAudioStream oldAudio[GSTDEMUX_MAXAUDIO];
+  int oldNumAudio = numAudio;
+  memcpy(oldAudio, audio, sizeof(audio));
+  tGstSubtitleStream oldSubtitles[GSTDEMUX_MAXSUBS];
+  int oldNumSubtitles = numSubtitles;
+  memcpy(oldSubtitles, subtitles, sizeof(subtitles));
+  videoPid = 0;
+  videoCodec = -1;
+  numAudio = 0;
+  numSubtitles = 0;
+
+  int i = 12 + (((Data[10] & 0x0F) << 8) | Data[11]);
+  while (i + 5 <= Length - 4) {
+    int type = Data[i];
+    int pid = ((Data[i + 1] & 0x1F) << 8) | Data[i + 2];
+    int esLength = ((Data[i + 3] & 0x0F) << 8) | Data[i + 4];
+    const uchar *desc = Data + i + 5;
+    int descLength = min(esLength, Length - 4 - i - 5);
+
+    const char *language = "";
+    for (int d = 0; d + 2 <= descLength; d += 2 + desc[d + 1]) {
+      if (desc[d] == 0x0A && desc[d + 1] >= 3 && d + 5 <= descLength) { // ISO 639 language
+        language = (const char *)desc + d + 2;
+        break;
+      }
+    }
+
+    // Private streams are identified by their descriptors
+    if (type == 0x06) {
+      for (int d = 0; d + 2 <= descLength; d += 2 + desc[d + 1]) {
+        int tag = desc[d];
+        if (tag == 0x6A || tag == 0x7A || tag == 0x7B || tag == 0x7C) { // AC-3, E-AC-3, DTS, AAC
+          type = tag;
+          break;
+        }
+        const uchar *e = desc + d + 2;
+        int n = min(int(desc[d + 1]), descLength - d - 2);
+        if (tag == 0x59) { // subtitling, one stream per PID (the decoder shows all pages)
+          if (n >= 8)
+            AddSubtitle(pid, stDvb, 0, e[3] >= 0x20 && e[3] <= 0x25, e);
+        }
+        else if (tag == 0x56) { // teletext, one stream per subtitle page
+          for (int t = 0; t + 5 <= n; t += 5) {
+            int ttxType = e[t + 3] >> 3;
+            if (ttxType == 0x02 || ttxType == 0x05) {
+              int magazine = e[t + 3] & 0x07;
+              int page = e[t + 4];
+              AddSubtitle(pid, stTeletext, (magazine ? magazine : 8) * 100 + (page >> 4) * 10 + (page & 0x0F), ttxType == 0x05, e + t);
+            }
+          }
+        }
+      }
+    }
+
+    switch (type) {
+      case 0x01: // MPEG-1 video
+      case 0x02: // MPEG-2 video
+      case 0x1B: // H.264
+      case 0x24: // H.265
+        if (!videoPid) {
+          videoPid = pid;
+          videoCodec = StreamCodec(type);
+        }
+        break;
+      case 0x03: // MPEG-1 audio
+      case 0x04: // MPEG-2 audio
+      case 0x0F: // AAC
+      case 0x11: // LATM AAC
+      case 0x81: // AC-3 (ATSC)
+      case 0x6A: // AC-3
+      case 0x7A: // E-AC-3
+      case 0x7B: // DTS
+      case 0x7C: // AAC
+        if (numAudio < GSTDEMUX_MAXAUDIO) {
+          audio[numAudio].pid = pid;
+          audio[numAudio].streamType = type;
+          strn0cpy(audio[numAudio].language, language, sizeof(audio[numAudio].language));
+          numAudio++;
+        }
+        break;
+      default:
+        break;
+    }
+    i += 5 + esLength;
+  }
+
+  if (videoPid != oldVideoPid)
+    videoPes.Clear();
+  bool audioChanged = numAudio != oldNumAudio;
+  for (int n = 0; n < numAudio && !audioChanged; n++)
+    audioChanged = audio[n].pid != oldAudio[n].pid || audio[n].streamType != oldAudio[n].streamType;
+  if (audioChanged) {
+    for (int n = 0; n < GSTDEMUX_MAXAUDIO; n++)
+      audioPes[n].Clear();
+    audioMask = 1;
+    audioVersion++;
+  }
+  bool subtitlesChanged = numSubtitles != oldNumSubtitles;
+  for (int n = 0; n < numSubtitles && !subtitlesChanged; n++)
+    subtitlesChanged = subtitles[n].pid != oldSubtitles[n].pid || subtitles[n].page != oldSubtitles[n].page;
+  if (subtitlesChanged) {
+    subtitlePes.Clear();
+    subtitlePid = 0;
+    subtitleVersion++;
+  }
+
+  isyslog("gstout: PMT version %d: video PID %d (%s), %d audio PID(s), %d subtitle stream(s)",
+          version, videoPid,
+          videoCodec >= 0 ? cGstoutConfig::CodecName(videoCodec) : "none",
+          numAudio, numSubtitles);
+}
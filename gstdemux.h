@@ -0,0 +1,140 @@
+/*
+ * gstdemux.h: TS demultiplexer for GStreamer output
+ */
+
+#ifndef __GSTDEMUX_H
+#define __GSTDEMUX_H
+
+#include <vdr/tools.h>
+
+#define GSTDEMUX_MAXAUDIO   16
+#define GSTDEMUX_MAXSUBS    16
+#define GSTDEMUX_SUBTITLE   -1  // ReadyTrack() of a subtitle packet
+#define GSTDEMUX_MAXPES     (4 * MEGABYTE(1)) // larger PES packets are dropped
+
+// --- cGstPesBuffer ---------------------------------------------------------
+
+class cGstPesBuffer {
+private:
+  uchar *data;
+  int length;
+  int size;
+
+public:
+  cGstPesBuffer(void);
+  ~cGstPesBuffer();
+
+  bool Append(const uchar *Data, int Length);
+  void Swap(cGstPesBuffer &Other);
+  void Clear(void) { length = 0; }
+
+  const uchar *Data(void) const { return data; }
+  int Length(void) const { return length; }
+};
+
+// --- cGstTsDemux -----------------------------------------------------------
+
+struct tGstAudioStream {
+  int pid;
+  int streamType;   // PMT stream type or descriptor tag for private streams
+  char language[4]; // ISO 639 code, empty if the PMT has none
+};
+
+enum eGstSubtitleType { stDvb, stTeletext };
+
+struct tGstSubtitleStream {
+  int pid;
+  int type;         // eGstSubtitleType
+  int page;         // teletext page (100-899), 0 for DVB subtitles
+  bool hearingImpaired;
+  char language[4];
+};
+
+// Reassembles the PES packets of the video, the selected audio streams
+// (by default the first one) and the selected subtitle stream (none by
+// default) from single TS packets, using the PIDs announced in PAT/PMT.
+// Only one completed PES packet is held at a time, so the caller can stop
+// consuming TS data while the output is full.
+
+class cGstTsDemux {
+private:
+  uchar section[1024];
+  int sectionLength;
+  int sectionPid;
+
+  int pmtPid;
+  int pmtVersion;
+  int videoPid;
+  int videoCodec;
+  tGstAudioStream audio[GSTDEMUX_MAXAUDIO];
+  int numAudio;
+  int audioVersion;
+  uint32_t audioMask;
+  tGstSubtitleStream subtitles[GSTDEMUX_MAXSUBS];
+  int numSubtitles;
+  int subtitleVersion;
+  int subtitlePid;
+
+  cGstPesBuffer videoPes;
+  cGstPesBuffer audioPes[GSTDEMUX_MAXAUDIO];
+  cGstPesBuffer subtitlePes;
+  cGstPesBuffer ready;
+  bool readyVideo;
+  int readyTrack;
+
+  uint64_t pesCount[2];
+
+  void PutSection(const uchar *Data);
+  void ParsePat(const uchar *Data, int Length);
+  void ParsePmt(const uchar *Data, int Length);
+  void AddSubtitle(int Pid, int Type, int Page, bool HearingImpaired, const uchar *Language);
+  void PutPes(cGstPesBuffer &Pes, const uchar *Data, bool Video, int Track = 0);
+  static int StreamCodec(int StreamType);
+
+public:
+  cGstTsDemux(void);
+
+  // Drops partial PES data, PIDs are kept until the next PMT
+  void Clear(void);
+
+  // Fixed video PID for input without PAT/PMT (a cReceiver only gets the
+  // PIDs it asked for), StreamType as in the PMT
+  void SetVideoPid(int Pid, int StreamType);
+
+  // Processes one TS packet, returns false (without consuming it) while a
+  // completed PES packet is waiting to be fetched
+  bool PutTs(const uchar *Data, bool VideoOnly = false);
+
+  // Completed PES packet, if any
+  const uchar *GetPes(int &Length, bool &Video);
+  void DelPes(void);
+
+  // Audio stream of the completed packet, an index into Audio(), or
+  // GSTDEMUX_SUBTITLE
+  int ReadyTrack(void) const { return readyTrack; }
+
+  // Bit n selects the audio stream Audio(n), only the first one by default
+  void SetAudioMask(uint32_t Mask);
+  
+  // Subtitle stream Subtitle(Index) is demuxed, none if Index is -1. A
+  // subtitle packet is complete as soon as it has the length given in its
+  // header, it doesn't wait for the next one.
+  void SetSubtitle(int Index);
+
+  // False after Clear() until the next PMT has been parsed
+  bool HasPmt(void) const { return pmtVersion >= 0; }
+  int VideoPid(void) const { return videoPid; }
+  int VideoCodec(void) const { return videoCodec; }
+  int NumAudio(void) const { return numAudio; }
+  const tGstAudioStream *Audio(int Index) const { return (Index >= 0 && Index < numAudio) ? &audio[Index] : NULL; }
+  // Changes whenever the PMT announces a different list of audio streams
+  int AudioVersion(void) const { return audioVersion; }
+  static const char *AudioName(int StreamType);
+  int NumSubtitles(void) const { return numSubtitles; }
+  const tGstSubtitleStream *Subtitle(int Index) const { return (Index >= 0 && Index < numSubtitles) ? &subtitles[Index] : NULL; }
+  // Changes whenever the PMT announces a different list of subtitle streams
+  int SubtitleVersion(void) const { return subtitleVersion; }
+  uint64_t PesCount(bool Video) const { return pesCount[Video]; }
+};
+
+#endif // __GSTDEMUX_H
@@ -0,0 +1,215 @@
+/*
+ * gstdump.c: Pipeline snapshots for live diagnosis
+ */
+
+#include "gstdump.h"
+
+// Fill levels, read from whichever of these an element has (queue, queue2,
+// multiqueue and appsrc use different integer types)
+static const char *LevelProperties[] = {
+  "current-level-buffers",
+  "current-level-bytes",
+  "current-level-time",
+  "max-size-buffers",
+  "max-size-bytes",
+  "max-size-time",
+  "max-bytes",
+  "max-time",
+  NULL
+};
+
+bool GstDumpDot(GstElement *Pipeline, const char *FileName)
+{
+  gchar *dot = gst_debug_bin_to_dot_data(GST_BIN(Pipeline), GST_DEBUG_GRAPH_SHOW_ALL);
+  if (!dot || !*dot) {
+    // GStreamer built without the debugging subsystem
+    g_free(dot);
+    return false;
+  }
+  bool ok = g_file_set_contents(FileName, dot, -1, NULL);
+  g_free(dot);
+  return ok;
+}
+
+void GstJsonString(GString *Json, const char *S)
+{
+  if (!S) {
+    g_string_append(Json, "null");
+    return;
+  }
+  g_string_append_c(Json, '"');
+  for (const char *p = S; *p; p++) {
+    switch (*p) {
+      case '"':  g_string_append(Json, "\\\""); break;
+      case '\\': g_string_append(Json, "\\\\"); break;
+      case '\n': g_string_append(Json, "\\n"); break;
+      case '\t': g_string_append(Json, "\\t"); break;
+      default:
+        if ((uchar)*p < 0x20)
+          g_string_append_printf(Json, "\\u%04x", (uchar)*p);
+        else
+          g_string_append_c(Json, *p);
+    }
+  }
+  g_string_append_c(Json, '"');
+}
+
+static void JsonPad(GString *Json, GstPad *Pad)
+{
+  g_string_append(Json, "{\"name\": ");
+  GstJsonString(Json, GST_PAD_NAME(Pad));
+  g_string_append_printf(Json, ", \"direction\": \"%s\"", GST_PAD_DIRECTION(Pad) == GST_PAD_SRC ? "src" : "sink");
+
+  GstPad *peer = gst_pad_get_peer(Pad);
+  g_string_append(Json, ", \"peer\": ");
+  if (peer) {
+    GstElement *parent = gst_pad_get_parent_element(peer);
+    gchar *name = g_strdup_printf("%s:%s", parent ? GST_ELEMENT_NAME(parent) : "", GST_PAD_NAME(peer));
+    GstJsonString(Json, name);
+    g_free(name);
+    if (parent)
+      gst_object_unref(parent);
+    gst_object_unref(peer);
+  }
+  else
+    g_string_append(Json, "null");
+
+  // Negotiated caps, not what the pad could accept
+  GstCaps *caps = gst_pad_get_current_caps(Pad);
+  g_string_append(Json, ", \"caps\": ");
+  if (caps) {
+    gchar *s = gst_caps_to_string(caps);
+    GstJsonString(Json, s);
+    g_free(s);
+    gst_caps_unref(caps);
+  }
+  else
+    g_string_append(Json, "null");
+  g_string_append_c(Json, '}');
+}
+
+static void JsonElement(GString *Json, GstElement *Element)
+{
+  GstElementFactory *factory = gst_element_get_factory(Element);
+  GstObject *parent = gst_object_get_parent(GST_OBJECT(Element));
+  GstState state = GST_STATE_VOID_PENDING;
+  GstState pending = GST_STATE_VOID_PENDING;
+  gst_element_get_state(Element, &state, &pending, 0);
+
+  g_string_append(Json, "{\"name\": ");
+  GstJsonString(Json, GST_ELEMENT_NAME(Element));
+  g_string_append(Json, ", \"factory\": ");
+  GstJsonString(Json, factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : NULL);
+  g_string_append(Json, ", \"parent\": ");
+  GstJsonString(Json, parent ? GST_OBJECT_NAME(parent) : NULL);
+  if (parent)
+    gst_object_unref(parent);
+  g_string_append_printf(Json, ", \"state\": \"%s\", \"pending\": \"%s\"",
+                         gst_element_state_get_name(state), gst_element_state_get_name(pending));
+
+  // Fill levels
+  bool first = true;
+  for (int i = 0; LevelProperties[i]; i++) {
+    GParamSpec *spec = g_object_class_find_property(G_OBJECT_GET_CLASS(Element), LevelProperties[i]);
+    if (!spec || !(spec->flags & G_PARAM_READABLE) || !g_value_type_transformable(spec->value_type, G_TYPE_UINT64))
+      continue;
+    GValue value = G_VALUE_INIT;
+    g_value_init(&value, G_TYPE_UINT64);
+    g_object_get_property(G_OBJECT(Element), LevelProperties[i], &value);
+    g_string_append_printf(Json, "%s\"%s\": %llu", first ? ", \"levels\": {" : ", ", LevelProperties[i],
+                           (unsigned long long)g_value_get_uint64(&value));
+    g_value_unset(&value);
+    first = false;
+  }
+  if (!first)
+    g_string_append_c(Json, '}');
+
+  g_string_append(Json, ", \"pads\": [");
+  first = true;
+  GstIterator *it = gst_element_iterate_pads(Element);
+  GValue item = G_VALUE_INIT;
+  bool done = false;
+  gsize start = Json->len;
+  while (!done) {
+    switch (gst_iterator_next(it, &item)) {
+      case GST_ITERATOR_OK:
+        if (!first)
+          g_string_append(Json, ", ");
+        JsonPad(Json, GST_PAD(g_value_get_object(&item)));
+        g_value_reset(&item);
+        first = false;
+        break;
+      case GST_ITERATOR_RESYNC:
+        // Pads changed while iterating, start over
+        gst_iterator_resync(it);
+        g_string_truncate(Json, start);
+        first = true;
+        break;
+      default:
+        done = true;
+        break;
+    }
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+  g_string_append(Json, "]}");
+}
+
+void GstDumpJson(GString *Json, GstElement *Pipeline)
+{
+  GstState state = GST_STATE_VOID_PENDING;
+  gst_element_get_state(Pipeline, &state, NULL, 0);
+  g_string_append(Json, "{\"name\": ");
+  GstJsonString(Json, GST_ELEMENT_NAME(Pipeline));
+  g_string_append_printf(Json, ", \"state\": \"%s\"", gst_element_state_get_name(state));
+
+  // Same query the sinks answer when the pipeline configures its latency
+  GstQuery *query = gst_query_new_latency();
+  if (gst_element_query(Pipeline, query)) {
+    gboolean live;
+    GstClockTime minLatency, maxLatency;
+    gst_query_parse_latency(query, &live, &minLatency, &maxLatency);
+    g_string_append_printf(Json, ", \"latency\": {\"live\": %s, \"min_ns\": %lld, \"max_ns\": %lld}",
+                           live ? "true" : "false",
+                           GST_CLOCK_TIME_IS_VALID(minLatency) ? (long long)minLatency : -1LL,
+                           GST_CLOCK_TIME_IS_VALID(maxLatency) ? (long long)maxLatency : -1LL);
+  }
+  else
+    g_string_append(Json, ", \"latency\": null");
+  gst_query_unref(query);
+  g_string_append_printf(Json, ", \"configured_latency_ns\": %lld", (long long)gst_pipeline_get_latency(GST_PIPELINE(Pipeline)));
+
+  gint64 position;
+  if (gst_element_query_position(Pipeline, GST_FORMAT_TIME, &position))
+    g_string_append_printf(Json, ", \"position_ns\": %lld", (long long)position);
+
+  g_string_append(Json, ", \"elements\": [");
+  bool first = true;
+  GstIterator *it = gst_bin_iterate_recurse(GST_BIN(Pipeline));
+  GValue item = G_VALUE_INIT;
+  bool done = false;
+  gsize start = Json->len;
+  while (!done) {
+    switch (gst_iterator_next(it, &item)) {
+      case GST_ITERATOR_OK:
+        if (!first)
+          g_string_append(Json, ", ");
+        JsonElement(Json, GST_ELEMENT(g_value_get_object(&item)));
+        g_value_reset(&item);
+        first = false;
+        break;
+      case GST_ITERATOR_RESYNC:
+        // Elements were added or removed (decodebin), start over
+        gst_iterator_resync(it);
+        g_string_truncate(Json, start);
+        first = true;
+        break;
+      default:
+        done = true;
+        break;
+    }
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+  g_string_append(Json, "]}");
+}
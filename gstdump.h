@@ -0,0 +1,25 @@
+/*
+ * gstdump.h: Pipeline snapshots for live diagnosis
+ */
+
+#ifndef __GSTDUMP_H
+#define __GSTDUMP_H
+
+#include <vdr/tools.h>
+#include <gst/gst.h>
+
+// All of these run while the pipeline is playing, they only query it
+
+// Writes the Graphviz graph of Pipeline (as GST_DEBUG_BIN_TO_DOT_FILE would,
+// but without GST_DEBUG_DUMP_DOT_DIR)
+bool GstDumpDot(GstElement *Pipeline, const char *FileName);
+
+// Appends a JSON object with the state, latency query result and every
+// element of Pipeline (factory, state, pads with negotiated caps and peer,
+// queue and appsrc fill levels)
+void GstDumpJson(GString *Json, GstElement *Pipeline);
+
+// Appends S as a JSON string
+void GstJsonString(GString *Json, const char *S);
+
+#endif // __GSTDUMP_H
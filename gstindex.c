@@ -0,0 +1,339 @@
+/*
+ * gstindex.c: Keyframe index and parameter set cache of the video stream
+ */
+
+#include "gstindex.h"
+#include "gstconfig.h"
+#include "gstsync.h"
+#include <vdr/remux.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define INDEX_MAX_GOP_MS  10000  // longer distances are gaps in the stream
+
+int GstFindStartCode(const uchar *Data, int Length)
+{
+  int i = 0;
+
+  // Each lane compares bytes i, i + 1 and i + 2 of one candidate position
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; i + 18 <= Length; i += 16) {
+    __m128i b0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data + i)), zero);
+    __m128i b1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data + i + 1)), zero);
+    __m128i b2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data + i + 2)), one);
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t one = vdupq_n_u8(1);
+  for (; i + 18 <= Length; i += 16) {
+    uint8x16_t b0 = vceqq_u8(vld1q_u8(Data + i), zero);
+    uint8x16_t b1 = vceqq_u8(vld1q_u8(Data + i + 1), zero);
+    uint8x16_t b2 = vceqq_u8(vld1q_u8(Data + i + 2), one);
+    uint8x16_t m = vandq_u8(vandq_u8(b0, b1), b2);
+    // Four bits per lane, there is no movemask
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (mask)
+      return i + (__builtin_ctzll(mask) >> 2);
+  }
+#endif
+
+  for (; i + 2 < Length; i++) {
+    if (Data[i + 2] > 1)
+      i += 2; // none of the three positions ending here can match
+    else if (Data[i] == 0 && Data[i + 1] == 0 && Data[i + 2] == 1)
+      return i;
+  }
+  return -1;
+}
+
+// Exp-Golomb code at bit position Bit, -1 if it runs past the end
+static int ReadUe(const uchar *Data, int Length, int &Bit)
+{
+  int zeros = 0;
+  while (Bit < Length * 8 && !((Data[Bit >> 3] >> (7 - (Bit & 7))) & 1)) {
+    if (++zeros > 16)
+      return -1;
+    Bit++;
+  }
+  Bit++;
+  int value = 0;
+  for (int i = 0; i < zeros; i++, Bit++) {
+    if (Bit >= Length * 8)
+      return -1;
+    value = (value << 1) | ((Data[Bit >> 3] >> (7 - (Bit & 7))) & 1);
+  }
+  return (1 << zeros) - 1 + value;
+}
+
+// The first start code of a payload is an AUD, a parameter set or an MPEG-2
+// sequence, GOP or picture header
+static int DetectCodec(const uchar *Code, int Length)
+{
+  if (Code[0] == 0x00 || Code[0] == 0xB3 || Code[0] == 0xB8)
+    return gcMpeg2;
+  if (Code[0] == 0x09 || (Code[0] & 0x9F) == 7)
+    return gcH264;
+  if ((Code[0] == 0x46 || Code[0] == 0x40) && Length >= 2 && Code[1] >= 1 && Code[1] <= 7)
+    return gcH265;
+  return -1;
+}
+
+// --- cGstKeyIndex ----------------------------------------------------------
+
+cGstKeyIndex::cGstKeyIndex(void)
+{
+  total = 0;
+  skipped = 0;
+  scanLength = 0;
+  paramsLength = 0;
+  paramsChanged = false;
+  Clear();
+}
+
+void cGstKeyIndex::Clear(void)
+{
+  head = 0;
+  tail = 0;
+  bytesIn = 0;
+  bytesOut = 0;
+  codec = -1;
+  lastPts = GSTSYNC_NOPTS;
+  gopMs = 0;
+  paramsLength = 0;
+  paramsChanged = false;
+}
+
+void cGstKeyIndex::AddParams(const uchar *Data, int Length)
+{
+  // Parameter sets that don't fit are not kept at all
+  if (scanLength < 0 || scanLength + Length > GSTINDEX_MAXPARAMS)
+    scanLength = -1;
+  else {
+    memcpy(scanParams + scanLength, Data, Length);
+    scanLength += Length;
+  }
+}
+
+bool cGstKeyIndex::Scan(const uchar *Data, int Length, bool &Closed, bool &Params)
+{
+  // Bits of the parameter sets seen in front of the picture, the one being
+  // collected ends at the next start code
+  int params = 0;
+  int paramStart = -1;
+  scanLength = 0;
+  int i = 0;
+  for (;;) {
+    int start = GstFindStartCode(Data + i, Length - i);
+    int code = start < 0 ? Length : i + start;
+    if (paramStart >= 0) {
+      AddParams(Data + paramStart, code - paramStart);
+      paramStart = -1;
+    }
+    if (start < 0)
+      return false;
+    i = code + 3;
+    if (i >= Length)
+      return false;
+    const uchar *p = Data + i;
+    int n = Length - i;
+
+    if (codec < 0) {
+      codec = DetectCodec(p, n);
+      if (codec < 0)
+        return false;
+      dsyslog("gstout: Video index detected %s", cGstoutConfig::CodecName(codec));
+    }
+
+    if (codec == gcMpeg2) {
+      if (p[0] == 0xB3 || (p[0] == 0xB5 && params)) {
+        params = 1; // sequence header and its extensions
+        paramStart = code;
+      }
+      else if (p[0] == 0xB8 && n >= 5)
+        Closed = p[4] & 0x40; // closed_gop
+      else if (p[0] == 0x00) {
+        Params = params != 0;
+        return n >= 3 && ((p[2] >> 3) & 0x07) == 1; // I-picture
+      }
+      else if (p[0] <= 0xAF)
+        return false; // a slice without a picture header
+    }
+    else if (codec == gcH264) {
+      int type = p[0] & 0x1F;
+      if (type == 7 || type == 8) {
+        params |= 1 << (type - 7);
+        paramStart = code;
+      }
+      else if (type == 5) {
+        Closed = true;
+        Params = params == 3;
+        return true;
+      }
+      else if (type == 1) {
+        // first_mb_in_slice and slice_type, I or SI slices are recovery
+        // points in streams without IDR pictures
+        int bit = 8;
+        int sliceType = ReadUe(p, min(n, 8), bit) >= 0 ? ReadUe(p, min(n, 8), bit) : -1;
+        Params = params == 3;
+        return sliceType % 5 == 2 || sliceType % 5 == 4;
+      }
+      else if (type >= 2 && type <= 4)
+        return false;
+    }
+    else if (codec == gcH265) {
+      int type = (p[0] >> 1) & 0x3F;
+      if (type >= 32 && type <= 34) {
+        params |= 1 << (type - 32);
+        paramStart = code;
+      }
+      else if (type >= 16 && type <= 23) {
+        Closed = type == 19 || type == 20; // IDR, CRA and BLA may lead RASL pictures
+        Params = params == 7;
+        return true;
+      }
+      else if (type < 16)
+        return false;
+    }
+    else
+      return false;
+  }
+}
+
+void cGstKeyIndex::Put(const uchar *Data, int Length)
+{
+  if (Data && Length > 9 && Data[0] == 0x00 && Data[1] == 0x00 && Data[2] == 0x01) {
+    int offset = PesPayloadOffset(Data);
+    bool closed = false;
+    bool inBand = false;
+    if (offset < Length && Scan(Data + offset, Length - offset, closed, inBand)) {
+      int64_t pts = Length >= 14 && PesHasPts(Data) ? PesGetPts(Data) : GSTSYNC_NOPTS;
+      if (pts != GSTSYNC_NOPTS && lastPts != GSTSYNC_NOPTS) {
+        int ms = GstPtsDiffMs(lastPts, pts);
+        if (ms > 0 && ms < INDEX_MAX_GOP_MS)
+          gopMs = ms;
+      }
+      lastPts = pts;
+
+      int next = (head + 1) % GSTINDEX_MAXKEYS;
+      if (next == tail) // full, drop the oldest key
+        tail = (tail + 1) % GSTINDEX_MAXKEYS;
+      keys[head].offset = bytesIn;
+      keys[head].pts = pts;
+      keys[head].closed = closed;
+      keys[head].params = inBand;
+      head = next;
+      total++;
+
+      if (inBand && scanLength > 0 && (scanLength != paramsLength || memcmp(scanParams, params, scanLength))) {
+        memcpy(params, scanParams, scanLength);
+        paramsLength = scanLength;
+        paramsChanged = true;
+      }
+    }
+  }
+  bytesIn += Length;
+}
+
+void cGstKeyIndex::Del(int Count)
+{
+  bytesOut += Count;
+  while (tail != head && keys[tail].offset < bytesOut)
+    tail = (tail + 1) % GSTINDEX_MAXKEYS;
+}
+
+int cGstKeyIndex::ToKey(bool ParamsKnown) const
+{
+  for (int i = tail; i != head; i = (i + 1) % GSTINDEX_MAXKEYS) {
+    if (ParamsKnown || keys[i].params)
+      return int(keys[i].offset - bytesOut);
+  }
+  return -1;
+}
+
+const uchar *cGstKeyIndex::TakeParams(int &Length)
+{
+  if (!paramsChanged)
+    return NULL;
+  paramsChanged = false;
+  Length = paramsLength;
+  return params;
+}
+
+cString cGstKeyIndex::Status(void) const
+{
+  return cString::sprintf("Index: %s, %d keys buffered, GOP %d ms, %d found, %llu KB skipped",
+                          codec >= 0 ? cGstoutConfig::CodecName(codec) : "unknown",
+                          (head - tail + GSTINDEX_MAXKEYS) % GSTINDEX_MAXKEYS,
+                          gopMs,
+                          total,
+                          (unsigned long long)skipped / 1024);
+}
+
+// --- cGstParamCache --------------------------------------------------------
+
+cGstParamCache::cGstParamCache(void)
+{
+  for (int i = 0; i < GSTINDEX_CHANNELS; i++) {
+    *entries[i].channel = 0;
+    entries[i].length = 0;
+    entries[i].used = 0;
+  }
+  useCount = 0;
+  injected = 0;
+}
+
+void cGstParamCache::Put(const char *Channel, int Codec, const uchar *Data, int Length)
+{
+  if (!Channel || !*Channel || Length > GSTINDEX_MAXPARAMS)
+    return;
+
+  tEntry *entry = &entries[0];
+  for (int i = 0; i < GSTINDEX_CHANNELS; i++) {
+    if (!strcmp(entries[i].channel, Channel)) {
+      entry = &entries[i];
+      break;
+    }
+    if (entries[i].used < entry->used)
+      entry = &entries[i];
+  }
+  strn0cpy(entry->channel, Channel, sizeof(entry->channel));
+  entry->codec = Codec;
+  entry->length = Length;
+  memcpy(entry->data, Data, Length);
+  entry->used = ++useCount;
+}
+
+const uchar *cGstParamCache::Get(const char *Channel, int Codec, int &Length)
+{
+  if (!Channel || !*Channel)
+    return NULL;
+
+  for (int i = 0; i < GSTINDEX_CHANNELS; i++) {
+    tEntry &entry = entries[i];
+    if (entry.length && entry.codec == Codec && !strcmp(entry.channel, Channel)) {
+      entry.used = ++useCount;
+      Length = entry.length;
+      return entry.data;
+    }
+  }
+  return NULL;
+}
+
+cString cGstParamCache::Status(void) const
+{
+  int channels = 0;
+  for (int i = 0; i < GSTINDEX_CHANNELS; i++) {
+    if (entries[i].length)
+      channels++;
+  }
+  return cString::sprintf("Parameter sets: %d channels, %d injected", channels, injected);
+}
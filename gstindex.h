@@ -0,0 +1,129 @@
+/*
+ * gstindex.h: Keyframe index and parameter set cache of the video stream
+ */
+
+#ifndef __GSTINDEX_H
+#define __GSTINDEX_H
+
+#include <vdr/tools.h>
+
+#define GSTINDEX_MAXKEYS    128   // random access points kept per ring buffer
+#define GSTINDEX_MAXPARAMS  1024  // bytes of parameter sets per stream
+#define GSTINDEX_CHANNELS   64    // channels with cached parameter sets
+
+struct tGstKeyFrame {
+  int64_t offset;  // ring buffer offset of the PES packet
+  int64_t pts;     // GSTSYNC_NOPTS if the packet carries none
+  bool closed;     // IDR (closed GOP), otherwise an I-picture with recovery
+  bool params;     // preceded by its parameter sets in the same packet
+};
+
+// Offset of the first 00 00 01 start code prefix in Data, -1 if there is
+// none. Scans 16 bytes at a time with SSE2 or NEON where available.
+int GstFindStartCode(const uchar *Data, int Length);
+
+// --- cGstKeyIndex ----------------------------------------------------------
+
+// Records the intra pictures of the PES packets entering a ring buffer
+// (MPEG-2 I-pictures, H.264 IDR pictures and I-slices, H.265 IRAP pictures)
+// and whether their parameter sets (sequence header and extensions,
+// SPS/PPS, VPS/SPS/PPS) come with them; only those are random access points
+// without a parameter set cache. The parameter sets themselves are kept as
+// Annex B NAL units or MPEG-2 headers. Only the start of each packet's
+// payload is scanned, up to its first picture. The codec is detected from
+// the first start code of a payload (DVB streams open each access unit with
+// an AUD, MPEG-2 with a sequence or picture header).
+// Not thread-safe, the owning output serializes access with its own mutex.
+
+class cGstKeyIndex {
+private:
+  tGstKeyFrame keys[GSTINDEX_MAXKEYS];
+  int head;
+  int tail;
+  int64_t bytesIn;
+  int64_t bytesOut;
+  int codec;
+  int64_t lastPts;
+  int gopMs;
+  int total;
+  uint64_t skipped;
+
+  // Parameter sets of the packet being scanned and of the last key
+  uchar scanParams[GSTINDEX_MAXPARAMS];
+  int scanLength;
+  uchar params[GSTINDEX_MAXPARAMS];
+  int paramsLength;
+  bool paramsChanged;
+
+  void AddParams(const uchar *Data, int Length);
+  bool Scan(const uchar *Data, int Length, bool &Closed, bool &Params);
+
+public:
+  cGstKeyIndex(void);
+
+  // Forgets the buffered keys and the codec, the statistics are kept
+  void Clear(void);
+
+  // Called with each PES packet written to the ring buffer
+  void Put(const uchar *Data, int Length);
+
+  // Called with the number of bytes removed from the ring buffer
+  void Del(int Count);
+
+  // Called instead of Del() for bytes that were dropped undecoded
+  void Skip(int Count) { Del(Count); skipped += Count; }
+
+  // Bytes from the read position to the first buffered random access point,
+  // -1 if there is none. With ParamsKnown any intra picture will do.
+  int ToKey(bool ParamsKnown) const;
+
+  // True if the first buffered key carries its parameter sets
+  bool KeyParams(void) const { return tail != head && keys[tail].params; }
+
+  // True if the first buffered key is an IDR picture or opens a closed GOP
+  bool KeyClosed(void) const { return tail != head && keys[tail].closed; }
+
+  // The parameter sets of the latest key, once after they have changed
+  const uchar *TakeParams(int &Length);
+
+  // eGstCodec, -1 until the stream has been recognized
+  int Codec(void) const { return codec; }
+
+  cString Status(void) const;
+};
+
+// --- cGstParamCache --------------------------------------------------------
+
+// The last parameter sets seen per channel, so they can be fed to the
+// decoder ahead of an intra picture that comes without them after a zap.
+// The least recently used channel makes room for a new one.
+// Not thread-safe, the owning output serializes access with its own mutex.
+
+class cGstParamCache {
+private:
+  struct tEntry {
+    char channel[64];
+    int codec;
+    int length;
+    uchar data[GSTINDEX_MAXPARAMS];
+    uint64_t used;
+  };
+  tEntry entries[GSTINDEX_CHANNELS];
+  uint64_t useCount;
+  int injected;
+
+public:
+  cGstParamCache(void);
+
+  void Put(const char *Channel, int Codec, const uchar *Data, int Length);
+
+  // The parameter sets of Channel, NULL if there are none for Codec
+  const uchar *Get(const char *Channel, int Codec, int &Length);
+
+  // Counts the parameter sets handed to the decoder
+  void Injected(void) { injected++; }
+
+  cString Status(void) const;
+};
+
+#endif // __GSTINDEX_H
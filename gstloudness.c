@@ -0,0 +1,354 @@
+/*
+ * gstloudness.c: Loudness normalization and dynamic range compression
+ */
+
+#include "gstloudness.h"
+#include <math.h>
+#include <string.h>
+#include <vdr/tools.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define LOUDNESS_NONE      -99.0f  // nothing measured
+#define LOUDNESS_GATE      -70.0f  // LUFS, absolute gate
+#define LOUDNESS_RELATIVE  0.1     // relative gate, -10 LU as energy
+#define LOUDNESS_MAX_BOOST 12.0f   // dB
+#define LOUDNESS_MAX_CUT   20.0f
+#define LOUDNESS_DOWN_STEP 1.0f    // dB per 100 ms, 10 dB/s
+#define LOUDNESS_UP_STEP   0.3f    // 3 dB/s
+#define DRC_RELEASE_STEP   0.5f    // 5 dB/s
+#define LIMIT_CEILING      0.944f  // -0.5 dBFS
+#define LIMIT_RELEASE      1.0116f // +0.1 dB per chunk
+#define SURROUND_WEIGHT    1.41f   // BS.1770 weight of the surround channels
+
+// Threshold above the target (LU) and ratio per eGstCompression
+static const float CompressionThreshold[dcCount] = { 0, 4, 0 };
+static const float CompressionRatio[dcCount] = { 1, 2, 4 };
+
+// --- Vector helpers --------------------------------------------------------
+
+#if defined(__SSE2__)
+
+typedef __m128 tVec;
+
+static inline tVec VecSet(float x) { return _mm_set1_ps(x); }
+static inline tVec VecLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void VecStore(float *p, tVec a) { _mm_storeu_ps(p, a); }
+static inline tVec VecAdd(tVec a, tVec b) { return _mm_add_ps(a, b); }
+static inline tVec VecSub(tVec a, tVec b) { return _mm_sub_ps(a, b); }
+static inline tVec VecMul(tVec a, tVec b) { return _mm_mul_ps(a, b); }
+static inline tVec VecMax(tVec a, tVec b) { return _mm_max_ps(a, b); }
+static inline tVec VecAbs(tVec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+#elif defined(__ARM_NEON)
+
+typedef float32x4_t tVec;
+
+static inline tVec VecSet(float x) { return vdupq_n_f32(x); }
+static inline tVec VecLoad(const float *p) { return vld1q_f32(p); }
+static inline void VecStore(float *p, tVec a) { vst1q_f32(p, a); }
+static inline tVec VecAdd(tVec a, tVec b) { return vaddq_f32(a, b); }
+static inline tVec VecSub(tVec a, tVec b) { return vsubq_f32(a, b); }
+static inline tVec VecMul(tVec a, tVec b) { return vmulq_f32(a, b); }
+static inline tVec VecMax(tVec a, tVec b) { return vmaxq_f32(a, b); }
+static inline tVec VecAbs(tVec a) { return vabsq_f32(a); }
+
+#else
+
+// Four lanes in plain C, which the compiler may vectorize itself
+struct tVec {
+  float v[4];
+};
+
+static inline tVec VecSet(float x) { tVec r; for (int i = 0; i < 4; i++) r.v[i] = x; return r; }
+static inline tVec VecLoad(const float *p) { tVec r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void VecStore(float *p, tVec a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline tVec VecAdd(tVec a, tVec b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline tVec VecSub(tVec a, tVec b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline tVec VecMul(tVec a, tVec b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline tVec VecMax(tVec a, tVec b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline tVec VecAbs(tVec a) { for (int i = 0; i < 4; i++) a.v[i] = fabsf(a.v[i]); return a; }
+
+#endif
+
+// The channels of a group that exist, the others are zero
+static inline tVec VecLoadPartial(const float *p, int n)
+{
+  float t[4] = { 0, 0, 0, 0 };
+  memcpy(t, p, n * sizeof(float));
+  return VecLoad(t);
+}
+
+static inline float Lufs(double Energy)
+{
+  return Energy > 0 ? -0.691f + 10 * log10f(float(Energy)) : LOUDNESS_NONE;
+}
+
+// --- cGstLoudness ----------------------------------------------------------
+
+cGstLoudness::cGstLoudness(void)
+{
+  normalize = 0;
+  target = -23;
+  compression = dcOff;
+  resetPending = 0;
+  rate = 0;
+  channels = 0;
+  groups = 0;
+  stepFrames = 0;
+  chunkFrames = 0;
+  memset(stage1, 0, sizeof(stage1));
+  memset(stage2, 0, sizeof(stage2));
+  memset(weight, 0, sizeof(weight));
+  normGain = 0;
+  drcGain = 0;
+  targetGain = 1;
+  gain = 1;
+  Clear();
+}
+
+void cGstLoudness::SetParams(bool Normalize, int Target, int Compression)
+{
+  // A measurement from before it was switched off is stale
+  if (!Active() && (Normalize || Compression != dcOff))
+    Reset();
+  __atomic_store_n(&target, Target, __ATOMIC_RELAXED);
+  __atomic_store_n(&compression, constrain(Compression, int(dcOff), int(dcCount) - 1), __ATOMIC_RELAXED);
+  __atomic_store_n(&normalize, int(Normalize), __ATOMIC_RELAXED);
+}
+
+bool cGstLoudness::Active(void) const
+{
+  return __atomic_load_n(&normalize, __ATOMIC_RELAXED) || __atomic_load_n(&compression, __ATOMIC_RELAXED) != dcOff;
+}
+
+void cGstLoudness::Reset(void)
+{
+  __atomic_store_n(&resetPending, 1, __ATOMIC_RELAXED);
+}
+
+void cGstLoudness::Clear(void)
+{
+  memset(state, 0, sizeof(state));
+  stepEnergy = 0;
+  stepPos = 0;
+  memset(steps, 0, sizeof(steps));
+  numSteps = 0;
+  numBlocks = 0;
+  blockHead = 0;
+  momentary = LOUDNESS_NONE;
+  integrated = LOUDNESS_NONE;
+  peak = LOUDNESS_NONE;
+  stepPeak = 0;
+}
+
+bool cGstLoudness::Setup(int Rate, int Channels)
+{
+  if (Rate < 8000 || Channels < 1 || Channels > GSTLOUDNESS_MAXCHANNELS) {
+    rate = 0;
+    return false;
+  }
+  rate = Rate;
+  channels = Channels;
+  groups = (Channels + 3) / 4;
+  stepFrames = Rate / 10;
+  chunkFrames = Rate / 100;
+
+  // BS.1770 K-weighting for any sample rate: a high shelf of +4 dB above
+  // 1.5 kHz and a second order high pass at 38 Hz
+  double k = tan(M_PI * 1681.974450955533 / Rate);
+  double q = 0.7071752369554196;
+  double vh = pow(10.0, 3.999843853973347 / 20);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / q + k * k;
+  stage1[0] = (vh + vb * k / q + k * k) / a0;
+  stage1[1] = 2 * (k * k - vh) / a0;
+  stage1[2] = (vh - vb * k / q + k * k) / a0;
+  stage1[3] = 2 * (k * k - 1) / a0;
+  stage1[4] = (1 - k / q + k * k) / a0;
+  k = tan(M_PI * 38.13547087602444 / Rate);
+  q = 0.5003270373238773;
+  a0 = 1 + k / q + k * k;
+  stage2[0] = 2 * (k * k - 1) / a0;
+  stage2[1] = (1 - k / q + k * k) / a0;
+
+  // GStreamer's default positions for 5.1 and 7.1: FL FR FC LFE RL RR (SL SR)
+  for (int i = 0; i < GSTLOUDNESS_MAXCHANNELS; i++)
+    weight[i] = i < Channels ? 1 : 0;
+  if (Channels == 6 || Channels == 8) {
+    weight[3] = 0;
+    for (int i = 4; i < Channels; i++)
+      weight[i] = SURROUND_WEIGHT;
+  }
+
+  Clear();
+  return true;
+}
+
+void cGstLoudness::Measure(const float *Data, int Frames, float &Peak)
+{
+  tVec b0 = VecSet(stage1[0]), b1 = VecSet(stage1[1]), b2 = VecSet(stage1[2]);
+  tVec a1 = VecSet(stage1[3]), a2 = VecSet(stage1[4]);
+  tVec c1 = VecSet(stage2[0]), c2 = VecSet(stage2[1]);
+  tVec minus2 = VecSet(-2.0f);
+  tVec z[4][GSTLOUDNESS_MAXCHANNELS / 4];
+  tVec acc[GSTLOUDNESS_MAXCHANNELS / 4];
+  tVec pk = VecSet(0);
+  for (int g = 0; g < groups; g++) {
+    for (int s = 0; s < 4; s++)
+      z[s][g] = VecLoad(&state[s][g * 4]);
+    acc[g] = VecSet(0);
+  }
+
+  // Transposed direct form II, one lane per channel
+  for (int f = 0; f < Frames; f++, Data += channels) {
+    for (int g = 0; g < groups; g++) {
+      int n = channels - g * 4;
+      tVec x = n >= 4 ? VecLoad(Data + g * 4) : VecLoadPartial(Data + g * 4, n);
+      pk = VecMax(pk, VecAbs(x));
+      tVec y = VecAdd(VecMul(b0, x), z[0][g]);
+      z[0][g] = VecSub(VecAdd(VecMul(b1, x), z[1][g]), VecMul(a1, y));
+      z[1][g] = VecSub(VecMul(b2, x), VecMul(a2, y));
+      tVec w = VecAdd(y, z[2][g]);
+      z[2][g] = VecSub(VecAdd(VecMul(minus2, y), z[3][g]), VecMul(c1, w));
+      z[3][g] = VecSub(y, VecMul(c2, w));
+      acc[g] = VecAdd(acc[g], VecMul(w, w));
+    }
+  }
+
+  float lanes[4];
+  for (int g = 0; g < groups; g++) {
+    // Denormals in the decaying filters would be slow in silence
+    for (int s = 0; s < 4; s++) {
+      VecStore(&state[s][g * 4], z[s][g]);
+      for (int i = g * 4; i < g * 4 + 4; i++) {
+        if (fabsf(state[s][i]) < 1e-15f)
+          state[s][i] = 0;
+      }
+    }
+    VecStore(lanes, acc[g]);
+    for (int i = 0; i < 4 && g * 4 + i < channels; i++)
+      stepEnergy += weight[g * 4 + i] * lanes[i];
+  }
+  VecStore(lanes, pk);
+  Peak = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+}
+
+void cGstLoudness::Apply(float *Data, int Frames, float From, float To)
+{
+  // Ramped per sample, the channels of a frame differ by less than 1e-5 dB
+  int count = Frames * channels;
+  float step = (To - From) / count;
+  float ramp[4] = { From, From + step, From + 2 * step, From + 3 * step };
+  tVec g = VecLoad(ramp);
+  tVec inc = VecSet(4 * step);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    VecStore(Data + i, VecMul(VecLoad(Data + i), g));
+    g = VecAdd(g, inc);
+  }
+  for (; i < count; i++)
+    Data[i] *= From + i * step;
+}
+
+void cGstLoudness::Process(float *Data, int Frames)
+{
+  if (__atomic_exchange_n(&resetPending, 0, __ATOMIC_RELAXED))
+    Clear();
+  if (!rate || !Active())
+    return;
+
+  while (Frames > 0) {
+    int n = min(min(Frames, stepFrames - stepPos), chunkFrames);
+    float chunkPeak;
+    Measure(Data, n, chunkPeak);
+    stepPeak = max(stepPeak, chunkPeak);
+
+    // A boost is taken back right away as far as the chunk's peak would
+    // exceed the ceiling after it, then released by at most LIMIT_RELEASE
+    // per chunk
+    float limit = chunkPeak > 0 ? max(LIMIT_CEILING / chunkPeak, 1.0f) : 1e6f;
+    float from = min(gain, limit);
+    float to = min(min(targetGain, from * LIMIT_RELEASE), limit);
+    if (from != 1.0f || to != 1.0f)
+      Apply(Data, n, from, to);
+    gain = to;
+
+    Data += n * channels;
+    Frames -= n;
+    stepPos += n;
+    if (stepPos >= stepFrames)
+      EndStep();
+  }
+}
+
+void cGstLoudness::EndStep(void)
+{
+  steps[numSteps % 4] = stepEnergy / stepFrames;
+  numSteps++;
+  peak = stepPeak > 0 ? 20 * log10f(stepPeak) : LOUDNESS_NONE;
+  stepPeak = 0;
+  stepEnergy = 0;
+  stepPos = 0;
+  if (numSteps < 4)
+    return;
+
+  // 400 ms block, overlapping the previous one by 75%
+  double block = (steps[0] + steps[1] + steps[2] + steps[3]) / 4;
+  momentary = Lufs(block);
+  blocks[blockHead] = block;
+  blockHead = (blockHead + 1) % GSTLOUDNESS_WINDOW;
+  if (numBlocks < GSTLOUDNESS_WINDOW)
+    numBlocks++;
+
+  // Absolute gate, then relative gate 10 LU below the loudness of what
+  // passed. Silence keeps the previous value.
+  double gate = pow(10.0, (LOUDNESS_GATE + 0.691) / 10);
+  double sum = 0;
+  int n = 0;
+  for (int i = 0; i < numBlocks; i++) {
+    if (blocks[i] > gate) {
+      sum += blocks[i];
+      n++;
+    }
+  }
+  if (n) {
+    double relative = max(gate, sum / n * LOUDNESS_RELATIVE);
+    sum = 0;
+    n = 0;
+    for (int i = 0; i < numBlocks; i++) {
+      if (blocks[i] > relative) {
+        sum += blocks[i];
+        n++;
+      }
+    }
+    if (n)
+      integrated = Lufs(sum / n);
+  }
+  UpdateGain();
+}
+
+void cGstLoudness::UpdateGain(void)
+{
+  bool norm = __atomic_load_n(&normalize, __ATOMIC_RELAXED);
+  int comp = __atomic_load_n(&compression, __ATOMIC_RELAXED);
+  float goal = Target();
+
+  float desired = 0;
+  if (norm)
+    desired = integrated > LOUDNESS_GATE ? constrain(goal - integrated, -LOUDNESS_MAX_CUT, LOUDNESS_MAX_BOOST) : normGain;
+  normGain += constrain(desired - normGain, -LOUDNESS_DOWN_STEP, LOUDNESS_UP_STEP);
+
+  float drc = 0;
+  if (comp != dcOff && momentary > LOUDNESS_GATE) {
+    float excess = momentary + normGain - (goal + CompressionThreshold[comp]);
+    if (excess > 0)
+      drc = -excess * (1 - 1 / CompressionRatio[comp]);
+  }
+  drcGain = drc < drcGain ? drc : min(drcGain + DRC_RELEASE_STEP, drc);
+
+  targetGain = powf(10, (normGain + drcGain) / 20);
+}
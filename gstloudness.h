@@ -0,0 +1,107 @@
+/*
+ * gstloudness.h: Loudness normalization and dynamic range compression
+ */
+
+#ifndef __GSTLOUDNESS_H
+#define __GSTLOUDNESS_H
+
+#include <stdint.h>
+#include "gstconfig.h"
+
+#define GSTLOUDNESS_MAXCHANNELS 8
+#define GSTLOUDNESS_WINDOW      100  // 400 ms blocks every 100 ms, 10 s
+
+// --- cGstLoudness ----------------------------------------------------------
+
+// Measures the loudness of interleaved float audio as in ITU-R BS.1770 /
+// EBU R128 (K-weighting, 400 ms blocks, absolute and relative gate) and
+// applies a gain that moves it towards the target:
+//
+// - Normalization follows the gated loudness of the last 10 seconds, down
+//   quickly (a loud commercial) and up slowly. Silence doesn't count.
+// - Compression lowers 400 ms blocks that are louder than the target by more
+//   than a threshold, with a light or heavy ratio.
+// - A peak limiter keeps the samples below -0.5 dBFS, a gain above 0 dB
+//   never clips.
+//
+// The gain is ramped over each 10 ms chunk. The filters run on up to four
+// channels per SIMD vector (SSE2 or NEON), peak scan and gain on all
+// samples. Process() runs in the streaming thread; SetParams() and Reset()
+// may be called from any thread, they only store atomics that Process()
+// picks up with the next buffer.
+
+class cGstLoudness {
+private:
+  // Settings
+  int normalize;
+  int target;          // LUFS
+  int compression;     // eGstCompression
+  int resetPending;
+
+  // Format, set by Setup()
+  int rate;
+  int channels;
+  int groups;          // channels in groups of four
+  int stepFrames;      // 100 ms
+  int chunkFrames;     // 10 ms
+  float stage1[5];     // K-weighting high shelf: b0, b1, b2, a1, a2
+  float stage2[2];     // K-weighting high pass (b = 1, -2, 1): a1, a2
+  float weight[GSTLOUDNESS_MAXCHANNELS];
+  float state[4][GSTLOUDNESS_MAXCHANNELS]; // z1, z2 of both stages
+
+  // Measurement
+  double stepEnergy;
+  int stepPos;
+  double steps[4];     // the last four steps make a block
+  int numSteps;
+  float blocks[GSTLOUDNESS_WINDOW];
+  int numBlocks;
+  int blockHead;
+
+  // Gain
+  float normGain;      // dB
+  float drcGain;       // dB
+  float targetGain;    // linear, normGain + drcGain
+  float gain;          // linear, at the end of the last chunk
+
+  // Statistics, read without locking
+  float momentary;     // LUFS of the last block
+  float integrated;    // gated LUFS of the window
+  float peak;          // dBFS of the last step
+  float stepPeak;
+
+  void Clear(void);
+  void Measure(const float *Data, int Frames, float &Peak);
+  void Apply(float *Data, int Frames, float From, float To);
+  void EndStep(void);
+  void UpdateGain(void);
+
+public:
+  cGstLoudness(void);
+
+  void SetParams(bool Normalize, int Target, int Compression);
+  bool Active(void) const;
+
+  // Starts over with the measurement, keeps the gain (channel switch)
+  void Reset(void);
+
+  // Called with the negotiated format, returns false if it can't be
+  // processed (then Process() does nothing)
+  bool Setup(int Rate, int Channels);
+
+  // Frames of interleaved samples, changed in place
+  void Process(float *Data, int Frames);
+
+  bool Normalize(void) const { return __atomic_load_n(&normalize, __ATOMIC_RELAXED); }
+  int Compression(void) const { return __atomic_load_n(&compression, __ATOMIC_RELAXED); }
+  int Channels(void) const { return rate ? channels : 0; }
+  bool Measured(void) const { return integrated > -70; }
+  float Momentary(void) const { return momentary; }
+  float Integrated(void) const { return integrated; }
+  float Peak(void) const { return peak; }
+  float GainDb(void) const { return normGain + drcGain; }
+  float CompressionDb(void) const { return drcGain; }
+  int Target(void) const { return __atomic_load_n(&target, __ATOMIC_RELAXED); }
+};
+
+#endif // __GSTLOUDNESS_H
@@ -0,0 +1,317 @@
+/*
+ * gstmetrics.c: OpenMetrics export for GStreamer output
+ */
+
+#include "gstmetrics.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_CLIENT_MS  1000  // max. time for a whole exchange
+#define METRICS_BACKLOG    4
+
+// --- cGstMetricsWriter -----------------------------------------------------
+
+cGstMetricsWriter::cGstMetricsWriter(void)
+{
+  buffer = NULL;
+  length = 0;
+  size = 0;
+}
+
+cGstMetricsWriter::~cGstMetricsWriter()
+{
+  free(buffer);
+}
+
+void cGstMetricsWriter::Append(const char *Format, ...)
+{
+  for (;;) {
+    va_list ap;
+    va_start(ap, Format);
+    int n = buffer ? vsnprintf(buffer + length, size - length, Format, ap) : -1;
+    va_end(ap);
+    if (n >= 0 && length + n < size) {
+      length += n;
+      return;
+    }
+    int newSize = max(size * 2, 4096);
+    if (n >= 0)
+      newSize = max(newSize, length + n + 1);
+    char *p = (char *)realloc(buffer, newSize);
+    if (!p)
+      return;
+    buffer = p;
+    size = newSize;
+  }
+}
+
+void cGstMetricsWriter::Family(const char *Name, const char *Type, const char *Help)
+{
+  Append("# TYPE %s %s\n# HELP %s %s\n", Name, Type, Name, Help);
+}
+
+void cGstMetricsWriter::Sample(const char *Name, const char *Labels, double Value)
+{
+  if (Labels)
+    Append("%s{%s} %g\n", Name, Labels, Value);
+  else
+    Append("%s %g\n", Name, Value);
+}
+
+void cGstMetricsWriter::SampleInt(const char *Name, const char *Labels, uint64_t Value)
+{
+  if (Labels)
+    Append("%s{%s} %llu\n", Name, Labels, (unsigned long long)Value);
+  else
+    Append("%s %llu\n", Name, (unsigned long long)Value);
+}
+
+cString cGstMetricsWriter::Finish(void)
+{
+  Append("# EOF\n");
+  char *s = buffer;
+  buffer = NULL;
+  length = size = 0;
+  return cString(s ? s : strdup(""), true);
+}
+
+// --- cGstMetricsServer -----------------------------------------------------
+
+cGstMetricsServer::cGstMetricsServer(void)
+{
+  fd = -1;
+  for (int i = 0; i < METRICS_CLIENTS; i++)
+    clients[i].fd = -1;
+}
+
+cGstMetricsServer::~cGstMetricsServer()
+{
+  Close();
+}
+
+bool cGstMetricsServer::Open(const char *Address)
+{
+  Close();
+  if (!Address || !*Address)
+    return false;
+
+  if (*Address == '/') {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(Address) >= sizeof(addr.sun_path)) {
+      esyslog("gstout: Metrics socket path too long: %s", Address);
+      return false;
+    }
+    strn0cpy(addr.sun_path, Address, sizeof(addr.sun_path));
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+      unlink(Address); // left over from a crash
+      if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        path = Address;
+      else {
+        close(fd);
+        fd = -1;
+      }
+    }
+  }
+  else {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const char *port = strrchr(Address, ':');
+    if (port) {
+      cString host(strndup(Address, port - Address), true);
+      if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        esyslog("gstout: Invalid metrics address: %s", Address);
+        return false;
+      }
+      port++;
+    }
+    else
+      port = Address;
+    addr.sin_port = htons(atoi(port));
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+      int on = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+  }
+
+  if (fd < 0 || listen(fd, METRICS_BACKLOG) < 0) {
+    esyslog("gstout: Failed to open metrics endpoint %s: %s", Address, strerror(errno));
+    Close();
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  isyslog("gstout: Metrics endpoint %s", Address);
+  return true;
+}
+
+void cGstMetricsServer::Close(void)
+{
+  for (int i = 0; i < METRICS_CLIENTS; i++)
+    Drop(clients[i]);
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  if (*path) {
+    unlink(path);
+    path = NULL;
+  }
+}
+
+void cGstMetricsServer::Drop(tClient &Client)
+{
+  if (Client.fd >= 0) {
+    close(Client.fd);
+    Client.fd = -1;
+  }
+  Client.response = NULL;
+}
+
+void cGstMetricsServer::AcceptClients(void)
+{
+  for (;;) {
+    int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client < 0)
+      return;
+    tClient *c = NULL;
+    for (int i = 0; i < METRICS_CLIENTS && !c; i++) {
+      if (clients[i].fd < 0)
+        c = &clients[i];
+    }
+    if (!c) {
+      // Too many scrapers at once, this one may retry
+      close(client);
+      continue;
+    }
+    c->fd = client;
+    c->start = cTimeMs::Now();
+    c->received = 0;
+    c->waiting = false;
+    c->response = NULL;
+    c->length = c->sent = 0;
+  }
+}
+
+void cGstMetricsServer::Receive(tClient &Client)
+{
+  int r = read(Client.fd, Client.request + Client.received, sizeof(Client.request) - 1 - Client.received);
+  if (r < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      Drop(Client);
+    return;
+  }
+  if (r == 0 && !Client.received) {
+    Drop(Client);
+    return;
+  }
+  Client.received += r;
+  Client.request[Client.received] = 0;
+  // The request itself is not looked at, every path serves the metrics
+  if (r == 0 || Client.received >= (int)sizeof(Client.request) - 1 ||
+      strstr(Client.request, "\r\n\r\n") || strstr(Client.request, "\n\n"))
+    Client.waiting = true;
+}
+
+void cGstMetricsServer::Send(tClient &Client)
+{
+  while (Client.sent < Client.length) {
+    int w = send(Client.fd, *Client.response + Client.sent, Client.length - Client.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        Drop(Client);
+      return;
+    }
+    Client.sent += w;
+  }
+  // Complete, HTTP/1.0 closes the connection
+  Drop(Client);
+}
+
+bool cGstMetricsServer::Poll(int TimeoutMs)
+{
+  if (fd < 0)
+    return false;
+  struct pollfd pfd[METRICS_CLIENTS + 1];
+  tClient *polled[METRICS_CLIENTS + 1];
+  int n = 0;
+  pfd[n].fd = fd;
+  pfd[n].events = POLLIN;
+  polled[n++] = NULL;
+  for (int i = 0; i < METRICS_CLIENTS; i++) {
+    tClient &c = clients[i];
+    if (c.fd < 0)
+      continue;
+    if (c.waiting)
+      TimeoutMs = 0; // the owner still has to respond
+    else {
+      pfd[n].fd = c.fd;
+      pfd[n].events = *c.response ? POLLOUT : POLLIN;
+      polled[n++] = &c;
+    }
+  }
+
+  if (poll(pfd, n, TimeoutMs) > 0) {
+    for (int i = 1; i < n; i++) {
+      if (!pfd[i].revents)
+        continue;
+      if (*polled[i]->response)
+        Send(*polled[i]);
+      else
+        Receive(*polled[i]);
+    }
+    if (pfd[0].revents & POLLIN)
+      AcceptClients();
+  }
+
+  // Stalled scrapers must not hold a slot
+  uint64_t now = cTimeMs::Now();
+  bool waiting = false;
+  for (int i = 0; i < METRICS_CLIENTS; i++) {
+    tClient &c = clients[i];
+    if (c.fd < 0)
+      continue;
+    if (now - c.start > METRICS_CLIENT_MS) {
+      dsyslog("gstout: Dropped metrics client after %d ms", int(now - c.start));
+      Drop(c);
+    }
+    else if (c.waiting)
+      waiting = true;
+  }
+  return waiting;
+}
+
+void cGstMetricsServer::Respond(const char *Body)
+{
+  cString response = cString::sprintf("HTTP/1.0 200 OK\r\n"
+                                      "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                                      "Content-Length: %d\r\n"
+                                      "Connection: close\r\n\r\n%s", int(strlen(Body)), Body);
+  for (int i = 0; i < METRICS_CLIENTS; i++) {
+    tClient &c = clients[i];
+    if (c.fd < 0 || !c.waiting)
+      continue;
+    c.waiting = false;
+    c.response = response;
+    c.length = strlen(response);
+    c.sent = 0;
+    Send(c);
+  }
+}
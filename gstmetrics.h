@@ -0,0 +1,100 @@
+/*
+ * gstmetrics.h: OpenMetrics export for GStreamer output
+ */
+
+#ifndef __GSTMETRICS_H
+#define __GSTMETRICS_H
+
+#include <vdr/tools.h>
+
+// Snapshot of one output, collected without taking the output's mutex
+struct tGstStreamMetrics {
+  uint64_t bytesIn;       // accepted by Play()
+  uint64_t bytesOut;      // pushed into appsrc
+  int ringFill;           // bytes
+  int ringSize;
+  uint64_t appsrcLevel;   // bytes queued in appsrc
+  const char *decoder;    // decoder factory name, NULL until plugged
+  int poolHits;
+  int poolMisses;
+  int poolBytes;          // input pool limit
+  // Video only
+  uint64_t framesLate;
+  int framesDropped;
+  double qosProportion;
+  int overloadLevel;
+};
+
+// --- cGstMetricsWriter -----------------------------------------------------
+
+// Builds an OpenMetrics text exposition, families have to be written one
+// after the other with all of their samples
+
+class cGstMetricsWriter {
+private:
+  char *buffer;
+  int length;
+  int size;
+
+  void Append(const char *Format, ...) __attribute__ ((format (printf, 2, 3)));
+
+public:
+  cGstMetricsWriter(void);
+  ~cGstMetricsWriter();
+
+  void Family(const char *Name, const char *Type, const char *Help);
+  void Sample(const char *Name, const char *Labels, double Value);
+  void SampleInt(const char *Name, const char *Labels, uint64_t Value);
+
+  // Adds "# EOF" and returns the exposition
+  cString Finish(void);
+};
+
+// --- cGstMetricsServer -----------------------------------------------------
+
+// Minimal HTTP/1.0 listener on a Unix socket ("/path") or a TCP port
+// ("port" binds to 127.0.0.1, "host:port"). It has no thread of its own,
+// the owner polls it. All sockets are non-blocking, a client that doesn't
+// send its request and take the whole response within METRICS_CLIENT_MS
+// is dropped.
+
+#define METRICS_CLIENTS 4
+
+class cGstMetricsServer {
+private:
+  struct tClient {
+    int fd;
+    uint64_t start;
+    char request[1024];
+    int received;
+    bool waiting;       // request read, waits for Respond()
+    cString response;
+    int length;
+    int sent;
+  };
+  int fd;
+  cString path;  // Unix socket to remove on Close()
+  tClient clients[METRICS_CLIENTS];
+
+  void AcceptClients(void);
+  void Receive(tClient &Client);
+  void Send(tClient &Client);
+  void Drop(tClient &Client);
+
+public:
+  cGstMetricsServer(void);
+  ~cGstMetricsServer();
+
+  bool Open(const char *Address);
+  void Close(void);
+  bool Active(void) { return fd >= 0; }
+
+  // Waits up to TimeoutMs for the listener and the clients and does what
+  // they are ready for. Returns true if a client waits for Respond().
+  bool Poll(int TimeoutMs);
+  // Sends Body to every waiting client, what the socket doesn't take right
+  // away is sent by the next Poll() calls
+  void Respond(const char *Body);
+};
+
+#endif // __GSTMETRICS_H
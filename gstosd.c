@@ -13,6 +13,7 @@ cGstOsd::cGstOsd(int Left, int Top, uint Level, cGstOsdProvider *Provider)
 {
   provider = Provider;
   bitmap = NULL;
+  pixels = NULL;
   dirty = false;
 }
 
@@ -20,6 +21,7 @@ cGstOsd::~cGstOsd()
 {
   cMutexLock lock(&mutex);
   delete bitmap;
+  free(pixels);
   
   if (provider)
     provider->ClearOsdBuffer();
@@ -49,13 +51,14 @@ eOsdError cGstOsd::SetAreas(const tArea *Areas, int NumAreas)
         maxHeight = bottom;
     }
     
-    // Create bitmap for OSD
+    // Create bitmap for OSD (palette based, converted to tColor on flush)
     delete bitmap;
-    bitmap = new cBitmap(maxWidth, maxHeight, 32); // 32-bit ARGB
-    if (!bitmap)
+    bitmap = new cBitmap(maxWidth, maxHeight, 8);
+    free(pixels);
+    pixels = (uint32_t *)calloc(maxWidth * maxHeight, sizeof(uint32_t));
+    if (!bitmap || !pixels)
       return oeOutOfMemory;
     
-    bitmap->Clean();
     dirty = true;
     
     dsyslog("gstout: OSD areas set: %dx%d", maxWidth, maxHeight);
@@ -115,7 +118,7 @@ void cGstOsd::DrawRectangle(int x1, int y1, int x2, int y2, tColor Color)
   cMutexLock lock(&mutex);
   
   if (bitmap) {
-    bitmap->DrawRectangle(x1, y1, x2 - x1 + 1, y2 - y1 + 1, Color);
+    bitmap->DrawRectangle(x1, y1, x2, y2, Color);
     dirty = true;
   }
 }
@@ -125,7 +128,7 @@ void cGstOsd::DrawEllipse(int x1, int y1, int x2, int y2, tColor Color, int Quad
   cMutexLock lock(&mutex);
   
   if (bitmap) {
-    bitmap->DrawEllipse(x1, y1, x2 - x1 + 1, y2 - y1 + 1, Color, Quadrants);
+    bitmap->DrawEllipse(x1, y1, x2, y2, Color, Quadrants);
     dirty = true;
   }
 }
@@ -135,7 +138,7 @@ void cGstOsd::DrawSlope(int x1, int y1, int x2, int y2, tColor Color, int Type)
   cMutexLock lock(&mutex);
   
   if (bitmap) {
-    bitmap->DrawSlope(x1, y1, x2 - x1 + 1, y2 - y1 + 1, Color, Type);
+    bitmap->DrawSlope(x1, y1, x2, y2, Color, Type);
     dirty = true;
   }
 }
@@ -152,44 +155,36 @@ void cGstOsd::Flush(void)
 
 void cGstOsd::RenderBitmap(void)
 {
-  if (!bitmap)
+  if (!bitmap || !pixels)
     return;
   
-  int width = bitmap->Width();
-  int height = bitmap->Height();
-  
-  // Allocate ARGB buffer
-  int stride = width * 4; // 4 bytes per pixel (ARGB)
-  uint8_t *data = (uint8_t *)malloc(stride * height);
-  if (!data) {
-    esyslog("gstout: Failed to allocate OSD buffer");
+  // Only the dirty area of the bitmap is converted and handed over
+  int x1, y1, x2, y2;
+  if (!bitmap->Dirty(x1, y1, x2, y2))
     return;
-  }
   
-  // Get direct access to bitmap data
-  const uint8_t *bitmapData = bitmap->Data(0, 0);
-  if (!bitmapData) {
-    // Fallback: clear to transparent
-    memset(data, 0, stride * height);
-  } else {
-    // Copy bitmap data to ARGB buffer
-    // Note: VDR bitmap is already in ARGB format
-    memcpy(data, bitmapData, stride * height);
+  int width = bitmap->Width();
+  int height = bitmap->Height();
+  for (int y = y1; y <= y2; y++) {
+    uint32_t *p = pixels + y * width;
+    for (int x = x1; x <= x2; x++)
+      p[x] = bitmap->GetColor(x, y);
   }
+  bitmap->Clean();
   
-  // Send to provider
-  provider->UpdateOsdBuffer(data, width, height, stride);
-  
-  free(data);
+  tGstBlendRect dirtyRect = { x1, y1, x2 - x1 + 1, y2 - y1 + 1 };
+  provider->UpdateOsdBuffer((uint8_t *)pixels, width, height, width * 4, &dirtyRect);
 }
 
 bool cGstOsd::GetOsdData(uint8_t **data, int *width, int *height, int *stride)
 {
   cMutexLock lock(&mutex);
   
-  if (!bitmap || !dirty)
+  if (!bitmap || !pixels || !dirty)
     return false;
   
+  RenderBitmap();
+  
   *width = bitmap->Width();
   *height = bitmap->Height();
   *stride = (*width) * 4;
@@ -199,14 +194,7 @@ bool cGstOsd::GetOsdData(uint8_t **data, int *width, int *height, int *stride)
   if (!*data)
     return false;
   
-  // Get direct access to bitmap data
-  const uint8_t *bitmapData = bitmap->Data(0, 0);
-  if (bitmapData) {
-    memcpy(*data, bitmapData, (*stride) * (*height));
-  } else {
-    // Clear to transparent if data unavailable
-    memset(*data, 0, (*stride) * (*height));
-  }
+  memcpy(*data, pixels, (*stride) * (*height));
   
   return true;
 }
@@ -222,6 +210,8 @@ cGstOsdProvider::cGstOsdProvider(void)
   osdHeight = 0;
   osdStride = 0;
   osdActive = false;
+  memset(&osdBounds, 0, sizeof(osdBounds));
+  formatWarned = false;
 }
 
 cGstOsdProvider::~cGstOsdProvider()
@@ -246,30 +236,38 @@ cOsd *cGstOsdProvider::CreateOsd(int Left, int Top, uint Level)
   return osd;
 }
 
-void cGstOsdProvider::UpdateOsdBuffer(uint8_t *data, int width, int height, int stride)
+void cGstOsdProvider::UpdateOsdBuffer(uint8_t *data, int width, int height, int stride, const tGstBlendRect *Dirty)
 {
   cMutexLock lock(&mutex);
   
-  // Free old buffer
-  free(osdBuffer);
-  
-  // Allocate new buffer
-  int size = stride * height;
-  osdBuffer = (uint8_t *)malloc(size);
-  if (!osdBuffer) {
-    esyslog("gstout: Failed to allocate OSD buffer");
-    return;
+  if (!osdBuffer || width != osdWidth || height != osdHeight || stride != osdStride) {
+    // New size, reallocate and take everything
+    free(osdBuffer);
+    osdBuffer = (uint8_t *)malloc(stride * height);
+    if (!osdBuffer) {
+      esyslog("gstout: Failed to allocate OSD buffer");
+      osdActive = false;
+      return;
+    }
+    memcpy(osdBuffer, data, stride * height);
+    osdWidth = width;
+    osdHeight = height;
+    osdStride = stride;
   }
+  else if (Dirty) {
+    for (int y = Dirty->y; y < Dirty->y + Dirty->height; y++) {
+      int offset = y * stride + Dirty->x * 4;
+      memcpy(osdBuffer + offset, data + offset, Dirty->width * 4);
+    }
+  }
+  else
+    memcpy(osdBuffer, data, stride * height);
   
-  // Copy data
-  memcpy(osdBuffer, data, size);
-  
-  osdWidth = width;
-  osdHeight = height;
-  osdStride = stride;
-  osdActive = true;
+  // Frames are only blended where the OSD is visible
+  osdActive = GstBlendBounds((const uint32_t *)osdBuffer, osdStride / 4, osdWidth, osdHeight, osdBounds);
   
-  dsyslog("gstout: OSD buffer updated: %dx%d", width, height);
+  dsyslog("gstout: OSD buffer updated: %dx%d, visible %dx%d+%d+%d", width, height,
+          osdBounds.width, osdBounds.height, osdBounds.x, osdBounds.y);
 }
 
 void cGstOsdProvider::ClearOsdBuffer(void)
@@ -286,47 +284,68 @@ void cGstOsdProvider::ClearOsdBuffer(void)
   dsyslog("gstout: OSD buffer cleared");
 }
 
-void cGstOsdProvider::ApplyOsdOverlay(GstBuffer *buffer)
+static int BlendFormat(GstVideoFormat Format)
+{
+  switch (Format) {
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_BGRx: return bfBGRA;
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_RGBx: return bfRGBA;
+    case GST_VIDEO_FORMAT_ARGB:
+    case GST_VIDEO_FORMAT_xRGB: return bfARGB;
+    case GST_VIDEO_FORMAT_ABGR:
+    case GST_VIDEO_FORMAT_xBGR: return bfABGR;
+    case GST_VIDEO_FORMAT_NV12: return bfNV12;
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12: return bfI420;
+    default:                    return -1;
+  }
+}
+
+void cGstOsdProvider::ApplyOsdOverlay(GstBuffer *buffer, const GstVideoInfo *info)
 {
   cMutexLock lock(&mutex);
   
-  if (!osdActive || !osdBuffer || !buffer)
+  if (!osdActive || !osdBuffer || !buffer || !info)
     return;
   
-  // Map video buffer
-  GstMapInfo map;
-  if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE)) {
-    esyslog("gstout: Failed to map video buffer for OSD overlay");
+  int format = BlendFormat(GST_VIDEO_INFO_FORMAT(info));
+  if (format < 0) {
+    if (!formatWarned)
+      esyslog("gstout: OSD blending not supported for %s", GST_VIDEO_INFO_NAME(info));
+    formatWarned = true;
     return;
   }
   
-  // For simplicity, assume video dimensions match OSD dimensions
-  // A proper implementation would get video info from caps on the pad
-  // and scale OSD accordingly
-  
-  int minSize = (map.size < (size_t)(osdStride * osdHeight)) ? map.size : (osdStride * osdHeight);
+  // Map video frame
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, (GstVideoInfo *)info, buffer, GST_MAP_READWRITE)) {
+    esyslog("gstout: Failed to map video buffer for OSD overlay");
+    return;
+  }
   
-  // Simple alpha blending (assumes ARGB format for both)
-  for (size_t i = 0; i < minSize; i += 4) {
-    uint8_t osdA = osdBuffer[i + 0];
-    
-    if (osdA > 0) {
-      // Simple alpha blending
-      uint8_t osdR = osdBuffer[i + 1];
-      uint8_t osdG = osdBuffer[i + 2];
-      uint8_t osdB = osdBuffer[i + 3];
-      
-      uint8_t videoR = map.data[i + 1];
-      uint8_t videoG = map.data[i + 2];
-      uint8_t videoB = map.data[i + 3];
-      
-      float alpha = osdA / 255.0f;
-      
-      map.data[i + 1] = (uint8_t)(osdR * alpha + videoR * (1.0f - alpha));
-      map.data[i + 2] = (uint8_t)(osdG * alpha + videoG * (1.0f - alpha));
-      map.data[i + 3] = (uint8_t)(osdB * alpha + videoB * (1.0f - alpha));
-    }
+  // The OSD is blended unscaled at the top left corner of the frame
+  tGstBlendFrame blend;
+  blend.format = format;
+  blend.width = min(GST_VIDEO_FRAME_WIDTH(&frame), osdWidth);
+  blend.height = min(GST_VIDEO_FRAME_HEIGHT(&frame), osdHeight);
+  blend.bt709 = GST_VIDEO_INFO_COLORIMETRY(info).matrix != GST_VIDEO_COLOR_MATRIX_BT601;
+  for (int i = 0; i < 3; i++) {
+    bool plane = i < (int)GST_VIDEO_FRAME_N_PLANES(&frame);
+    blend.data[i] = plane ? (uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&frame, i) : NULL;
+    blend.stride[i] = plane ? GST_VIDEO_FRAME_PLANE_STRIDE(&frame, i) : 0;
+  }
+  if (GST_VIDEO_INFO_FORMAT(info) == GST_VIDEO_FORMAT_YV12) {
+    // V before U
+    uint8_t *data = blend.data[1];
+    int stride = blend.stride[1];
+    blend.data[1] = blend.data[2];
+    blend.stride[1] = blend.stride[2];
+    blend.data[2] = data;
+    blend.stride[2] = stride;
   }
   
-  gst_buffer_unmap(buffer, &map);
+  GstBlendOsd(blend, (const uint32_t *)osdBuffer, osdStride / 4, osdBounds);
+  
+  gst_video_frame_unmap(&frame);
 }
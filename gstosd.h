@@ -10,6 +10,7 @@
 #include <vdr/thread.h>
 #include <gst/gst.h>
 #include <gst/video/video.h>
+#include "gstblend.h"
 
 // Forward declaration
 class cGstOsdProvider;
@@ -20,6 +21,7 @@ class cGstOsd : public cOsd {
 private:
   cGstOsdProvider *provider;
   cBitmap *bitmap;
+  uint32_t *pixels;   // bitmap converted to tColor
   bool dirty;
   cMutex mutex;
   
@@ -42,7 +44,7 @@ public:
   virtual void DrawSlope(int x1, int y1, int x2, int y2, tColor Color, int Type);
   virtual void Flush(void);
   
-  // Get rendered ARGB data for overlay
+  // Get rendered tColor (0xAARRGGBB) data for overlay
   bool GetOsdData(uint8_t **data, int *width, int *height, int *stride);
   bool IsDirty(void) const { return dirty; }
   void ClearDirty(void) { dirty = false; }
@@ -56,11 +58,13 @@ private:
   GstElement *overlayElement;
   cMutex mutex;
   
-  uint8_t *osdBuffer;
+  uint8_t *osdBuffer;   // tColor pixels
   int osdWidth;
   int osdHeight;
   int osdStride;
   bool osdActive;
+  tGstBlendRect osdBounds; // non-transparent part of the OSD
+  bool formatWarned;
   
   friend class cGstOsd;
   
@@ -71,14 +75,14 @@ public:
   virtual cOsd *CreateOsd(int Left, int Top, uint Level);
   virtual bool ProvidesCa(const cChannel *Channel) { return false; }
   
-  // Called by video pipeline to apply OSD overlay
-  void ApplyOsdOverlay(GstBuffer *buffer);
+  // Called by video pipeline to apply OSD overlay to a raw video frame
+  void ApplyOsdOverlay(GstBuffer *buffer, const GstVideoInfo *info);
   
   // Set overlay element from video pipeline
   void SetOverlayElement(GstElement *element) { overlayElement = element; }
   
-  // Update OSD buffer from cGstOsd
-  void UpdateOsdBuffer(uint8_t *data, int width, int height, int stride);
+  // Update OSD buffer from cGstOsd, only Dirty is copied if the size is unchanged
+  void UpdateOsdBuffer(uint8_t *data, int width, int height, int stride, const tGstBlendRect *Dirty = NULL);
   void ClearOsdBuffer(void);
 };
 
@@ -6,25 +6,130 @@
 
 #include "gstout.h"
 #include "gstsetup.h"
+#include <vdr/channels.h>
+#include <vdr/device.h>
 #include <vdr/plugin.h>
+#include <vdr/remux.h>
 #include <getopt.h>
 
-// Global configuration
-cGstoutConfig GstoutConfig;
+// --- cGstoutStatus ---------------------------------------------------------
 
-// --- cGstoutConfig ---------------------------------------------------------
+void cGstoutStatus::ChannelSwitch(const cDevice *Device, int ChannelNumber, bool LiveView)
+{
+  // ChannelNumber is 0 while the device is being switched
+  if (LiveView && ChannelNumber > 0) {
+    cString id;
+    {
+      LOCK_CHANNELS_READ;
+      const cChannel *channel = Channels->GetByNumber(ChannelNumber);
+      if (channel)
+        id = channel->GetChannelID().ToString();
+    }
+    output->SetChannel(ChannelNumber, id);
+  }
+}
+
+void cGstoutStatus::SetVolume(int Volume, bool Absolute)
+{
+  // Volume is a step when not Absolute, the device has the result
+  UpdateVolume();
+}
 
-cGstoutConfig::cGstoutConfig(void)
+void cGstoutStatus::Replaying(const cControl *Control, const char *Name, const char *FileName, bool On)
 {
-  audioDevice = 0;
-  videoDevice = 0;
-  useHardwareDecoding = true;
-  deinterlace = true;
-  audioBufferSize = 200;
-  videoBufferSize = 200;
-  strcpy(audioSink, "autoaudiosink");
-  strcpy(videoSink, "autovideosink");
-  osdBlending = true;
+  // The plugin has no device of its own. VDR attaches every replay to the
+  // primary device, so this assumes the primary device's output is what
+  // reaches this plugin.
+  output->SetReplay(On);
+}
+
+void cGstoutStatus::UpdateVolume(void)
+{
+  cDevice *device = cDevice::PrimaryDevice();
+  output->SetVolume(double(cDevice::CurrentVolume()) / MAXVOLUME, device && device->IsMute());
+}
+
+static cString ChannelName(int Number)
+{
+  LOCK_CHANNELS_READ;
+  const cChannel *channel = Channels->GetByNumber(Number);
+  return channel ? channel->Name() : "";
+}
+
+// Setup parameters CONF can't apply to the running pipelines
+struct tConfDeferred {
+  const char *name;
+  const char *when; // NULL if the parameter isn't used at all
+};
+
+// The limits are read with every packet, the sizes when the elements are
+// created at startup
+#define CONF_TARGET_LATENCY "the ring buffer fill limit and the A/V sync window follow at once, " \
+                            "the appsrc, decoder queue, ring buffer and pool sizes after a restart of VDR"
+
+static const tConfDeferred ConfDeferred[] = {
+  { "TargetLatency",   CONF_TARGET_LATENCY },
+  { "InputPoolSize",   "takes effect after a restart of VDR" },
+  { "PipMixer",        "takes effect when a picture in picture starts with none open" },
+  { "AudioTracks",     "takes effect with the next channel switch" },
+  { "Subtitles",       "takes effect with the next channel switch" },
+  { "RadioMode",       "takes effect with the next channel switch" },
+  { "ZapLogLevel",     "takes effect with the next channel switch" },
+  { "DecoderMode",     "takes effect with the next video decoder" },
+  { "ZapFirstPicture", "takes effect with the next video decoder" },
+  { "AudioDevice",     NULL },
+  { "VideoDevice",     NULL },
+  { "OsdBlending",     NULL },
+  { "AudioBufferSize", NULL },
+  { "VideoBufferSize", NULL },
+};
+
+// The entry of the parameter Name if Reconfigure() doesn't apply it
+static const tConfDeferred *ConfDeferredParam(const char *Name)
+{
+  for (unsigned int i = 0; i < sizeof(ConfDeferred) / sizeof(ConfDeferred[0]); i++) {
+    if (!strcasecmp(Name, ConfDeferred[i].name))
+      return &ConfDeferred[i];
+  }
+  // Per codec decoder tuning, e.g. "H264Threading"
+  static const tConfDeferred Decoder = { "", "takes effect with the next video decoder" };
+  for (int i = 0; i < gcCount; i++) {
+    if (startswith(Name, cGstoutConfig::CodecName(i)))
+      return &Decoder;
+  }
+  return NULL;
+}
+
+// --- cGstoutPipReceiver ----------------------------------------------------
+
+cGstoutPipReceiver::cGstoutPipReceiver(const cChannel *Channel, cGstOutput *Output, int Index)
+:cReceiver(Channel, MINPRIORITY)
+{
+  output = Output;
+  index = Index;
+  
+  // There is no PAT/PMT on a receiver, only the video PID is demuxed
+  demux.SetVideoPid(Channel->Vpid(), Channel->Vtype());
+}
+
+cGstoutPipReceiver::~cGstoutPipReceiver()
+{
+  Detach();
+}
+
+void cGstoutPipReceiver::Receive(const uchar *Data, int Length)
+{
+  for (; Length >= TS_SIZE; Data += TS_SIZE, Length -= TS_SIZE) {
+    // Completed packets are passed on right away, so PutTs() never refuses
+    demux.PutTs(Data, true);
+    int length;
+    bool video;
+    const uchar *pes = demux.GetPes(length, video);
+    if (pes) {
+      output->PutPip(index, pes, length);
+      demux.DelPes();
+    }
+  }
 }
 
 // --- cPluginGstout ---------------------------------------------------------
@@ -34,11 +139,15 @@ cPluginGstout::cPluginGstout(void)
   // Initialize any member variables here.
   output = NULL;
   osdProvider = NULL;
+  status = NULL;
+  for (int i = 0; i < GSTPIP_MAX; i++)
+    pipReceivers[i] = NULL;
 }
 
 cPluginGstout::~cPluginGstout()
 {
   // Clean up after yourself!
+  delete status;
   delete output;
   delete osdProvider;
 }
@@ -48,7 +157,12 @@ const char *cPluginGstout::CommandLineHelp(void)
   return "  -a SINK,  --audio=SINK   GStreamer audio sink (default: autoaudiosink)\n"
          "  -v SINK,  --video=SINK   GStreamer video sink (default: autovideosink)\n"
          "  -d,       --hwdec        Enable hardware decoding (default: yes)\n"
-         "  -D,       --no-hwdec     Disable hardware decoding\n";
+         "  -D,       --no-hwdec     Disable hardware decoding\n"
+         "  -m ADDR,  --metrics=ADDR Serve OpenMetrics on a Unix socket (/path)\n"
+         "                           or TCP port ([host:]port, default host 127.0.0.1)\n"
+         "  -t DIR,   --timeshift-dir=DIR\n"
+         "                           Directory of the time-shift buffer (default: the\n"
+         "                           plugin's cache directory)\n";
 }
 
 bool cPluginGstout::ProcessArgs(int argc, char *argv[])
@@ -58,11 +172,13 @@ bool cPluginGstout::ProcessArgs(int argc, char *argv[])
     { "video",      required_argument, NULL, 'v' },
     { "hwdec",      no_argument,       NULL, 'd' },
     { "no-hwdec",   no_argument,       NULL, 'D' },
+    { "metrics",    required_argument, NULL, 'm' },
+    { "timeshift-dir", required_argument, NULL, 't' },
     { NULL, 0, NULL, 0 }
   };
 
   int c;
-  while ((c = getopt_long(argc, argv, "a:v:dD", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "a:v:dDm:t:", long_options, NULL)) != -1) {
     switch (c) {
       case 'a':
         strncpy(GstoutConfig.audioSink, optarg, sizeof(GstoutConfig.audioSink) - 1);
@@ -78,6 +194,12 @@ bool cPluginGstout::ProcessArgs(int argc, char *argv[])
       case 'D':
         GstoutConfig.useHardwareDecoding = false;
         break;
+      case 'm':
+        strn0cpy(GstoutConfig.metrics, optarg, sizeof(GstoutConfig.metrics));
+        break;
+      case 't':
+        strn0cpy(GstoutConfig.timeshiftDir, optarg, sizeof(GstoutConfig.timeshiftDir));
+        break;
       default:
         return false;
     }
@@ -87,15 +209,13 @@ bool cPluginGstout::ProcessArgs(int argc, char *argv[])
 
 bool cPluginGstout::Initialize(void)
 {
-  // Initialize GStreamer output
-  output = new cGstOutput();
+  if (!*GstoutConfig.timeshiftDir)
+    strn0cpy(GstoutConfig.timeshiftDir, CacheDirectory(Name()), sizeof(GstoutConfig.timeshiftDir));
   
-  if (!output->Initialize()) {
-    esyslog("gstout: Failed to initialize GStreamer output");
-    delete output;
-    output = NULL;
-    return false;
-  }
+  // GStreamer itself is set up by the output thread once started, errors
+  // are logged from there and leave the plugin without output
+  output = new cGstOutput();
+  output->Initialize();
   
   // Create and register OSD provider
   osdProvider = new cGstOsdProvider();
@@ -106,6 +226,9 @@ bool cPluginGstout::Initialize(void)
   if (output)
     output->SetOsdProvider(osdProvider);
   
+  // Channel numbers for the zap timeline, VDR's volume
+  status = new cGstoutStatus(output);
+  
   return true;
 }
 
@@ -115,16 +238,166 @@ bool cPluginGstout::Start(void)
   if (output)
     output->Start();
   
+  // VDR's volume from setup.conf, it only reports later changes
+  if (status)
+    status->UpdateVolume();
+  
   return true;
 }
 
 void cPluginGstout::Stop(void)
 {
   // Stop plugin activity
+  StopPips();
   if (output)
     output->Stop();
 }
 
+int cPluginGstout::StartPip(int Number, int X, int Y, int Width, int Height, cString &Error)
+{
+  LOCK_CHANNELS_READ;
+  const cChannel *channel = Channels->GetByNumber(Number);
+  if (!channel || !channel->Vpid()) {
+    Error = cString::sprintf("Channel %d not found or without video", Number);
+    return -1;
+  }
+  
+  // The lowest priority only gets a tuner that is idle or already on the
+  // transponder, live viewing and recordings are never interrupted
+  cDevice *device = cDevice::GetDevice(channel, MINPRIORITY, false);
+  if (!device) {
+    Error = cString::sprintf("No free tuner for channel %d", Number);
+    return -1;
+  }
+  
+  int index = output->AddPip(Number, channel->Name(), X, Y, Width, Height);
+  if (index < 0) {
+    Error = cString::sprintf("Failed to add PiP stream for channel %d", Number);
+    return -1;
+  }
+  
+  cGstoutPipReceiver *receiver = new cGstoutPipReceiver(channel, output, index);
+  if (!device->SwitchChannel(channel, false) || !device->AttachReceiver(receiver)) {
+    delete receiver;
+    output->DelPip(index);
+    Error = cString::sprintf("Failed to tune channel %d on device %d", Number, device->DeviceNumber() + 1);
+    return -1;
+  }
+  pipReceivers[index] = receiver;
+  isyslog("gstout: PiP %d receiving channel %d on device %d", index, Number, device->DeviceNumber() + 1);
+  return index;
+}
+
+bool cPluginGstout::StopPip(int Index)
+{
+  if (Index < 0 || Index >= GSTPIP_MAX || !pipReceivers[Index])
+    return false;
+  
+  // The receiver thread is done with the stream before it is deleted
+  delete pipReceivers[Index];
+  pipReceivers[Index] = NULL;
+  output->DelPip(Index);
+  return true;
+}
+
+void cPluginGstout::StopPips(void)
+{
+  for (int i = 0; i < GSTPIP_MAX; i++)
+    StopPip(i);
+}
+
+cString cPluginGstout::PipCommand(const char *Option, int &ReplyCode)
+{
+  if (!Option || !*Option)
+    return output->GetPips();
+  
+  char verb[16];
+  int n = 0;
+  sscanf(Option, "%15s%n", verb, &n);
+  const char *args = skipspace(Option + n);
+  
+  if (strcasecmp(verb, "ADD") == 0) {
+    // The lower right corner by default
+    int number, x = 70, y = 70, width = 25, height = 25;
+    int count = sscanf(args, "%d %d %d %d %d", &number, &x, &y, &width, &height);
+    if (count != 1 && count != 5) {
+      ReplyCode = 501;
+      return "Usage: PIP ADD <channel> [ <x> <y> <width> <height> ]";
+    }
+    if (number <= 0 || x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > 100 || y + height > 100) {
+      ReplyCode = 501;
+      return cString::sprintf("Invalid channel or rectangle \"%s\"", args);
+    }
+    cString error;
+    int index = StartPip(number, x, y, width, height, error);
+    if (index < 0) {
+      ReplyCode = 550;
+      return error;
+    }
+    return cString::sprintf("PiP %d: channel %d", index, number);
+  }
+  else if (strcasecmp(verb, "DEL") == 0) {
+    if (!isnumber(args) || !StopPip(atoi(args))) {
+      ReplyCode = 501;
+      return cString::sprintf("No PiP stream \"%s\"", args);
+    }
+    return cString::sprintf("PiP %d removed", atoi(args));
+  }
+  else if (strcasecmp(verb, "OFF") == 0) {
+    StopPips();
+    return "PiP streams removed";
+  }
+  else if (strcasecmp(verb, "MOSAIC") == 0) {
+    int numbers[GSTPIP_MAX];
+    int count = 0;
+    for (const char *p = args; *p; p = skipspace(p + n)) {
+      if (sscanf(p, "%d%n", &numbers[count], &n) != 1 || numbers[count] <= 0) {
+        ReplyCode = 501;
+        return cString::sprintf("Invalid channel number \"%s\"", p);
+      }
+      if (++count == GSTPIP_MAX && *skipspace(p + n)) {
+        ReplyCode = 501;
+        return cString::sprintf("At most %d channels besides the live one", GSTPIP_MAX);
+      }
+    }
+    if (!count) {
+      ReplyCode = 501;
+      return "Usage: PIP MOSAIC <channel> ...";
+    }
+    
+    // The live channel takes the first cell of the smallest square grid
+    StopPips();
+    int cells = count + 1;
+    int columns = 1;
+    while (columns * columns < cells)
+      columns++;
+    int rows = (cells + columns - 1) / columns;
+    int width = 100 / columns;
+    int height = 100 / rows;
+    output->SetMainLayout(0, 0, width, height);
+    
+    cString result = "";
+    bool started = false;
+    for (int i = 0; i < count; i++) {
+      int cell = i + 1;
+      cString error;
+      int index = StartPip(numbers[i], cell % columns * width, cell / columns * height, width, height, error);
+      if (index >= 0)
+        error = cString::sprintf("PiP %d: channel %d", index, numbers[i]);
+      started |= index >= 0;
+      result = cString::sprintf("%s%s%s", *result, **result ? "\n" : "", *error);
+    }
+    if (!started) {
+      output->SetMainLayout(0, 0, 100, 100);
+      ReplyCode = 550;
+    }
+    return result;
+  }
+  
+  ReplyCode = 501;
+  return cString::sprintf("Unknown option \"%s\"", Option);
+}
+
 void cPluginGstout::Housekeeping(void)
 {
   // Perform any cleanup or regular tasks
@@ -158,7 +431,7 @@ cOsdObject *cPluginGstout::MainMenuAction(void)
 cMenuSetupPage *cPluginGstout::SetupMenu(void)
 {
   // Return a setup menu
-  return new cGstoutSetupPage();
+  return new cGstoutSetupPage(output);
 }
 
 bool cPluginGstout::SetupParse(const char *Name, const char *Value)
@@ -168,11 +441,34 @@ bool cPluginGstout::SetupParse(const char *Name, const char *Value)
   else if (!strcasecmp(Name, "VideoDevice"))        GstoutConfig.videoDevice = atoi(Value);
   else if (!strcasecmp(Name, "UseHardwareDecoding")) GstoutConfig.useHardwareDecoding = atoi(Value);
   else if (!strcasecmp(Name, "Deinterlace"))        GstoutConfig.deinterlace = atoi(Value);
-  else if (!strcasecmp(Name, "AudioBufferSize"))    GstoutConfig.audioBufferSize = atoi(Value);
-  else if (!strcasecmp(Name, "VideoBufferSize"))    GstoutConfig.videoBufferSize = atoi(Value);
+  else if (!strcasecmp(Name, "DeinterlaceMethod"))  GstoutConfig.deinterlaceMethod = constrain(atoi(Value), int(dmAuto), int(dmCount) - 1);
+  else if (!strcasecmp(Name, "TargetLatency"))      GstoutConfig.targetLatency = constrain(atoi(Value), 100, 5000);
+  else if (!strcasecmp(Name, "SyncMinLatency"))     GstoutConfig.syncMinLatency = constrain(atoi(Value), 0, 2000);
+  else if (!strcasecmp(Name, "InputPoolSize"))      GstoutConfig.inputPoolSize = max(atoi(Value), 0);
+  else if (!strcasecmp(Name, "AudioBufferSize"))    ; // obsolete, sized from TargetLatency
+  else if (!strcasecmp(Name, "VideoBufferSize"))    ; // obsolete, sized from TargetLatency
   else if (!strcasecmp(Name, "AudioSink"))          strn0cpy(GstoutConfig.audioSink, Value, sizeof(GstoutConfig.audioSink));
   else if (!strcasecmp(Name, "VideoSink"))          strn0cpy(GstoutConfig.videoSink, Value, sizeof(GstoutConfig.videoSink));
+  else if (!strcasecmp(Name, "VideoStream"))        strn0cpy(GstoutConfig.videoStream, Value, sizeof(GstoutConfig.videoStream));
+  else if (!strcasecmp(Name, "PipMixer"))           strn0cpy(GstoutConfig.pipMixer, Value, sizeof(GstoutConfig.pipMixer));
+  else if (!strcasecmp(Name, "TimeshiftSize"))      GstoutConfig.timeshiftSize = constrain(atoi(Value), 0, 65536);
+  else if (!strcasecmp(Name, "AudioTracks"))        GstoutConfig.audioTracks = constrain(atoi(Value), 1, GSTTRACK_MAX + 1);
+  else if (!strcasecmp(Name, "Subtitles"))          GstoutConfig.subtitles = atoi(Value);
+  else if (!strcasecmp(Name, "RadioMode"))          GstoutConfig.radioMode = atoi(Value);
+  else if (!strcasecmp(Name, "AudioSinkLatency"))   GstoutConfig.audioSinkLatency = constrain(atoi(Value), int(alDefault), int(alCount) - 1);
+  else if (!strcasecmp(Name, "AudioBufferTime"))    GstoutConfig.audioBufferTime = constrain(atoi(Value), 20, 2000);
+  else if (!strcasecmp(Name, "AudioLatencyTime"))   GstoutConfig.audioLatencyTime = constrain(atoi(Value), 1, 200);
+  else if (!strcasecmp(Name, "AudioSlaveMethod"))   GstoutConfig.audioSlaveMethod = constrain(atoi(Value), int(asResample), int(asCount) - 1);
+  else if (!strcasecmp(Name, "AudioDriftTolerance")) GstoutConfig.audioDriftTolerance = constrain(atoi(Value), 1, 1000);
+  else if (!strcasecmp(Name, "AudioProvideClock"))  GstoutConfig.audioProvideClock = atoi(Value);
+  else if (!strcasecmp(Name, "AudioLoudness"))      GstoutConfig.audioLoudness = atoi(Value);
+  else if (!strcasecmp(Name, "AudioLoudnessTarget")) GstoutConfig.audioLoudnessTarget = constrain(atoi(Value), -31, -14);
+  else if (!strcasecmp(Name, "AudioCompression"))   GstoutConfig.audioCompression = constrain(atoi(Value), int(dcOff), int(dcCount) - 1);
   else if (!strcasecmp(Name, "OsdBlending"))        GstoutConfig.osdBlending = atoi(Value);
+  else if (!strcasecmp(Name, "DecoderMode"))        GstoutConfig.decoderMode = constrain(atoi(Value), int(gdLowLatency), int(gdAuto));
+  else if (!strcasecmp(Name, "ZapLogLevel"))        GstoutConfig.zapLogLevel = constrain(atoi(Value), int(zlOff), int(zlCount) - 1);
+  else if (!strcasecmp(Name, "ZapFirstPicture"))    GstoutConfig.zapFirstPicture = atoi(Value);
+  else if (GstoutConfig.ParseDecoder(Name, Value))  ;
   else
     return false;
   
@@ -193,6 +489,39 @@ const char **cPluginGstout::SVDRPHelpPages(void)
     "    Print GStreamer pipeline statistics.",
     "RSET\n"
     "    Reset GStreamer pipeline.",
+    "LTCY [ RESET ]\n"
+    "    Print per stage latency percentiles of the audio and video pipelines.\n"
+    "    With RESET the histograms are cleared after printing.",
+    "ZAPT [ <number> | RESET ]\n"
+    "    Print the median channel switch timeline of each channel, or the\n"
+    "    last zaps to channel <number>. RESET clears the history.",
+    "DUMP [ <directory> ]\n"
+    "    Write dot graphs of both pipelines and a JSON snapshot (elements,\n"
+    "    negotiated caps, latency, queue levels) without stopping playback.\n"
+    "    The default directory is the plugin's cache directory.",
+    "CONF [ <name> <value> ]\n"
+    "    Set the setup parameter <name> (as in setup.conf, e.g. VideoSink) and\n"
+    "    apply the sink, hardware decoding, deinterlacer and stream settings to the\n"
+    "    running pipelines. Without a parameter only applies the current setup.\n"
+    "    Parameters that can't be applied to the running pipelines are stored and\n"
+    "    the reply says when they take effect (e.g. InputPoolSize after a restart).",
+    "PIP [ ADD <channel> [ <x> <y> <w> <h> ] | DEL <n> | OFF | MOSAIC <channel> ... ]\n"
+    "    Without option, list the picture in picture streams. ADD decodes\n"
+    "    <channel> from a free tuner into a window at <x>,<y> of size <w>x<h>\n"
+    "    (percent of the frame, default 70 70 25 25). MOSAIC shows the live\n"
+    "    channel and up to eight others in a grid.",
+    "TSHF [ PAUSE | PLAY | BACK <seconds> | FWD <seconds> | LIVE ]\n"
+    "    Time shift of the live stream (needs a time-shift buffer size in the\n"
+    "    setup). PAUSE freezes playback while the stream is recorded, PLAY\n"
+    "    continues, BACK and FWD move to the nearest random access point and\n"
+    "    LIVE catches up. Without option, print the time-shift state.",
+    "ATRK [ <n> ]\n"
+    "    List the audio tracks of the live channel (* marks the one playing),\n"
+    "    or switch to track <n>. Tracks that are decoded ahead switch without\n"
+    "    interruption.",
+    "STRK [ <n> | OFF ]\n"
+    "    List the subtitle streams of the live channel (* marks the one shown),\n"
+    "    show stream <n> in the picture or turn subtitles off.",
     NULL
   };
   return HelpPages;
@@ -215,6 +544,138 @@ cString cPluginGstout::SVDRPCommand(const char *Command, const char *Option, int
     else
       return "GStreamer output not initialized";
   }
+  else if (strcasecmp(Command, "LTCY") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    bool reset = Option && *Option;
+    if (reset && strcasecmp(Option, "RESET") != 0) {
+      ReplyCode = 501;
+      return cString::sprintf("Unknown option \"%s\"", Option);
+    }
+    return output->GetLatency(reset);
+  }
+  else if (strcasecmp(Command, "ZAPT") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    if (!Option || !*Option)
+      return output->GetZapHistory(0, ChannelName);
+    if (strcasecmp(Option, "RESET") == 0) {
+      output->ClearZapHistory();
+      return "Zap history cleared";
+    }
+    if (!isnumber(Option) || atoi(Option) <= 0) {
+      ReplyCode = 501;
+      return cString::sprintf("Invalid channel number \"%s\"", Option);
+    }
+    return output->GetZapHistory(atoi(Option), ChannelName);
+  }
+  else if (strcasecmp(Command, "DUMP") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    cString files;
+    if (!output->Dump(Option && *Option ? Option : CacheDirectory(Name()), files))
+      ReplyCode = 550;
+    return files;
+  }
+  else if (strcasecmp(Command, "CONF") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    if (Option && *Option) {
+      const char *value = strchr(Option, ' ');
+      if (!value) {
+        ReplyCode = 501;
+        return cString::sprintf("Missing value for \"%s\"", Option);
+      }
+      cString name(Option, value);
+      value = skipspace(value);
+      const tConfDeferred *deferred = ConfDeferredParam(name);
+      if (deferred && !deferred->when) {
+        ReplyCode = 501;
+        return cString::sprintf("Setup parameter \"%s\" has no effect", *name);
+      }
+      if (!SetupParse(name, value)) {
+        ReplyCode = 501;
+        return cString::sprintf("Unknown setup parameter \"%s\"", *name);
+      }
+      SetupStore(name, value);
+      // Nothing to swap in the running pipelines
+      if (deferred)
+        return cString::sprintf("%s stored, %s", *name, deferred->when);
+    }
+    return output->Reconfigure();
+  }
+  else if (strcasecmp(Command, "PIP") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    return PipCommand(Option, ReplyCode);
+  }
+  else if (strcasecmp(Command, "TSHF") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    if (!Option || !*Option)
+      return output->TimeshiftStatus();
+    
+    char verb[16];
+    int n = 0;
+    sscanf(Option, "%15s%n", verb, &n);
+    const char *args = skipspace(Option + n);
+    bool ok;
+    if (strcasecmp(verb, "PAUSE") == 0)
+      ok = output->TimeshiftPause();
+    else if (strcasecmp(verb, "PLAY") == 0)
+      ok = output->TimeshiftPlay();
+    else if (strcasecmp(verb, "LIVE") == 0)
+      ok = output->TimeshiftLive();
+    else if (strcasecmp(verb, "BACK") == 0 || strcasecmp(verb, "FWD") == 0) {
+      if (!isnumber(args) || atoi(args) <= 0) {
+        ReplyCode = 501;
+        return cString::sprintf("Invalid number of seconds \"%s\"", args);
+      }
+      ok = output->TimeshiftSeek(strcasecmp(verb, "BACK") == 0 ? -atoi(args) : atoi(args));
+    }
+    else {
+      ReplyCode = 501;
+      return cString::sprintf("Unknown option \"%s\"", Option);
+    }
+    if (!ok) {
+      ReplyCode = 550;
+      return "Time shift not available (no buffer size set or output not ready)";
+    }
+    return output->TimeshiftStatus();
+  }
+  else if (strcasecmp(Command, "ATRK") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    if (Option && *Option) {
+      if (!isnumber(Option)) {
+        ReplyCode = 501;
+        return cString::sprintf("Invalid track number \"%s\"", Option);
+      }
+      cString error;
+      if (!output->SelectAudioTrack(atoi(Option), error)) {
+        ReplyCode = 550;
+        return error;
+      }
+    }
+    return output->GetAudioTracks();
+  }
+  else if (strcasecmp(Command, "STRK") == 0) {
+    if (!output)
+      return "GStreamer output not initialized";
+    if (Option && *Option) {
+      bool off = strcasecmp(Option, "OFF") == 0;
+      if (!off && !isnumber(Option)) {
+        ReplyCode = 501;
+        return cString::sprintf("Invalid subtitle stream \"%s\"", Option);
+      }
+      cString error;
+      if (!output->SelectSubtitle(off ? -1 : atoi(Option), error)) {
+        ReplyCode = 550;
+        return error;
+      }
+    }
+    return output->GetSubtitles();
+  }
   
   return NULL;
 }
@@ -11,35 +11,61 @@
 
 #include <vdr/plugin.h>
 #include <vdr/player.h>
+#include <vdr/receiver.h>
+#include <vdr/status.h>
 #include <vdr/thread.h>
+#include "gstconfig.h"
 #include "gstoutput.h"
 #include "gstosd.h"
 
 static const char *VERSION        = "0.2.0";
 static const char *DESCRIPTION    = "GStreamer-based Audio/Video Output with OSD";
 
-// Plugin configuration
-class cGstoutConfig {
+// Follows live channel switches, zap timelines are recorded per channel,
+// VDR's volume and mute, and whether a recording is being replayed
+class cGstoutStatus : public cStatus {
+private:
+  cGstOutput *output;
+  
+protected:
+  virtual void ChannelSwitch(const cDevice *Device, int ChannelNumber, bool LiveView);
+  virtual void SetVolume(int Volume, bool Absolute);
+  virtual void Replaying(const cControl *Control, const char *Name, const char *FileName, bool On);
+  
 public:
-  int audioDevice;
-  int videoDevice;
-  bool useHardwareDecoding;
-  bool deinterlace;
-  int audioBufferSize;
-  int videoBufferSize;
-  char audioSink[256];
-  char videoSink[256];
-  bool osdBlending;
+  cGstoutStatus(cGstOutput *Output) { output = Output; }
   
-  cGstoutConfig(void);
+  // Passes the current volume on to the output
+  void UpdateVolume(void);
 };
 
-extern cGstoutConfig GstoutConfig;
+// Feeds a picture in picture stream from a tuner that is free or already
+// on the channel's transponder
+class cGstoutPipReceiver : public cReceiver {
+private:
+  cGstOutput *output;
+  int index;
+  cGstTsDemux demux;
+  
+protected:
+  virtual void Receive(const uchar *Data, int Length);
+  
+public:
+  cGstoutPipReceiver(const cChannel *Channel, cGstOutput *Output, int Index);
+  virtual ~cGstoutPipReceiver();
+};
 
 class cPluginGstout : public cPlugin {
 private:
   cGstOutput *output;
   cGstOsdProvider *osdProvider;
+  cGstoutStatus *status;
+  cGstoutPipReceiver *pipReceivers[GSTPIP_MAX];
+  
+  int StartPip(int Number, int X, int Y, int Width, int Height, cString &Error);
+  bool StopPip(int Index);
+  void StopPips(void);
+  cString PipCommand(const char *Option, int &ReplyCode);
   
 public:
   cPluginGstout(void);
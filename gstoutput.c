@@ -3,9 +3,132 @@
  */
 
 #include "gstoutput.h"
-#include "gstout.h"
+#include "gstconfig.h"
+#include "gstosd.h"
+#include <vdr/remux.h>
 #include <vdr/tools.h>
 
+// --- Buffering model -------------------------------------------------------
+
+// The target latency is split between the ring buffer (compressed data
+// waiting for appsrc), appsrc's internal queue and a leaky queue behind the
+// decoder. Byte limits are derived from the peak bitrate of each stream.
+
+#define AUDIO_PEAK_KBPS  1600   // E-AC-3 with headroom
+#define VIDEO_PEAK_KBPS  40000  // UHD HEVC with headroom
+#define MIN_BUFFER_SIZE  (64 * 1024)
+#define AUDIO_SLAB_SIZE  (32 * TS_SIZE)   // appsrc input buffers, a few audio frames
+#define VIDEO_SLAB_SIZE  (348 * TS_SIZE)  // ~64 KB
+#define VIDEO_KEYWAIT_MS 5000  // longest GOP waited for after a clear
+#define QUEUE_LEAK_DOWNSTREAM 2 // GstQueueLeaky, drop the oldest buffers
+#define SELECTOR_SYNC_CLOCK   1 // GstInputSelectorSyncMode, inactive pads follow the clock
+#define DEINTERLACE_SCALER_BOB 6 // GstDeinterlaceMethods, cheapest method
+#define SKIP_FRAME_NONREF      1 // avdec skip-frame
+#define ZAP_ABSENT_MS  2000     // a stream without data by then is not waited for
+#define ZAP_TIMEOUT_MS 10000    // incomplete timelines are recorded after this
+#define STOP_TIMEOUT_S 10       // covers a pipeline build on a cold registry
+#define AUDIO_LATENCY_QUERY_MS 1000 // pipeline latency for the underrun check
+
+// Stream formats VDR delivers, their decoders and parsers are loaded ahead
+#define WARM_CAPS "video/mpeg, mpegversion=(int)2; video/x-h264; video/x-h265; " \
+                  "audio/mpeg; audio/x-ac3; audio/x-eac3; audio/x-private1-ac3"
+
+static int RingLatencyMs(void)   { return GstoutConfig.targetLatency / 2; }
+static int AppsrcLatencyMs(void) { return GstoutConfig.targetLatency / 4; }
+static int QueueLatencyMs(void)  { return GstoutConfig.targetLatency / 4; }
+
+static int LatencyBytes(int Ms, int Kbps)
+{
+  // kbit/s * ms / 8 = bytes
+  return max(Ms * (Kbps / 8), MIN_BUFFER_SIZE);
+}
+
+// Input pool limit, configured in MB (split by peak bitrate) or twice what
+// appsrc and the decoder queue hold at the target latency
+static int PoolBytes(int Kbps)
+{
+  if (GstoutConfig.inputPoolSize > 0)
+    return int((int64_t)GstoutConfig.inputPoolSize * 1024 * 1024 * Kbps / (AUDIO_PEAK_KBPS + VIDEO_PEAK_KBPS));
+  return 2 * LatencyBytes(AppsrcLatencyMs() + QueueLatencyMs(), Kbps);
+}
+
+static bool HasProperty(GstElement *element, const char *name)
+{
+  return element && g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+}
+
+static void ConfigureAppsrc(GstElement *source, int Kbps)
+{
+  g_object_set(G_OBJECT(source),
+               "stream-type", GST_APP_STREAM_TYPE_STREAM,
+               "format", GST_FORMAT_TIME,
+               "is-live", TRUE,
+               "max-bytes", (guint64)LatencyBytes(AppsrcLatencyMs(), Kbps),
+               "min-percent", 50,
+               NULL);
+  
+  // max-time is available since GStreamer 1.20
+  if (HasProperty(source, "max-time"))
+    g_object_set(G_OBJECT(source), "max-time", (guint64)AppsrcLatencyMs() * GST_MSECOND, NULL);
+}
+
+static int DecoderCodec(GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory(element);
+  if (!factory)
+    return -1;
+  
+  const gchar *klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+  if (!klass || !strstr(klass, "Decoder") || !strstr(klass, "Video"))
+    return -1;
+  
+  const gchar *name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+  if (strstr(name, "h264"))
+    return gcH264;
+  if (strstr(name, "h265") || strstr(name, "hevc"))
+    return gcH265;
+  if (strstr(name, "mpeg2"))
+    return gcMpeg2;
+  return -1;
+}
+
+// Sinks are given as a factory name or as a description with properties,
+// e.g. "fakesink sync=false" or "videoconvert ! xvimagesink"
+static GstElement *CreateSink(const char *description, const char *name)
+{
+  if (!strpbrk(description, " =!"))
+    return gst_element_factory_make(description, name);
+  
+  GError *error = NULL;
+  GstElement *sink = strchr(description, '!') ?
+                     gst_parse_bin_from_description(description, TRUE, &error) :
+                     gst_parse_launch(description, &error);
+  if (error) {
+    esyslog("gstout: Invalid sink '%s': %s", description, error->message);
+    g_error_free(error);
+    if (sink)
+      gst_object_unref(sink);
+    return NULL;
+  }
+  if (sink)
+    gst_object_set_name(GST_OBJECT(sink), name);
+  return sink;
+}
+
+static GstElement *CreateLeakyQueue(const char *name)
+{
+  GstElement *queue = gst_element_factory_make("queue", name);
+  if (queue) {
+    g_object_set(G_OBJECT(queue),
+                 "max-size-buffers", 0,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64)QueueLatencyMs() * GST_MSECOND,
+                 "leaky", QUEUE_LEAK_DOWNSTREAM,
+                 NULL);
+  }
+  return queue;
+}
+
 // --- cGstOutput ------------------------------------------------------------
 
 cGstOutput::cGstOutput(void)
@@ -15,6 +138,19 @@ cGstOutput::cGstOutput(void)
   videoOutput = NULL;
   osdProvider = NULL;
   initialized = false;
+  ready = 0;
+  warmThread = NULL;
+  demuxVideoOnly = false;
+  audioTrack = 0;
+  audioVersion = -1;
+  audioTracksBuilt = false;
+  subtitle = -1;
+  subtitleVersion = -1;
+  radio = false;
+  channel = 0;
+  zapActive = false;
+  zapStart = 0;
+  zapTime = 0;
 }
 
 cGstOutput::~cGstOutput()
@@ -23,75 +159,149 @@ cGstOutput::~cGstOutput()
   delete audioOutput;
   delete videoOutput;
   
+  if (warmThread)
+    g_thread_join(warmThread);
   if (initialized)
     gst_deinit();
 }
 
 bool cGstOutput::Initialize(void)
 {
-  cMutexLock lock(&mutex);
+  // Only creates the objects, GStreamer and the pipelines are set up by the
+  // output thread so VDR's startup doesn't wait for the registry scan
+  audioOutput = new cGstAudioOutput();
+  videoOutput = new cGstVideoOutput();
+  return true;
+}
+
+gpointer cGstOutput::BuildAudio(gpointer data)
+{
+  cGstAudioOutput *output = (cGstAudioOutput *)data;
+  return GINT_TO_POINTER(output->Initialize());
+}
+
+gpointer cGstOutput::WarmDecoders(gpointer data)
+{
+  // Loads the decoder and parser plugins decodebin will pick, including
+  // the VAAPI display probe, before the first stream arrives
+  uint64_t start = cTimeMs::Now();
+  GstCaps *caps = gst_caps_from_string(WARM_CAPS);
+  GList *factories = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_DECODABLE, GST_RANK_MARGINAL);
+  GList *matching = gst_element_factory_list_filter(factories, caps, GST_PAD_SINK, FALSE);
+  int loaded = 0;
+  for (GList *l = matching; l; l = l->next) {
+    GstPluginFeature *feature = gst_plugin_feature_load(GST_PLUGIN_FEATURE(l->data));
+    if (feature) {
+      gst_object_unref(feature);
+      loaded++;
+    }
+  }
+  gst_plugin_feature_list_free(matching);
+  gst_plugin_feature_list_free(factories);
+  gst_caps_unref(caps);
+  dsyslog("gstout: %d decoders and parsers loaded in %d ms", loaded, int(cTimeMs::Now() - start));
+  return NULL;
+}
+
+bool cGstOutput::Setup(void)
+{
+  uint64_t start = cTimeMs::Now();
   
-  // Initialize GStreamer
+  // Initialize GStreamer (loads or rebuilds the registry)
   GError *error = NULL;
   if (!gst_init_check(NULL, NULL, &error)) {
     esyslog("gstout: Failed to initialize GStreamer: %s", error ? error->message : "unknown error");
     if (error)
       g_error_free(error);
+    g_atomic_int_set(&ready, -1);
     return false;
   }
-  
   initialized = true;
-  isyslog("gstout: GStreamer %s initialized", gst_version_string());
+  uint64_t initDone = cTimeMs::Now();
+  isyslog("gstout: GStreamer %s initialized in %d ms", gst_version_string(), int(initDone - start));
   
-  // Create audio and video outputs
-  audioOutput = new cGstAudioOutput();
-  if (!audioOutput->Initialize()) {
-    esyslog("gstout: Failed to initialize audio output");
-    return false;
-  }
+  warmThread = g_thread_new("gstout warm", WarmDecoders, NULL);
   
-  videoOutput = new cGstVideoOutput();
-  if (!videoOutput->Initialize()) {
+  // Audio and video pipelines are built in parallel
+  GThread *audioThread = g_thread_new("gstout audio", BuildAudio, audioOutput);
+  bool videoOk = videoOutput->Initialize();
+  bool audioOk = GPOINTER_TO_INT(g_thread_join(audioThread));
+  if (!audioOk)
+    esyslog("gstout: Failed to initialize audio output");
+  if (!videoOk)
     esyslog("gstout: Failed to initialize video output");
+  if (!audioOk || !videoOk) {
+    g_atomic_int_set(&ready, -1);
     return false;
   }
   
+  audioOutput->Start();
+  videoOutput->Start();
+  if (GstoutConfig.timeshiftSize > 0)
+    timeshift.Open(GstoutConfig.timeshiftDir, GstoutConfig.timeshiftSize);
+  g_atomic_int_set(&ready, 1);
+  isyslog("gstout: Pipelines ready in %d ms (%d ms after GStreamer init)",
+          int(cTimeMs::Now() - start), int(cTimeMs::Now() - initDone));
   return true;
 }
 
+bool cGstOutput::WaitReady(int TimeoutMs)
+{
+  uint64_t start = cTimeMs::Now();
+  while (!g_atomic_int_get(&ready) && cTimeMs::Now() - start < (uint64_t)TimeoutMs)
+    cCondWait::SleepMs(10);
+  return Ready();
+}
+
 void cGstOutput::Start(void)
 {
   cMutexLock lock(&mutex);
   
-  if (audioOutput)
+  // A restart after Stop(), the first start is done by the output thread
+  if (Ready()) {
     audioOutput->Start();
-  if (videoOutput)
     videoOutput->Start();
+  }
+  
+  if (*GstoutConfig.metrics)
+    metrics.Open(GstoutConfig.metrics);
   
   cThread::Start();
 }
 
 void cGstOutput::Stop(void)
 {
+  // The output thread takes the mutex as well
+  if (Running())
+    Cancel(STOP_TIMEOUT_S);
+  metrics.Close();
+  
   cMutexLock lock(&mutex);
   
   if (audioOutput)
     audioOutput->Stop();
   if (videoOutput)
     videoOutput->Stop();
-  
-  if (Running())
-    Cancel(3);
 }
 
 void cGstOutput::Reset(void)
 {
+  if (!Ready())
+    return;
+  
   cMutexLock lock(&mutex);
   
   if (audioOutput)
     audioOutput->Reset();
   if (videoOutput)
     videoOutput->Reset();
+  StartZap();
+  
+  syncController.Reset();
+  if (audioOutput)
+    audioOutput->SetSyncDelay(0);
+  if (videoOutput)
+    videoOutput->SetSyncDelay(0);
 }
 
 void cGstOutput::MainThreadHook(void)
@@ -99,322 +309,911 @@ void cGstOutput::MainThreadHook(void)
   // Process any pending events
 }
 
+void cGstOutput::UpdateSync(void)
+{
+  if (!audioOutput || !videoOutput)
+    return;
+  
+  if (syncController.Update(audioOutput->OutPts(), videoOutput->OutPts())) {
+    audioOutput->SetSyncDelay(syncController.AudioDelayMs());
+    videoOutput->SetSyncDelay(syncController.VideoDelayMs());
+  }
+}
+
+void cGstOutput::SetChannel(int Number, const char *ChannelId)
+{
+  cMutexLock lock(&mutex);
+  channel = Number;
+  if (videoOutput)
+    videoOutput->SetChannel(ChannelId ? ChannelId : *cString::sprintf("%d", Number));
+  
+  // The time-shift buffer holds a single channel, a switch returns to live
+  if (timeshift.Shifted()) {
+    if (timeshift.Paused())
+      PauseOutputs(false);
+    Flush();
+  }
+  timeshift.Clear();
+}
+
+void cGstOutput::SetVolume(double Level, bool Mute)
+{
+  // Taken over by the pipeline once it is built
+  if (audioOutput)
+    audioOutput->SetVolume(Level, Mute);
+}
+
+void cGstOutput::StartZap(void)
+{
+  // Caller must hold mutex, the outputs have restarted their tracers
+  zapActive = true;
+  zapStart = cTimeMs::Now();
+  zapTime = time(NULL);
+}
+
+void cGstOutput::UpdateZap(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!zapActive || !audioOutput || !videoOutput)
+    return;
+  
+  int elapsed = cTimeMs::Now() - zapStart;
+  int audioByte = audioOutput->ZapMark(zmByte);
+  int videoByte = videoOutput->ZapMark(zmByte);
+  int frame = videoOutput->ZapMark(zmRendered);
+  int audio = audioOutput->ZapMark(zmRendered);
+  
+  // Radio and audio only recordings have no video to wait for
+  bool videoDone = frame >= 0 || (videoByte < 0 && elapsed > ZAP_ABSENT_MS);
+  bool audioDone = audio >= 0 || (audioByte < 0 && elapsed > ZAP_ABSENT_MS);
+  if (!(videoDone && audioDone) && elapsed < ZAP_TIMEOUT_MS)
+    return;
+  zapActive = false;
+  
+  // Nothing was played, e.g. a Clear() before stopping
+  if (audioByte < 0 && videoByte < 0)
+    return;
+  
+  tGstZap zap;
+  zap.when = zapTime;
+  zap.channel = channel;
+  zap.ms[zeFlush] = 0;
+  zap.ms[zeFirstByte] = audioByte < 0 ? videoByte : videoByte < 0 ? audioByte : min(audioByte, videoByte);
+  zap.ms[zeCaps] = videoOutput->ZapMark(zmCaps);
+  zap.ms[zeDecoded] = videoOutput->ZapMark(zmDecoded);
+  zap.ms[zeFirstFrame] = frame;
+  zap.ms[zeFirstAudio] = audio;
+  zapHistory.Add(zap);
+  
+  if (GstoutConfig.zapLogLevel == zlInfo)
+    isyslog("gstout: Zap to channel %d: %s", channel, *cGstZapHistory::Format(zap));
+  else if (GstoutConfig.zapLogLevel == zlDebug)
+    dsyslog("gstout: Zap to channel %d: %s", channel, *cGstZapHistory::Format(zap));
+}
+
 void cGstOutput::Action(void)
 {
+  if (!Ready() && !Setup())
+    return;
+  
   while (Running()) {
-    // Process GStreamer events
-    cCondWait::SleepMs(100);
+    // Process GStreamer events (dispatches the bus watches)
+    while (g_main_context_iteration(NULL, FALSE))
+      ;
+    
+    UpdateSync();
+    UpdateZap();
+    ProcessTimeshift();
+    if (audioOutput) {
+      audioOutput->ProcessFeed();
+      audioOutput->ProcessSink();
+    }
+    if (videoOutput) {
+      videoOutput->ProcessFeed();
+      videoOutput->ProcessQos();
+      videoOutput->ProcessPip();
+    }
+    
+    // Scrapes are answered from this thread, the poll replaces the sleep
+    if (metrics.Active()) {
+      if (metrics.Poll(100))
+        metrics.Respond(GetMetrics());
+    }
+    else
+      cCondWait::SleepMs(100);
   }
 }
 
 bool cGstOutput::PlayAudio(const uchar *Data, int Length)
 {
-  if (audioOutput)
+  if (Ready())
     return audioOutput->Play(Data, Length);
   return false;
 }
 
 bool cGstOutput::PlayVideo(const uchar *Data, int Length)
 {
-  if (videoOutput)
+  if (Ready())
     return videoOutput->Play(Data, Length);
   return false;
 }
 
 
-int cGstOutput::PlayTs(const uchar *Data, int Length, bool VideoOnly)
+bool cGstOutput::FlushPes(void)
 {
-  //if (videoOutput)
-  //  return videoOutput->Play(Data, Length);
-  // return false;
+  // Caller must hold mutex
+  int length;
+  bool video;
+  const uchar *pes = demux.GetPes(length, video);
+  if (!pes)
+    return true;
+  
+  // The tracks decoded ahead and the subtitles never hold up the first one
+  if (demux.ReadyTrack() == GSTDEMUX_SUBTITLE)
+    videoOutput->PutSubtitle(pes, length);
+  else if (!video && demux.ReadyTrack() > 0)
+    audioOutput->PutTrack(demux.ReadyTrack(), pes, length);
+  else if (!(video ? PlayVideo(pes, length) : PlayAudio(pes, length)))
+    return false;
+  
+  demux.DelPes();
+  return true;
 }
 
+int cGstOutput::PlayTs(const uchar *Data, int Length, bool VideoOnly)
+{
+  // Nothing is taken until the pipelines are built
+  if (!Ready())
+    return 0;
+  
+  cMutexLock lock(&mutex);
+  
+  if (!Data) {
+    demux.Clear();
+    return 0;
+  }
+  demuxVideoOnly = VideoOnly;
+  
+  int played = 0;
+  while (Length - played >= TS_SIZE) {
+    const uchar *p = Data + played;
+    if (*p != TS_SYNC_BYTE) {
+      // Skip to the next sync byte
+      int skipped = 1;
+      while (played + skipped < Length && Data[played + skipped] != TS_SYNC_BYTE)
+        skipped++;
+      played += skipped;
+      continue;
+    }
+    
+    // While time-shifted the live stream is only recorded, the output
+    // thread plays from the buffer
+    if (timeshift.Shifted()) {
+      timeshift.Put(p, demux.VideoPid());
+      played += TS_SIZE;
+      continue;
+    }
+    
+    // A completed PES packet has to be accepted before more TS data is
+    // consumed, otherwise the caller retries with the same data
+    if (!FlushPes() || !demux.PutTs(p, VideoOnly))
+      break;
+    timeshift.Put(p, demux.VideoPid());
+    played += TS_SIZE;
+  }
+  FlushPes();
+  UpdateAudioTracks();
+  UpdateSubtitles();
+  UpdateRadio();
+  
+  return played;
+}
 
-void cGstOutput::Clear(void)
+void cGstOutput::Flush(void)
 {
-  if (audioOutput)
+  // Caller must hold mutex
+  demux.Clear();
+  if (audioOutput) {
     audioOutput->Clear();
+    audioOutput->ClearTracks();
+  }
+  audioTracksBuilt = false;
   if (videoOutput)
     videoOutput->Clear();
+  
+  syncController.Reset();
+  if (audioOutput)
+    audioOutput->SetSyncDelay(0);
+  if (videoOutput)
+    videoOutput->SetSyncDelay(0);
 }
 
-cString cGstOutput::GetStatistics(void)
+void cGstOutput::Clear(void)
 {
-  cString audio = audioOutput ? audioOutput->GetStatistics() : "Audio: N/A";
-  cString video = videoOutput ? videoOutput->GetStatistics() : "Video: N/A";
+  if (!Ready())
+    return;
   
-  return cString::sprintf("%s\n%s", *audio, *video);
+  cMutexLock lock(&mutex);
+  
+  Flush();
+  StartZap();
 }
 
-gboolean cGstOutput::BusCallback(GstBus *bus, GstMessage *msg, gpointer data)
+void cGstOutput::PauseOutputs(bool On)
 {
-  switch (GST_MESSAGE_TYPE(msg)) {
-    case GST_MESSAGE_ERROR: {
-      GError *err;
-      gchar *debug;
-      gst_message_parse_error(msg, &err, &debug);
-      esyslog("gstout: GStreamer error: %s", err->message);
-      if (debug)
-        dsyslog("gstout: Debug info: %s", debug);
-      g_error_free(err);
-      g_free(debug);
-      break;
-    }
-    case GST_MESSAGE_WARNING: {
-      GError *err;
-      gchar *debug;
-      gst_message_parse_warning(msg, &err, &debug);
-      isyslog("gstout: GStreamer warning: %s", err->message);
-      g_error_free(err);
-      g_free(debug);
-      break;
-    }
-    case GST_MESSAGE_EOS:
-      dsyslog("gstout: End of stream");
-      break;
-    case GST_MESSAGE_STATE_CHANGED: {
-      GstState old_state, new_state;
-      gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
-      dsyslog("gstout: State changed from %s to %s",
-              gst_element_state_get_name(old_state),
-              gst_element_state_get_name(new_state));
+  audioOutput->Pause(On);
+  videoOutput->Pause(On);
+}
+
+void cGstOutput::ProcessTimeshift(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!timeshift.Shifted() || timeshift.Paused())
+    return;
+  
+  // As much as the outputs take, they are paced by the sinks
+  while (FlushPes()) {
+    int length = 0;
+    const uchar *data = timeshift.Get(length);
+    if (timeshift.Discontinuity())
+      Flush();
+    if (!data) {
+      // Caught up, the live stream is played directly again
+      timeshift.Live();
+      dsyslog("gstout: Time shift caught up with the live stream");
       break;
     }
-    default:
+    
+    int played = 0;
+    while (played < length && FlushPes() && demux.PutTs(data + played, demuxVideoOnly))
+      played += TS_SIZE;
+    timeshift.Del(played);
+    UpdateAudioTracks();
+    UpdateSubtitles();
+    UpdateRadio();
+    if (played < length)
       break;
   }
-  
-  return TRUE;
 }
 
-// --- cGstAudioOutput -------------------------------------------------------
-
-cGstAudioOutput::cGstAudioOutput(void)
+void cGstOutput::UpdateAudioTracks(void)
 {
-  pipeline = NULL;
-  source = NULL;
-  decoder = NULL;
-  converter = NULL;
-  resampler = NULL;
-  sink = NULL;
-  bus = NULL;
-  buffer = NULL;
-  playing = false;
+  // Caller must hold mutex
+  if (!audioOutput || !demux.HasPmt())
+    return;
+  if (audioTracksBuilt && demux.AudioVersion() == audioVersion)
+    return;
+  
+  // Another channel or audio streams starts with the first track again, a
+  // flush keeps the selection (time shift)
+  if (demux.AudioVersion() != audioVersion) {
+    audioTrack = 0;
+    audioVersion = demux.AudioVersion();
+  }
+  audioTracksBuilt = true;
+  
+  // The selected track first, then the ones following the first track
+  audioOutput->ClearTracks();
+  if (audioTrack > 0 && !(audioOutput->AddTrack(audioTrack, demux.Audio(audioTrack)->streamType) && audioOutput->SelectTrack(audioTrack)))
+    audioTrack = 0;
+  int count = min(demux.NumAudio(), GstoutConfig.audioTracks);
+  for (int i = 1; i < count; i++)
+    audioOutput->AddTrack(i, demux.Audio(i)->streamType);
+  UpdateAudioMask();
 }
 
-cGstAudioOutput::~cGstAudioOutput()
+void cGstOutput::UpdateAudioMask(void)
 {
-  Stop();
-  
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_NULL);
-    gst_object_unref(pipeline);
+  // Caller must hold mutex
+  uint32_t mask = 0;
+  for (int i = 0; i < demux.NumAudio(); i++) {
+    if (audioOutput->HasTrack(i))
+      mask |= 1 << i;
   }
-  
-  delete buffer;
+  demux.SetAudioMask(mask);
 }
 
-bool cGstAudioOutput::Initialize(void)
+bool cGstOutput::SelectAudioTrack(int Track, cString &Error)
 {
-  cMutexLock lock(&mutex);
-  
-  // Create ring buffer for audio data
-  buffer = new cRingBufferLinear(GstoutConfig.audioBufferSize * 1024, 0, false);
-  if (!buffer) {
-    esyslog("gstout: Failed to create audio buffer");
+  if (!Ready()) {
+    Error = "GStreamer output not ready";
     return false;
   }
   
-  // Create pipeline elements
-  source = gst_element_factory_make("appsrc", "audio-source");
-  decoder = gst_element_factory_make("decodebin", "audio-decoder");
-  converter = gst_element_factory_make("audioconvert", "audio-converter");
-  resampler = gst_element_factory_make("audioresample", "audio-resampler");
-  sink = gst_element_factory_make(GstoutConfig.audioSink, "audio-sink");
+  cMutexLock lock(&mutex);
   
-  if (!source || !decoder || !converter || !resampler || !sink) {
-    esyslog("gstout: Failed to create audio pipeline elements");
+  const tGstAudioStream *stream = demux.Audio(Track);
+  if (!stream) {
+    Error = cString::sprintf("No audio track %d", Track);
     return false;
   }
-  
-  // Create pipeline
-  pipeline = gst_pipeline_new("audio-pipeline");
-  if (!pipeline) {
-    esyslog("gstout: Failed to create audio pipeline");
+  if (!audioOutput->HasTrack(Track)) {
+    // Makes room by dropping a track that is decoded ahead, from the end
+    if (!audioOutput->AddTrack(Track, stream->streamType)) {
+      for (int i = demux.NumAudio() - 1; i > 0; i--) {
+        if (i != audioOutput->ActiveTrack() && audioOutput->DelTrack(i))
+          break;
+      }
+      if (!audioOutput->AddTrack(Track, stream->streamType)) {
+        UpdateAudioMask();
+        Error = cString::sprintf("Failed to decode audio track %d", Track);
+        return false;
+      }
+    }
+    UpdateAudioMask();
+  }
+  if (!audioOutput->SelectTrack(Track)) {
+    Error = cString::sprintf("Failed to select audio track %d", Track);
     return false;
   }
+  audioTrack = Track;
+  return true;
+}
+
+cString cGstOutput::GetAudioTracks(void)
+{
+  if (!Ready())
+    return "GStreamer output not ready";
   
-  // Add elements to pipeline
-  gst_bin_add_many(GST_BIN(pipeline), source, decoder, converter, resampler, sink, NULL);
+  cMutexLock lock(&mutex);
   
-  // Link elements (decoder will be linked dynamically via pad-added signal)
-  if (!gst_element_link(source, decoder)) {
-    esyslog("gstout: Failed to link audio source and decoder");
-    return false;
+  if (!demux.NumAudio())
+    return "No audio tracks";
+  cString s = "";
+  for (int i = 0; i < demux.NumAudio(); i++) {
+    const tGstAudioStream *stream = demux.Audio(i);
+    s = cString::sprintf("%s%s%c%d: PID %d, %s, %s, %s", *s, i ? "\n" : "",
+                         i == audioOutput->ActiveTrack() ? '*' : ' ', i,
+                         stream->pid,
+                         cGstTsDemux::AudioName(stream->streamType),
+                         *stream->language ? stream->language : "---",
+                         *audioOutput->TrackStatus(i));
   }
+  return s;
+}
+
+void cGstOutput::UpdateSubtitles(void)
+{
+  // Caller must hold mutex
+  if (!videoOutput || !demux.HasPmt() || demux.SubtitleVersion() == subtitleVersion)
+    return;
+  
+  // The overlay stays across a flush, another channel or subtitle streams
+  // start with the default again
+  subtitleVersion = demux.SubtitleVersion();
+  subtitle = (GstoutConfig.subtitles && demux.NumSubtitles()) ? 0 : -1;
+  const tGstSubtitleStream *stream = demux.Subtitle(subtitle);
+  if (!videoOutput->SetSubtitles(stream ? stream->type : -1, stream ? stream->page : 0))
+    subtitle = -1;
+  demux.SetSubtitle(subtitle);
+}
+
+void cGstOutput::UpdateRadio(void)
+{
+  // Caller must hold mutex
+  // After a clear the mode is kept until the next PMT, so zapping between
+  // radio channels doesn't start the video pipeline in between
+  if (!videoOutput || (GstoutConfig.radioMode && !demux.HasPmt()))
+    return;
+  SetRadio(GstoutConfig.radioMode && !demux.VideoPid() && !videoOutput->HasPips());
+}
+
+void cGstOutput::SetRadio(bool On)
+{
+  // Caller must hold mutex
+  if (On == radio)
+    return;
+  radio = On;
+  videoOutput->Suspend(On);
   
-  if (!gst_element_link_many(converter, resampler, sink, NULL)) {
-    esyslog("gstout: Failed to link audio converter, resampler, and sink");
+  // The video offset no longer applies
+  syncController.Reset();
+  audioOutput->SetSyncDelay(0);
+  videoOutput->SetSyncDelay(0);
+}
+
+bool cGstOutput::SelectSubtitle(int Index, cString &Error)
+{
+  if (!Ready()) {
+    Error = "GStreamer output not ready";
     return false;
   }
   
-  // Connect decoder pad-added signal
-  g_signal_connect(decoder, "pad-added", G_CALLBACK(+[](GstElement *src, GstPad *new_pad, gpointer data) {
-    GstElement *conv = (GstElement *)data;
-    GstPad *sink_pad = gst_element_get_static_pad(conv, "sink");
-    if (!gst_pad_is_linked(sink_pad)) {
-      gst_pad_link(new_pad, sink_pad);
-    }
-    gst_object_unref(sink_pad);
-  }), converter);
-  
-  // Configure appsrc
-  g_object_set(G_OBJECT(source),
-               "stream-type", GST_APP_STREAM_TYPE_STREAM,
-               "format", GST_FORMAT_TIME,
-               "is-live", TRUE,
-               NULL);
-  
-  // Connect appsrc callbacks
-  g_signal_connect(source, "need-data", G_CALLBACK(NeedDataCallback), this);
-  g_signal_connect(source, "enough-data", G_CALLBACK(EnoughDataCallback), this);
-  
-  // Set up bus
-  bus = gst_element_get_bus(pipeline);
-  gst_bus_add_watch(bus, cGstOutput::BusCallback, this);
-  
-  isyslog("gstout: Audio pipeline created (sink: %s)", GstoutConfig.audioSink);
+  cMutexLock lock(&mutex);
   
+  const tGstSubtitleStream *stream = demux.Subtitle(Index);
+  if (Index >= 0 && !stream) {
+    Error = cString::sprintf("No subtitle stream %d", Index);
+    return false;
+  }
+  if (!videoOutput->SetSubtitles(stream ? stream->type : -1, stream ? stream->page : 0)) {
+    Error = cString::sprintf("Failed to render subtitle stream %d", Index);
+    return false;
+  }
+  subtitle = Index;
+  demux.SetSubtitle(subtitle);
   return true;
 }
 
-void cGstAudioOutput::Start(void)
+cString cGstOutput::GetSubtitles(void)
 {
+  if (!Ready())
+    return "GStreamer output not ready";
+  
   cMutexLock lock(&mutex);
   
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_PLAYING);
-    playing = true;
-    isyslog("gstout: Audio pipeline started");
+  if (!demux.NumSubtitles())
+    return "No subtitle streams";
+  cString s = "";
+  for (int i = 0; i < demux.NumSubtitles(); i++) {
+    const tGstSubtitleStream *stream = demux.Subtitle(i);
+    cString name = stream->type == stTeletext ? cString::sprintf("teletext page %d", stream->page) : cString("DVB");
+    s = cString::sprintf("%s%s%c%d: PID %d, %s, %s%s", *s, i ? "\n" : "",
+                         i == subtitle ? '*' : ' ', i,
+                         stream->pid,
+                         *name,
+                         *stream->language ? stream->language : "---",
+                         stream->hearingImpaired ? " (hearing impaired)" : "");
   }
+  return cString::sprintf("%s\n%s", *s, *videoOutput->SubtitleStatus());
 }
 
-void cGstAudioOutput::Stop(void)
+bool cGstOutput::TimeshiftPause(void)
 {
+  if (!Ready())
+    return false;
+  
   cMutexLock lock(&mutex);
   
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_NULL);
-    playing = false;
-    isyslog("gstout: Audio pipeline stopped");
+  if (!timeshift.IsOpen())
+    return false;
+  if (!timeshift.Paused()) {
+    timeshift.Pause();
+    PauseOutputs(true);
+    isyslog("gstout: Time shift paused");
   }
+  return true;
 }
 
-void cGstAudioOutput::Reset(void)
+bool cGstOutput::TimeshiftPlay(void)
 {
-  cMutexLock lock(&mutex);
+  if (!Ready())
+    return false;
   
-  Clear();
+  cMutexLock lock(&mutex);
   
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_NULL);
-    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  if (!timeshift.IsOpen())
+    return false;
+  if (timeshift.Paused()) {
+    timeshift.Play();
+    PauseOutputs(false);
+    isyslog("gstout: Time shift playing %d s behind live", timeshift.DelayMs() / 1000);
   }
+  return true;
 }
 
-bool cGstAudioOutput::Play(const uchar *Data, int Length)
+bool cGstOutput::TimeshiftSeek(int Seconds)
 {
+  if (!Ready())
+    return false;
+  
   cMutexLock lock(&mutex);
   
-  if (!buffer || !playing)
+  if (!timeshift.IsOpen())
     return false;
   
-  int free = buffer->Free();
-  if (free < Length)
+  // Restarts decoding like a channel switch, a paused output stays paused
+  bool paused = timeshift.Paused();
+  if (!timeshift.Seek(Seconds) && paused)
+    PauseOutputs(false);
+  Flush();
+  isyslog("gstout: Time shift moved to %d s behind live", timeshift.DelayMs() / 1000);
+  return true;
+}
+
+bool cGstOutput::TimeshiftLive(void)
+{
+  if (!Ready())
     return false;
   
-  int written = buffer->Put(Data, Length);
-  return written == Length;
+  cMutexLock lock(&mutex);
+  
+  if (!timeshift.IsOpen())
+    return false;
+  if (timeshift.Shifted()) {
+    if (timeshift.Paused())
+      PauseOutputs(false);
+    timeshift.Live();
+    Flush();
+    isyslog("gstout: Time shift back to live");
+  }
+  return true;
 }
 
-void cGstAudioOutput::Clear(void)
+cString cGstOutput::TimeshiftStatus(void)
 {
   cMutexLock lock(&mutex);
+  return timeshift.Status();
+}
+
+int cGstOutput::BufferFill(bool Video)
+{
+  if (Video)
+    return videoOutput ? videoOutput->BufferFill() : 0;
+  return audioOutput ? audioOutput->BufferFill() : 0;
+}
+
+void cGstOutput::SetReplay(bool On)
+{
+  if (videoOutput)
+    videoOutput->SetReplay(On);
+}
+
+cString cGstOutput::Reconfigure(void)
+{
+  // Before that the pipelines are built from the current setup anyway
+  if (!Ready())
+    return "GStreamer output starting, the setup applies once it is ready";
+  
+  cString shift = "";
+  if (GstoutConfig.timeshiftSize != timeshift.SizeMB()) {
+    // A new size starts with an empty buffer
+    cMutexLock lock(&mutex);
+    if (timeshift.Shifted()) {
+      if (timeshift.Paused())
+        PauseOutputs(false);
+      Flush();
+    }
+    timeshift.Close();
+    if (GstoutConfig.timeshiftSize > 0)
+      timeshift.Open(GstoutConfig.timeshiftDir, GstoutConfig.timeshiftSize);
+    shift = cString::sprintf("\nTime shift: %s", timeshift.IsOpen() ? *cString::sprintf("%d MB", timeshift.SizeMB()) : "off");
+  }
   
-  if (buffer)
-    buffer->Clear();
+  cString audio = audioOutput->Reconfigure();
+  cString video = videoOutput->Reconfigure();
+  return cString::sprintf("%s\n%s%s", *audio, *video, *shift);
 }
 
-void cGstAudioOutput::NeedDataCallback(GstElement *source, guint size, gpointer data)
+int cGstOutput::AddPip(int Channel, const char *Name, int X, int Y, int Width, int Height)
 {
-  cGstAudioOutput *self = (cGstAudioOutput *)data;
-  cMutexLock lock(&self->mutex);
+  if (!Ready())
+    return -1;
+  
+  // The mosaic needs the video pipeline on a radio channel as well, it is
+  // stopped again with the first PMT after the last stream is gone
+  {
+    cMutexLock lock(&mutex);
+    SetRadio(false);
+  }
+  return videoOutput->AddPip(Channel, Name, X, Y, Width, Height);
+}
+
+void cGstOutput::PutPip(int Index, const uchar *Data, int Length)
+{
+  // Only called between a successful AddPip() and DelPip()
+  videoOutput->PutPip(Index, Data, Length);
+}
+
+bool cGstOutput::DelPip(int Index)
+{
+  return Ready() && videoOutput->DelPip(Index);
+}
+
+cString cGstOutput::GetPips(void)
+{
+  if (!Ready())
+    return "GStreamer output not ready";
+  return videoOutput->GetPips();
+}
+
+void cGstOutput::SetMainLayout(int X, int Y, int Width, int Height)
+{
+  if (Ready())
+    videoOutput->SetMainLayout(X, Y, Width, Height);
+}
+
+cString cGstOutput::GetStatistics(void)
+{
+  if (!Ready())
+    return g_atomic_int_get(&ready) < 0 ? "GStreamer output failed to start" : "GStreamer output starting";
   
-  if (!self->buffer)
-    return;
+  cString audio = audioOutput ? audioOutput->GetStatistics() : "Audio: N/A";
+  cString video = videoOutput ? videoOutput->GetStatistics() : "Video: N/A";
   
-  int available = self->buffer->Available();
-  if (available > 0) {
-    uchar *readData;
-    int count = 0;
-	readData = self->buffer->Get(count);
-    if (count > 0) {
-      GstBuffer *gstBuffer = gst_buffer_new_allocate(NULL, count, NULL);
-      GstMapInfo map;
-      gst_buffer_map(gstBuffer, &map, GST_MAP_WRITE);
-      memcpy(map.data, readData, count);
-      gst_buffer_unmap(gstBuffer, &map);
-      
-      GstFlowReturn ret;
-      g_signal_emit_by_name(source, "push-buffer", gstBuffer, &ret);
-      gst_buffer_unref(gstBuffer);
-      
-      self->buffer->Del(count);
-    }
-  }
+  cString sync = syncController.Valid() ?
+                 cString::sprintf("Sync: A/V offset %+d ms, delay audio %d ms / video %d ms",
+                                  syncController.OffsetMs(),
+                                  syncController.AudioDelayMs(),
+                                  syncController.VideoDelayMs()) :
+                 cString("Sync: N/A");
+  
+  cString shift = TimeshiftStatus();
+  
+  return cString::sprintf("%s\n%s\n%s\n%s", *audio, *video, *sync, *shift);
 }
 
-void cGstAudioOutput::EnoughDataCallback(GstElement *source, gpointer data)
+cString cGstOutput::GetLatency(bool Reset)
 {
-  // Appsrc has enough data, we can pause feeding
+  cString audio = audioOutput ? audioOutput->GetLatency(Reset) : "Audio: N/A";
+  cString video = videoOutput ? videoOutput->GetLatency(Reset) : "Video: N/A";
+  return cString::sprintf("Latency (ms)\n%s\n%s", *audio, *video);
 }
 
-cString cGstAudioOutput::GetStatistics(void)
+cString cGstOutput::GetMetrics(void)
 {
-  cMutexLock lock(&mutex);
+  static const char *Streams[2] = { "audio", "video" };
+  cGstMetricsWriter w;
+  w.Family("gstout_ready", "gauge", "Pipelines built and playing.");
+  w.SampleInt("gstout_ready", NULL, Ready());
+  if (!Ready())
+    return w.Finish();
+  
+  tGstStreamMetrics m[2];
+  memset(m, 0, sizeof(m));
+  audioOutput->GetMetrics(m[0]);
+  videoOutput->GetMetrics(m[1]);
+  
+  w.Family("gstout_bytes_in", "counter", "Bytes accepted by the output.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_bytes_in_total", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].bytesIn);
+  w.Family("gstout_bytes_out", "counter", "Bytes pushed into appsrc.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_bytes_out_total", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].bytesOut);
+  w.Family("gstout_ring_fill_bytes", "gauge", "Bytes in the ring buffer.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_ring_fill_bytes", cString::sprintf("stream=\"%s\"", Streams[i]), max(m[i].ringFill, 0));
+  w.Family("gstout_ring_size_bytes", "gauge", "Ring buffer size.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_ring_size_bytes", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].ringSize);
+  w.Family("gstout_appsrc_level_bytes", "gauge", "Bytes queued in appsrc.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_appsrc_level_bytes", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].appsrcLevel);
+  w.Family("gstout_pool_hits", "counter", "Input buffers taken from the pool.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_pool_hits_total", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].poolHits);
+  w.Family("gstout_pool_misses", "counter", "Pushes deferred because the pool was exhausted.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_pool_misses_total", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].poolMisses);
+  w.Family("gstout_pool_size_bytes", "gauge", "Input pool limit.");
+  for (int i = 0; i < 2; i++)
+    w.SampleInt("gstout_pool_size_bytes", cString::sprintf("stream=\"%s\"", Streams[i]), m[i].poolBytes);
+  w.Family("gstout_decoder", "info", "Decoder in use.");
+  for (int i = 0; i < 2; i++) {
+    if (m[i].decoder)
+      w.SampleInt("gstout_decoder_info", cString::sprintf("stream=\"%s\",decoder=\"%s\"", Streams[i], m[i].decoder), 1);
+  }
   
-  int available = buffer ? buffer->Available() : 0;
-  int free = buffer ? buffer->Free() : 0;
+  w.Family("gstout_frames_late", "counter", "Video frames reported late by the sink.");
+  w.SampleInt("gstout_frames_late_total", NULL, m[1].framesLate);
+  w.Family("gstout_frames_dropped", "counter", "Non-reference video frames dropped before decode.");
+  w.SampleInt("gstout_frames_dropped_total", NULL, m[1].framesDropped);
+  w.Family("gstout_qos_proportion", "gauge", "Last QoS proportion of the video sink.");
+  w.Sample("gstout_qos_proportion", NULL, m[1].qosProportion);
+  w.Family("gstout_overload_level", "gauge", "Overload level of the video pipeline.");
+  w.SampleInt("gstout_overload_level", NULL, m[1].overloadLevel);
+  
+  w.Family("gstout_stage_latency_seconds", "summary", "Latency per pipeline stage.");
+  for (int i = 0; i < 2; i++) {
+    cGstStageTracer *trace = i ? (videoOutput ? videoOutput->Tracer() : NULL) : (audioOutput ? audioOutput->Tracer() : NULL);
+    if (!trace)
+      continue;
+    for (int stage = 0; stage < gsCount; stage++) {
+      cGstHistogram &h = trace->Histogram(stage);
+      static const int Quantiles[] = { 50, 95, 99 };
+      for (int q = 0; q < 3; q++) {
+        w.Sample("gstout_stage_latency_seconds",
+                 cString::sprintf("stream=\"%s\",stage=\"%s\",quantile=\"%.2f\"", Streams[i], cGstStageTracer::StageName(stage), Quantiles[q] / 100.0),
+                 h.Percentile(Quantiles[q]) / 1e6);
+      }
+      w.SampleInt("gstout_stage_latency_seconds_count",
+                  cString::sprintf("stream=\"%s\",stage=\"%s\"", Streams[i], cGstStageTracer::StageName(stage)),
+                  h.Count());
+    }
+  }
   
-  GstState state = GST_STATE_NULL;
-  if (pipeline)
-    gst_element_get_state(pipeline, &state, NULL, GST_CLOCK_TIME_NONE);
+  w.Family("gstout_zaps", "counter", "Recorded channel switches.");
+  w.SampleInt("gstout_zaps_total", NULL, zapHistory.Total());
+  tGstZap zap;
+  if (zapHistory.Last(zap)) {
+    w.Family("gstout_zap_last_seconds", "gauge", "Timeline of the last channel switch.");
+    for (int e = zeFirstByte; e < zeCount; e++) {
+      if (zap.ms[e] >= 0)
+        w.Sample("gstout_zap_last_seconds", cString::sprintf("event=\"%s\"", cGstZapHistory::EventName(e)), zap.ms[e] / 1000.0);
+    }
+  }
   
-  return cString::sprintf("Audio: %s, Buffer: %d/%d KB",
-                         gst_element_state_get_name(state),
-                         available / 1024,
-                         (available + free) / 1024);
+  return w.Finish();
 }
 
-// --- cGstVideoOutput -------------------------------------------------------
+bool cGstOutput::Dump(const char *Directory, cString &Files)
+{
+  if (!Ready()) {
+    Files = "GStreamer output not ready";
+    return false;
+  }
+  
+  // No output mutex, playback goes on while the pipelines are inspected
+  char stamp[32];
+  time_t now = time(NULL);
+  struct tm tm_r;
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&now, &tm_r));
+  
+  GstElement *pipelines[2] = { audioOutput ? audioOutput->Pipeline() : NULL,
+                               videoOutput ? videoOutput->Pipeline() : NULL };
+  Files = "";
+  for (int i = 0; i < 2; i++) {
+    if (!pipelines[i])
+      continue;
+    cString dot = cString::sprintf("%s/gstout-%s-%s.dot", Directory, stamp, GST_ELEMENT_NAME(pipelines[i]));
+    if (GstDumpDot(pipelines[i], dot))
+      Files = cString::sprintf("%s%s\n", *Files, *dot);
+    else
+      esyslog("gstout: Failed to write %s", *dot);
+  }
+  
+  // Not GetStatistics(), it takes the output mutexes and waits for a
+  // pending state change, which never ends when the pipeline is stuck. The
+  // counters are the metrics' atomics, the states come from 0 timeout
+  // queries in GstDumpJson().
+  static const char *Streams[2] = { "audio", "video" };
+  tGstStreamMetrics m[2];
+  memset(m, 0, sizeof(m));
+  if (audioOutput)
+    audioOutput->GetMetrics(m[0]);
+  if (videoOutput)
+    videoOutput->GetMetrics(m[1]);
+  
+  GString *json = g_string_new("{\"time\": ");
+  GstJsonString(json, stamp);
+  g_string_append(json, ", \"streams\": [");
+  for (int i = 0; i < 2; i++) {
+    g_string_append_printf(json, "%s{\"name\": \"%s\", \"bytes_in\": %llu, \"bytes_out\": %llu, \"ring_fill\": %d, \"ring_size\": %d, "
+                           "\"appsrc_level\": %llu, \"pool_hits\": %d, \"pool_misses\": %d, \"decoder\": ",
+                           i ? ", " : "", Streams[i], (unsigned long long)m[i].bytesIn, (unsigned long long)m[i].bytesOut,
+                           max(m[i].ringFill, 0), m[i].ringSize, (unsigned long long)m[i].appsrcLevel, m[i].poolHits, m[i].poolMisses);
+    if (m[i].decoder)
+      GstJsonString(json, m[i].decoder);
+    else
+      g_string_append(json, "null");
+    if (i)
+      g_string_append_printf(json, ", \"frames_late\": %llu, \"frames_dropped\": %d, \"overload_level\": %d",
+                             (unsigned long long)m[i].framesLate, m[i].framesDropped, m[i].overloadLevel);
+    g_string_append(json, "}");
+  }
+  g_string_append(json, "], \"config\": {\"audio_sink\": ");
+  GstJsonString(json, GstoutConfig.audioSink);
+  g_string_append(json, ", \"video_sink\": ");
+  GstJsonString(json, GstoutConfig.videoSink);
+  g_string_append_printf(json, ", \"hw_decoding\": %s, \"target_latency_ms\": %d}, \"pipelines\": [",
+                         GstoutConfig.useHardwareDecoding ? "true" : "false", GstoutConfig.targetLatency);
+  bool first = true;
+  for (int i = 0; i < 2; i++) {
+    if (!pipelines[i])
+      continue;
+    if (!first)
+      g_string_append(json, ", ");
+    GstDumpJson(json, pipelines[i]);
+    first = false;
+  }
+  g_string_append(json, "]}\n");
+  
+  cString name = cString::sprintf("%s/gstout-%s.json", Directory, stamp);
+  bool ok = g_file_set_contents(name, json->str, json->len, NULL);
+  g_string_free(json, TRUE);
+  if (!ok) {
+    esyslog("gstout: Failed to write %s", *name);
+    Files = cString::sprintf("Failed to write %s", *name);
+    return false;
+  }
+  Files = cString::sprintf("%s%s", *Files, *name);
+  isyslog("gstout: Pipeline snapshot written to %s", *name);
+  return true;
+}
 
-cGstVideoOutput::cGstVideoOutput(void)
+gboolean cGstOutput::BusCallback(GstBus *bus, GstMessage *msg, gpointer data)
+{
+  switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_ERROR: {
+      GError *err;
+      gchar *debug;
+      gst_message_parse_error(msg, &err, &debug);
+      esyslog("gstout: GStreamer error: %s", err->message);
+      if (debug)
+        dsyslog("gstout: Debug info: %s", debug);
+      g_error_free(err);
+      g_free(debug);
+      break;
+    }
+    case GST_MESSAGE_WARNING: {
+      GError *err;
+      gchar *debug;
+      gst_message_parse_warning(msg, &err, &debug);
+      isyslog("gstout: GStreamer warning: %s", err->message);
+      g_error_free(err);
+      g_free(debug);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      dsyslog("gstout: End of stream");
+      break;
+    case GST_MESSAGE_LATENCY: {
+      // A stream joining the video mixer changes the pipeline latency
+      GstObject *pipeline = GST_MESSAGE_SRC(msg);
+      while (GST_OBJECT_PARENT(pipeline))
+        pipeline = GST_OBJECT_PARENT(pipeline);
+      gst_bin_recalculate_latency(GST_BIN(pipeline));
+      break;
+    }
+    case GST_MESSAGE_CLOCK_LOST: {
+      // The clock providing sink was swapped, select a new clock
+      GstObject *pipeline = GST_MESSAGE_SRC(msg);
+      while (GST_OBJECT_PARENT(pipeline))
+        pipeline = GST_OBJECT_PARENT(pipeline);
+      dsyslog("gstout: Clock lost, selecting a new one");
+      gst_element_set_state(GST_ELEMENT(pipeline), GST_STATE_PAUSED);
+      gst_element_set_state(GST_ELEMENT(pipeline), GST_STATE_PLAYING);
+      break;
+    }
+    case GST_MESSAGE_STATE_CHANGED: {
+      GstState old_state, new_state;
+      gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
+      dsyslog("gstout: State changed from %s to %s",
+              gst_element_state_get_name(old_state),
+              gst_element_state_get_name(new_state));
+      break;
+    }
+    default:
+      break;
+  }
+  
+  return TRUE;
+}
+
+// --- cGstAudioOutput -------------------------------------------------------
+
+cGstAudioOutput::cGstAudioOutput(void)
+:trace("Audio")
 {
   pipeline = NULL;
   source = NULL;
   decoder = NULL;
-  deinterlace = NULL;
+  selector = NULL;
+  queue = NULL;
+  dspConverter = NULL;
+  dspFilter = NULL;
+  volume = NULL;
   converter = NULL;
-  scaler = NULL;
+  resampler = NULL;
   sink = NULL;
   bus = NULL;
   buffer = NULL;
   playing = false;
+  needData = false;
+  prebuffering = true;
+  syncDelayMs = 0;
+  newSink = NULL;
+  sinkLatencyMs = 0;
+  latencyQueried = 0;
+  volumeLevel = 1.0;
+  muted = false;
+  primaryPad = NULL;
+  for (int i = 0; i < GSTTRACK_MAX; i++)
+    tracks[i] = NULL;
+  activeTrack = 0;
 }
 
-cGstVideoOutput::~cGstVideoOutput()
+cGstAudioOutput::~cGstAudioOutput()
 {
   Stop();
+  ClearTracks();
+  
+  if (primaryPad)
+    gst_object_unref(primaryPad);
+  if (newSink)
+    gst_object_unref(newSink);
   
   if (pipeline) {
     gst_element_set_state(pipeline, GST_STATE_NULL);
@@ -424,144 +1223,331 @@ cGstVideoOutput::~cGstVideoOutput()
   delete buffer;
 }
 
-bool cGstVideoOutput::Initialize(void)
+bool cGstAudioOutput::Initialize(void)
 {
   cMutexLock lock(&mutex);
   
-  // Create ring buffer for video data
-  buffer = new cRingBufferLinear(GstoutConfig.videoBufferSize * 1024, 0, false);
+  // Create ring buffer for audio data
+  buffer = new cRingBufferLinear(LatencyBytes(RingLatencyMs(), AUDIO_PEAK_KBPS), 0, false);
   if (!buffer) {
-    esyslog("gstout: Failed to create video buffer");
+    esyslog("gstout: Failed to create audio buffer");
     return false;
   }
   
-  // Create pipeline elements
-  source = gst_element_factory_make("appsrc", "video-source");
-  
-  // Use hardware decoder if available and configured
-  if (GstoutConfig.useHardwareDecoding) {
-    decoder = gst_element_factory_make("vaapidecodebin", "video-decoder");
-    if (!decoder) {
-      isyslog("gstout: Hardware decoder not available, using software decoder");
-      decoder = gst_element_factory_make("decodebin", "video-decoder");
-    }
-  } else {
-    decoder = gst_element_factory_make("decodebin", "video-decoder");
-  }
-  
-  if (GstoutConfig.deinterlace)
-    deinterlace = gst_element_factory_make("deinterlace", "deinterlacer");
+  // Fixed size buffers for appsrc
+  if (!pool.Setup(AUDIO_SLAB_SIZE, PoolBytes(AUDIO_PEAK_KBPS)))
+    return false;
   
-  converter = gst_element_factory_make("videoconvert", "video-converter");
-  scaler = gst_element_factory_make("videoscale", "video-scaler");
-  sink = gst_element_factory_make(GstoutConfig.videoSink, "video-sink");
+  // Create pipeline elements
+  source = gst_element_factory_make("appsrc", "audio-source");
+  decoder = gst_element_factory_make("decodebin", "audio-decoder");
+  selector = gst_element_factory_make("input-selector", "audio-selector");
+  queue = CreateLeakyQueue("audio-queue");
+  dspConverter = gst_element_factory_make("audioconvert", "audio-dsp-converter");
+  dspFilter = gst_element_factory_make("capsfilter", "audio-dsp-caps");
+  volume = gst_element_factory_make("volume", "audio-volume");
+  converter = gst_element_factory_make("audioconvert", "audio-converter");
+  resampler = gst_element_factory_make("audioresample", "audio-resampler");
+  sink = CreateSink(GstoutConfig.audioSink, "audio-sink");
   
-  if (!source || !decoder || !converter || !scaler || !sink) {
-    esyslog("gstout: Failed to create video pipeline elements");
+  if (!source || !decoder || !selector || !queue || !dspConverter || !dspFilter || !volume || !converter || !resampler || !sink) {
+    esyslog("gstout: Failed to create audio pipeline elements");
     return false;
   }
+  tuner.Setup();
+  tuner.ConfigureSink(sink);
+  
+  // Volume and loudness work on interleaved native float, the converter
+  // behind them turns it into what the sink takes
+  GstCaps *dspCaps = gst_caps_new_simple("audio/x-raw",
+                                         "format", G_TYPE_STRING, G_BYTE_ORDER == G_LITTLE_ENDIAN ? "F32LE" : "F32BE",
+                                         "layout", G_TYPE_STRING, "interleaved",
+                                         "channels", GST_TYPE_INT_RANGE, 1, GSTLOUDNESS_MAXCHANNELS,
+                                         NULL);
+  g_object_set(G_OBJECT(dspFilter), "caps", dspCaps, NULL);
+  gst_caps_unref(dspCaps);
+  ApplyVolume();
+  ApplyLoudness();
   
   // Create pipeline
-  pipeline = gst_pipeline_new("video-pipeline");
+  pipeline = gst_pipeline_new("audio-pipeline");
   if (!pipeline) {
-    esyslog("gstout: Failed to create video pipeline");
+    esyslog("gstout: Failed to create audio pipeline");
     return false;
   }
   
   // Add elements to pipeline
-  gst_bin_add_many(GST_BIN(pipeline), source, decoder, NULL);
-  if (deinterlace)
-    gst_bin_add(GST_BIN(pipeline), deinterlace);
-  gst_bin_add_many(GST_BIN(pipeline), converter, scaler, sink, NULL);
+  gst_bin_add_many(GST_BIN(pipeline), source, decoder, selector, queue, dspConverter, dspFilter, volume, converter, resampler, sink, NULL);
   
-  // Link elements
+  // Link elements (decoder will be linked dynamically via pad-added signal)
   if (!gst_element_link(source, decoder)) {
-    esyslog("gstout: Failed to link video source and decoder");
+    esyslog("gstout: Failed to link audio source and decoder");
+    return false;
+  }
+  
+  if (!gst_element_link_many(selector, queue, dspConverter, dspFilter, volume, converter, resampler, sink, NULL)) {
+    esyslog("gstout: Failed to link audio selector, queue, DSP, volume, converter, resampler, and sink");
     return false;
   }
   
-  GstElement *linkTarget = deinterlace ? deinterlace : converter;
+  // The first track's pad is requested first and so is the active one,
+  // the tracks added later are kept in step with it by the clock
+  g_object_set(G_OBJECT(selector), "sync-streams", TRUE, NULL);
+  if (HasProperty(selector, "sync-mode"))
+    g_object_set(G_OBJECT(selector), "sync-mode", SELECTOR_SYNC_CLOCK, NULL);
+#if GST_CHECK_VERSION(1, 20, 0)
+  primaryPad = gst_element_request_pad_simple(selector, "sink_%u");
+#else
+  primaryPad = gst_element_get_request_pad(selector, "sink_%u");
+#endif
+  if (!primaryPad) {
+    esyslog("gstout: Failed to request the audio selector pad");
+    return false;
+  }
   
   // Connect decoder pad-added signal
-  g_signal_connect(decoder, "pad-added", G_CALLBACK(+[](GstElement *src, GstPad *new_pad, gpointer data) {
-    GstElement *target = (GstElement *)data;
-    GstPad *sink_pad = gst_element_get_static_pad(target, "sink");
-    if (!gst_pad_is_linked(sink_pad)) {
-      gst_pad_link(new_pad, sink_pad);
-    }
-    gst_object_unref(sink_pad);
-  }), linkTarget);
+  g_signal_connect(decoder, "pad-added", G_CALLBACK(PadAddedCallback), this);
   
-  if (deinterlace) {
-    if (!gst_element_link_many(deinterlace, converter, scaler, sink, NULL)) {
-      esyslog("gstout: Failed to link video pipeline with deinterlace");
-      return false;
-    }
-  } else {
-    if (!gst_element_link_many(converter, scaler, sink, NULL)) {
-      esyslog("gstout: Failed to link video pipeline");
-      return false;
-    }
-  }
+  // Sinks created by an auto sink on its way to READY, and buffers that
+  // reach the sink too late
+  g_signal_connect(pipeline, "deep-element-added", G_CALLBACK(SinkAddedCallback), this);
+  GstPad *resamplerPad = gst_element_get_static_pad(resampler, "src");
+  gst_pad_add_probe(resamplerPad, GST_PAD_PROBE_TYPE_BUFFER, UnderrunProbe, this, NULL);
+  gst_object_unref(resamplerPad);
+  
+  // Loudness measurement and gain on the float samples
+  GstPad *dspPad = gst_element_get_static_pad(dspFilter, "src");
+  gst_pad_add_probe(dspPad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM), DspProbe, this, NULL);
+  gst_object_unref(dspPad);
   
   // Configure appsrc
-  g_object_set(G_OBJECT(source),
-               "stream-type", GST_APP_STREAM_TYPE_STREAM,
-               "format", GST_FORMAT_TIME,
-               "is-live", TRUE,
-               NULL);
+  ConfigureAppsrc(source, AUDIO_PEAK_KBPS);
   
   // Connect appsrc callbacks
   g_signal_connect(source, "need-data", G_CALLBACK(NeedDataCallback), this);
   g_signal_connect(source, "enough-data", G_CALLBACK(EnoughDataCallback), this);
   
+  // Latency tracing, the decoder is attached once decodebin plugs it
+  trace.SetPipeline(pipeline);
+  trace.AttachSource(source);
+  trace.AttachSink(sink);
+  g_signal_connect(decoder, "deep-element-added", G_CALLBACK(DeepElementAddedCallback), this);
+  
   // Set up bus
   bus = gst_element_get_bus(pipeline);
   gst_bus_add_watch(bus, cGstOutput::BusCallback, this);
   
-  isyslog("gstout: Video pipeline created (sink: %s, hwdec: %s, deinterlace: %s)",
-          GstoutConfig.videoSink,
-          GstoutConfig.useHardwareDecoding ? "yes" : "no",
-          GstoutConfig.deinterlace ? "yes" : "no");
+  sinkName = GstoutConfig.audioSink;
+  isyslog("gstout: Audio pipeline created (sink: %s)", *sinkName);
   
   return true;
 }
 
-void cGstVideoOutput::Start(void)
+void cGstAudioOutput::Start(void)
 {
   cMutexLock lock(&mutex);
   
   if (pipeline) {
     gst_element_set_state(pipeline, GST_STATE_PLAYING);
     playing = true;
-    isyslog("gstout: Video pipeline started");
+    isyslog("gstout: Audio pipeline started");
   }
 }
 
-void cGstVideoOutput::Stop(void)
+void cGstAudioOutput::Stop(void)
 {
-  cMutexLock lock(&mutex);
-  
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_NULL);
+  // The state change joins the streaming threads, which may wait for the
+  // mutex (need-data, the sink swap), so it is made without it
+  {
+    cMutexLock lock(&mutex);
+    if (!pipeline)
+      return;
     playing = false;
-    isyslog("gstout: Video pipeline stopped");
   }
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  isyslog("gstout: Audio pipeline stopped");
 }
 
-void cGstVideoOutput::Reset(void)
+void cGstAudioOutput::Pause(bool On)
+{
+  // Changed without the mutex, see Stop()
+  bool change;
+  {
+    cMutexLock lock(&mutex);
+    change = pipeline && playing;
+    // Running time stands still while the clock goes on
+    tuner.Hold();
+  }
+  if (change)
+    gst_element_set_state(pipeline, On ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+}
+
+cString cGstAudioOutput::Reconfigure(void)
 {
   cMutexLock lock(&mutex);
   
-  Clear();
+  if (!pipeline)
+    return "Audio: not running";
+  
+  // Taken over by the streaming thread with the next buffer
+  bool dspChanged = ApplyLoudness();
+  cString dsp = dspChanged ? cString::sprintf(", %s", *LoudnessStatus()) : cString("");
+  if (newSink)
+    return cString::sprintf("Audio: sink switch pending%s", *dsp);
+  bool newName = strcmp(sinkName, GstoutConfig.audioSink) != 0;
+  if (!newName && !tuner.Changed())
+    return dspChanged ? cString::sprintf("Audio: %s", *LoudnessStatus()) : cString("Audio: unchanged");
+  
+  // The sink only takes a new buffer size when it is set up again
+  tuner.Setup();
+  if (!ReplaceSink(GstoutConfig.audioSink))
+    return cString::sprintf("Audio: failed to create sink \"%s\"", GstoutConfig.audioSink);
+  
+  cString result = newName ? cString::sprintf("Audio: sink %s -> %s%s", *sinkName, GstoutConfig.audioSink, *dsp) :
+                             cString::sprintf("Audio: sink %s, %s%s", *sinkName, *tuner.Status(), *dsp);
+  isyslog("gstout: %s", *result);
+  sinkName = GstoutConfig.audioSink;
+  return result;
+}
+
+bool cGstAudioOutput::ReplaceSink(const char *Name)
+{
+  // Caller must hold mutex
+  // Created here, so an invalid sink leaves the running one alone
+  newSink = CreateSink(Name, NULL);
+  if (!newSink)
+    return false;
+  gst_object_ref_sink(newSink);
+  tuner.ConfigureSink(newSink);
   
-  if (pipeline) {
-    gst_element_set_state(pipeline, GST_STATE_NULL);
-    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  // Called right away if no buffer is passing
+  GstPad *pad = gst_element_get_static_pad(resampler, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_IDLE, SwapProbe, this, NULL);
+  gst_object_unref(pad);
+  return true;
+}
+
+GstPadProbeReturn cGstAudioOutput::SwapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  self->SwapSink();
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void cGstAudioOutput::SwapSink(void)
+{
+  cMutexLock lock(&mutex);
+  
+  // The resampler's src pad is blocked, nothing reaches the sink. Removing
+  // the clock providing sink posts CLOCK_LOST, see cGstOutput::BusCallback()
+  GstElement *old = sink;
+  gst_element_set_state(old, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(pipeline), old);
+  
+  sink = newSink;
+  newSink = NULL;
+  gst_object_set_name(GST_OBJECT(sink), "audio-sink");
+  gst_bin_add(GST_BIN(pipeline), sink);
+  gst_object_unref(sink);
+  if (!gst_element_link(resampler, sink))
+    esyslog("gstout: Failed to link audio sink %s", *sinkName);
+  gst_element_sync_state_with_parent(sink);
+  
+  trace.AttachSink(sink);
+  if (HasProperty(sink, "ts-offset"))
+    g_object_set(G_OBJECT(sink), "ts-offset", (gint64)g_atomic_int_get(&syncDelayMs) * GST_MSECOND, NULL);
+  tuner.Hold();
+  latencyQueried = 0;
+  isyslog("gstout: Audio sink switched to %s", *sinkName);
+}
+
+void cGstAudioOutput::SetVolume(double Level, bool Mute)
+{
+  cMutexLock lock(&mutex);
+  volumeLevel = constrain(Level, 0.0, 1.0);
+  muted = Mute;
+  ApplyVolume();
+}
+
+void cGstAudioOutput::ApplyVolume(void)
+{
+  // Caller must hold mutex
+  // A cubic curve, so VDR's volume steps are heard as about even steps
+  if (volume)
+    g_object_set(G_OBJECT(volume), "volume", volumeLevel * volumeLevel * volumeLevel, "mute", (gboolean)muted, NULL);
+}
+
+bool cGstAudioOutput::ApplyLoudness(void)
+{
+  // Caller must hold mutex
+  bool changed = GstoutConfig.audioLoudness != loudness.Normalize() ||
+                 GstoutConfig.audioLoudnessTarget != loudness.Target() ||
+                 GstoutConfig.audioCompression != loudness.Compression();
+  loudness.SetParams(GstoutConfig.audioLoudness, GstoutConfig.audioLoudnessTarget, GstoutConfig.audioCompression);
+  return changed;
+}
+
+cString cGstAudioOutput::LoudnessStatus(void)
+{
+  if (!loudness.Active())
+    return "Loudness: off";
+  static const char *CompressionNames[dcCount] = { "", ", light DRC", ", heavy DRC" };
+  cString measured = loudness.Measured() ? cString::sprintf("%.1f LUFS", loudness.Integrated()) : cString("---");
+  return cString::sprintf("Loudness: %s (target %d), gain %+.1f dB%s", *measured, loudness.Target(),
+                          loudness.GainDb(), CompressionNames[loudness.Compression()]);
+}
+
+GstPadProbeReturn cGstAudioOutput::DspProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+      gst_event_parse_caps(event, &caps);
+      GstStructure *structure = gst_caps_get_structure(caps, 0);
+      gint rate = 0;
+      gint channels = 0;
+      gst_structure_get_int(structure, "rate", &rate);
+      gst_structure_get_int(structure, "channels", &channels);
+      if (self->loudness.Setup(rate, channels))
+        dsyslog("gstout: Audio DSP at %d Hz, %d channels", rate, channels);
+      else
+        esyslog("gstout: Audio DSP can't process %d Hz, %d channels", rate, channels);
+    }
+    return GST_PAD_PROBE_OK;
   }
+  
+  int channels = self->loudness.Channels();
+  if (!channels || !self->loudness.Active())
+    return GST_PAD_PROBE_OK;
+  
+  // The decoder's buffer may be shared, changed in place otherwise
+  GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+  GST_PAD_PROBE_INFO_DATA(info) = buffer;
+  GstMapInfo map;
+  if (gst_buffer_map(buffer, &map, GST_MAP_READWRITE)) {
+    self->loudness.Process((float *)map.data, map.size / (channels * sizeof(float)));
+    gst_buffer_unmap(buffer, &map);
+  }
+  return GST_PAD_PROBE_OK;
 }
 
-bool cGstVideoOutput::Play(const uchar *Data, int Length)
+void cGstAudioOutput::Reset(void)
+{
+  // Restarted without the mutex, see Stop()
+  {
+    cMutexLock lock(&mutex);
+    Clear();
+    if (!pipeline)
+      return;
+  }
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+}
+
+bool cGstAudioOutput::Play(const uchar *Data, int Length)
 {
   cMutexLock lock(&mutex);
   
@@ -572,53 +1558,372 @@ bool cGstVideoOutput::Play(const uchar *Data, int Length)
   if (free < Length)
     return false;
   
+  // Keep the buffered duration inside the latency window
+  if (sync.BufferedMs() > RingLatencyMs())
+    return false;
+  
   int written = buffer->Put(Data, Length);
+  if (written > 0) {
+    sync.Put(Data, written);
+    trace.Put(written);
+  }
+  
+  Feed();
+  
   return written == Length;
 }
 
-void cGstVideoOutput::Clear(void)
+void cGstAudioOutput::Clear(void)
 {
   cMutexLock lock(&mutex);
   
   if (buffer)
     buffer->Clear();
+  sync.Clear();
+  trace.Clear();
+  trace.Zap();
+  tuner.Hold();
+  loudness.Reset();
+  prebuffering = true;
 }
 
-void cGstVideoOutput::NeedDataCallback(GstElement *source, guint size, gpointer data)
+void cGstAudioOutput::Feed(void)
 {
-  cGstVideoOutput *self = (cGstVideoOutput *)data;
-  cMutexLock lock(&self->mutex);
-  
-  if (!self->buffer)
+  // Caller must hold mutex
+  if (!buffer || !source || !needData)
     return;
   
-  int available = self->buffer->Available();
-  if (available > 0) {
-    uchar *readData;
+  if (prebuffering) {
+    // After a clear, hold back data until the minimum latency is buffered
+    // (or the ring is half full, for streams without usable PTS)
+    int buffered = sync.BufferedMs();
+    if (buffered >= 0 && buffered < min(GstoutConfig.syncMinLatency, RingLatencyMs()) && buffer->Available() < buffer->Free())
+      return;
+    prebuffering = false;
+  }
+  
+  while (needData) {
     int count = 0;
-	readData = self->buffer->Get(count);
-    if (count > 0) {
-      GstBuffer *gstBuffer = gst_buffer_new_allocate(NULL, count, NULL);
-      GstMapInfo map;
-      gst_buffer_map(gstBuffer, &map, GST_MAP_WRITE);
-      memcpy(map.data, readData, count);
-      gst_buffer_unmap(gstBuffer, &map);
-      
-      GstFlowReturn ret;
-      g_signal_emit_by_name(source, "push-buffer", gstBuffer, &ret);
-      gst_buffer_unref(gstBuffer);
-      
-      self->buffer->Del(count);
+    uchar *readData = buffer->Get(count);
+    if (!readData || count <= 0)
+      break;
+    
+    // If the pool is exhausted the data stays in the ring, ProcessFeed()
+    // picks it up again
+    GstBuffer *gstBuffer = pool.Get(readData, count);
+    if (!gstBuffer)
+      break;
+    count = gst_buffer_get_size(gstBuffer);
+    
+    trace.Pushed(count);
+    GstFlowReturn ret;
+    g_signal_emit_by_name(source, "push-buffer", gstBuffer, &ret);
+    gst_buffer_unref(gstBuffer);
+    
+    buffer->Del(count);
+    sync.Del(count);
+    
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+}
+
+void cGstAudioOutput::ProcessFeed(void)
+{
+  cMutexLock lock(&mutex);
+  Feed();
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i])
+      tracks[i]->Feed();
+  }
+}
+
+void cGstAudioOutput::ProcessSink(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!pipeline || !playing)
+    return;
+  
+  // The latency only changes with the sink or the decoder
+  uint64_t now = cTimeMs::Now();
+  if (now - latencyQueried >= AUDIO_LATENCY_QUERY_MS) {
+    latencyQueried = now;
+    GstQuery *query = gst_query_new_latency();
+    if (gst_element_query(pipeline, query)) {
+      GstClockTime latency;
+      gst_query_parse_latency(query, NULL, &latency, NULL);
+      g_atomic_int_set(&sinkLatencyMs, int(latency / GST_MSECOND));
     }
+    gst_query_unref(query);
   }
+  
+  if (tuner.Tick() && !newSink && ReplaceSink(sinkName))
+    isyslog("gstout: Audio sink replaced, %s", *tuner.Status());
 }
 
-void cGstVideoOutput::EnoughDataCallback(GstElement *source, gpointer data)
+void cGstAudioOutput::NeedDataCallback(GstElement *source, guint size, gpointer data)
 {
-  // Appsrc has enough data, we can pause feeding
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  cMutexLock lock(&self->mutex);
+  
+  // Push what we have now, the rest follows from Play()
+  self->needData = true;
+  self->Feed();
 }
 
-cString cGstVideoOutput::GetStatistics(void)
+void cGstAudioOutput::PadAddedCallback(GstElement *element, GstPad *pad, gpointer data)
+{
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  if (!gst_pad_is_linked(self->primaryPad))
+    gst_pad_link(pad, self->primaryPad);
+}
+
+void cGstAudioOutput::DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data)
+{
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  if (cGstStageTracer::IsDecoder(element))
+    self->trace.AttachDecoder(element);
+}
+
+void cGstAudioOutput::SinkAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data)
+{
+  // Also called for the decoders, which have no buffer-time
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  self->tuner.Configure(element);
+}
+
+GstPadProbeReturn cGstAudioOutput::UnderrunProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  
+  // A buffer that reaches the sink after it should have been played means
+  // the sink has run out of data and played silence. It only counts if the
+  // queue still had data, otherwise the input stalled.
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstClock *clock = gst_element_get_clock(self->pipeline);
+  GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+  bool underrun = false;
+  if (clock && event && GST_BUFFER_PTS_IS_VALID(buffer)) {
+    const GstSegment *segment;
+    gst_event_parse_segment(event, &segment);
+    guint64 running = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (running != GST_CLOCK_TIME_NONE) {
+      gint64 now = gst_clock_get_time(clock) - gst_element_get_base_time(self->pipeline);
+      gint64 due = running + (gint64)(g_atomic_int_get(&self->sinkLatencyMs) + g_atomic_int_get(&self->syncDelayMs)) * GST_MSECOND;
+      if (due < now) {
+        guint level = 0;
+        g_object_get(G_OBJECT(self->queue), "current-level-buffers", &level, NULL);
+        underrun = level > 0;
+      }
+    }
+  }
+  if (event)
+    gst_event_unref(event);
+  if (clock)
+    gst_object_unref(clock);
+  
+  self->tuner.Report(underrun);
+  return GST_PAD_PROBE_OK;
+}
+
+void cGstAudioOutput::EnoughDataCallback(GstElement *source, gpointer data)
+{
+  // Appsrc has enough data, pause feeding until the next need-data
+  cGstAudioOutput *self = (cGstAudioOutput *)data;
+  cMutexLock lock(&self->mutex);
+  
+  self->needData = false;
+}
+
+bool cGstAudioOutput::AddTrack(int Track, int StreamType)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!pipeline || Track <= 0)
+    return false;
+  int slot = -1;
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i] && tracks[i]->Track() == Track)
+      return true;
+    if (!tracks[i] && slot < 0)
+      slot = i;
+  }
+  if (slot < 0) {
+    esyslog("gstout: No free slot for audio track %d", Track);
+    return false;
+  }
+  
+  cGstAudioTrack *track = new cGstAudioTrack(Track, StreamType);
+  GstElement *bin = track->Create(cString::sprintf("audio-track-%d", Track));
+  if (!bin) {
+    delete track;
+    return false;
+  }
+  
+  // Started once linked, as the PiP streams
+  gst_bin_add(GST_BIN(pipeline), bin);
+  if (!track->Link(selector, primaryPad)) {
+    gst_bin_remove(GST_BIN(pipeline), bin);
+    delete track;
+    return false;
+  }
+  gst_element_sync_state_with_parent(bin);
+  tracks[slot] = track;
+  return true;
+}
+
+bool cGstAudioOutput::DelTrack(int Track)
+{
+  cMutexLock lock(&mutex);
+  
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    cGstAudioTrack *track = tracks[i];
+    if (!track || track->Track() != Track)
+      continue;
+    tracks[i] = NULL;
+    if (activeTrack == Track)
+      SelectTrack(0);
+    
+    // An inactive selector pad may be waiting for its running time, the
+    // flush wakes it up before the branch is stopped
+    gst_pad_send_event(track->SelectorPad(), gst_event_new_flush_start());
+    gst_element_set_state(track->Bin(), GST_STATE_NULL);
+    track->Unlink(selector);
+    gst_bin_remove(GST_BIN(pipeline), track->Bin());
+    isyslog("gstout: Audio track %d removed", Track);
+    delete track;
+    return true;
+  }
+  return false;
+}
+
+void cGstAudioOutput::ClearTracks(void)
+{
+  cMutexLock lock(&mutex);
+  
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i])
+      DelTrack(tracks[i]->Track());
+  }
+  activeTrack = 0;
+}
+
+void cGstAudioOutput::PutTrack(int Track, const uchar *Data, int Length)
+{
+  cMutexLock lock(&mutex);
+  
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i] && tracks[i]->Track() == Track) {
+      tracks[i]->Put(Data, Length);
+      tracks[i]->Feed();
+      break;
+    }
+  }
+}
+
+bool cGstAudioOutput::HasTrack(int Track)
+{
+  cMutexLock lock(&mutex);
+  
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i] && tracks[i]->Track() == Track)
+      return true;
+  }
+  return Track == 0;
+}
+
+bool cGstAudioOutput::SelectTrack(int Track)
+{
+  cMutexLock lock(&mutex);
+  
+  GstPad *pad = Track == 0 ? primaryPad : NULL;
+  for (int i = 0; i < GSTTRACK_MAX && !pad; i++) {
+    if (tracks[i] && tracks[i]->Track() == Track)
+      pad = tracks[i]->SelectorPad();
+  }
+  if (!pad || !selector)
+    return false;
+  
+  g_object_set(G_OBJECT(selector), "active-pad", pad, NULL);
+  if (Track != activeTrack)
+    isyslog("gstout: Audio track %d -> %d", activeTrack, Track);
+  activeTrack = Track;
+  return true;
+}
+
+cString cGstAudioOutput::TrackStatus(int Track)
+{
+  cMutexLock lock(&mutex);
+  
+  if (Track == 0)
+    return "decoded";
+  for (int i = 0; i < GSTTRACK_MAX; i++) {
+    if (tracks[i] && tracks[i]->Track() == Track)
+      return cString::sprintf("decoded, %s", *tracks[i]->Status());
+  }
+  return "not decoded";
+}
+
+int64_t cGstAudioOutput::OutPts(void)
+{
+  cMutexLock lock(&mutex);
+  return sync.OutPts();
+}
+
+int cGstAudioOutput::BufferedMs(void)
+{
+  cMutexLock lock(&mutex);
+  return sync.BufferedMs();
+}
+
+void cGstAudioOutput::SetSyncDelay(int DelayMs)
+{
+  cMutexLock lock(&mutex);
+  
+  g_atomic_int_set(&syncDelayMs, DelayMs);
+  // Not every sink (or auto sink bin) supports ts-offset
+  if (HasProperty(sink, "ts-offset"))
+    g_object_set(G_OBJECT(sink), "ts-offset", (gint64)DelayMs * GST_MSECOND, NULL);
+}
+
+int cGstAudioOutput::BufferFill(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!buffer)
+    return 0;
+  int available = buffer->Available();
+  int size = available + buffer->Free();
+  return size ? available * 100 / size : 0;
+}
+
+void cGstAudioOutput::GetMetrics(tGstStreamMetrics &Metrics)
+{
+  // No mutex, buffer and source do not change after Initialize()
+  Metrics.bytesIn = trace.BytesIn();
+  Metrics.bytesOut = trace.BytesOut();
+  Metrics.ringFill = trace.RingFill();
+  Metrics.ringSize = buffer ? buffer->Size() : 0;
+  guint64 level = 0;
+  if (source)
+    g_object_get(G_OBJECT(source), "current-level-bytes", &level, NULL);
+  Metrics.appsrcLevel = level;
+  Metrics.decoder = trace.DecoderName();
+  Metrics.poolHits = pool.Hits();
+  Metrics.poolMisses = pool.Misses();
+  Metrics.poolBytes = pool.MaxBytes();
+}
+
+cString cGstAudioOutput::GetLatency(bool Reset)
+{
+  cString s = trace.Report();
+  if (Reset)
+    trace.Reset();
+  return s;
+}
+
+cString cGstAudioOutput::GetStatistics(void)
 {
   cMutexLock lock(&mutex);
   
@@ -629,8 +1934,1640 @@ cString cGstVideoOutput::GetStatistics(void)
   if (pipeline)
     gst_element_get_state(pipeline, &state, NULL, GST_CLOCK_TIME_NONE);
   
-  return cString::sprintf("Video: %s, Buffer: %d/%d KB",
+  cString level = muted ? cString("muted") : cString::sprintf("%d%%", int(volumeLevel * 100 + 0.5));
+  return cString::sprintf("Audio: %s, Buffer: %d/%d KB, %d ms, Pool: %d KB, %d hits, %d misses, %s, Volume: %s, %s",
+                         gst_element_state_get_name(state),
+                         available / 1024,
+                         (available + free) / 1024,
+                         max(sync.BufferedMs(), 0),
+                         pool.MaxBytes() / 1024,
+                         pool.Hits(),
+                         pool.Misses(),
+                         *tuner.Status(),
+                         *level,
+                         *LoudnessStatus());
+}
+
+// --- cGstVideoOutput -------------------------------------------------------
+
+cGstVideoOutput::cGstVideoOutput(void)
+:trace("Video")
+{
+  pipeline = NULL;
+  source = NULL;
+  decoder = NULL;
+  tee = NULL;
+  queue = NULL;
+  deinterlace = NULL;
+  converter = NULL;
+  scaler = NULL;
+  sink = NULL;
+  bus = NULL;
+  buffer = NULL;
+  playing = false;
+  needData = false;
+  prebuffering = true;
+  keyWait = true;
+  keyWaitStart = 0;
+  replay = 0;
+  suspended = false;
+  syncDelayMs = 0;
+  hwConfigured = false;
+  hwDecoding = false;
+  deinterlaceConfigured = false;
+  deinterlaceConfiguredMethod = dmAuto;
+  newDecoder = NULL;
+  newHwDecoding = false;
+  newDeinterlace = NULL;
+  swapDeinterlace = false;
+  newSink = NULL;
+  tailPending = false;
+  tailCaps = NULL;
+  stream = NULL;
+  streamPad = NULL;
+  streamRemoving = false;
+  streamOverruns = 0;
+  for (int i = 0; i < GSTPIP_MAX; i++)
+    pip[i] = NULL;
+  mixer = NULL;
+  mixerFilter = NULL;
+  mixerWanted = false;
+  frameWidth = 1920;
+  frameHeight = 1080;
+  mainX = mainY = 0;
+  mainWidth = mainHeight = 100;
+  subtitles = NULL;
+  newSubtitles = NULL;
+  swapSubtitles = false;
+  deinterlaceName = "off";
+  progressive = false;
+  deinterlaceLinked = false;
+  directLink = false;
+  memoryType = "system";
+  codec = NULL;
+  codecType = -1;
+  deinterlaceMethod = 0;
+  droppedFrames = 0;
+}
+
+cGstVideoOutput::~cGstVideoOutput()
+{
+  Stop();
+  
+  if (codec)
+    gst_object_unref(codec);
+  if (newDecoder)
+    gst_object_unref(newDecoder);
+  if (newDeinterlace)
+    gst_object_unref(newDeinterlace);
+  if (newSink)
+    gst_object_unref(newSink);
+  gst_caps_replace(&tailCaps, NULL);
+  if (streamPad)
+    gst_object_unref(streamPad);
+  
+  if (pipeline) {
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+  }
+  
+  // Their bins went with the pipeline
+  for (int i = 0; i < GSTPIP_MAX; i++)
+    delete pip[i];
+  delete subtitles;
+  if (newSubtitles) {
+    gst_object_unref(newSubtitles->Bin());
+    delete newSubtitles;
+  }
+  
+  delete buffer;
+}
+
+bool cGstVideoOutput::Initialize(void)
+{
+  cMutexLock lock(&mutex);
+  
+  // Create ring buffer for video data
+  buffer = new cRingBufferLinear(LatencyBytes(RingLatencyMs(), VIDEO_PEAK_KBPS), 0, false);
+  if (!buffer) {
+    esyslog("gstout: Failed to create video buffer");
+    return false;
+  }
+  
+  // Fixed size buffers for appsrc
+  if (!pool.Setup(VIDEO_SLAB_SIZE, PoolBytes(VIDEO_PEAK_KBPS)))
+    return false;
+  
+  // Create pipeline elements
+  source = gst_element_factory_make("appsrc", "video-source");
+  
+  hwConfigured = GstoutConfig.useHardwareDecoding;
+  decoder = CreateDecoder(hwDecoding);
+  if (decoder)
+    SetupDecoderBin();
+  
+  deinterlaceConfigured = GstoutConfig.deinterlace;
+  deinterlaceConfiguredMethod = GstoutConfig.deinterlaceMethod;
+  if (GstoutConfig.deinterlace)
+    deinterlace = CreateDeinterlacer(hwDecoding);
+  if (deinterlace)
+    SetupDeinterlacer();
+  
+  // The display branch is the first tee pad, the stream branch is added
+  // on a second one
+  tee = gst_element_factory_make("tee", "video-tee");
+  if (HasProperty(tee, "allow-not-linked"))
+    g_object_set(G_OBJECT(tee), "allow-not-linked", TRUE, NULL);
+  queue = CreateLeakyQueue("video-queue");
+  converter = gst_element_factory_make("videoconvert", "video-converter");
+  scaler = gst_element_factory_make("videoscale", "video-scaler");
+  sink = CreateSink(GstoutConfig.videoSink, "video-sink");
+  
+  if (!source || !decoder || !tee || !queue || !converter || !scaler || !sink) {
+    esyslog("gstout: Failed to create video pipeline elements");
+    return false;
+  }
+  
+  // Create pipeline
+  pipeline = gst_pipeline_new("video-pipeline");
+  if (!pipeline) {
+    esyslog("gstout: Failed to create video pipeline");
+    return false;
+  }
+  
+  // Add elements to pipeline
+  gst_bin_add_many(GST_BIN(pipeline), source, decoder, tee, queue, NULL);
+  if (deinterlace)
+    gst_bin_add(GST_BIN(pipeline), deinterlace);
+  gst_bin_add_many(GST_BIN(pipeline), converter, scaler, sink, NULL);
+  
+  // Link elements
+  if (!gst_element_link(source, decoder)) {
+    esyslog("gstout: Failed to link video source and decoder");
+    return false;
+  }
+  
+  if (!gst_element_link(tee, queue)) {
+    esyslog("gstout: Failed to link video tee and queue");
+    return false;
+  }
+  
+  // Progressive content bypasses the deinterlacer
+  GstPad *queuePad = gst_element_get_static_pad(queue, "src");
+  gst_pad_add_probe(queuePad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, CapsProbe, this, NULL);
+  gst_object_unref(queuePad);
+  
+  // Start with the converters, LinkDecoderPad() drops them once the
+  // decoder caps are known to be accepted by the sink
+  if (!LinkTail(false)) {
+    esyslog("gstout: Failed to link video pipeline");
+    return false;
+  }
+  
+  // vaapidecodebin has an always src pad and never emits pad-added
+  GstPad *decoderPad = gst_element_get_static_pad(decoder, "src");
+  if (decoderPad) {
+    LinkDecoderPad(decoderPad);
+    gst_object_unref(decoderPad);
+  }
+  
+  // Configure appsrc
+  ConfigureAppsrc(source, VIDEO_PEAK_KBPS);
+  
+  // Connect appsrc callbacks
+  g_signal_connect(source, "need-data", G_CALLBACK(NeedDataCallback), this);
+  g_signal_connect(source, "enough-data", G_CALLBACK(EnoughDataCallback), this);
+  
+  // Latency tracing, decoders are attached in SetupDecoder()
+  trace.SetPipeline(pipeline);
+  trace.AttachSource(source);
+  trace.AttachSink(sink);
+  
+  // Set up bus
+  bus = gst_element_get_bus(pipeline);
+  gst_bus_add_watch(bus, BusCallback, this);
+  
+  streamName = GstoutConfig.videoStream;
+  if (*streamName)
+    AddStream();
+  
+  sinkName = GstoutConfig.videoSink;
+  isyslog("gstout: Video pipeline created (sink: %s, hwdec: %s, deinterlace: %s)",
+          *sinkName,
+          hwDecoding ? "yes" : "no",
+          deinterlaceName);
+  
+  return true;
+}
+
+void cGstVideoOutput::Start(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (pipeline && !suspended) {
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    playing = true;
+    isyslog("gstout: Video pipeline started");
+  }
+}
+
+void cGstVideoOutput::Stop(void)
+{
+  // The state change joins the streaming threads, which may wait for the
+  // mutex (need-data, tail and decoder swaps, caps changes), so it is made
+  // without it
+  {
+    cMutexLock lock(&mutex);
+    if (!pipeline)
+      return;
+    playing = false;
+  }
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  isyslog("gstout: Video pipeline stopped");
+}
+
+void cGstVideoOutput::Pause(bool On)
+{
+  // Changed without the mutex, see Stop()
+  {
+    cMutexLock lock(&mutex);
+    if (!pipeline || !playing)
+      return;
+  }
+  gst_element_set_state(pipeline, On ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+}
+
+void cGstVideoOutput::Suspend(bool On)
+{
+  // Called by the output with its mutex held, never twice at a time. The
+  // state change joins the streaming threads, which may wait for this
+  // mutex in need-data, so it is made without it.
+  if (!pipeline || On == suspended)
+    return;
+  
+  if (On) {
+    {
+      cMutexLock lock(&mutex);
+      suspended = true;
+      playing = false;
+      Clear();
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    isyslog("gstout: Video pipeline suspended (audio only)");
+  }
+  else {
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    {
+      cMutexLock lock(&mutex);
+      suspended = false;
+      playing = true;
+    }
+    isyslog("gstout: Video pipeline resumed");
+  }
+}
+
+cString cGstVideoOutput::Reconfigure(void)
+{
+  cString result = "";
+  bool swapDecoder, swapTail;
+  {
+    cMutexLock lock(&mutex);
+    
+    if (!pipeline)
+      return "Video: not running";
+    if (newDecoder || swapDeinterlace || newSink)
+      return "Video: switch pending";
+    
+    // New elements are created here, so one that isn't available leaves the
+    // running pipeline alone
+    bool hw = hwDecoding;
+    if (GstoutConfig.useHardwareDecoding != hwConfigured) {
+      hwConfigured = GstoutConfig.useHardwareDecoding;
+      newDecoder = CreateDecoder(newHwDecoding);
+      if (newDecoder)
+        gst_object_ref_sink(newDecoder);
+      if (newDecoder && newHwDecoding == hwDecoding) {
+        // No VAAPI, the software decoder stays
+        gst_object_unref(newDecoder);
+        newDecoder = NULL;
+      }
+      else if (newDecoder) {
+        hw = newHwDecoding;
+        result = cString::sprintf("%s, decoder %s", *result, GST_OBJECT_NAME(gst_element_get_factory(newDecoder)));
+      }
+      else
+        result = cString::sprintf("%s, failed to create decoder", *result);
+    }
+    
+    // The automatic and VAAPI methods depend on the decoder
+    bool hwDependent = GstoutConfig.deinterlaceMethod == dmAuto || GstoutConfig.deinterlaceMethod == dmVaapi;
+    if (GstoutConfig.deinterlace != deinterlaceConfigured ||
+        (GstoutConfig.deinterlace && (GstoutConfig.deinterlaceMethod != deinterlaceConfiguredMethod || (hw != hwDecoding && hwDependent)))) {
+      deinterlaceConfigured = GstoutConfig.deinterlace;
+      deinterlaceConfiguredMethod = GstoutConfig.deinterlaceMethod;
+      newDeinterlace = GstoutConfig.deinterlace ? CreateDeinterlacer(hw) : NULL;
+      if (newDeinterlace)
+        gst_object_ref_sink(newDeinterlace);
+      if (!GstoutConfig.deinterlace)
+        deinterlaceName = "off";
+      swapDeinterlace = true;
+      result = cString::sprintf("%s, deinterlacer %s", *result, deinterlaceName);
+    }
+    
+    if (strcmp(sinkName, GstoutConfig.videoSink) != 0) {
+      newSink = CreateSink(GstoutConfig.videoSink, NULL);
+      if (newSink) {
+        gst_object_ref_sink(newSink);
+        result = cString::sprintf("%s, sink %s -> %s", *result, *sinkName, GstoutConfig.videoSink);
+        sinkName = GstoutConfig.videoSink;
+      }
+      else
+        result = cString::sprintf("%s, failed to create sink \"%s\"", *result, GstoutConfig.videoSink);
+    }
+    
+    // A running stream branch is replaced once it is removed
+    if (strcmp(streamName, GstoutConfig.videoStream) != 0) {
+      streamName = GstoutConfig.videoStream;
+      result = cString::sprintf("%s, stream %s", *result, *streamName ? *streamName : "off");
+      if (stream)
+        RemoveStream();
+      else if (*streamName)
+        AddStream();
+    }
+    
+    if (!**result)
+      return "Video: unchanged";
+    result = cString::sprintf("Video:%s", *result + 1);
+    isyslog("gstout: %s", *result);
+    swapDecoder = newDecoder != NULL;
+    swapTail = swapDeinterlace || newSink;
+  }
+    
+  // Each probe is called right away (in this thread, so without the mutex,
+  // see SwapDecoder()) if no buffer is passing
+  if (swapDecoder) {
+    GstPad *pad = gst_element_get_static_pad(source, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_IDLE, DecoderSwapProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+  if (swapTail)
+    RelinkTail(NULL);
+  return result;
+}
+
+GstElement *cGstVideoOutput::CreateDecoder(bool &HwDecoding)
+{
+  // Use hardware decoder if available and configured
+  GstElement *element = NULL;
+  HwDecoding = false;
+  if (GstoutConfig.useHardwareDecoding) {
+    element = gst_element_factory_make("vaapidecodebin", "video-decoder");
+    if (!element)
+      isyslog("gstout: Hardware decoder not available, using software decoder");
+    else
+      HwDecoding = true;
+  }
+  if (!element)
+    element = gst_element_factory_make("decodebin", "video-decoder");
+  
+  if (element) {
+    // Tune the codec specific decoder as soon as decodebin plugs it
+    g_signal_connect(element, "deep-element-added", G_CALLBACK(DeepElementAddedCallback), this);
+    g_signal_connect(element, "pad-added", G_CALLBACK(PadAddedCallback), this);
+  }
+  return element;
+}
+
+void cGstVideoOutput::SetupDecoderBin(void)
+{
+  // vaapidecodebin creates its decoder up front
+  GstIterator *it = gst_bin_iterate_recurse(GST_BIN(decoder));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+    SetupDecoder(GST_ELEMENT(g_value_get_object(&item)));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+GstPadProbeReturn cGstVideoOutput::DecoderSwapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  self->SwapDecoder();
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void cGstVideoOutput::SwapDecoder(void)
+{
+  // Appsrc's src pad is blocked. The old decoder's streaming threads may be
+  // waiting for the mutex (pad-added, deep-element-added), so it is stopped
+  // before taking it
+  gst_element_set_state(decoder, GST_STATE_NULL);
+  
+  cMutexLock lock(&mutex);
+  
+  // Removing also unlinks it from appsrc and the queue
+  gst_bin_remove(GST_BIN(pipeline), decoder);
+  if (codec) {
+    gst_object_unref(codec);
+    codec = NULL;
+    codecType = -1;
+  }
+  
+  decoder = newDecoder;
+  newDecoder = NULL;
+  hwDecoding = newHwDecoding;
+  gst_bin_add(GST_BIN(pipeline), decoder);
+  gst_object_unref(decoder);
+  SetupDecoderBin();
+  if (!gst_element_link(source, decoder))
+    esyslog("gstout: Failed to link video source and decoder");
+  gst_element_sync_state_with_parent(decoder);
+  
+  // The queue still holds frames of the old decoder, decoding restarts
+  // with the next keyframe
+  GstPad *decoderPad = gst_element_get_static_pad(decoder, "src");
+  if (decoderPad) {
+    LinkDecoderPad(decoderPad);
+    gst_object_unref(decoderPad);
+  }
+  isyslog("gstout: Video decoder switched to %s", GST_OBJECT_NAME(gst_element_get_factory(decoder)));
+}
+
+void cGstVideoOutput::RelinkTail(GstCaps *Caps)
+{
+  cMutexLock lock(&mutex);
+  
+  // The tail runs in the queue's streaming thread, so it is only touched
+  // while the queue's src pad is idle (right away if nothing is flowing)
+  if (Caps)
+    gst_caps_replace(&tailCaps, Caps);
+  if (tailPending)
+    return;
+  tailPending = true;
+  GstPad *pad = gst_element_get_static_pad(queue, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_IDLE, TailProbe, this, NULL);
+  gst_object_unref(pad);
+}
+
+GstPadProbeReturn cGstVideoOutput::TailProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  self->SwapTail(pad);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void cGstVideoOutput::SwapTail(GstPad *Pad)
+{
+  cMutexLock lock(&mutex);
+  
+  tailPending = false;
+  bool swapped = swapDeinterlace || newSink || swapSubtitles || mixerWanted != (mixer != NULL) ||
+                 deinterlaceLinked != (deinterlace && !progressive);
+  
+  if (swapDeinterlace) {
+    // Removing unlinks it from the queue and the tail
+    if (deinterlace) {
+      gst_element_set_state(deinterlace, GST_STATE_NULL);
+      gst_bin_remove(GST_BIN(pipeline), deinterlace);
+    }
+    deinterlace = newDeinterlace;
+    newDeinterlace = NULL;
+    swapDeinterlace = false;
+    deinterlaceLinked = false;
+    if (deinterlace) {
+      // LinkTail() puts it behind the queue unless the content is progressive
+      gst_bin_add(GST_BIN(pipeline), deinterlace);
+      gst_object_unref(deinterlace);
+      SetupDeinterlacer();
+      gst_element_sync_state_with_parent(deinterlace);
+      ApplyOverloadLevel(qos.Level());
+    }
+    isyslog("gstout: Video deinterlacer switched to %s", deinterlace ? deinterlaceName : "off");
+  }
+  
+  if (newSink) {
+    gst_element_set_state(sink, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), sink);
+    sink = newSink;
+    newSink = NULL;
+    gst_object_set_name(GST_OBJECT(sink), "video-sink");
+    gst_bin_add(GST_BIN(pipeline), sink);
+    gst_object_unref(sink);
+    gst_element_sync_state_with_parent(sink);
+    trace.AttachSink(sink);
+    if (HasProperty(sink, "ts-offset"))
+      g_object_set(G_OBJECT(sink), "ts-offset", (gint64)syncDelayMs * GST_MSECOND, NULL);
+    isyslog("gstout: Video sink switched to %s", *sinkName);
+  }
+  
+  if (swapSubtitles) {
+    // Removing unlinks it, LinkTail() puts the new one in its place
+    if (subtitles) {
+      gst_element_set_state(subtitles->Bin(), GST_STATE_NULL);
+      gst_bin_remove(GST_BIN(pipeline), subtitles->Bin());
+      delete subtitles;
+    }
+    subtitles = newSubtitles;
+    newSubtitles = NULL;
+    swapSubtitles = false;
+    if (subtitles) {
+      gst_bin_add(GST_BIN(pipeline), subtitles->Bin());
+      gst_object_unref(subtitles->Bin());
+      gst_element_sync_state_with_parent(subtitles->Bin());
+    }
+    isyslog("gstout: Video subtitles %s", subtitles ? "inserted" : "removed");
+  }
+  
+  // The mixer goes in with the first secondary stream and out with the
+  // last, LinkTail() routes the live picture through it
+  if (mixerWanted && !mixer)
+    CreateMixer();
+  else if (!mixerWanted && mixer)
+    RemoveMixer();
+  
+  // New decoder caps, or the current ones for a new deinterlacer or sink
+  GstCaps *caps = tailCaps ? gst_caps_ref(tailCaps) : gst_pad_get_current_caps(Pad);
+  gst_caps_replace(&tailCaps, NULL);
+  bool direct = !mixer && CanLinkDirect(caps);
+  if (caps)
+    gst_caps_unref(caps);
+  if (direct == directLink && !swapped)
+    return;
+  
+  dsyslog("gstout: Relinking video tail (%s)", direct ? "direct" : mixer ? "mixed" : "converted");
+  if (!LinkTail(direct)) {
+    esyslog("gstout: Failed to relink video pipeline, using converters");
+    if (!LinkTail(false))
+      esyslog("gstout: Failed to link video sink %s", *sinkName);
+  }
+}
+
+void cGstVideoOutput::AddStream(void)
+{
+  // Caller must hold mutex
+  GError *error = NULL;
+  GstElement *encoder = gst_parse_bin_from_description(streamName, TRUE, &error);
+  if (error || !encoder) {
+    esyslog("gstout: Invalid video stream '%s': %s", *streamName, error ? error->message : "unknown error");
+    if (error)
+      g_error_free(error);
+    if (encoder)
+      gst_object_unref(encoder);
+    return;
+  }
+  
+  // Its own leaky queue, a slow encoder or network never stalls the display
+  GstElement *streamQueue = CreateLeakyQueue("stream-queue");
+  GstElement *streamConverter = gst_element_factory_make("videoconvert", "stream-converter");
+  stream = gst_bin_new("video-stream");
+  gst_bin_add(GST_BIN(stream), encoder);
+  if (streamQueue)
+    gst_bin_add(GST_BIN(stream), streamQueue);
+  if (streamConverter)
+    gst_bin_add(GST_BIN(stream), streamConverter);
+  if (!streamQueue || !streamConverter || !gst_element_link_many(streamQueue, streamConverter, encoder, NULL)) {
+    esyslog("gstout: Failed to create video stream '%s'", *streamName);
+    gst_object_unref(stream);
+    stream = NULL;
+    return;
+  }
+  GstPad *pad = gst_element_get_static_pad(streamQueue, "sink");
+  gst_element_add_pad(stream, gst_ghost_pad_new("sink", pad));
+  gst_object_unref(pad);
+  g_signal_connect(streamQueue, "overrun", G_CALLBACK(OverrunCallback), this);
+  
+  // Linked once running, so the tee never pushes into a flushing pad
+  gst_bin_add(GST_BIN(pipeline), stream);
+  gst_element_sync_state_with_parent(stream);
+#if GST_CHECK_VERSION(1, 20, 0)
+  streamPad = gst_element_request_pad_simple(tee, "src_%u");
+#else
+  streamPad = gst_element_get_request_pad(tee, "src_%u");
+#endif
+  pad = gst_element_get_static_pad(stream, "sink");
+  bool linked = streamPad && GST_PAD_LINK_SUCCESSFUL(gst_pad_link(streamPad, pad));
+  gst_object_unref(pad);
+  if (!linked) {
+    esyslog("gstout: Failed to link video stream '%s'", *streamName);
+    if (streamPad) {
+      gst_element_release_request_pad(tee, streamPad);
+      gst_object_unref(streamPad);
+      streamPad = NULL;
+    }
+    gst_element_set_state(stream, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), stream);
+    stream = NULL;
+    return;
+  }
+  isyslog("gstout: Video stream started (%s)", *streamName);
+}
+
+void cGstVideoOutput::RemoveStream(void)
+{
+  // Caller must hold mutex. The branch is taken out while the tee's pad
+  // is idle, a pending removal picks up the latest streamName
+  if (!streamRemoving) {
+    streamRemoving = true;
+    gst_pad_add_probe(streamPad, GST_PAD_PROBE_TYPE_IDLE, StreamProbe, this, NULL);
+  }
+}
+
+GstPadProbeReturn cGstVideoOutput::StreamProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  cMutexLock lock(&self->mutex);
+  
+  GstPad *streamSink = gst_element_get_static_pad(self->stream, "sink");
+  gst_pad_unlink(pad, streamSink);
+  gst_object_unref(streamSink);
+  gst_element_release_request_pad(self->tee, pad);
+  gst_object_unref(self->streamPad);
+  self->streamPad = NULL;
+  
+  gst_element_set_state(self->stream, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(self->pipeline), self->stream);
+  self->stream = NULL;
+  self->streamRemoving = false;
+  isyslog("gstout: Video stream stopped");
+  
+  if (*self->streamName)
+    self->AddStream();
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void cGstVideoOutput::OverrunCallback(GstElement *queue, gpointer data)
+{
+  // The leaky queue drops the oldest buffer
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  g_atomic_int_inc(&self->streamOverruns);
+}
+
+void cGstVideoOutput::Reset(void)
+{
+  // Restarted without the mutex, see Stop()
+  {
+    cMutexLock lock(&mutex);
+    Clear();
+    if (!pipeline || suspended)
+      return;
+  }
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+}
+
+bool cGstVideoOutput::Play(const uchar *Data, int Length)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!buffer || !playing)
+    return false;
+  
+  int free = buffer->Free();
+  if (free < Length)
+    return false;
+  
+  // Keep the buffered duration inside the latency window
+  if (sync.BufferedMs() > RingLatencyMs())
+    return false;
+  
+  int written = buffer->Put(Data, Length);
+  if (written > 0) {
+    sync.Put(Data, written);
+    index.Put(Data, written);
+    trace.Put(written);
+    
+    int length;
+    const uchar *params = index.TakeParams(length);
+    if (params)
+      paramCache.Put(channelId, index.Codec(), params, length);
+  }
+  
+  Feed();
+  
+  return written == Length;
+}
+
+void cGstVideoOutput::Clear(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (buffer)
+    buffer->Clear();
+  sync.Clear();
+  index.Clear();
+  trace.Clear();
+  trace.Zap();
+  prebuffering = true;
+  keyWait = true;
+  keyWaitStart = 0;
+  if (subtitles)
+    subtitles->Clear();
+}
+
+bool cGstVideoOutput::SkipToKey(void)
+{
+  // Caller must hold mutex
+  if (!buffer->Available())
+    return false;
+  
+  // Streams the index doesn't recognize go to the decoder as they are
+  int codec = index.Codec();
+  if (codec < 0) {
+    keyWait = false;
+    return true;
+  }
+  
+  // With the channel's parameter sets at hand any intra picture will do,
+  // or the first picture at all where corrupt pictures are wanted
+  int paramsLength = 0;
+  const uchar *params = paramCache.Get(channelId, codec, paramsLength);
+  bool anyPicture = GstoutConfig.decoder[codec].outputCorrupt || (GstoutConfig.zapFirstPicture && params);
+  
+  if (!keyWaitStart)
+    keyWaitStart = cTimeMs::Now();
+  
+  int skip = anyPicture ? 0 : index.ToKey(params != NULL);
+  if (skip < 0) {
+    if (cTimeMs::Now() - keyWaitStart >= VIDEO_KEYWAIT_MS) {
+      dsyslog("gstout: No video keyframe within %d ms, decoding from here", VIDEO_KEYWAIT_MS);
+      keyWait = false;
+      return true;
+    }
+    // Nothing buffered so far can be decoded
+    skip = buffer->Available();
+  }
+  
+  while (skip > 0) {
+    int count = 0;
+    if (!buffer->Get(count) || count <= 0)
+      break;
+    count = min(count, skip);
+    buffer->Del(count);
+    sync.Del(count);
+    index.Skip(count);
+    trace.Skipped(count);
+    skip -= count;
+  }
+  
+  if (skip > 0 || (!anyPicture && index.ToKey(params != NULL) != 0))
+    return false;
+  
+  if (params && (anyPicture || !index.KeyParams()))
+    PushParams(params, paramsLength);
+  keyWait = false;
+  return true;
+}
+
+void cGstVideoOutput::PushParams(const uchar *Data, int Length)
+{
+  // Caller must hold mutex, the parameter sets go in a PES packet of their
+  // own without PTS
+  uchar pes[9 + GSTINDEX_MAXPARAMS];
+  int length = 3 + Length;
+  pes[0] = 0x00;
+  pes[1] = 0x00;
+  pes[2] = 0x01;
+  pes[3] = 0xE0;
+  pes[4] = length >> 8;
+  pes[5] = length & 0xFF;
+  pes[6] = 0x80;
+  pes[7] = 0x00;
+  pes[8] = 0x00;
+  memcpy(pes + 9, Data, Length);
+  
+  GstBuffer *gstBuffer = pool.Get(pes, 9 + Length);
+  if (!gstBuffer)
+    return;
+  GstFlowReturn ret;
+  g_signal_emit_by_name(source, "push-buffer", gstBuffer, &ret);
+  gst_buffer_unref(gstBuffer);
+  paramCache.Injected();
+  dsyslog("gstout: Injected %d bytes of cached %s parameter sets for channel %s", Length, cGstoutConfig::CodecName(index.Codec()), *channelId);
+}
+
+void cGstVideoOutput::SetChannel(const char *ChannelId)
+{
+  cMutexLock lock(&mutex);
+  channelId = ChannelId;
+}
+
+void cGstVideoOutput::Feed(void)
+{
+  // Caller must hold mutex
+  if (!buffer || !source || !needData)
+    return;
+  
+  // After a clear, decoding starts at the first random access point
+  // instead of the decoder discarding everything in front of it
+  if (keyWait && !SkipToKey())
+    return;
+  
+  if (prebuffering) {
+    // After a clear, hold back data until the minimum latency is buffered
+    // (or the ring is half full, for streams without usable PTS)
+    int buffered = sync.BufferedMs();
+    if (buffered >= 0 && buffered < min(GstoutConfig.syncMinLatency, RingLatencyMs()) && buffer->Available() < buffer->Free())
+      return;
+    prebuffering = false;
+  }
+  
+  while (needData) {
+    int count = 0;
+    uchar *readData = buffer->Get(count);
+    if (!readData || count <= 0)
+      break;
+    
+    // If the pool is exhausted the data stays in the ring, ProcessFeed()
+    // picks it up again
+    GstBuffer *gstBuffer = pool.Get(readData, count);
+    if (!gstBuffer)
+      break;
+    count = gst_buffer_get_size(gstBuffer);
+    
+    trace.Pushed(count);
+    GstFlowReturn ret;
+    g_signal_emit_by_name(source, "push-buffer", gstBuffer, &ret);
+    gst_buffer_unref(gstBuffer);
+    
+    buffer->Del(count);
+    sync.Del(count);
+    index.Del(count);
+    
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+}
+
+void cGstVideoOutput::ProcessFeed(void)
+{
+  cMutexLock lock(&mutex);
+  Feed();
+}
+
+void cGstVideoOutput::NeedDataCallback(GstElement *source, guint size, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  cMutexLock lock(&self->mutex);
+  
+  // Push what we have now, the rest follows from Play()
+  self->needData = true;
+  self->Feed();
+}
+
+void cGstVideoOutput::DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  self->SetupDecoder(element);
+}
+
+void cGstVideoOutput::SetupDecoder(GstElement *element)
+{
+  if (cGstStageTracer::IsDecoder(element))
+    trace.AttachDecoder(element);
+  
+  int type = DecoderCodec(element);
+  if (type < 0)
+    return;
+  
+  const tGstDecoderTuning &tuning = GstoutConfig.decoder[type];
+  bool lowLatency = GstoutConfig.decoderMode == gdLowLatency ||
+                    (GstoutConfig.decoderMode == gdAuto && !g_atomic_int_get(&replay));
+  
+  // Frame threading adds a frame of delay per thread, slice threading doesn't
+  int threading = tuning.threading;
+  if (threading == gtAuto)
+    threading = lowLatency ? gtSlice : gtFrame;
+  
+  if (HasProperty(element, "thread-type"))
+    g_object_set(G_OBJECT(element), "thread-type", threading, NULL);
+  if (HasProperty(element, "max-threads"))
+    g_object_set(G_OBJECT(element), "max-threads", tuning.threads, NULL);
+  if (HasProperty(element, "output-corrupt"))
+    g_object_set(G_OBJECT(element), "output-corrupt", (gboolean)(tuning.outputCorrupt || GstoutConfig.zapFirstPicture), NULL);
+  if (HasProperty(element, "skip-frame"))
+    g_object_set(G_OBJECT(element), "skip-frame", tuning.skipFrame, NULL);
+  if (HasProperty(element, "qos"))
+    g_object_set(G_OBJECT(element), "qos", (gboolean)tuning.qos, NULL);
+  
+  // Remember the decoder for overload handling
+  cMutexLock lock(&mutex);
+  if (codec)
+    gst_object_unref(codec);
+  codec = GST_ELEMENT(gst_object_ref(element));
+  codecType = type;
+  
+  GstPad *pad = gst_element_get_static_pad(element, "sink");
+  if (pad) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, DropProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+  ApplyOverloadLevel(qos.Level());
+  
+  isyslog("gstout: Decoder %s set up for %s (%s threading, %d threads)",
+          GST_OBJECT_NAME(element),
+          lowLatency ? "low latency" : "throughput",
+          threading == gtSlice ? "slice" : "frame",
+          tuning.threads);
+}
+
+void cGstVideoOutput::PadAddedCallback(GstElement *element, GstPad *pad, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  self->LinkDecoderPad(pad);
+}
+
+void cGstVideoOutput::LinkDecoderPad(GstPad *pad)
+{
+  GstPad *teePad = gst_element_get_static_pad(tee, "sink");
+  if (!gst_pad_is_linked(teePad)) {
+    // Fixed caps once decodebin exposes the pad, possible caps for
+    // vaapidecodebin's always pad
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+      caps = gst_pad_query_caps(pad, NULL);
+    
+    memoryType = "system";
+    GstCapsFeatures *features = caps && gst_caps_get_size(caps) > 0 ? gst_caps_get_features(caps, 0) : NULL;
+    if (features) {
+      if (gst_caps_features_contains(features, "memory:DMABuf"))
+        memoryType = "DMABuf";
+      else if (gst_caps_features_contains(features, "memory:VAMemory"))
+        memoryType = "VAMemory";
+      else if (gst_caps_features_contains(features, "memory:VASurface"))
+        memoryType = "VASurface";
+    }
+    
+    // The converters are dropped or added as needed
+    RelinkTail(caps);
+    if (caps)
+      gst_caps_unref(caps);
+    
+    if (GST_PAD_LINK_FAILED(gst_pad_link(pad, teePad)))
+      esyslog("gstout: Failed to link video decoder");
+    else
+      isyslog("gstout: Video decoder linked (%s memory, %s)", memoryType, directLink ? "direct" : "converted");
+  }
+  gst_object_unref(teePad);
+}
+
+bool cGstVideoOutput::CanLinkDirect(GstCaps *caps)
+{
+  if (!caps)
+    return false;
+  
+  // The CPU and GL deinterlacers need the converters in front of the sink,
+  // a bypassed one doesn't count
+  bool deinterlacing = deinterlace && !progressive;
+  if (deinterlacing && !HasProperty(deinterlace, "deinterlace-mode"))
+    return false;
+  
+  // vaapipostproc negotiates memory and format with the sink on its own
+  if (deinterlacing)
+    return true;
+  
+  GstPad *sinkPad = gst_element_get_static_pad(sink, "sink");
+  if (!sinkPad)
+    return false;
+  
+  GstCaps *sinkCaps = gst_pad_query_caps(sinkPad, NULL);
+  bool direct = sinkCaps && gst_caps_can_intersect(caps, sinkCaps);
+  if (direct && gst_caps_is_fixed(caps))
+    direct = gst_pad_query_accept_caps(sinkPad, caps);
+  
+  if (sinkCaps)
+    gst_caps_unref(sinkCaps);
+  gst_object_unref(sinkPad);
+  return direct;
+}
+
+bool cGstVideoOutput::LinkTail(bool Direct)
+{
+  // Progressive content goes from the queue straight on, the deinterlacer
+  // stays in the pipeline unlinked until interlaced content arrives
+  GstElement *heads[] = { queue, deinterlace };
+  for (int i = 0; i < 2; i++) {
+    if (!heads[i])
+      continue;
+    if (subtitles)
+      gst_element_unlink(heads[i], subtitles->Bin());
+    gst_element_unlink(heads[i], sink);
+    gst_element_unlink(heads[i], converter);
+  }
+  GstElement *last = queue;
+  deinterlaceLinked = false;
+  if (deinterlace) {
+    gst_element_unlink(queue, deinterlace);
+    if (!progressive) {
+      if (!gst_element_link(queue, deinterlace))
+        return false;
+      last = deinterlace;
+      deinterlaceLinked = true;
+    }
+  }
+  
+  // The subtitle overlay comes first, so it only covers the live picture
+  // in a mosaic
+  if (subtitles) {
+    if (!gst_element_link(last, subtitles->Bin()))
+      return false;
+    last = subtitles->Bin();
+  }
+  
+  // Unlinking elements that aren't linked is a no-op, the mixer's request
+  // pad for the live picture is released with it
+  gst_element_unlink(last, sink);
+  gst_element_unlink_many(last, converter, scaler, sink, NULL);
+  if (mixer) {
+    gst_element_unlink(converter, mixer);
+    gst_element_unlink(mixer, sink);
+    if (mixerFilter)
+      gst_element_unlink_many(mixer, mixerFilter, scaler, NULL);
+  }
+  
+  if (mixer) {
+    // The mixer takes raw system memory, GL mixers output GL memory for
+    // glimagesink
+    bool ok = gst_element_link_many(last, converter, mixer, NULL) &&
+              (mixerFilter ? gst_element_link_many(mixer, mixerFilter, scaler, sink, NULL) :
+                             gst_element_link(mixer, sink));
+    directLink = false;
+    if (ok) {
+      for (int i = 0; i < GSTPIP_MAX; i++) {
+        if (pip[i] && !pip[i]->Linked() && pip[i]->Link(mixer))
+          gst_element_sync_state_with_parent(pip[i]->Bin());
+      }
+      ApplyLayout();
+    }
+    return ok;
+  }
+  
+  bool ok = Direct ? gst_element_link(last, sink) :
+                     gst_element_link_many(last, converter, scaler, sink, NULL);
+  directLink = Direct && ok;
+  return ok;
+}
+
+bool cGstVideoOutput::SetSubtitles(int Type, int Page)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!pipeline)
+    return false;
+  cGstSubtitleOverlay *current = swapSubtitles ? newSubtitles : subtitles;
+  if (current ? current->Type() == Type && current->Page() == Page : Type < 0)
+    return true;
+  
+  if (newSubtitles) {
+    // Replaced before it was swapped in
+    gst_object_unref(newSubtitles->Bin());
+    delete newSubtitles;
+    newSubtitles = NULL;
+  }
+  if (Type >= 0) {
+    GstPad *pad = gst_element_get_static_pad(queue, "src");
+    cGstSubtitleOverlay *overlay = new cGstSubtitleOverlay(Type, Page, pad);
+    gst_object_unref(pad);
+    GstElement *bin = overlay->Create("video-subtitles");
+    if (!bin) {
+      delete overlay;
+      return false;
+    }
+    gst_object_ref_sink(bin);
+    newSubtitles = overlay;
+  }
+  swapSubtitles = true;
+  RelinkTail(NULL);
+  return true;
+}
+
+void cGstVideoOutput::PutSubtitle(const uchar *Data, int Length)
+{
+  cMutexLock lock(&mutex);
+  
+  // Dropped while a new overlay is waiting to be swapped in
+  if (subtitles && !swapSubtitles)
+    subtitles->Put(Data, Length);
+}
+
+cString cGstVideoOutput::SubtitleStatus(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (swapSubtitles)
+    return "Subtitles: switching";
+  return subtitles ? subtitles->Status() : cString("Subtitles: off");
+}
+
+void cGstVideoOutput::CreateMixer(void)
+{
+  // Caller must hold mutex
+  mixer = gst_element_factory_make(GstoutConfig.pipMixer, "video-mixer");
+  bool gl = strncmp(GstoutConfig.pipMixer, "gl", 2) == 0;
+  mixerFilter = gl ? NULL : gst_element_factory_make("capsfilter", "video-mixer-caps");
+  if (!mixer || (!gl && !mixerFilter)) {
+    esyslog("gstout: Failed to create video mixer %s", GstoutConfig.pipMixer);
+    if (mixer)
+      gst_object_unref(mixer);
+    if (mixerFilter)
+      gst_object_unref(mixerFilter);
+    mixer = mixerFilter = NULL;
+    mixerWanted = false;
+    return;
+  }
+  
+  // Black around a mosaic, output is timed by the live picture and a
+  // stream that hasn't started yet doesn't hold it up
+  if (HasProperty(mixer, "background"))
+    gst_util_set_object_arg(G_OBJECT(mixer), "background", "black");
+  if (HasProperty(mixer, "start-time-selection"))
+    gst_util_set_object_arg(G_OBJECT(mixer), "start-time-selection", "first");
+  if (HasProperty(mixer, "ignore-inactive-pads"))
+    g_object_set(G_OBJECT(mixer), "ignore-inactive-pads", TRUE, NULL);
+  
+  gst_bin_add(GST_BIN(pipeline), mixer);
+  gst_element_sync_state_with_parent(mixer);
+  if (mixerFilter) {
+    gst_bin_add(GST_BIN(pipeline), mixerFilter);
+    gst_element_sync_state_with_parent(mixerFilter);
+  }
+  isyslog("gstout: Video mixer %s inserted", GstoutConfig.pipMixer);
+}
+
+void cGstVideoOutput::RemoveMixer(void)
+{
+  // Caller must hold mutex, the secondary streams are gone
+  gst_element_set_state(mixer, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(pipeline), mixer);
+  if (mixerFilter) {
+    gst_element_set_state(mixerFilter, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), mixerFilter);
+  }
+  mixer = mixerFilter = NULL;
+  isyslog("gstout: Video mixer removed");
+}
+
+void cGstVideoOutput::ApplyLayout(void)
+{
+  // Caller must hold mutex
+  if (!mixer)
+    return;
+  
+  // Square pixels, the live picture is stretched to its display size
+  if (mixerFilter) {
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "width", G_TYPE_INT, frameWidth,
+                                        "height", G_TYPE_INT, frameHeight,
+                                        "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                        NULL);
+    g_object_set(G_OBJECT(mixerFilter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+  }
+  
+  GstPad *src = gst_element_get_static_pad(converter, "src");
+  GstPad *pad = gst_pad_get_peer(src);
+  if (pad) {
+    g_object_set(G_OBJECT(pad),
+                 "xpos", frameWidth * mainX / 100,
+                 "ypos", frameHeight * mainY / 100,
+                 "width", (frameWidth * mainWidth / 100) & ~1,
+                 "height", (frameHeight * mainHeight / 100) & ~1,
+                 "zorder", 0u,
+                 NULL);
+    gst_object_unref(pad);
+  }
+  gst_object_unref(src);
+  
+  for (int i = 0; i < GSTPIP_MAX; i++) {
+    if (pip[i])
+      pip[i]->Layout(frameWidth, frameHeight);
+  }
+}
+
+int cGstVideoOutput::AddPip(int Channel, const char *Name, int X, int Y, int Width, int Height)
+{
+  int slot;
+  bool relink;
+  {
+    cMutexLock lock(&mutex);
+    
+    if (!pipeline)
+      return -1;
+    for (slot = 0; slot < GSTPIP_MAX && pip[slot]; slot++)
+      ;
+    if (slot == GSTPIP_MAX) {
+      esyslog("gstout: No free PiP slot for channel %d", Channel);
+      return -1;
+    }
+    if (!mixer) {
+      GstElementFactory *factory = gst_element_factory_find(GstoutConfig.pipMixer);
+      if (!factory) {
+        esyslog("gstout: Video mixer %s not available", GstoutConfig.pipMixer);
+        return -1;
+      }
+      gst_object_unref(factory);
+    }
+    
+    cGstPipStream *stream = new cGstPipStream(Channel, Name, X, Y, Width, Height, slot + 1);
+    GstElement *bin = stream->Create(cString::sprintf("video-pip-%d", slot));
+    if (!bin) {
+      delete stream;
+      return -1;
+    }
+    pip[slot] = stream;
+    
+    // Started once linked, an unlinked src pad would stop its streaming
+    // thread with not-linked
+    gst_bin_add(GST_BIN(pipeline), bin);
+    if (mixer && stream->Link(mixer)) {
+      stream->Layout(frameWidth, frameHeight);
+      gst_element_sync_state_with_parent(bin);
+    }
+    relink = !mixer;
+    mixerWanted = true;
+  }
+  
+  // The first stream inserts the mixer in front of the sink
+  if (relink)
+    RelinkTail(NULL);
+  return slot;
+}
+
+void cGstVideoOutput::PutPip(int Index, const uchar *Data, int Length)
+{
+  // Receiver thread, the slot is filled before the receiver is attached and
+  // cleared after it is detached
+  if (Index >= 0 && Index < GSTPIP_MAX && pip[Index])
+    pip[Index]->Put(Data, Length);
+}
+
+bool cGstVideoOutput::DelPip(int Index)
+{
+  bool relink = false;
+  {
+    cMutexLock lock(&mutex);
+    
+    if (Index < 0 || Index >= GSTPIP_MAX || !pip[Index])
+      return false;
+    cGstPipStream *stream = pip[Index];
+    pip[Index] = NULL;
+    
+    // Stopped before its mixer pad goes away, so it doesn't push into it
+    gst_element_set_state(stream->Bin(), GST_STATE_NULL);
+    if (mixer)
+      stream->Unlink(mixer);
+    gst_bin_remove(GST_BIN(pipeline), stream->Bin());
+    isyslog("gstout: PiP %d for channel %d removed", Index, stream->Channel());
+    delete stream;
+    
+    // The last one takes the mixer out again
+    mixerWanted = false;
+    for (int i = 0; i < GSTPIP_MAX; i++)
+      mixerWanted |= pip[i] != NULL;
+    if (!mixerWanted) {
+      mainX = mainY = 0;
+      mainWidth = mainHeight = 100;
+      relink = mixer != NULL;
+    }
+  }
+  
+  if (relink)
+    RelinkTail(NULL);
+  return true;
+}
+
+cString cGstVideoOutput::GetPips(void)
+{
+  cMutexLock lock(&mutex);
+  
+  cString s = "";
+  for (int i = 0; i < GSTPIP_MAX; i++) {
+    if (pip[i])
+      s = cString::sprintf("%s%s%d: %s%s", *s, **s ? "\n" : "", i, *pip[i]->Status(), pip[i]->Linked() ? "" : ", not linked");
+  }
+  if (!**s)
+    return "No PiP streams";
+  return cString::sprintf("Mixer: %s, %dx%d, live picture %d,%d %dx%d%%\n%s",
+                          mixer ? GST_OBJECT_NAME(gst_element_get_factory(mixer)) : "pending",
+                          frameWidth, frameHeight,
+                          mainX, mainY, mainWidth, mainHeight,
+                          *s);
+}
+
+bool cGstVideoOutput::HasPips(void)
+{
+  cMutexLock lock(&mutex);
+  for (int i = 0; i < GSTPIP_MAX; i++) {
+    if (pip[i])
+      return true;
+  }
+  return false;
+}
+
+void cGstVideoOutput::SetMainLayout(int X, int Y, int Width, int Height)
+{
+  cMutexLock lock(&mutex);
+  mainX = X;
+  mainY = Y;
+  mainWidth = Width;
+  mainHeight = Height;
+  ApplyLayout();
+}
+
+void cGstVideoOutput::ProcessPip(void)
+{
+  cMutexLock lock(&mutex);
+  
+  for (int i = 0; i < GSTPIP_MAX; i++) {
+    if (pip[i])
+      pip[i]->Feed();
+  }
+  if (!mixer)
+    return;
+  
+  // The canvas follows the display size of the live picture
+  GstPad *pad = gst_element_get_static_pad(queue, "src");
+  GstCaps *caps = gst_pad_get_current_caps(pad);
+  gst_object_unref(pad);
+  if (!caps)
+    return;
+  
+  GstStructure *s = gst_caps_get_structure(caps, 0);
+  int width, height, parN = 1, parD = 1;
+  if (gst_structure_get_int(s, "width", &width) && gst_structure_get_int(s, "height", &height)) {
+    gst_structure_get_fraction(s, "pixel-aspect-ratio", &parN, &parD);
+    width = int((int64_t)width * parN / max(parD, 1)) & ~1;
+    if (width != frameWidth || height != frameHeight) {
+      dsyslog("gstout: Video mixer canvas %dx%d", width, height);
+      frameWidth = width;
+      frameHeight = height;
+      ApplyLayout();
+    }
+  }
+  gst_caps_unref(caps);
+}
+
+GstElement *cGstVideoOutput::CreateDeinterlacer(bool HwDecoding)
+{
+  int method = GstoutConfig.deinterlaceMethod;
+  if (method == dmAuto)
+    method = HwDecoding ? dmVaapi : dmLinear;
+  
+  GstElement *element = NULL;
+  switch (method) {
+    case dmVaapi:
+      if (HwDecoding) {
+        // vaapidecodebin deinterlaces in its own vaapipostproc
+        deinterlaceName = "vaapidecodebin";
+        return NULL;
+      }
+      element = gst_element_factory_make("vaapipostproc", "deinterlacer");
+      deinterlaceName = "vaapipostproc";
+      break;
+    case dmGl: {
+      GError *error = NULL;
+      element = gst_parse_bin_from_description("glupload ! gldeinterlace ! gldownload", TRUE, &error);
+      if (error) {
+        esyslog("gstout: Failed to create GL deinterlacer: %s", error->message);
+        g_error_free(error);
+      }
+      if (element)
+        gst_object_set_name(GST_OBJECT(element), "deinterlacer");
+      deinterlaceName = "gldeinterlace";
+      break;
+    }
+    default:
+      element = gst_element_factory_make("deinterlace", "deinterlacer");
+      deinterlaceName = method == dmGreedyH ? "greedyh" : method == dmYadif ? "yadif" : "linear";
+      if (element)
+        gst_util_set_object_arg(G_OBJECT(element), "method", deinterlaceName);
+      break;
+  }
+  
+  if (!element && method != dmLinear) {
+    isyslog("gstout: Deinterlacer %s not available, using linear", deinterlaceName);
+    element = gst_element_factory_make("deinterlace", "deinterlacer");
+    deinterlaceName = "linear";
+  }
+  if (!element)
+    deinterlaceName = "off";
+  
+  return element;
+}
+
+void cGstVideoOutput::SetupDeinterlacer(void)
+{
+  if (HasProperty(deinterlace, "method"))
+    g_object_get(G_OBJECT(deinterlace), "method", &deinterlaceMethod, NULL);
+}
+
+GstPadProbeReturn cGstVideoOutput::CapsProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  
+  if (event && GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+    GstCaps *caps = NULL;
+    gst_event_parse_caps(event, &caps);
+    GstStructure *s = caps ? gst_caps_get_structure(caps, 0) : NULL;
+    if (s) {
+      // No interlace-mode field means progressive
+      const gchar *mode = gst_structure_get_string(s, "interlace-mode");
+      bool progressive = !mode || strcmp(mode, "progressive") == 0;
+      cMutexLock lock(&self->mutex);
+      if (progressive != self->progressive) {
+        self->progressive = progressive;
+        // Relinked once the caps event has passed, before the first buffer
+        // with these caps
+        if (self->deinterlace) {
+          dsyslog("gstout: Deinterlacer %s", progressive ? "bypassed for progressive content" : "linked for interlaced content");
+          self->RelinkTail(caps);
+        }
+      }
+    }
+  }
+  
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn cGstVideoOutput::DropProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  
+  if (self->qos.Level() < olDropNonRef)
+    return GST_PAD_PROBE_OK;
+  
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (!buffer || !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_PAD_PROBE_OK;
+  
+  bool drop = false;
+  GstMapInfo map;
+  if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    drop = GstFrameDroppable(self->codecType, map.data, map.size);
+    gst_buffer_unmap(buffer, &map);
+  }
+  
+  if (drop) {
+    g_atomic_int_inc(&self->droppedFrames);
+    return GST_PAD_PROBE_DROP;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+void cGstVideoOutput::ApplyOverloadLevel(int Level)
+{
+  // Caller must hold mutex
+  if (HasProperty(deinterlace, "method"))
+    g_object_set(G_OBJECT(deinterlace), "method", Level >= olDeinterlace ? DEINTERLACE_SCALER_BOB : deinterlaceMethod, NULL);
+  
+  if (codec && codecType >= 0 && HasProperty(codec, "skip-frame"))
+    g_object_set(G_OBJECT(codec), "skip-frame", Level >= olSkipNonRef ? SKIP_FRAME_NONREF : GstoutConfig.decoder[codecType].skipFrame, NULL);
+  
+  // olDropNonRef is handled by DropProbe()
+}
+
+void cGstVideoOutput::ProcessQos(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (qos.Tick())
+    ApplyOverloadLevel(qos.Level());
+}
+
+gboolean cGstVideoOutput::BusCallback(GstBus *bus, GstMessage *msg, gpointer data)
+{
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_QOS) {
+    // Posted by the sink for each buffer it had to drop for being late
+    gint64 jitter;
+    gdouble proportion;
+    gint quality;
+    gst_message_parse_qos_values(msg, &jitter, &proportion, &quality);
+    
+    cMutexLock lock(&self->mutex);
+    self->qos.Report(proportion);
+    return TRUE;
+  }
+  
+  return cGstOutput::BusCallback(bus, msg, data);
+}
+
+void cGstVideoOutput::SetReplay(bool On)
+{
+  // Takes effect when decodebin plugs the next decoder (channel switch or reset)
+  g_atomic_int_set(&replay, On);
+}
+
+void cGstVideoOutput::EnoughDataCallback(GstElement *source, gpointer data)
+{
+  // Appsrc has enough data, pause feeding until the next need-data
+  cGstVideoOutput *self = (cGstVideoOutput *)data;
+  cMutexLock lock(&self->mutex);
+  
+  self->needData = false;
+}
+
+int64_t cGstVideoOutput::OutPts(void)
+{
+  cMutexLock lock(&mutex);
+  return sync.OutPts();
+}
+
+int cGstVideoOutput::BufferedMs(void)
+{
+  cMutexLock lock(&mutex);
+  return sync.BufferedMs();
+}
+
+void cGstVideoOutput::SetSyncDelay(int DelayMs)
+{
+  cMutexLock lock(&mutex);
+  
+  syncDelayMs = DelayMs;
+  // Not every sink (or auto sink bin) supports ts-offset
+  if (HasProperty(sink, "ts-offset"))
+    g_object_set(G_OBJECT(sink), "ts-offset", (gint64)DelayMs * GST_MSECOND, NULL);
+}
+
+int cGstVideoOutput::BufferFill(void)
+{
+  cMutexLock lock(&mutex);
+  
+  if (!buffer)
+    return 0;
+  int available = buffer->Available();
+  int size = available + buffer->Free();
+  return size ? available * 100 / size : 0;
+}
+
+void cGstVideoOutput::GetMetrics(tGstStreamMetrics &Metrics)
+{
+  // No mutex, buffer and source do not change after Initialize(), the
+  // counters and the QoS values are atomic. Called by the output thread
+  // for scrapes and by the SVDRP thread for DUMP.
+  Metrics.bytesIn = trace.BytesIn();
+  Metrics.bytesOut = trace.BytesOut();
+  Metrics.ringFill = trace.RingFill();
+  Metrics.ringSize = buffer ? buffer->Size() : 0;
+  guint64 level = 0;
+  if (source)
+    g_object_get(G_OBJECT(source), "current-level-bytes", &level, NULL);
+  Metrics.appsrcLevel = level;
+  Metrics.decoder = trace.DecoderName();
+  Metrics.poolHits = pool.Hits();
+  Metrics.poolMisses = pool.Misses();
+  Metrics.poolBytes = pool.MaxBytes();
+  Metrics.framesLate = qos.LateTotal();
+  Metrics.framesDropped = g_atomic_int_get(&droppedFrames);
+  Metrics.qosProportion = qos.Proportion();
+  Metrics.overloadLevel = qos.Level();
+}
+
+cString cGstVideoOutput::GetLatency(bool Reset)
+{
+  cString s = trace.Report();
+  if (Reset)
+    trace.Reset();
+  return s;
+}
+
+cString cGstVideoOutput::GetStatistics(void)
+{
+  cMutexLock lock(&mutex);
+  
+  int available = buffer ? buffer->Available() : 0;
+  int free = buffer ? buffer->Free() : 0;
+  
+  GstState state = GST_STATE_NULL;
+  if (pipeline)
+    gst_element_get_state(pipeline, &state, NULL, GST_CLOCK_TIME_NONE);
+  
+  cString streamInfo = stream ? cString::sprintf("\nStream: %s, %d overruns", *streamName, g_atomic_int_get(&streamOverruns)) : cString("");
+  cString subtitleInfo = subtitles ? cString::sprintf("\n%s", *subtitles->Status()) : cString("");
+  
+  return cString::sprintf("Video: %s%s, Buffer: %d/%d KB, %d ms, Pool: %d KB, %d hits, %d misses, Deinterlace: %s%s, Path: %s %s\n"
+                         "QoS: level %d (%s), %llu late, %d dropped\n%s, %s%s%s",
                          gst_element_state_get_name(state),
+                         suspended ? " (audio only)" : "",
                          available / 1024,
-                         (available + free) / 1024);
+                         (available + free) / 1024,
+                         max(sync.BufferedMs(), 0),
+                         pool.MaxBytes() / 1024,
+                         pool.Hits(),
+                         pool.Misses(),
+                         deinterlaceName,
+                         deinterlace && !deinterlaceLinked ? " (bypassed)" : "",
+                         memoryType,
+                         directLink ? "direct" : "converted",
+                         qos.Level(),
+                         cGstQosController::LevelName(qos.Level()),
+                         (unsigned long long)qos.LateTotal(),
+                         g_atomic_int_get(&droppedFrames),
+                         *index.Status(),
+                         *paramCache.Status(),
+                         *streamInfo,
+                         *subtitleInfo);
 }
@@ -9,6 +9,21 @@
 #include <vdr/ringbuffer.h>
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
+#include "gstsync.h"
+#include "gstqos.h"
+#include "gstdemux.h"
+#include "gsttrace.h"
+#include "gstzap.h"
+#include "gstmetrics.h"
+#include "gstdump.h"
+#include "gstpool.h"
+#include "gstpip.h"
+#include "gsttimeshift.h"
+#include "gstindex.h"
+#include "gsttrack.h"
+#include "gstsubtitle.h"
+#include "gstaudiosink.h"
+#include "gstloudness.h"
 
 // Forward declarations
 class cGstAudioOutput;
@@ -22,8 +37,44 @@ private:
   cGstVideoOutput *videoOutput;
   cGstOsdProvider *osdProvider;
   bool initialized;
+  gint ready;           // 1 pipelines playing, -1 setup failed
+  GThread *warmThread;
   cMutex mutex;
+  cGstSyncController syncController;
+  cGstTsDemux demux;
+  bool demuxVideoOnly;
+  cGstTimeshift timeshift;
+  int audioTrack;       // selected audio track, a PMT index
+  int audioVersion;     // of the demuxer's audio streams audioTrack refers to
+  bool audioTracksBuilt;
+  int subtitle;         // selected subtitle stream, a PMT index or -1
+  int subtitleVersion;  // of the demuxer's subtitle streams subtitle refers to
+  bool radio;           // the channel has no video, the video pipeline is in NULL
   
+  // Channel switch timeline
+  cGstZapHistory zapHistory;
+  int channel;
+  bool zapActive;
+  uint64_t zapStart;
+  time_t zapTime;
+  
+  cGstMetricsServer metrics;
+  
+  bool Setup(void);
+  static gpointer BuildAudio(gpointer data);
+  static gpointer WarmDecoders(gpointer data);
+  void UpdateSync(void);
+  void StartZap(void);
+  void UpdateZap(void);
+  bool FlushPes(void);
+  void Flush(void);
+  void PauseOutputs(bool On);
+  void ProcessTimeshift(void);
+  void UpdateAudioTracks(void);
+  void UpdateAudioMask(void);
+  void UpdateSubtitles(void);
+  void UpdateRadio(void);
+  void SetRadio(bool On);
   
 protected:
   virtual void Action(void);
@@ -38,17 +89,86 @@ public:
   void Reset(void);
   void MainThreadHook(void);
   
+  // GStreamer and the pipelines are set up by the output thread after
+  // Start(), data is only accepted once they are ready
+  bool Ready(void) { return g_atomic_int_get(&ready) > 0; }
+  bool WaitReady(int TimeoutMs);
+  
   cString GetStatistics(void);
   
+  // Per stage latency, Reset clears the histograms
+  cString GetLatency(bool Reset = false);
+  
+  // OpenMetrics exposition, never takes the output mutexes
+  cString GetMetrics(void);
+  
+  // Writes dot graphs of both pipelines and a JSON snapshot into Directory,
+  // Files lists the written files (or the error)
+  bool Dump(const char *Directory, cString &Files);
+  
+  // Channel switch timelines, see cGstZapHistory::Report()
+  cString GetZapHistory(int Channel = 0, cString (*ChannelName)(int Number) = NULL) { return zapHistory.Report(Channel, ChannelName); }
+  void ClearZapHistory(void) { zapHistory.Clear(); }
+  
+  // Live channel, zaps are recorded for it and the video parameter sets
+  // are cached for ChannelId (the number if there is none)
+  void SetChannel(int Number, const char *ChannelId = NULL);
+  
+  // VDR's volume as a level of 0..1 and its mute state, changed in the
+  // running audio pipeline
+  void SetVolume(double Level, bool Mute);
+  
   // Audio/Video data input
   bool PlayAudio(const uchar *Data, int Length);
   bool PlayVideo(const uchar *Data, int Length);
   int PlayTs(const uchar *Data, int Length, bool VideoOnly = false);
-
   
   // Flush buffers
   void Clear(void);
   
+  // Ring buffer fill level in percent and number of demuxed PES packets
+  int BufferFill(bool Video);
+  uint64_t PesCount(bool Video) { return demux.PesCount(Video); }
+  
+  // Live TV or replay, selects the decoder mode if set to auto
+  void SetReplay(bool On);
+  
+  // Applies changed sink, hardware decoding and deinterlacer settings to
+  // the running pipelines, returns what is being swapped
+  cString Reconfigure(void);
+  
+  // Time shift of the live stream (if a buffer size is set): Pause()
+  // freezes playback while the stream is recorded, Seek() moves by about
+  // Seconds (negative is back) to a random access point
+  bool TimeshiftPause(void);
+  bool TimeshiftPlay(void);
+  bool TimeshiftSeek(int Seconds);
+  bool TimeshiftLive(void);
+  cString TimeshiftStatus(void);
+  
+  // Picture in picture, rectangles in percent of the frame. AddPip()
+  // returns the stream's index, the caller feeds it with the PES packets
+  // of the channel's video PID and stops doing so before DelPip()
+  int AddPip(int Channel, const char *Name, int X, int Y, int Width, int Height);
+  void PutPip(int Index, const uchar *Data, int Length);
+  bool DelPip(int Index);
+  cString GetPips(void);
+  
+  // Live picture rectangle, the whole frame unless it is part of a mosaic
+  void SetMainLayout(int X, int Y, int Width, int Height);
+  
+  // Audio track of the live channel, an index into the PMT's audio
+  // streams. The next tracks are decoded ahead (see "Parallel Audio
+  // Tracks"), switching to one of them only changes the selector's pad.
+  bool SelectAudioTrack(int Track, cString &Error);
+  cString GetAudioTracks(void);
+  
+  // Subtitle stream of the live channel rendered into the picture, an
+  // index into the PMT's subtitle streams or -1 for none. A new channel
+  // starts with the first stream if "Show Subtitles" is on.
+  bool SelectSubtitle(int Index, cString &Error);
+  cString GetSubtitles(void);
+  
   // OSD provider link
   void SetOsdProvider(cGstOsdProvider *provider) { osdProvider = provider; }
   
@@ -63,17 +183,62 @@ private:
   GstElement *pipeline;
   GstElement *source;
   GstElement *decoder;
+  GstElement *selector;
+  GstElement *queue;
+  GstElement *dspConverter;
+  GstElement *dspFilter;
+  GstElement *volume;
   GstElement *converter;
   GstElement *resampler;
   GstElement *sink;
   GstBus *bus;
   
   cRingBufferLinear *buffer;
+  cGstSyncTracker sync;
+  cGstStageTracer trace;
+  cGstInputPool pool;
   cMutex mutex;
   bool playing;
+  bool needData;
+  bool prebuffering;
+  gint syncDelayMs; // also read by the underrun check in the streaming thread
+  
+  // Hot reconfiguration, newSink replaces sink once the resampler is idle
+  cString sinkName;
+  GstElement *newSink;
   
+  // Sink buffering, sinkLatencyMs is the pipeline latency for the underrun
+  // check in the streaming thread
+  cGstAudioSinkTuner tuner;
+  gint sinkLatencyMs;
+  uint64_t latencyQueried;
+  
+  // Volume and mute are properties of the volume element, loudness runs in
+  // a probe on the float samples in front of it. Neither changes state.
+  double volumeLevel;
+  bool muted;
+  cGstLoudness loudness;
+  
+  // More audio tracks decoded into the selector, the first track (from
+  // source) is linked to primaryPad
+  GstPad *primaryPad;
+  cGstAudioTrack *tracks[GSTTRACK_MAX];
+  int activeTrack;
+  
+  void Feed(void);
+  bool ReplaceSink(const char *Name);
+  void SwapSink(void);
+  void ApplyVolume(void);
+  bool ApplyLoudness(void);
+  cString LoudnessStatus(void);
   static void NeedDataCallback(GstElement *source, guint size, gpointer data);
   static void EnoughDataCallback(GstElement *source, gpointer data);
+  static void PadAddedCallback(GstElement *element, GstPad *pad, gpointer data);
+  static void DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data);
+  static void SinkAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data);
+  static GstPadProbeReturn SwapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn UnderrunProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn DspProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
   
 public:
   cGstAudioOutput(void);
@@ -83,10 +248,47 @@ public:
   void Start(void);
   void Stop(void);
   void Reset(void);
+  cString Reconfigure(void);
+  
+  // Holds the pipeline in PAUSED, running time continues where it stopped
+  void Pause(bool On);
   
   bool Play(const uchar *Data, int Length);
   void Clear(void);
   
+  // Called periodically, resumes feeding after the input pool ran dry
+  void ProcessFeed(void);
+  
+  // Called periodically, replaces the sink with a larger buffer when the
+  // automatic sink latency finds it running dry
+  void ProcessSink(void);
+  
+  // Level 0..1, taken over by the running pipeline
+  void SetVolume(double Level, bool Mute);
+  
+  // Audio tracks besides the first one, Track is the PMT index. PutTrack()
+  // drops the packet if the track has no branch or its buffer is full.
+  bool AddTrack(int Track, int StreamType);
+  bool DelTrack(int Track);
+  void ClearTracks(void);
+  void PutTrack(int Track, const uchar *Data, int Length);
+  bool HasTrack(int Track);
+  bool SelectTrack(int Track);
+  int ActiveTrack(void) { return activeTrack; }
+  cString TrackStatus(int Track);
+  
+  // A/V sync
+  int64_t OutPts(void);
+  int BufferedMs(void);
+  void SetSyncDelay(int DelayMs);
+  
+  int BufferFill(void);
+  cString GetLatency(bool Reset);
+  int ZapMark(int Mark) { return trace.ZapMark(Mark); }
+  void GetMetrics(tGstStreamMetrics &Metrics);
+  cGstStageTracer *Tracer(void) { return &trace; }
+  GstElement *Pipeline(void) { return pipeline; }
+  
   cString GetStatistics(void);
 };
 
@@ -97,6 +299,8 @@ private:
   GstElement *pipeline;
   GstElement *source;
   GstElement *decoder;
+  GstElement *tee;
+  GstElement *queue;
   GstElement *deinterlace;
   GstElement *converter;
   GstElement *scaler;
@@ -104,11 +308,110 @@ private:
   GstBus *bus;
   
   cRingBufferLinear *buffer;
+  cGstSyncTracker sync;
+  cGstStageTracer trace;
+  cGstKeyIndex index;
+  cGstParamCache paramCache;
+  cString channelId;
+  cGstInputPool pool;
   cMutex mutex;
   bool playing;
+  bool needData;
+  bool prebuffering;
+  bool keyWait;
+  uint64_t keyWaitStart;
+  gint replay; // written by VDR's status thread, read on streaming threads
+  bool suspended;
+  int syncDelayMs;
+  
+  // Settings the pipeline was built with
+  cString sinkName;
+  bool hwConfigured;
+  bool hwDecoding;
+  bool deinterlaceConfigured;
+  int deinterlaceConfiguredMethod;
+  
+  // Hot reconfiguration, the decoder is swapped while appsrc's src pad is
+  // idle, the deinterlacer, sink and converters while the queue's is
+  GstElement *newDecoder;
+  bool newHwDecoding;
+  GstElement *newDeinterlace;
+  bool swapDeinterlace;
+  GstElement *newSink;
+  bool tailPending;
+  GstCaps *tailCaps;
+  
+  // Encoder branch on a second tee pad, behind its own leaky queue
+  cString streamName;
+  GstElement *stream;
+  GstPad *streamPad;
+  bool streamRemoving;
+  gint streamOverruns;
+  
+  // Picture in picture, the mixer is inserted in front of the sink while
+  // there are secondary streams
+  cGstPipStream *pip[GSTPIP_MAX];
+  GstElement *mixer;
+  GstElement *mixerFilter;
+  bool mixerWanted;
+  int frameWidth;
+  int frameHeight;
+  int mainX, mainY, mainWidth, mainHeight;
+  
+  // Subtitle overlay behind the deinterlacer, swapped in and out with the
+  // tail
+  cGstSubtitleOverlay *subtitles;
+  cGstSubtitleOverlay *newSubtitles;
+  bool swapSubtitles;
+  
+  // Deinterlacing, the deinterlacer is only linked into the tail for
+  // interlaced content
+  const char *deinterlaceName;
+  bool progressive;
+  bool deinterlaceLinked;
+  
+  // Decoder to sink path, converters are only linked if needed
+  bool directLink;
+  const char *memoryType;
+  
+  // Overload handling
+  cGstQosController qos;
+  GstElement *codec;
+  int codecType;
+  int deinterlaceMethod;
+  gint droppedFrames;
   
+  void Feed(void);
+  bool SkipToKey(void);
+  void PushParams(const uchar *Data, int Length);
+  GstElement *CreateDecoder(bool &HwDecoding);
+  void SetupDecoderBin(void);
+  void LinkDecoderPad(GstPad *pad);
+  bool CanLinkDirect(GstCaps *caps);
+  bool LinkTail(bool Direct);
+  void RelinkTail(GstCaps *Caps);
+  void SwapDecoder(void);
+  void SwapTail(GstPad *Pad);
+  GstElement *CreateDeinterlacer(bool HwDecoding);
+  void SetupDeinterlacer(void);
+  void AddStream(void);
+  void RemoveStream(void);
+  void CreateMixer(void);
+  void RemoveMixer(void);
+  void ApplyLayout(void);
+  void SetupDecoder(GstElement *element);
+  void ApplyOverloadLevel(int Level);
   static void NeedDataCallback(GstElement *source, guint size, gpointer data);
   static void EnoughDataCallback(GstElement *source, gpointer data);
+  static void DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data);
+  static void PadAddedCallback(GstElement *element, GstPad *pad, gpointer data);
+  static GstPadProbeReturn DropProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn CapsProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn DecoderSwapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn TailProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn StreamProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static void OverrunCallback(GstElement *queue, gpointer data);
+  static gboolean BusCallback(GstBus *bus, GstMessage *msg, gpointer data);
   
 public:
   cGstVideoOutput(void);
@@ -118,10 +421,61 @@ public:
   void Start(void);
   void Stop(void);
   void Reset(void);
+  cString Reconfigure(void);
+  
+  // Holds the pipeline in PAUSED, running time continues where it stopped
+  void Pause(bool On);
+  
+  // Audio only: the pipeline goes to NULL, which frees the decoder's and
+  // the sink's resources (VAAPI surfaces, the window), and Play() refuses
+  // data. Resuming needs no rebuild, decoding starts at the next keyframe.
+  void Suspend(bool On);
+  bool Suspended(void) { return suspended; }
   
   bool Play(const uchar *Data, int Length);
   void Clear(void);
   
+  // Called periodically, resumes feeding after the input pool ran dry
+  void ProcessFeed(void);
+  
+  // A/V sync
+  int64_t OutPts(void);
+  int BufferedMs(void);
+  void SetSyncDelay(int DelayMs);
+  
+  int BufferFill(void);
+  cString GetLatency(bool Reset);
+  int ZapMark(int Mark) { return trace.ZapMark(Mark); }
+  void GetMetrics(tGstStreamMetrics &Metrics);
+  cGstStageTracer *Tracer(void) { return &trace; }
+  GstElement *Pipeline(void) { return pipeline; }
+  
+  void SetReplay(bool On);
+  
+  // Live channel the parameter sets are cached for
+  void SetChannel(const char *ChannelId);
+  
+  // Called periodically to escalate or recover the overload level
+  void ProcessQos(void);
+  
+  // Picture in picture, see cGstOutput
+  int AddPip(int Channel, const char *Name, int X, int Y, int Width, int Height);
+  void PutPip(int Index, const uchar *Data, int Length);
+  bool DelPip(int Index);
+  cString GetPips(void);
+  bool HasPips(void);
+  void SetMainLayout(int X, int Y, int Width, int Height);
+  
+  // Called periodically, feeds the secondary streams and follows the live
+  // picture's size
+  void ProcessPip(void);
+  
+  // Subtitle stream rendered into the live picture (eGstSubtitleType, -1
+  // for none), Page selects the teletext page
+  bool SetSubtitles(int Type, int Page);
+  void PutSubtitle(const uchar *Data, int Length);
+  cString SubtitleStatus(void);
+  
   cString GetStatistics(void);
 };
 
@@ -0,0 +1,146 @@
+/*
+ * gstpip.c: Secondary video streams for picture in picture and mosaic
+ */
+
+#include "gstpip.h"
+#include <vdr/remux.h>
+
+#define PIP_RING_SIZE   MEGABYTE(2)        // ~1 s of an HD channel
+#define PIP_SLAB_SIZE   (348 * TS_SIZE)    // as the main video input
+#define PIP_POOL_SIZE   MEGABYTE(4)
+#define PIP_APPSRC_SIZE MEGABYTE(1)
+#define PIP_QUEUE_MS    200
+#define PIP_MIN_SIZE    16
+
+// --- cGstPipStream ---------------------------------------------------------
+
+cGstPipStream::cGstPipStream(int Channel, const char *Name, int X, int Y, int Width, int Height, int ZOrder)
+:cGstBranch(PIP_RING_SIZE)
+{
+  channel = Channel;
+  name = Name;
+  x = X;
+  y = Y;
+  width = Width;
+  height = Height;
+  zorder = ZOrder;
+  description = cString::sprintf("PiP channel %d", Channel);
+
+  // Windows up to a quarter of the frame are decoded at a quarter of the
+  // resolution, up to half of it at half
+  int size = max(Width, Height);
+  lowres = size <= 25 ? 2 : size <= 50 ? 1 : 0;
+
+  filter = NULL;
+}
+
+GstElement *cGstPipStream::Create(const char *BinName)
+{
+  GstElement *scaler = gst_element_factory_make("videoscale", NULL);
+  filter = gst_element_factory_make("capsfilter", NULL);
+  GstElement *queue = gst_element_factory_make("queue", NULL);
+
+  if (!scaler || !filter || !queue ||
+      !CreateInput(BinName, gst_element_factory_make("videoconvert", NULL), PIP_SLAB_SIZE, PIP_POOL_SIZE, PIP_APPSRC_SIZE)) {
+    esyslog("gstout: Failed to create PiP elements");
+    GstElement *elements[] = { scaler, filter, queue };
+    for (unsigned int i = 0; i < sizeof(elements) / sizeof(elements[0]); i++) {
+      if (elements[i])
+        gst_object_unref(elements[i]);
+    }
+    filter = NULL;
+    return NULL;
+  }
+
+  // A late window picture is dropped rather than holding up the mixer
+  g_object_set(G_OBJECT(queue),
+               "max-size-buffers", 0,
+               "max-size-bytes", 0,
+               "max-size-time", (guint64)PIP_QUEUE_MS * GST_MSECOND,
+               "leaky", 2, // downstream
+               NULL);
+
+  gst_bin_add_many(GST_BIN(bin), scaler, filter, queue, NULL);
+  if (!gst_element_link_many(converter, scaler, filter, queue, NULL)) {
+    esyslog("gstout: Failed to link PiP elements");
+    gst_object_unref(bin);
+    bin = NULL;
+    return NULL;
+  }
+  AddSrcPad(queue);
+
+  g_signal_connect(decoder, "deep-element-added", G_CALLBACK(DeepElementAddedCallback), this);
+
+  isyslog("gstout: PiP %s created for channel %d (%s), %d,%d %dx%d%%, lowres %d",
+          BinName, channel, *name, x, y, width, height, lowres);
+  return bin;
+}
+
+void cGstPipStream::DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data)
+{
+  cGstPipStream *self = (cGstPipStream *)data;
+
+  // Reduced resolution decoding, libav clamps it to what the codec supports
+  // (MPEG-2 does, H.264 and H.265 don't)
+  if (self->lowres && g_object_class_find_property(G_OBJECT_GET_CLASS(element), "lowres")) {
+    g_object_set(G_OBJECT(element), "lowres", self->lowres, NULL);
+    dsyslog("gstout: PiP decoder %s at lowres %d", GST_OBJECT_NAME(element), self->lowres);
+  }
+}
+
+bool cGstPipStream::Align(GstPad *Pad, GstBuffer *Buffer)
+{
+  // The stream joins a running pipeline with timestamps of its own, they
+  // are moved to the current running time so the mixer doesn't drop every
+  // picture as late
+  GstClock *clock = gst_element_get_clock(bin);
+  GstEvent *event = gst_pad_get_sticky_event(Pad, GST_EVENT_SEGMENT, 0);
+  bool done = false;
+  if (clock && event && GST_BUFFER_PTS_IS_VALID(Buffer)) {
+    const GstSegment *segment;
+    gst_event_parse_segment(event, &segment);
+    guint64 position = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(Buffer));
+    if (position != GST_CLOCK_TIME_NONE) {
+      GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(bin);
+      gst_pad_set_offset(Pad, (gint64)now - (gint64)position);
+      done = true;
+    }
+  }
+  if (event)
+    gst_event_unref(event);
+  if (clock)
+    gst_object_unref(clock);
+  return done;
+}
+
+void cGstPipStream::Layout(int FrameWidth, int FrameHeight)
+{
+  // Even sizes for the chroma planes
+  int w = max(FrameWidth * width / 100, PIP_MIN_SIZE) & ~1;
+  int h = max(FrameHeight * height / 100, PIP_MIN_SIZE) & ~1;
+
+  // Square pixels, the mixer doesn't look at the aspect ratio
+  GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                      "width", G_TYPE_INT, w,
+                                      "height", G_TYPE_INT, h,
+                                      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                      NULL);
+  g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+  gst_caps_unref(caps);
+
+  if (RequestPad()) {
+    g_object_set(G_OBJECT(RequestPad()),
+                 "xpos", FrameWidth * x / 100,
+                 "ypos", FrameHeight * y / 100,
+                 "width", w,
+                 "height", h,
+                 "zorder", (guint)zorder,
+                 NULL);
+  }
+}
+
+cString cGstPipStream::Status(void)
+{
+  return cString::sprintf("channel %d (%s), %d,%d %dx%d%%, %s",
+                          channel, *name, x, y, width, height, *BufferStatus());
+}
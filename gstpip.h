@@ -0,0 +1,48 @@
+/*
+ * gstpip.h: Secondary video streams for picture in picture and mosaic
+ */
+
+#ifndef __GSTPIP_H
+#define __GSTPIP_H
+
+#include "gstbranch.h"
+
+#define GSTPIP_MAX  8  // secondary streams, a 3x3 mosaic with the live one
+
+// --- cGstPipStream ---------------------------------------------------------
+
+// One secondary decoder, as a branch whose ghost src pad is linked to a
+// request pad of the video mixer. PES packets come from a receiver thread.
+// The decoded pictures are scaled down to the window size in the bin, and
+// the decoder is asked for reduced resolution output where it supports it
+// (avdec's lowres).
+
+class cGstPipStream : public cGstBranch {
+private:
+  int channel;
+  cString name;
+  int x, y, width, height;  // percent of the frame
+  int zorder;
+  int lowres;
+  GstElement *filter;
+
+  static void DeepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data);
+
+protected:
+  virtual bool Align(GstPad *Pad, GstBuffer *Buffer);
+
+public:
+  cGstPipStream(int Channel, const char *Name, int X, int Y, int Width, int Height, int ZOrder);
+
+  // Builds the bin, which is owned by the pipeline it is added to
+  GstElement *Create(const char *BinName);
+
+  // Mixer pad, the caller holds the video output's mutex
+  void Layout(int FrameWidth, int FrameHeight);
+  bool Linked(void) { return RequestPad() != NULL; }
+
+  int Channel(void) { return channel; }
+  cString Status(void);
+};
+
+#endif // __GSTPIP_H
@@ -0,0 +1,65 @@
+/*
+ * gstpool.c: Bounded buffer pool for appsrc input
+ */
+
+#include "gstpool.h"
+
+#define POOL_MIN_BUFFERS 8
+
+// --- cGstInputPool ---------------------------------------------------------
+
+cGstInputPool::cGstInputPool(void)
+{
+  pool = NULL;
+  slabSize = 0;
+  maxBuffers = 0;
+  hits = 0;
+  misses = 0;
+}
+
+cGstInputPool::~cGstInputPool()
+{
+  if (pool) {
+    // Buffers still in the pipeline are freed when they come back
+    gst_buffer_pool_set_active(pool, FALSE);
+    gst_object_unref(pool);
+  }
+}
+
+bool cGstInputPool::Setup(int SlabSize, int MaxBytes)
+{
+  slabSize = SlabSize;
+  maxBuffers = max(MaxBytes / SlabSize, POOL_MIN_BUFFERS);
+
+  pool = gst_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  // Half of the buffers are allocated up front, the rest on demand
+  gst_buffer_pool_config_set_params(config, NULL, slabSize, maxBuffers / 2, maxBuffers);
+  if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+    esyslog("gstout: Failed to set up input buffer pool (%d x %d bytes)", maxBuffers, slabSize);
+    gst_object_unref(pool);
+    pool = NULL;
+    return false;
+  }
+  return true;
+}
+
+GstBuffer *cGstInputPool::Get(const uchar *Data, int Length)
+{
+  if (!pool)
+    return NULL;
+
+  GstBufferPoolAcquireParams params = { GST_FORMAT_UNDEFINED, 0, 0, GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT };
+  GstBuffer *buffer = NULL;
+  if (gst_buffer_pool_acquire_buffer(pool, &buffer, &params) != GST_FLOW_OK) {
+    g_atomic_int_inc(&misses);
+    return NULL;
+  }
+  g_atomic_int_inc(&hits);
+
+  // The pool restores the full size when the buffer is released
+  int length = min(Length, slabSize);
+  gst_buffer_fill(buffer, 0, Data, length);
+  gst_buffer_set_size(buffer, length);
+  return buffer;
+}
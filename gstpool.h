@@ -0,0 +1,42 @@
+/*
+ * gstpool.h: Bounded buffer pool for appsrc input
+ */
+
+#ifndef __GSTPOOL_H
+#define __GSTPOOL_H
+
+#include <vdr/tools.h>
+#include <gst/gst.h>
+
+// --- cGstInputPool ---------------------------------------------------------
+
+// Fixed size buffers for everything pushed into appsrc, so the streaming
+// threads don't churn the heap with variable sized allocations. The pool
+// never grows beyond its maximum; when every buffer is in the pipeline,
+// Get() fails and the data stays in the ring buffer until buffers return.
+
+class cGstInputPool {
+private:
+  GstBufferPool *pool;
+  int slabSize;
+  int maxBuffers;
+  gint hits;
+  gint misses;
+
+public:
+  cGstInputPool(void);
+  ~cGstInputPool();
+
+  bool Setup(int SlabSize, int MaxBytes);
+
+  // Returns a buffer holding the first min(Length, SlabSize()) bytes of
+  // Data, or NULL if the pool is exhausted
+  GstBuffer *Get(const uchar *Data, int Length);
+
+  int SlabSize(void) { return slabSize; }
+  int MaxBytes(void) { return slabSize * maxBuffers; }
+  int Hits(void) { return g_atomic_int_get(&hits); }
+  int Misses(void) { return g_atomic_int_get(&misses); }
+};
+
+#endif // __GSTPOOL_H
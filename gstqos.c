@@ -0,0 +1,165 @@
+/*
+ * gstqos.c: QoS driven overload controller for GStreamer output
+ */
+
+#include "gstqos.h"
+#include "gstconfig.h"
+
+#define QOS_WINDOW_MS     1000  // late frames are counted per window
+#define QOS_LATE_LIMIT    3     // late frames per window that mean overload
+#define QOS_HOLD_MS       2000  // min. time between two escalations
+#define QOS_RECOVER_SECS  5     // quiet windows before recovering one level
+
+// --- cGstQosController -----------------------------------------------------
+
+cGstQosController::cGstQosController(void)
+{
+  Reset();
+}
+
+void cGstQosController::Reset(void)
+{
+  g_atomic_int_set(&level, olNone);
+  lateInWindow = 0;
+  quietSeconds = 0;
+  windowStart = cTimeMs::Now();
+  lastChange = 0;
+  g_atomic_int_set(&proportion, 1000);
+  __atomic_store_n(&lateTotal, 0, __ATOMIC_RELAXED);
+}
+
+void cGstQosController::Report(double Proportion)
+{
+  lateInWindow++;
+  __atomic_fetch_add(&lateTotal, 1, __ATOMIC_RELAXED);
+  g_atomic_int_set(&proportion, int(Proportion * 1000 + 0.5));
+}
+
+bool cGstQosController::Tick(void)
+{
+  uint64_t now = cTimeMs::Now();
+  if (now - windowStart < QOS_WINDOW_MS)
+    return false;
+
+  int late = lateInWindow;
+  lateInWindow = 0;
+  windowStart = now;
+
+  int current = Level();
+  int next = current;
+  if (late >= QOS_LATE_LIMIT) {
+    quietSeconds = 0;
+    if (current < olMax && now - lastChange >= QOS_HOLD_MS)
+      next = current + 1;
+  }
+  else if (late == 0) {
+    g_atomic_int_set(&proportion, 1000);
+    if (++quietSeconds >= QOS_RECOVER_SECS && current > olNone) {
+      next = current - 1;
+      quietSeconds = 0;
+    }
+  }
+  else
+    quietSeconds = 0;
+
+  if (next == current)
+    return false;
+
+  g_atomic_int_set(&level, next);
+  lastChange = now;
+  isyslog("gstout: Overload level %d (%s), %d late frames/s", next, LevelName(next), late);
+  return true;
+}
+
+const char *cGstQosController::LevelName(int Level)
+{
+  switch (Level) {
+    case olNone:        return "none";
+    case olDeinterlace: return "deinterlacer downgraded";
+    case olSkipNonRef:  return "decoder skips non-ref frames";
+    case olDropNonRef:  return "non-ref frames dropped";
+    default:            return "unknown";
+  }
+}
+
+// --- Frame classification --------------------------------------------------
+
+// Returns true for a VCL NAL unit, Droppable is cleared if it is a
+// reference picture
+static bool CheckNal(int Codec, const uchar *Nal, int Length, bool &Droppable)
+{
+  if (Length < 1)
+    return false;
+
+  if (Codec == gcH264) {
+    int type = Nal[0] & 0x1F;
+    if (type < 1 || type > 5)
+      return false;
+    if ((Nal[0] & 0x60) != 0) // nal_ref_idc
+      Droppable = false;
+    return true;
+  }
+
+  if (Codec == gcH265) {
+    int type = (Nal[0] >> 1) & 0x3F;
+    if (type > 31)
+      return false;
+    // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N, RSV_VCL_N10/12/14
+    if (type > 14 || (type & 1))
+      Droppable = false;
+    return true;
+  }
+
+  return false;
+}
+
+bool GstFrameDroppable(int Codec, const uchar *Data, int Length)
+{
+  if (!Data || Length < 6)
+    return false;
+
+  bool annexB = Data[0] == 0 && Data[1] == 0 && (Data[2] == 1 || (Data[2] == 0 && Data[3] == 1));
+
+  if (Codec == gcMpeg2) {
+    // Picture start code followed by temporal_reference and picture_coding_type
+    for (int i = 0; i + 5 < Length; i++) {
+      if (Data[i] == 0 && Data[i + 1] == 0 && Data[i + 2] == 1 && Data[i + 3] == 0)
+        return ((Data[i + 5] >> 3) & 0x07) == 3; // B-picture
+    }
+    return false;
+  }
+
+  if (Codec != gcH264 && Codec != gcH265)
+    return false;
+
+  bool droppable = true;
+  bool vcl = false;
+
+  if (annexB) {
+    int start = -1;
+    for (int i = 0; i + 2 < Length; i++) {
+      if (Data[i] == 0 && Data[i + 1] == 0 && Data[i + 2] == 1) {
+        if (start >= 0)
+          vcl |= CheckNal(Codec, Data + start, i - start, droppable);
+        start = i + 3;
+        i += 2;
+      }
+    }
+    if (start >= 0 && start < Length)
+      vcl |= CheckNal(Codec, Data + start, Length - start, droppable);
+  }
+  else {
+    // Length prefixed NAL units (avc/hvc1 stream format)
+    int i = 0;
+    while (i + 4 < Length) {
+      int size = (Data[i] << 24) | (Data[i + 1] << 16) | (Data[i + 2] << 8) | Data[i + 3];
+      i += 4;
+      if (size <= 0 || size > Length - i)
+        return false;
+      vcl |= CheckNal(Codec, Data + i, size, droppable);
+      i += size;
+    }
+  }
+
+  return vcl && droppable;
+}
@@ -0,0 +1,61 @@
+/*
+ * gstqos.h: QoS driven overload controller for GStreamer output
+ */
+
+#ifndef __GSTQOS_H
+#define __GSTQOS_H
+
+#include <vdr/tools.h>
+#include <glib.h>
+
+// Degradation levels, each one includes the previous ones
+enum eGstOverloadLevel {
+  olNone,            // full quality
+  olDeinterlace,     // cheapest deinterlacer method
+  olSkipNonRef,      // decoder skips non-reference frames
+  olDropNonRef,      // non-reference frames dropped before decode
+  olMax = olDropNonRef
+};
+
+// --- cGstQosController -----------------------------------------------------
+
+// Collects the QoS messages of the video sink (one per late, dropped
+// buffer) and escalates or recovers the degradation level per second.
+// Report() and Tick() are called from the output thread, Level(),
+// Proportion() and LateTotal() may be read from any thread.
+
+class cGstQosController {
+private:
+  gint level;
+  int lateInWindow;
+  int quietSeconds;
+  uint64_t windowStart;
+  uint64_t lastChange;
+  gint proportion;     // per mille
+  uint64_t lateTotal;
+
+public:
+  cGstQosController(void);
+
+  void Reset(void);
+
+  // Called for each QoS message of the video pipeline
+  void Report(double Proportion);
+
+  // Called periodically, returns true if the level has changed
+  bool Tick(void);
+
+  int Level(void) const { return g_atomic_int_get(&level); }
+  double Proportion(void) const { return g_atomic_int_get(&proportion) / 1000.0; }
+  uint64_t LateTotal(void) const { return __atomic_load_n(&lateTotal, __ATOMIC_RELAXED); }
+
+  static const char *LevelName(int Level);
+};
+
+// Returns true if the access unit is a non-reference picture that can be
+// dropped without affecting other frames (H.264 nal_ref_idc 0, HEVC
+// sub-layer non-reference NAL units, MPEG-2 B-pictures). Accepts Annex B
+// byte streams and 4 byte length prefixed NAL units.
+bool GstFrameDroppable(int Codec, const uchar *Data, int Length);
+
+#endif // __GSTQOS_H
@@ -5,16 +5,80 @@
 #include "gstsetup.h"
 #include "gstout.h"
 
+// Characters of a pipeline description
+static const char *StreamChars = " abcdefghijklmnopqrstuvwxyz0123456789!=/.,:_-+()";
+
 // --- cGstoutSetupPage ------------------------------------------------------
 
-cGstoutSetupPage::cGstoutSetupPage(void)
+cGstoutSetupPage::cGstoutSetupPage(cGstOutput *Output)
 {
+  output = Output;
+  
   // Copy current config values
   useHardwareDecoding = GstoutConfig.useHardwareDecoding;
   deinterlace = GstoutConfig.deinterlace;
-  audioBufferSize = GstoutConfig.audioBufferSize;
-  videoBufferSize = GstoutConfig.videoBufferSize;
+  deinterlaceMethod = GstoutConfig.deinterlaceMethod;
+  targetLatency = GstoutConfig.targetLatency;
+  syncMinLatency = GstoutConfig.syncMinLatency;
+  inputPoolSize = GstoutConfig.inputPoolSize;
+  timeshiftSize = GstoutConfig.timeshiftSize;
+  audioTracks = GstoutConfig.audioTracks;
+  subtitles = GstoutConfig.subtitles;
+  radioMode = GstoutConfig.radioMode;
+  audioSinkLatency = GstoutConfig.audioSinkLatency;
+  audioBufferTime = GstoutConfig.audioBufferTime;
+  audioLatencyTime = GstoutConfig.audioLatencyTime;
+  audioSlaveMethod = GstoutConfig.audioSlaveMethod;
+  audioDriftTolerance = GstoutConfig.audioDriftTolerance;
+  audioProvideClock = GstoutConfig.audioProvideClock;
+  audioLoudness = GstoutConfig.audioLoudness;
+  audioLoudnessTarget = GstoutConfig.audioLoudnessTarget;
+  audioCompression = GstoutConfig.audioCompression;
+  strn0cpy(videoStream, GstoutConfig.videoStream, sizeof(videoStream));
   osdBlending = GstoutConfig.osdBlending;
+  decoderMode = GstoutConfig.decoderMode;
+  zapLogLevel = GstoutConfig.zapLogLevel;
+  zapFirstPicture = GstoutConfig.zapFirstPicture;
+  for (int i = 0; i < gcCount; i++) {
+    threading[i] = GstoutConfig.decoder[i].threading;
+    threads[i] = GstoutConfig.decoder[i].threads;
+  }
+  
+  // Decoder options
+  decoderModeNames[gdLowLatency] = tr("low latency");
+  decoderModeNames[gdThroughput] = tr("throughput");
+  decoderModeNames[gdAuto] = tr("auto");
+  
+  threadingNames[gtAuto] = tr("auto");
+  threadingNames[gtFrame] = tr("frame");
+  threadingNames[gtSlice] = tr("slice");
+  
+  // Deinterlacer options
+  deinterlaceMethodNames[dmAuto] = tr("auto");
+  deinterlaceMethodNames[dmLinear] = "linear";
+  deinterlaceMethodNames[dmGreedyH] = "greedyh";
+  deinterlaceMethodNames[dmYadif] = "yadif";
+  deinterlaceMethodNames[dmVaapi] = "VAAPI";
+  deinterlaceMethodNames[dmGl] = "OpenGL";
+  
+  // Zap timeline logging
+  zapLogLevelNames[zlOff] = tr("off");
+  zapLogLevelNames[zlInfo] = tr("info");
+  zapLogLevelNames[zlDebug] = tr("debug");
+  
+  // Audio sink buffering
+  audioSinkLatencyNames[alDefault] = tr("sink default");
+  audioSinkLatencyNames[alManual] = tr("manual");
+  audioSinkLatencyNames[alAuto] = tr("auto");
+  
+  audioSlaveMethodNames[asResample] = tr("resample");
+  audioSlaveMethodNames[asSkew] = tr("skew");
+  audioSlaveMethodNames[asNone] = tr("none");
+  
+  // Dynamic range compression
+  compressionNames[dcOff] = tr("off");
+  compressionNames[dcLight] = tr("light");
+  compressionNames[dcHeavy] = tr("heavy");
   
   // Audio sink options
   audioSinkNames[0] = "autoaudiosink";
@@ -23,6 +87,7 @@ cGstoutSetupPage::cGstoutSetupPage(void)
   audioSinkNames[3] = "osssink";
   audioSinkNames[4] = "jackaudiosink";
   audioSinkNames[5] = NULL;
+  numAudioSinks = 5;
   
   // Video sink options
   videoSinkNames[0] = "autovideosink";
@@ -32,23 +97,33 @@ cGstoutSetupPage::cGstoutSetupPage(void)
   videoSinkNames[4] = "glimagesink";
   videoSinkNames[5] = "fbdevsink";
   videoSinkNames[6] = NULL;
+  numVideoSinks = 6;
   
-  // Find current selections
-  audioSinkIndex = 0;
+  // Find current selections, a sink given with properties or as a partial
+  // pipeline is offered as well so storing doesn't replace it
+  audioSinkIndex = numAudioSinks;
   for (int i = 0; audioSinkNames[i]; i++) {
     if (strcmp(audioSinkNames[i], GstoutConfig.audioSink) == 0) {
       audioSinkIndex = i;
       break;
     }
   }
+  if (audioSinkIndex == numAudioSinks) {
+    audioSinkNames[numAudioSinks++] = GstoutConfig.audioSink;
+    audioSinkNames[numAudioSinks] = NULL;
+  }
   
-  videoSinkIndex = 0;
+  videoSinkIndex = numVideoSinks;
   for (int i = 0; videoSinkNames[i]; i++) {
     if (strcmp(videoSinkNames[i], GstoutConfig.videoSink) == 0) {
       videoSinkIndex = i;
       break;
     }
   }
+  if (videoSinkIndex == numVideoSinks) {
+    videoSinkNames[numVideoSinks++] = GstoutConfig.videoSink;
+    videoSinkNames[numVideoSinks] = NULL;
+  }
   
   Setup();
 }
@@ -58,13 +133,38 @@ void cGstoutSetupPage::Setup(void)
   int current = Current();
   Clear();
   
-  Add(new cMenuEditStraItem(tr("Audio Sink"), &audioSinkIndex, 5, audioSinkNames));
-  Add(new cMenuEditStraItem(tr("Video Sink"), &videoSinkIndex, 6, videoSinkNames));
+  Add(new cMenuEditStraItem(tr("Audio Sink"), &audioSinkIndex, numAudioSinks, audioSinkNames));
+  Add(new cMenuEditStraItem(tr("Audio Sink Latency"), &audioSinkLatency, alCount, audioSinkLatencyNames));
+  Add(new cMenuEditIntItem(tr("Audio Sink Buffer (ms)"), &audioBufferTime, 20, 2000));
+  Add(new cMenuEditIntItem(tr("Audio Sink Period (ms)"), &audioLatencyTime, 1, 200));
+  Add(new cMenuEditStraItem(tr("Audio Clock Slaving"), &audioSlaveMethod, asCount, audioSlaveMethodNames));
+  Add(new cMenuEditIntItem(tr("Audio Drift Tolerance (ms)"), &audioDriftTolerance, 1, 1000));
+  Add(new cMenuEditBoolItem(tr("Audio Sink Provides Clock"), &audioProvideClock));
+  Add(new cMenuEditBoolItem(tr("Loudness Normalization"), &audioLoudness));
+  Add(new cMenuEditIntItem(tr("Loudness Target (LUFS)"), &audioLoudnessTarget, -31, -14));
+  Add(new cMenuEditStraItem(tr("Dynamic Range Compression"), &audioCompression, dcCount, compressionNames));
+  Add(new cMenuEditStraItem(tr("Video Sink"), &videoSinkIndex, numVideoSinks, videoSinkNames));
+  Add(new cMenuEditStrItem(tr("Video Stream"), videoStream, sizeof(videoStream), StreamChars));
   Add(new cMenuEditBoolItem(tr("Hardware Decoding"), &useHardwareDecoding));
   Add(new cMenuEditBoolItem(tr("Deinterlace"), &deinterlace));
+  Add(new cMenuEditStraItem(tr("Deinterlace Method"), &deinterlaceMethod, dmCount, deinterlaceMethodNames));
   Add(new cMenuEditBoolItem(tr("OSD Blending"), &osdBlending));
-  Add(new cMenuEditIntItem(tr("Audio Buffer (KB)"), &audioBufferSize, 50, 1000));
-  Add(new cMenuEditIntItem(tr("Video Buffer (KB)"), &videoBufferSize, 100, 2000));
+  Add(new cMenuEditIntItem(tr("Target Latency (ms)"), &targetLatency, 100, 5000));
+  Add(new cMenuEditIntItem(tr("Min. Latency (ms)"), &syncMinLatency, 0, 2000));
+  Add(new cMenuEditIntItem(tr("Max. Input Memory (MB)"), &inputPoolSize, 0, 256, tr("auto")));
+  Add(new cMenuEditIntItem(tr("Time Shift Buffer (MB)"), &timeshiftSize, 0, 65536, tr("off")));
+  Add(new cMenuEditIntItem(tr("Parallel Audio Tracks"), &audioTracks, 1, GSTTRACK_MAX + 1));
+  Add(new cMenuEditBoolItem(tr("Show Subtitles"), &subtitles));
+  Add(new cMenuEditBoolItem(tr("Stop Video on Radio Channels"), &radioMode));
+  Add(new cMenuEditStraItem(tr("Decoder Mode"), &decoderMode, 3, decoderModeNames));
+  
+  static const char *CodecLabels[gcCount] = { "MPEG-2", "H.264", "H.265" };
+  for (int i = 0; i < gcCount; i++) {
+    Add(new cMenuEditStraItem(cString::sprintf("%s %s", CodecLabels[i], tr("Threading")), &threading[i], 3, threadingNames));
+    Add(new cMenuEditIntItem(cString::sprintf("%s %s", CodecLabels[i], tr("Threads")), &threads[i], 0, 16, tr("auto")));
+  }
+  Add(new cMenuEditStraItem(tr("Log Channel Switch Times"), &zapLogLevel, zlCount, zapLogLevelNames));
+  Add(new cMenuEditBoolItem(tr("Show First Picture on Zap"), &zapFirstPicture));
   
   SetCurrent(Get(current));
   Display();
@@ -72,24 +172,74 @@ void cGstoutSetupPage::Setup(void)
 
 void cGstoutSetupPage::Store(void)
 {
-  // Copy selected sink names to config
-  strncpy(GstoutConfig.audioSink, audioSinkNames[audioSinkIndex], sizeof(GstoutConfig.audioSink) - 1);
-  GstoutConfig.audioSink[sizeof(GstoutConfig.audioSink) - 1] = '\0';
-  
-  strncpy(GstoutConfig.videoSink, videoSinkNames[videoSinkIndex], sizeof(GstoutConfig.videoSink) - 1);
-  GstoutConfig.videoSink[sizeof(GstoutConfig.videoSink) - 1] = '\0';
+  // Copy selected sink names to config (the custom entry points into it)
+  if (audioSinkNames[audioSinkIndex] != GstoutConfig.audioSink)
+    strn0cpy(GstoutConfig.audioSink, audioSinkNames[audioSinkIndex], sizeof(GstoutConfig.audioSink));
+  if (videoSinkNames[videoSinkIndex] != GstoutConfig.videoSink)
+    strn0cpy(GstoutConfig.videoSink, videoSinkNames[videoSinkIndex], sizeof(GstoutConfig.videoSink));
   
+  strn0cpy(GstoutConfig.videoStream, stripspace(videoStream), sizeof(GstoutConfig.videoStream));
   GstoutConfig.useHardwareDecoding = useHardwareDecoding;
   GstoutConfig.deinterlace = deinterlace;
-  GstoutConfig.audioBufferSize = audioBufferSize;
-  GstoutConfig.videoBufferSize = videoBufferSize;
+  GstoutConfig.deinterlaceMethod = deinterlaceMethod;
+  GstoutConfig.targetLatency = targetLatency;
+  GstoutConfig.syncMinLatency = min(syncMinLatency, targetLatency);
+  GstoutConfig.inputPoolSize = inputPoolSize;
+  GstoutConfig.timeshiftSize = timeshiftSize;
+  GstoutConfig.audioTracks = audioTracks;
+  GstoutConfig.subtitles = subtitles;
+  GstoutConfig.radioMode = radioMode;
+  GstoutConfig.audioSinkLatency = audioSinkLatency;
+  GstoutConfig.audioBufferTime = audioBufferTime;
+  GstoutConfig.audioLatencyTime = min(audioLatencyTime, audioBufferTime / 2);
+  GstoutConfig.audioSlaveMethod = audioSlaveMethod;
+  GstoutConfig.audioDriftTolerance = audioDriftTolerance;
+  GstoutConfig.audioProvideClock = audioProvideClock;
+  GstoutConfig.audioLoudness = audioLoudness;
+  GstoutConfig.audioLoudnessTarget = audioLoudnessTarget;
+  GstoutConfig.audioCompression = audioCompression;
   GstoutConfig.osdBlending = osdBlending;
+  GstoutConfig.decoderMode = decoderMode;
+  GstoutConfig.zapLogLevel = zapLogLevel;
+  GstoutConfig.zapFirstPicture = zapFirstPicture;
+  for (int i = 0; i < gcCount; i++) {
+    GstoutConfig.decoder[i].threading = threading[i];
+    GstoutConfig.decoder[i].threads = threads[i];
+  }
   
   SetupStore("UseHardwareDecoding", GstoutConfig.useHardwareDecoding);
   SetupStore("Deinterlace", GstoutConfig.deinterlace);
-  SetupStore("AudioBufferSize", GstoutConfig.audioBufferSize);
-  SetupStore("VideoBufferSize", GstoutConfig.videoBufferSize);
+  SetupStore("DeinterlaceMethod", GstoutConfig.deinterlaceMethod);
+  SetupStore("TargetLatency", GstoutConfig.targetLatency);
+  SetupStore("SyncMinLatency", GstoutConfig.syncMinLatency);
+  SetupStore("InputPoolSize", GstoutConfig.inputPoolSize);
+  SetupStore("TimeshiftSize", GstoutConfig.timeshiftSize);
+  SetupStore("AudioTracks", GstoutConfig.audioTracks);
+  SetupStore("Subtitles", GstoutConfig.subtitles);
+  SetupStore("RadioMode", GstoutConfig.radioMode);
+  SetupStore("AudioSinkLatency", GstoutConfig.audioSinkLatency);
+  SetupStore("AudioBufferTime", GstoutConfig.audioBufferTime);
+  SetupStore("AudioLatencyTime", GstoutConfig.audioLatencyTime);
+  SetupStore("AudioSlaveMethod", GstoutConfig.audioSlaveMethod);
+  SetupStore("AudioDriftTolerance", GstoutConfig.audioDriftTolerance);
+  SetupStore("AudioProvideClock", GstoutConfig.audioProvideClock);
+  SetupStore("AudioLoudness", GstoutConfig.audioLoudness);
+  SetupStore("AudioLoudnessTarget", GstoutConfig.audioLoudnessTarget);
+  SetupStore("AudioCompression", GstoutConfig.audioCompression);
   SetupStore("AudioSink", GstoutConfig.audioSink);
   SetupStore("VideoSink", GstoutConfig.videoSink);
+  SetupStore("VideoStream", GstoutConfig.videoStream);
   SetupStore("OsdBlending", GstoutConfig.osdBlending);
+  SetupStore("DecoderMode", GstoutConfig.decoderMode);
+  SetupStore("ZapLogLevel", GstoutConfig.zapLogLevel);
+  SetupStore("ZapFirstPicture", GstoutConfig.zapFirstPicture);
+  for (int i = 0; i < gcCount; i++) {
+    const char *codec = cGstoutConfig::CodecName(i);
+    SetupStore(cString::sprintf("%sThreading", codec), GstoutConfig.decoder[i].threading);
+    SetupStore(cString::sprintf("%sThreads", codec), GstoutConfig.decoder[i].threads);
+  }
+  
+  // Swap sinks, decoder and deinterlacer in the running pipelines
+  if (output)
+    output->Reconfigure();
 }
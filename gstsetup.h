@@ -6,22 +6,54 @@
 #define __GSTSETUP_H
 
 #include <vdr/menuitems.h>
+#include "gstconfig.h"
 
-// Forward declaration to avoid circular dependency
-class cGstoutConfig;
+class cGstOutput;
 
 class cGstoutSetupPage : public cMenuSetupPage {
 private:
+  cGstOutput *output;
   int audioSinkIndex;
   int videoSinkIndex;
+  int numAudioSinks;
+  int numVideoSinks;
   int useHardwareDecoding;
   int deinterlace;
-  int audioBufferSize;
-  int videoBufferSize;
+  int deinterlaceMethod;
+  int targetLatency;
+  int syncMinLatency;
+  int inputPoolSize;
+  int timeshiftSize;
+  int audioTracks;
+  int subtitles;
+  int radioMode;
+  int audioSinkLatency;
+  int audioBufferTime;
+  int audioLatencyTime;
+  int audioSlaveMethod;
+  int audioDriftTolerance;
+  int audioProvideClock;
+  int audioLoudness;
+  int audioLoudnessTarget;
+  int audioCompression;
+  char videoStream[256];
   
   const char *audioSinkNames[10];
   const char *videoSinkNames[10];
   int osdBlending;
+  int decoderMode;
+  int zapLogLevel;
+  int zapFirstPicture;
+  int threading[gcCount];
+  int threads[gcCount];
+  
+  const char *decoderModeNames[3];
+  const char *threadingNames[3];
+  const char *deinterlaceMethodNames[dmCount];
+  const char *zapLogLevelNames[zlCount];
+  const char *audioSinkLatencyNames[alCount];
+  const char *audioSlaveMethodNames[asCount];
+  const char *compressionNames[dcCount];
   
   void Setup(void);
   
@@ -29,7 +61,7 @@ protected:
   virtual void Store(void);
   
 public:
-  cGstoutSetupPage(void);
+  cGstoutSetupPage(cGstOutput *Output);
 };
 
 #endif // __GSTSETUP_H
@@ -0,0 +1,171 @@
+/*
+ * gstsubtitle.c: Subtitle overlay of the video pipeline
+ */
+
+#include "gstsubtitle.h"
+#include "gstdemux.h"
+#include "gstsync.h"
+#include <gst/app/gstappsrc.h>
+#include <vdr/remux.h>
+
+#define SUBTITLE_APPSRC_SIZE KILOBYTE(256)
+
+// --- cGstSubtitleOverlay ---------------------------------------------------
+
+cGstSubtitleOverlay::cGstSubtitleOverlay(int Type, int Page, GstPad *SegmentPad)
+{
+  type = Type;
+  page = Page;
+  bin = NULL;
+  source = NULL;
+  segmentPad = (GstPad *)gst_object_ref(SegmentPad);
+  numPending = 0;
+  pushed = 0;
+  dropped = 0;
+}
+
+cGstSubtitleOverlay::~cGstSubtitleOverlay()
+{
+  // The bin is stopped and removed by now
+  for (int i = 0; i < numPending; i++)
+    gst_buffer_unref(pending[i].buffer);
+  gst_object_unref(segmentPad);
+}
+
+GstElement *cGstSubtitleOverlay::Create(const char *BinName)
+{
+  bool teletext = type == stTeletext;
+  source = gst_element_factory_make("appsrc", NULL);
+  GstElement *decoder = teletext ? gst_element_factory_make("teletextdec", NULL) : NULL;
+  GstElement *overlay = gst_element_factory_make(teletext ? "textoverlay" : "dvbsuboverlay", NULL);
+
+  if (!source || (teletext && !decoder) || !overlay) {
+    esyslog("gstout: Failed to create subtitle elements (%s)", teletext ? "teletextdec, textoverlay" : "dvbsuboverlay");
+    GstElement *elements[] = { source, decoder, overlay };
+    for (unsigned int i = 0; i < sizeof(elements) / sizeof(elements[0]); i++) {
+      if (elements[i])
+        gst_object_unref(elements[i]);
+    }
+    source = NULL;
+    return NULL;
+  }
+
+  // Buffers carry running time, the default segment passes it through
+  GstCaps *caps = gst_caps_new_empty_simple(teletext ? "application/x-teletext" : "subpicture/x-dvb");
+  g_object_set(G_OBJECT(source),
+               "caps", caps,
+               "stream-type", GST_APP_STREAM_TYPE_STREAM,
+               "format", GST_FORMAT_TIME,
+               "is-live", TRUE,
+               "max-bytes", (guint64)SUBTITLE_APPSRC_SIZE,
+               NULL);
+  gst_caps_unref(caps);
+
+  if (teletext) {
+    g_object_set(G_OBJECT(decoder), "page", page, NULL);
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(decoder), "subtitles-mode"))
+      g_object_set(G_OBJECT(decoder), "subtitles-mode", TRUE, NULL);
+    // Frames never wait for a subtitle
+    g_object_set(G_OBJECT(overlay), "wait-text", FALSE, NULL);
+  }
+
+  bin = gst_bin_new(BinName);
+  gst_bin_add_many(GST_BIN(bin), source, overlay, NULL);
+  if (decoder)
+    gst_bin_add(GST_BIN(bin), decoder);
+  bool ok = teletext ? gst_element_link(source, decoder) && gst_element_link_pads(decoder, "src", overlay, "text_sink") :
+                       gst_element_link_pads(source, "src", overlay, "text_sink");
+  if (!ok) {
+    esyslog("gstout: Failed to link subtitle elements");
+    gst_object_unref(bin);
+    bin = NULL;
+    source = NULL;
+    return NULL;
+  }
+
+  GstPad *pad = gst_element_get_static_pad(overlay, "video_sink");
+  gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+  gst_object_unref(pad);
+  pad = gst_element_get_static_pad(overlay, "src");
+  gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+  gst_object_unref(pad);
+
+  if (teletext)
+    isyslog("gstout: Teletext subtitles of page %d created as %s", page, BinName);
+  else
+    isyslog("gstout: DVB subtitles created as %s", BinName);
+  return bin;
+}
+
+void cGstSubtitleOverlay::Put(const uchar *Data, int Length)
+{
+  if (!source || Length < 9 || Data[0] != 0x00 || Data[1] != 0x00 || Data[2] != 0x01)
+    return;
+  int offset = PesPayloadOffset(Data);
+  if (offset >= Length || Length < 14 || !PesHasPts(Data)) {
+    dropped++; // can't be timed
+    return;
+  }
+
+  if (numPending == GSTSUBTITLE_PENDING) {
+    gst_buffer_unref(pending[0].buffer);
+    memmove(pending, pending + 1, (GSTSUBTITLE_PENDING - 1) * sizeof(tPending));
+    numPending--;
+    dropped++;
+  }
+  GstBuffer *buffer = gst_buffer_new_allocate(NULL, Length - offset, NULL);
+  gst_buffer_fill(buffer, 0, Data + offset, Length - offset);
+  pending[numPending].buffer = buffer;
+  pending[numPending].pts = PesGetPts(Data);
+  numPending++;
+  Push();
+}
+
+void cGstSubtitleOverlay::Push(void)
+{
+  // Nothing can be timed before the first decoded frame
+  GstEvent *event = gst_pad_get_sticky_event(segmentPad, GST_EVENT_SEGMENT, 0);
+  if (!event)
+    return;
+  const GstSegment *segment;
+  gst_event_parse_segment(event, &segment);
+
+  for (int i = 0; i < numPending; i++) {
+    GstBuffer *buffer = pending[i].buffer;
+    guint64 running = gst_segment_to_running_time(segment, GST_FORMAT_TIME, gst_util_uint64_scale(pending[i].pts, GST_SECOND, 90000));
+    if (running == GST_CLOCK_TIME_NONE)
+      dropped++; // before the segment of the frames
+    else {
+      GST_BUFFER_PTS(buffer) = running;
+      GstFlowReturn ret;
+      g_signal_emit_by_name(source, "push-buffer", buffer, &ret);
+      if (ret == GST_FLOW_OK)
+        pushed++;
+      else
+        dropped++;
+    }
+    gst_buffer_unref(buffer);
+  }
+  numPending = 0;
+  gst_event_unref(event);
+}
+
+void cGstSubtitleOverlay::Clear(void)
+{
+  for (int i = 0; i < numPending; i++)
+    gst_buffer_unref(pending[i].buffer);
+  numPending = 0;
+
+  // Through appsrc, which then drops its queue and sends a new segment.
+  // The overlay drops the subtitles it holds, the frames are not flushed.
+  if (source) {
+    gst_element_send_event(source, gst_event_new_flush_start());
+    gst_element_send_event(source, gst_event_new_flush_stop(FALSE));
+  }
+}
+
+cString cGstSubtitleOverlay::Status(void)
+{
+  cString name = type == stTeletext ? cString::sprintf("teletext page %d", page) : cString("DVB");
+  return cString::sprintf("Subtitles: %s, %d pending, %d pushed, %d dropped", *name, numPending, pushed, dropped);
+}
@@ -0,0 +1,68 @@
+/*
+ * gstsubtitle.h: Subtitle overlay of the video pipeline
+ */
+
+#ifndef __GSTSUBTITLE_H
+#define __GSTSUBTITLE_H
+
+#include <vdr/tools.h>
+#include <gst/gst.h>
+
+#define GSTSUBTITLE_PENDING  32  // packets held until the video has a segment
+
+// --- cGstSubtitleOverlay ---------------------------------------------------
+
+// DVB or teletext subtitles of the live channel, rendered by dvbsuboverlay
+// or teletextdec ! textoverlay in a bin that sits in the video tail:
+//
+//   sink → overlay → src
+//   appsrc → [teletextdec] ┘
+//
+// The overlay attaches its rectangles as GstVideoOverlayComposition meta if
+// the sink takes it and blends them into the frame otherwise, so the OSD
+// buffers are never touched. Subtitle packets are timestamped with the
+// running time their PTS has in the video's segment (both come from the
+// same program clock), which is what the overlay matches them to the
+// frames with. Not thread-safe, the owning output serializes access with
+// its own mutex.
+
+class cGstSubtitleOverlay {
+private:
+  int type;        // eGstSubtitleType
+  int page;
+  GstElement *bin;
+  GstElement *source;
+  GstPad *segmentPad;
+  struct tPending {
+    GstBuffer *buffer;
+    int64_t pts;
+  };
+  tPending pending[GSTSUBTITLE_PENDING];
+  int numPending;
+  int pushed;
+  int dropped;
+
+  void Push(void);
+
+public:
+  // SegmentPad carries the decoded video, its segment maps the PTS
+  cGstSubtitleOverlay(int Type, int Page, GstPad *SegmentPad);
+  ~cGstSubtitleOverlay();
+
+  // Builds the bin with "sink" and "src" pads, which is owned by the
+  // pipeline it is added to
+  GstElement *Create(const char *BinName);
+  GstElement *Bin(void) { return bin; }
+
+  // PES packet of the subtitle stream
+  void Put(const uchar *Data, int Length);
+
+  // Drops what is waiting and what the overlay still shows
+  void Clear(void);
+
+  int Type(void) { return type; }
+  int Page(void) { return page; }
+  cString Status(void);
+};
+
+#endif // __GSTSUBTITLE_H
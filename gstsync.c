@@ -0,0 +1,123 @@
+/*
+ * gstsync.c: A/V sync controller for GStreamer output
+ */
+
+#include "gstsync.h"
+#include "gstconfig.h"
+#include <vdr/remux.h>
+
+#define PTS_WRAP          (1LL << 33)
+#define SYNC_DEADBAND_MS  20  // offsets below this are not corrected
+#define SYNC_STEP_MS      5   // max. change of a delay per update
+#define SYNC_RESET_MS     5000 // offsets beyond this are discontinuities
+
+int GstPtsDiffMs(int64_t Pts1, int64_t Pts2)
+{
+  int64_t d = (Pts2 - Pts1) & (PTS_WRAP - 1);
+  if (d >= PTS_WRAP / 2)
+    d -= PTS_WRAP;
+  return int(d / 90);
+}
+
+// --- cGstSyncTracker -------------------------------------------------------
+
+cGstSyncTracker::cGstSyncTracker(void)
+{
+  Clear();
+}
+
+void cGstSyncTracker::Clear(void)
+{
+  head = 0;
+  tail = 0;
+  bytesIn = 0;
+  bytesOut = 0;
+  inPts = GSTSYNC_NOPTS;
+  outPts = GSTSYNC_NOPTS;
+}
+
+void cGstSyncTracker::Put(const uchar *Data, int Length)
+{
+  if (Data && Length >= 14 && PesHasPts(Data)) {
+    int next = (head + 1) % GSTSYNC_MAXMARKS;
+    if (next == tail) // full, drop the oldest mark
+      tail = (tail + 1) % GSTSYNC_MAXMARKS;
+    marks[head].offset = bytesIn;
+    marks[head].pts = PesGetPts(Data);
+    head = next;
+    inPts = PesGetPts(Data);
+    if (outPts == GSTSYNC_NOPTS)
+      outPts = inPts;
+  }
+  bytesIn += Length;
+}
+
+void cGstSyncTracker::Del(int Count)
+{
+  bytesOut += Count;
+  while (tail != head && marks[tail].offset < bytesOut) {
+    outPts = marks[tail].pts;
+    tail = (tail + 1) % GSTSYNC_MAXMARKS;
+  }
+}
+
+int cGstSyncTracker::BufferedMs(void) const
+{
+  if (inPts == GSTSYNC_NOPTS || outPts == GSTSYNC_NOPTS)
+    return -1;
+  int ms = GstPtsDiffMs(outPts, inPts);
+  return ms > 0 ? ms : 0;
+}
+
+// --- cGstSyncController ----------------------------------------------------
+
+cGstSyncController::cGstSyncController(void)
+{
+  Reset();
+}
+
+void cGstSyncController::Reset(void)
+{
+  offsetMs = 0;
+  audioDelayMs = 0;
+  videoDelayMs = 0;
+  valid = false;
+}
+
+bool cGstSyncController::Update(int64_t AudioPts, int64_t VideoPts)
+{
+  if (AudioPts == GSTSYNC_NOPTS || VideoPts == GSTSYNC_NOPTS) {
+    valid = false;
+    return false;
+  }
+
+  // Positive offset: audio is fed ahead of video
+  int measured = GstPtsDiffMs(VideoPts, AudioPts);
+  if (abs(measured) > SYNC_RESET_MS) {
+    // Channel switch or broken stream, don't chase it
+    valid = false;
+    return false;
+  }
+  if (!valid) {
+    offsetMs = measured;
+    valid = true;
+  }
+  else
+    offsetMs = (offsetMs * 7 + measured) / 8;
+
+  // Delay whichever stream runs ahead, limited to the latency window
+  int maxDelay = GstoutConfig.targetLatency;
+  int audioTarget = 0;
+  int videoTarget = 0;
+  if (offsetMs > SYNC_DEADBAND_MS)
+    audioTarget = min(offsetMs, maxDelay);
+  else if (offsetMs < -SYNC_DEADBAND_MS)
+    videoTarget = min(-offsetMs, maxDelay);
+
+  int oldAudio = audioDelayMs;
+  int oldVideo = videoDelayMs;
+  audioDelayMs += constrain(audioTarget - audioDelayMs, -SYNC_STEP_MS, SYNC_STEP_MS);
+  videoDelayMs += constrain(videoTarget - videoDelayMs, -SYNC_STEP_MS, SYNC_STEP_MS);
+
+  return audioDelayMs != oldAudio || videoDelayMs != oldVideo;
+}
@@ -0,0 +1,82 @@
+/*
+ * gstsync.h: A/V sync controller for GStreamer output
+ */
+
+#ifndef __GSTSYNC_H
+#define __GSTSYNC_H
+
+#include <vdr/tools.h>
+
+#define GSTSYNC_MAXMARKS  512  // PTS marks kept per ring buffer
+#define GSTSYNC_NOPTS     -1
+
+// --- cGstSyncTracker -------------------------------------------------------
+
+// Tracks the PTS of PES data entering and leaving a ring buffer, so the
+// buffered amount can be expressed as a duration instead of bytes.
+// Not thread-safe, the owning output serializes access with its own mutex.
+
+class cGstSyncTracker {
+private:
+  struct tMark {
+    int64_t offset;
+    int64_t pts;
+  };
+  tMark marks[GSTSYNC_MAXMARKS];
+  int head;
+  int tail;
+  int64_t bytesIn;
+  int64_t bytesOut;
+  int64_t inPts;
+  int64_t outPts;
+
+public:
+  cGstSyncTracker(void);
+
+  void Clear(void);
+
+  // Called with each PES packet written to the ring buffer
+  void Put(const uchar *Data, int Length);
+
+  // Called with the number of bytes removed from the ring buffer
+  void Del(int Count);
+
+  // Newest PTS written / PTS of the data last handed to appsrc
+  int64_t InPts(void) const { return inPts; }
+  int64_t OutPts(void) const { return outPts; }
+
+  // Buffered duration in ms, or -1 if the stream carries no PTS yet
+  int BufferedMs(void) const;
+};
+
+// --- cGstSyncController ----------------------------------------------------
+
+// Measures the A/V offset between the audio and video feeds and derives a
+// render offset for the stream that runs ahead.
+
+class cGstSyncController {
+private:
+  int offsetMs;
+  int audioDelayMs;
+  int videoDelayMs;
+  bool valid;
+
+public:
+  cGstSyncController(void);
+
+  void Reset(void);
+
+  // Feed the current output PTS of both streams, returns true if the
+  // delays have changed and need to be applied to the sinks
+  bool Update(int64_t AudioPts, int64_t VideoPts);
+
+  bool Valid(void) const { return valid; }
+  int OffsetMs(void) const { return offsetMs; }
+  int AudioDelayMs(void) const { return audioDelayMs; }
+  int VideoDelayMs(void) const { return videoDelayMs; }
+};
+
+// Wrap-aware difference Pts2 - Pts1 in ms
+int GstPtsDiffMs(int64_t Pts1, int64_t Pts2);
+
+#endif // __GSTSYNC_H
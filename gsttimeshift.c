@@ -0,0 +1,265 @@
+/*
+ * gsttimeshift.c: Time-shift buffer in memory mapped segment files
+ */
+
+#include "gsttimeshift.h"
+#include <vdr/remux.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TIMESHIFT_SEGMENT_MB  64
+#define TIMESHIFT_MARK_MS     1000  // without random access indicators
+
+// --- cGstTimeshift ---------------------------------------------------------
+
+cGstTimeshift::cGstTimeshift(void)
+{
+  sizeMB = 0;
+  numSegments = 0;
+  segmentSize = 0;
+  segments = NULL;
+  Clear();
+}
+
+cGstTimeshift::~cGstTimeshift()
+{
+  Close();
+}
+
+cString cGstTimeshift::SegmentName(int Index)
+{
+  return cString::sprintf("%s/timeshift-%03d.ts", *directory, Index);
+}
+
+bool cGstTimeshift::Open(const char *Directory, int SizeMB)
+{
+  Close();
+
+  // Segments hold whole TS packets, so a packet never straddles two
+  int segmentMB = SizeMB >= 2 * TIMESHIFT_SEGMENT_MB ? TIMESHIFT_SEGMENT_MB : max(SizeMB / 2, 1);
+  directory = Directory;
+  numSegments = max(SizeMB / segmentMB, 2);
+  segmentSize = MEGABYTE(segmentMB) / TS_SIZE * TS_SIZE;
+
+  if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+    esyslog("gstout: Can't create time-shift directory %s: %m", *directory);
+    return false;
+  }
+
+  segments = new uchar *[numSegments];
+  for (int i = 0; i < numSegments; i++)
+    segments[i] = NULL;
+
+  for (int i = 0; i < numSegments; i++) {
+    // Sparse files, the disk fills up as the segments are first written
+    cString name = SegmentName(i);
+    int fd = open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, segmentSize) < 0) {
+      esyslog("gstout: Can't create time-shift segment %s: %m", *name);
+      if (fd >= 0)
+        close(fd);
+      Close();
+      return false;
+    }
+    void *p = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      esyslog("gstout: Can't map time-shift segment %s: %m", *name);
+      Close();
+      return false;
+    }
+    madvise(p, segmentSize, MADV_SEQUENTIAL);
+    segments[i] = (uchar *)p;
+  }
+
+  sizeMB = SizeMB;
+  Clear();
+  isyslog("gstout: Time-shift buffer of %d x %d MB in %s", numSegments, segmentMB, *directory);
+  return true;
+}
+
+void cGstTimeshift::Close(void)
+{
+  if (segments) {
+    // The recorded stream is of no use after a restart
+    for (int i = 0; i < numSegments; i++) {
+      if (segments[i]) {
+        munmap(segments[i], segmentSize);
+        unlink(SegmentName(i));
+      }
+    }
+    delete[] segments;
+    segments = NULL;
+  }
+  sizeMB = 0;
+  Clear();
+}
+
+void cGstTimeshift::Clear(void)
+{
+  writePos = 0;
+  readPos = 0;
+  shifted = false;
+  paused = false;
+  discontinuity = false;
+  overruns = 0;
+  firstMark = 0;
+  numMarks = 0;
+  randomAccess = false;
+  lastMarkMs = 0;
+}
+
+void cGstTimeshift::AddMark(uint64_t TimeMs)
+{
+  // Marks in overwritten data go first, then the oldest if the index is full
+  while (numMarks && Mark(0)->position < Oldest()) {
+    firstMark = (firstMark + 1) % GSTTIMESHIFT_MARKS;
+    numMarks--;
+  }
+  if (numMarks == GSTTIMESHIFT_MARKS) {
+    firstMark = (firstMark + 1) % GSTTIMESHIFT_MARKS;
+    numMarks--;
+  }
+  tGstTimeshiftMark &mark = marks[(firstMark + numMarks) % GSTTIMESHIFT_MARKS];
+  mark.position = writePos;
+  mark.timeMs = TimeMs;
+  numMarks++;
+  lastMarkMs = TimeMs;
+}
+
+void cGstTimeshift::Put(const uchar *Data, int VideoPid)
+{
+  if (!segments)
+    return;
+
+  if (VideoPid && TsPid(Data) == VideoPid && TsPayloadStart(Data)) {
+    // Streams without the indicator get a mark per second, decoding then
+    // starts with the next keyframe after it
+    bool rai = TsHasAdaptationField(Data) && Data[4] > 0 && (Data[5] & 0x40);
+    randomAccess |= rai;
+    uint64_t now = cTimeMs::Now();
+    if (rai || (!randomAccess && now - lastMarkMs >= TIMESHIFT_MARK_MS))
+      AddMark(now);
+  }
+
+  memcpy(segments[(writePos / segmentSize) % numSegments] + writePos % segmentSize, Data, TS_SIZE);
+  writePos += TS_SIZE;
+  if (!shifted)
+    readPos = writePos;
+}
+
+int cGstTimeshift::FindMark(uint64_t TimeMs, bool After)
+{
+  // The last mark at or before TimeMs (the oldest one if there is none), or
+  // the first one at or after it
+  uint64_t oldest = Oldest();
+  int found = -1;
+  for (int i = 0; i < numMarks; i++) {
+    const tGstTimeshiftMark *mark = Mark(i);
+    if (mark->position < oldest)
+      continue;
+    if (After) {
+      if (mark->timeMs >= TimeMs)
+        return i;
+    }
+    else if (mark->timeMs <= TimeMs || found < 0)
+      found = i;
+    else
+      break;
+  }
+  return found;
+}
+
+uint64_t cGstTimeshift::TimeAt(uint64_t Position)
+{
+  if (Position >= writePos)
+    return cTimeMs::Now();
+
+  uint64_t time = numMarks ? Mark(0)->timeMs : cTimeMs::Now();
+  for (int i = 0; i < numMarks && Mark(i)->position <= Position; i++)
+    time = Mark(i)->timeMs;
+  return time;
+}
+
+void cGstTimeshift::Pause(void)
+{
+  // Playback continues from here, the live stream is recorded meanwhile
+  shifted = true;
+  paused = true;
+}
+
+void cGstTimeshift::Live(void)
+{
+  readPos = writePos;
+  shifted = false;
+  paused = false;
+}
+
+bool cGstTimeshift::Seek(int Seconds)
+{
+  uint64_t now = TimeAt(readPos);
+  uint64_t target = Seconds < 0 ? now - min(now, (uint64_t)-Seconds * 1000) : now + (uint64_t)Seconds * 1000;
+  int i = FindMark(target, Seconds > 0);
+  if (i < 0) {
+    Live();
+    return false;
+  }
+  readPos = Mark(i)->position;
+  shifted = true;
+  return true;
+}
+
+const uchar *cGstTimeshift::Get(int &Length)
+{
+  if (!segments)
+    return NULL;
+
+  if (readPos < Oldest()) {
+    // Overwritten while paused or behind for too long
+    int i = FindMark(0, true);
+    readPos = i >= 0 ? Mark(i)->position : Oldest();
+    overruns++;
+    discontinuity = true;
+    dsyslog("gstout: Time-shift reader overrun, continuing %d s behind live", DelayMs() / 1000);
+  }
+  if (readPos >= writePos)
+    return NULL;
+
+  int offset = readPos % segmentSize;
+  Length = (int)min(writePos - readPos, (uint64_t)(segmentSize - offset));
+  return segments[(readPos / segmentSize) % numSegments] + offset;
+}
+
+bool cGstTimeshift::Discontinuity(void)
+{
+  bool d = discontinuity;
+  discontinuity = false;
+  return d;
+}
+
+int cGstTimeshift::DelayMs(void)
+{
+  return shifted ? int(cTimeMs::Now() - TimeAt(readPos)) : 0;
+}
+
+cString cGstTimeshift::Status(void)
+{
+  if (!segments)
+    return "Time shift: off";
+
+  uint64_t available = writePos - Oldest();
+  int i = FindMark(0, true);
+  int seconds = i >= 0 ? int((cTimeMs::Now() - Mark(i)->timeMs) / 1000) : 0;
+  return cString::sprintf("Time shift: %s, %d s behind live, Buffer: %llu/%d MB (%d s), %d random access points%s, %d overruns",
+                          paused ? "paused" : shifted ? "shifted" : "live",
+                          DelayMs() / 1000,
+                          (unsigned long long)(available / MEGABYTE(1)),
+                          sizeMB,
+                          seconds,
+                          numMarks,
+                          randomAccess ? "" : " (timed)",
+                          overruns);
+}
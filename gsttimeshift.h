@@ -0,0 +1,99 @@
+/*
+ * gsttimeshift.h: Time-shift buffer in memory mapped segment files
+ */
+
+#ifndef __GSTTIMESHIFT_H
+#define __GSTTIMESHIFT_H
+
+#include <vdr/tools.h>
+
+#define GSTTIMESHIFT_MARKS 16384  // random access points, ~2 h at 2 per second
+
+struct tGstTimeshiftMark {
+  uint64_t position;  // stream offset of the TS packet
+  uint64_t timeMs;    // cTimeMs::Now() when it was written
+};
+
+// --- cGstTimeshift ---------------------------------------------------------
+
+// The live TS is appended to a fixed set of segment files, which are mapped
+// into memory and overwritten round robin, so the disk use is bounded and
+// the page cache decides what stays in RAM. Positions are offsets in the
+// whole stream; the oldest data still available is Size() bytes behind the
+// write position. Random access points (video PES starts with the random
+// access indicator) are indexed with their write time, seeking moves the
+// read position to one of them. Not thread safe, cGstOutput's mutex covers
+// the writer and the reader.
+
+class cGstTimeshift {
+private:
+  cString directory;
+  int sizeMB;
+  int numSegments;
+  int segmentSize;
+  uchar **segments;
+
+  uint64_t writePos;
+  uint64_t readPos;
+  bool shifted;
+  bool paused;
+  bool discontinuity;
+  int overruns;
+
+  tGstTimeshiftMark marks[GSTTIMESHIFT_MARKS];
+  int firstMark;
+  int numMarks;
+  bool randomAccess;
+  uint64_t lastMarkMs;
+
+  cString SegmentName(int Index);
+  uint64_t Oldest(void) { return writePos > Size() ? writePos - Size() : 0; }
+  const tGstTimeshiftMark *Mark(int Index) { return &marks[(firstMark + Index) % GSTTIMESHIFT_MARKS]; }
+  void AddMark(uint64_t TimeMs);
+  int FindMark(uint64_t TimeMs, bool After);
+  uint64_t TimeAt(uint64_t Position);
+
+public:
+  cGstTimeshift(void);
+  ~cGstTimeshift();
+
+  // Creates and maps SizeMB of segment files in Directory, any previous
+  // buffer is dropped
+  bool Open(const char *Directory, int SizeMB);
+  void Close(void);
+  bool IsOpen(void) { return segments != NULL; }
+  int SizeMB(void) { return sizeMB; }
+  uint64_t Size(void) { return (uint64_t)numSegments * segmentSize; }
+
+  // Drops the recorded stream (e.g. on a channel switch)
+  void Clear(void);
+
+  // Appends one TS packet, VideoPid is used to find random access points
+  void Put(const uchar *Data, int VideoPid);
+
+  // While shifted the live stream is only recorded and playback reads from
+  // the read position; otherwise it follows the write position
+  bool Shifted(void) { return shifted; }
+  bool Paused(void) { return paused; }
+  void Pause(void);
+  void Play(void) { paused = false; }
+  void Live(void);
+
+  // Moves the read position by about Seconds to a random access point,
+  // returns false if that reaches the live stream (which is then played)
+  bool Seek(int Seconds);
+
+  // Data at the read position, up to the end of its segment or the write
+  // position, NULL once the reader has caught up
+  const uchar *Get(int &Length);
+  void Del(int Length) { readPos += Length; }
+
+  // True once after the reader was overrun by the writer and moved on to
+  // the oldest random access point
+  bool Discontinuity(void);
+
+  int DelayMs(void);
+  cString Status(void);
+};
+
+#endif // __GSTTIMESHIFT_H
@@ -0,0 +1,358 @@
+/*
+ * gsttrace.c: Per stage latency tracing for GStreamer output
+ */
+
+#include "gsttrace.h"
+
+// --- cGstHistogram ---------------------------------------------------------
+
+cGstHistogram::cGstHistogram(void)
+{
+  Reset();
+}
+
+int cGstHistogram::Bucket(int Us)
+{
+  if (Us < 16)
+    return max(Us, 0);
+  int e = 31 - __builtin_clz(Us);
+  int sub = (Us >> (e - 2)) & 3;
+  return min(16 + (e - 4) * 4 + sub, GSTHIST_BUCKETS - 1);
+}
+
+int cGstHistogram::BucketValue(int Bucket)
+{
+  if (Bucket < 16)
+    return Bucket;
+  int e = (Bucket - 16) / 4 + 4;
+  int sub = (Bucket - 16) % 4;
+  // Middle of the bucket
+  return ((4 + sub) << (e - 2)) + (1 << (e - 3));
+}
+
+void cGstHistogram::Reset(void)
+{
+  for (int i = 0; i < GSTHIST_BUCKETS; i++)
+    g_atomic_int_set(&buckets[i], 0);
+  g_atomic_int_set(&count, 0);
+  g_atomic_int_set(&maxUs, 0);
+}
+
+void cGstHistogram::Add(int Us)
+{
+  g_atomic_int_inc(&buckets[Bucket(Us)]);
+  g_atomic_int_inc(&count);
+  int old = g_atomic_int_get(&maxUs);
+  while (Us > old && !g_atomic_int_compare_and_exchange(&maxUs, old, Us))
+    old = g_atomic_int_get(&maxUs);
+}
+
+int cGstHistogram::Percentile(int P)
+{
+  int total = 0;
+  for (int i = 0; i < GSTHIST_BUCKETS; i++)
+    total += g_atomic_int_get(&buckets[i]);
+  if (!total)
+    return 0;
+  int target = max((int)(((int64_t)total * P + 99) / 100), 1);
+  int sum = 0;
+  for (int i = 0; i < GSTHIST_BUCKETS; i++) {
+    sum += g_atomic_int_get(&buckets[i]);
+    if (sum >= target)
+      return min(BucketValue(i), Max());
+  }
+  return Max();
+}
+
+// --- cGstStageTracer -------------------------------------------------------
+
+cGstStageTracer::cGstStageTracer(const char *Name)
+{
+  name = Name;
+  pipeline = NULL;
+  markHead = markTail = 0;
+  bytesIn = bytesOut = 0;
+  totalIn = totalOut = 0;
+  ringFill = 0;
+  decoderName = NULL;
+  pushHead = pushTail = 0;
+  memset(&decodeIn, 0, sizeof(decodeIn));
+  memset(&decodeOut, 0, sizeof(decodeOut));
+  gst_segment_init(&segment, GST_FORMAT_UNDEFINED);
+  zapStart = 0;
+  zapPending = 0;
+  for (int i = 0; i < zmCount; i++)
+    zapMarks[i] = -1;
+}
+
+bool cGstStageTracer::IsDecoder(GstElement *Element)
+{
+  GstElementFactory *factory = gst_element_get_factory(Element);
+  if (!factory)
+    return false;
+  const gchar *klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+  return klass && strstr(klass, "Decoder");
+}
+
+const char *cGstStageTracer::StageName(int Stage)
+{
+  static const char *Names[gsCount] = { "ring", "appsrc", "decode", "post", "sink", "zap" };
+  return (Stage >= 0 && Stage < gsCount) ? Names[Stage] : "unknown";
+}
+
+void cGstStageTracer::AttachSource(GstElement *Source)
+{
+  GstPad *pad = gst_element_get_static_pad(Source, "src");
+  if (pad) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, SourceProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+}
+
+void cGstStageTracer::AttachDecoder(GstElement *Decoder)
+{
+  // Factory names live as long as the registry
+  GstElementFactory *factory = gst_element_get_factory(Decoder);
+  if (factory)
+    g_atomic_pointer_set(&decoderName, gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)));
+
+  GstPad *pad = gst_element_get_static_pad(Decoder, "sink");
+  if (pad) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, DecoderInProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+  pad = gst_element_get_static_pad(Decoder, "src");
+  if (pad) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, DecoderOutProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+}
+
+void cGstStageTracer::AttachSink(GstElement *Sink)
+{
+  GstPad *pad = gst_element_get_static_pad(Sink, "sink");
+  if (pad) {
+    gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM), SinkProbe, this, NULL);
+    gst_object_unref(pad);
+  }
+}
+
+void cGstStageTracer::Put(int Length)
+{
+  // Caller must hold the output's mutex
+  gint64 now = g_get_monotonic_time();
+  Mark(zmByte, now);
+  __atomic_fetch_add(&totalIn, (uint64_t)Length, __ATOMIC_RELAXED);
+  g_atomic_int_add(&ringFill, Length);
+  bytesIn += Length;
+  int next = (markHead + 1) % GSTTRACE_MAXMARKS;
+  if (next == markTail)
+    return; // full, this write is not traced
+  marks[markHead].offset = bytesIn;
+  marks[markHead].time = now;
+  markHead = next;
+}
+
+void cGstStageTracer::Pushed(int Length)
+{
+  // Caller must hold the output's mutex
+  gint64 now = g_get_monotonic_time();
+  __atomic_fetch_add(&totalOut, (uint64_t)Length, __ATOMIC_RELAXED);
+  g_atomic_int_add(&ringFill, -Length);
+  bytesOut += Length;
+  while (markTail != markHead && marks[markTail].offset <= bytesOut) {
+    hist[gsRing].Add(now - marks[markTail].time);
+    markTail = (markTail + 1) % GSTTRACE_MAXMARKS;
+  }
+
+  // Taken before push-buffer, appsrc may hand it on right away
+  guint head = __atomic_load_n(&pushHead, __ATOMIC_RELAXED);
+  if (head - __atomic_load_n(&pushTail, __ATOMIC_ACQUIRE) < GSTTRACE_FIFO) {
+    pushTimes[head % GSTTRACE_FIFO] = now;
+    __atomic_store_n(&pushHead, head + 1, __ATOMIC_RELEASE);
+  }
+}
+
+void cGstStageTracer::Skipped(int Length)
+{
+  // Caller must hold the output's mutex, dropped data has no ring latency
+  g_atomic_int_add(&ringFill, -Length);
+  bytesOut += Length;
+  while (markTail != markHead && marks[markTail].offset <= bytesOut)
+    markTail = (markTail + 1) % GSTTRACE_MAXMARKS;
+}
+
+void cGstStageTracer::Clear(void)
+{
+  // Caller must hold the output's mutex
+  markHead = markTail = 0;
+  bytesIn = bytesOut = 0;
+  g_atomic_int_set(&ringFill, 0);
+  // Buffers still queued in appsrc are flushed and never show up
+  __atomic_store_n(&pushTail, __atomic_load_n(&pushHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+void cGstStageTracer::Zap(void)
+{
+  zapStart = g_get_monotonic_time();
+  for (int i = 0; i < zmCount; i++)
+    g_atomic_int_set(&zapMarks[i], -1);
+  g_atomic_int_set(&zapPending, 1);
+}
+
+void cGstStageTracer::Mark(int Mark, gint64 Time)
+{
+  // Only the first time after Zap() counts
+  if (g_atomic_int_get(&zapMarks[Mark]) < 0 && zapStart)
+    g_atomic_int_compare_and_exchange(&zapMarks[Mark], -1, (gint)max(Time - zapStart, (gint64)0));
+}
+
+int cGstStageTracer::ZapMark(int Mark)
+{
+  int us = g_atomic_int_get(&zapMarks[Mark]);
+  return us < 0 ? -1 : us / 1000;
+}
+
+void cGstStageTracer::Reset(void)
+{
+  for (int i = 0; i < gsCount; i++)
+    hist[i].Reset();
+}
+
+void cGstStageTracer::PutFrame(tFrameTable &Table, GstClockTime Pts, gint64 Time)
+{
+  guint seq = __atomic_fetch_add(&Table.head, 1, __ATOMIC_RELAXED);
+  tFrame &f = Table.frames[seq % GSTTRACE_PTSSLOTS];
+  // Invalidate first, a TakeFrame() that read the old contents fails its
+  // compare-and-exchange
+  __atomic_store_n(&f.state, seq << 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&f.pts, (guint64)Pts, __ATOMIC_RELAXED);
+  __atomic_store_n(&f.time, Time, __ATOMIC_RELAXED);
+  __atomic_store_n(&f.state, (seq << 1) | 1, __ATOMIC_RELEASE);
+}
+
+gint64 cGstStageTracer::TakeFrame(tFrameTable &Table, GstClockTime Pts)
+{
+  // Decoders reorder frames, so the whole table is searched
+  for (int i = 0; i < GSTTRACE_PTSSLOTS; i++) {
+    tFrame &f = Table.frames[i];
+    guint state = __atomic_load_n(&f.state, __ATOMIC_ACQUIRE);
+    if (!(state & 1) || __atomic_load_n(&f.pts, __ATOMIC_RELAXED) != (guint64)Pts)
+      continue;
+    gint64 time = __atomic_load_n(&f.time, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // Fails if the slot was rewritten meanwhile, pts and time may not match
+    if (__atomic_compare_exchange_n(&f.state, &state, state & ~1u, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      return time;
+  }
+  return 0;
+}
+
+GstPadProbeReturn cGstStageTracer::SourceProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstStageTracer *self = (cGstStageTracer *)data;
+  guint tail = __atomic_load_n(&self->pushTail, __ATOMIC_RELAXED);
+  if (tail != __atomic_load_n(&self->pushHead, __ATOMIC_ACQUIRE)) {
+    self->hist[gsAppsrc].Add(g_get_monotonic_time() - self->pushTimes[tail % GSTTRACE_FIFO]);
+    // Clear() may have moved the tail meanwhile
+    __atomic_compare_exchange_n(&self->pushTail, &tail, tail + 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn cGstStageTracer::DecoderInProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstStageTracer *self = (cGstStageTracer *)data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (buffer && GST_BUFFER_PTS_IS_VALID(buffer))
+    self->PutFrame(self->decodeIn, GST_BUFFER_PTS(buffer), g_get_monotonic_time());
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn cGstStageTracer::DecoderOutProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstStageTracer *self = (cGstStageTracer *)data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer))
+    return GST_PAD_PROBE_OK;
+  gint64 now = g_get_monotonic_time();
+  gint64 in = self->TakeFrame(self->decodeIn, GST_BUFFER_PTS(buffer));
+  if (in)
+    self->hist[gsDecode].Add(now - in);
+  self->Mark(zmDecoded, now);
+  self->PutFrame(self->decodeOut, GST_BUFFER_PTS(buffer), now);
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn cGstStageTracer::SinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  cGstStageTracer *self = (cGstStageTracer *)data;
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+      self->Mark(zmCaps, g_get_monotonic_time());
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+      const GstSegment *segment;
+      gst_event_parse_segment(event, &segment);
+      gst_segment_copy_into(segment, &self->segment);
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (buffer)
+    self->SinkBuffer(pad, buffer);
+  return GST_PAD_PROBE_OK;
+}
+
+void cGstStageTracer::SinkBuffer(GstPad *Pad, GstBuffer *Buffer)
+{
+  gint64 now = g_get_monotonic_time();
+
+  if (g_atomic_int_compare_and_exchange(&zapPending, 1, 0))
+    hist[gsZap].Add(now - zapStart);
+
+  if (!GST_BUFFER_PTS_IS_VALID(Buffer)) {
+    Mark(zmRendered, now);
+    return;
+  }
+  GstClockTime pts = GST_BUFFER_PTS(Buffer);
+
+  gint64 out = TakeFrame(decodeOut, pts);
+  if (out)
+    hist[gsPost].Add(now - out);
+
+  // Time until the sink renders the buffer: its running time plus the
+  // pipeline latency, compared to the clock's running time
+  GstClock *clock = pipeline ? gst_element_get_clock(pipeline) : NULL;
+  if (!clock) {
+    Mark(zmRendered, now);
+    return;
+  }
+  GstClockTime clockTime = gst_clock_get_time(clock);
+  gst_object_unref(clock);
+  GstClockTime baseTime = gst_element_get_base_time(pipeline);
+  GstClockTime running = gst_segment_to_running_time(&segment, GST_FORMAT_TIME, pts);
+  if (!GST_CLOCK_TIME_IS_VALID(running) || clockTime < baseTime) {
+    Mark(zmRendered, now);
+    return;
+  }
+  gint64 wait = max((gint64)(running + gst_pipeline_get_latency(GST_PIPELINE(pipeline))) - (gint64)(clockTime - baseTime), (gint64)0) / 1000;
+  hist[gsSink].Add(wait);
+  // Due on the clock, that is when the sink renders it
+  Mark(zmRendered, now + wait);
+}
+
+cString cGstStageTracer::Report(void)
+{
+  cString s = cString::sprintf("%-6s %-7s %7s %8s %8s %8s %8s", name, "stage", "count", "p50", "p95", "p99", "max");
+  for (int i = 0; i < gsCount; i++) {
+    cGstHistogram &h = hist[i];
+    s = cString::sprintf("%s\n%-6s %-7s %7d %8.1f %8.1f %8.1f %8.1f", *s, "", StageName(i), h.Count(),
+                         h.Percentile(50) / 1000.0, h.Percentile(95) / 1000.0,
+                         h.Percentile(99) / 1000.0, h.Max() / 1000.0);
+  }
+  return s;
+}
@@ -0,0 +1,161 @@
+/*
+ * gsttrace.h: Per stage latency tracing for GStreamer output
+ */
+
+#ifndef __GSTTRACE_H
+#define __GSTTRACE_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+#include <gst/gst.h>
+
+#define GSTHIST_BUCKETS   112  // 16 linear + 4 per power of two up to ~67 s
+#define GSTTRACE_MAXMARKS 512  // ring buffer writes in flight
+#define GSTTRACE_FIFO     4096 // appsrc buffers in flight
+#define GSTTRACE_PTSSLOTS 64   // frames in flight per decoder/post stage
+
+// --- cGstHistogram ---------------------------------------------------------
+
+// Latency histogram in microseconds with logarithmic buckets (about 12% error).
+// Add() is lock-free and may be called from any streaming thread.
+
+class cGstHistogram {
+private:
+  gint buckets[GSTHIST_BUCKETS];
+  gint count;
+  gint maxUs;
+
+  static int Bucket(int Us);
+  static int BucketValue(int Bucket);
+
+public:
+  cGstHistogram(void);
+
+  void Reset(void);
+  void Add(int Us);
+
+  int Count(void) { return g_atomic_int_get(&count); }
+  int Max(void) { return g_atomic_int_get(&maxUs); }
+  int Percentile(int P);
+};
+
+// --- cGstStageTracer -------------------------------------------------------
+
+enum eGstStage {
+  gsRing,     // Play() to appsrc push
+  gsAppsrc,   // appsrc queue
+  gsDecode,   // decoder input to output, per frame (PTS)
+  gsPost,     // decoder output to sink (queue, deinterlacer, converters)
+  gsSink,     // sink arrival to render time
+  gsZap,      // Clear() to the first buffer at the sink
+  gsCount
+};
+
+// Milestones after Zap(), for the channel switch timeline
+enum eGstZapMark {
+  zmByte,      // first Put()
+  zmCaps,      // caps at the sink
+  zmDecoded,   // first decoder output
+  zmRendered,  // first buffer due at the sink
+  zmCount
+};
+
+// Timestamps the buffers of one pipeline at the ring buffer, appsrc, the
+// decoder and the sink. Probes only take a monotonic timestamp and do a
+// table lookup, so tracing stays enabled all the time.
+
+class cGstStageTracer {
+private:
+  const char *name;
+  GstElement *pipeline;
+  cGstHistogram hist[gsCount];
+
+  // Ring buffer, accessed under the owning output's mutex
+  struct tMark {
+    int64_t offset;
+    gint64 time;
+  };
+  tMark marks[GSTTRACE_MAXMARKS];
+  int markHead;
+  int markTail;
+  int64_t bytesIn;
+  int64_t bytesOut;
+
+  // Totals for the metrics export, read without the output's mutex
+  uint64_t totalIn;
+  uint64_t totalOut;
+  gint ringFill;
+  const char *decoderName;
+
+  // Push times, single producer (Feed) and single consumer (appsrc thread).
+  // The counters wrap, GSTTRACE_FIFO is a power of two so the slots don't.
+  gint64 pushTimes[GSTTRACE_FIFO];
+  guint pushHead;
+  guint pushTail;
+
+  // Frame times keyed by PTS, written by one streaming thread and taken by
+  // another. A slot's state is its write sequence number shifted left by
+  // one, with bit 0 set while it holds a frame that was not taken yet.
+  struct tFrame {
+    guint state;
+    guint64 pts;
+    gint64 time;
+  };
+  struct tFrameTable {
+    tFrame frames[GSTTRACE_PTSSLOTS];
+    guint head;
+  };
+  tFrameTable decodeIn;
+  tFrameTable decodeOut;
+  // Segment events are serialized with the buffers, so only the sink's
+  // streaming thread uses this
+  GstSegment segment;
+
+  gint64 zapStart;
+  gint zapPending;
+  gint zapMarks[zmCount]; // microseconds after zapStart, -1 until reached
+
+  void Mark(int Mark, gint64 Time);
+  void PutFrame(tFrameTable &Table, GstClockTime Pts, gint64 Time);
+  gint64 TakeFrame(tFrameTable &Table, GstClockTime Pts);
+  void SinkBuffer(GstPad *Pad, GstBuffer *Buffer);
+
+  static GstPadProbeReturn SourceProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn DecoderInProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn DecoderOutProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  static GstPadProbeReturn SinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+public:
+  cGstStageTracer(const char *Name);
+
+  void SetPipeline(GstElement *Pipeline) { pipeline = Pipeline; }
+  void AttachSource(GstElement *Source);
+  void AttachDecoder(GstElement *Decoder);
+  void AttachSink(GstElement *Sink);
+
+  // Ring buffer accounting, called with the owning output's mutex held
+  void Put(int Length);
+  void Pushed(int Length);
+  void Skipped(int Length);
+  void Clear(void);
+
+  // Starts the zap timer, stopped by the next buffer at the sink
+  void Zap(void);
+  // Milliseconds from Zap() to the milestone, -1 if not reached yet
+  int ZapMark(int Mark);
+
+  void Reset(void);
+  cString Report(void);
+
+  // Lock-free accessors for the metrics export
+  uint64_t BytesIn(void) { return __atomic_load_n(&totalIn, __ATOMIC_RELAXED); }
+  uint64_t BytesOut(void) { return __atomic_load_n(&totalOut, __ATOMIC_RELAXED); }
+  int RingFill(void) { return g_atomic_int_get(&ringFill); }
+  const char *DecoderName(void) { return (const char *)g_atomic_pointer_get(&decoderName); }
+  cGstHistogram &Histogram(int Stage) { return hist[Stage]; }
+
+  static bool IsDecoder(GstElement *Element);
+  static const char *StageName(int Stage);
+};
+
+#endif // __GSTTRACE_H
@@ -0,0 +1,78 @@
+/*
+ * gsttrack.c: Secondary audio tracks behind an input-selector
+ */
+
+#include "gsttrack.h"
+#include <vdr/remux.h>
+
+#define TRACK_RING_SIZE   KILOBYTE(512)     // ~5 s of 640 kbit/s AC-3
+#define TRACK_SLAB_SIZE   (32 * TS_SIZE)    // as the first track's input
+#define TRACK_POOL_SIZE   KILOBYTE(512)
+#define TRACK_APPSRC_SIZE KILOBYTE(128)
+
+// --- cGstAudioTrack --------------------------------------------------------
+
+cGstAudioTrack::cGstAudioTrack(int Track, int StreamType)
+:cGstBranch(TRACK_RING_SIZE)
+{
+  track = Track;
+  streamType = StreamType;
+  description = cString::sprintf("audio track %d", Track);
+  referencePad = NULL;
+}
+
+cGstAudioTrack::~cGstAudioTrack()
+{
+  if (referencePad)
+    gst_object_unref(referencePad);
+}
+
+GstElement *cGstAudioTrack::Create(const char *BinName)
+{
+  if (!CreateInput(BinName, gst_element_factory_make("audioconvert", NULL), TRACK_SLAB_SIZE, TRACK_POOL_SIZE, TRACK_APPSRC_SIZE))
+    return NULL;
+  AddSrcPad(converter);
+
+  isyslog("gstout: Audio track %d (stream type 0x%02X) created as %s", track, streamType, BinName);
+  return bin;
+}
+
+bool cGstAudioTrack::Align(GstPad *Pad, GstBuffer *Buffer)
+{
+  // Both tracks are timestamped from the PTS of the same program clock, so
+  // a timestamp has to map to the same running time in both. The branch
+  // started later, its segment does not match the first track's and the
+  // difference goes into the pad offset.
+  GstEvent *own = gst_pad_get_sticky_event(Pad, GST_EVENT_SEGMENT, 0);
+  GstEvent *reference = referencePad ? gst_pad_get_sticky_event(referencePad, GST_EVENT_SEGMENT, 0) : NULL;
+  bool done = false;
+  if (own && reference && GST_BUFFER_PTS_IS_VALID(Buffer)) {
+    const GstSegment *ownSegment;
+    const GstSegment *referenceSegment;
+    gst_event_parse_segment(own, &ownSegment);
+    gst_event_parse_segment(reference, &referenceSegment);
+    guint64 ownTime, referenceTime;
+    int ownSign = gst_segment_to_running_time_full(ownSegment, GST_FORMAT_TIME, GST_BUFFER_PTS(Buffer), &ownTime);
+    int referenceSign = gst_segment_to_running_time_full(referenceSegment, GST_FORMAT_TIME, GST_BUFFER_PTS(Buffer), &referenceTime);
+    if (ownSign && referenceSign) {
+      gint64 offset = (gint64)referenceTime * referenceSign - (gint64)ownTime * ownSign;
+      gst_pad_set_offset(Pad, offset);
+      dsyslog("gstout: Audio track %d aligned with an offset of %lld ms", track, (long long)(offset / GST_MSECOND));
+      done = true;
+    }
+  }
+  if (own)
+    gst_event_unref(own);
+  if (reference)
+    gst_event_unref(reference);
+  // Unaligned buffers go to an inactive selector pad, which drops them
+  return done;
+}
+
+bool cGstAudioTrack::Link(GstElement *Selector, GstPad *Reference)
+{
+  if (RequestPad())
+    return true;
+  gst_object_replace((GstObject **)&referencePad, (GstObject *)Reference);
+  return cGstBranch::Link(Selector);
+}
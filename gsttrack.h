@@ -0,0 +1,50 @@
+/*
+ * gsttrack.h: Secondary audio tracks behind an input-selector
+ */
+
+#ifndef __GSTTRACK_H
+#define __GSTTRACK_H
+
+#include "gstbranch.h"
+
+#define GSTTRACK_MAX  3  // secondary tracks decoded along with the first one
+
+// --- cGstAudioTrack --------------------------------------------------------
+
+// One more audio track of the live channel, as a branch whose ghost src pad
+// is linked to a request pad of the audio pipeline's input-selector. It is
+// decoded all the time, so switching to it only changes the selector's
+// active pad. Decoding AC-3, AAC or MPEG audio takes a few percent of a
+// core at most, a branch that only parses would have to plug and start a
+// decoder at the switch, which is the delay the selector is there to
+// avoid. PES packets come from the output thread. The first buffer
+// moves the branch onto the first track's running time (see Align()), the
+// selector then keeps the inactive tracks in sync with the active one.
+
+class cGstAudioTrack : public cGstBranch {
+private:
+  int track;       // index in the PMT's audio streams
+  int streamType;
+  GstPad *referencePad;
+
+protected:
+  virtual bool Align(GstPad *Pad, GstBuffer *Buffer);
+
+public:
+  cGstAudioTrack(int Track, int StreamType);
+  virtual ~cGstAudioTrack();
+
+  // Builds the bin, which is owned by the pipeline it is added to
+  GstElement *Create(const char *BinName);
+
+  // Selector pad, Reference is the first track's selector pad whose
+  // segment the branch is aligned to. The caller holds the audio output's
+  // mutex.
+  bool Link(GstElement *Selector, GstPad *Reference);
+  GstPad *SelectorPad(void) { return RequestPad(); }
+
+  int Track(void) { return track; }
+  cString Status(void) { return BufferStatus(); }
+};
+
+#endif // __GSTTRACK_H
@@ -0,0 +1,144 @@
+/*
+ * gstzap.c: Channel switch timeline for GStreamer output
+ */
+
+#include "gstzap.h"
+
+// --- cGstZapHistory --------------------------------------------------------
+
+cGstZapHistory::cGstZapHistory(void)
+{
+  numChannels = 0;
+  total = 0;
+  memset(&last, 0, sizeof(last));
+}
+
+const char *cGstZapHistory::EventName(int Event)
+{
+  static const char *Names[zeCount] = { "flush", "byte", "caps", "decoded", "frame", "audio" };
+  return (Event >= 0 && Event < zeCount) ? Names[Event] : "unknown";
+}
+
+cString cGstZapHistory::Format(const tGstZap &Zap)
+{
+  cString s = "";
+  for (int i = zeFirstByte; i < zeCount; i++) {
+    if (Zap.ms[i] >= 0)
+      s = cString::sprintf("%s%s%s %d", *s, i > zeFirstByte ? ", " : "", EventName(i), Zap.ms[i]);
+    else
+      s = cString::sprintf("%s%s%s -", *s, i > zeFirstByte ? ", " : "", EventName(i));
+  }
+  return cString::sprintf("%s ms", *s);
+}
+
+cGstZapHistory::tChannel *cGstZapHistory::GetChannel(int Number, bool Create)
+{
+  // Caller must hold mutex
+  for (int i = 0; i < numChannels; i++) {
+    if (channels[i].number == Number)
+      return &channels[i];
+  }
+  if (!Create)
+    return NULL;
+
+  tChannel *c;
+  if (numChannels < GSTZAP_CHANNELS)
+    c = &channels[numChannels++];
+  else {
+    // Replace the least recently zapped channel
+    c = &channels[0];
+    for (int i = 1; i < numChannels; i++) {
+      if (channels[i].last < c->last)
+        c = &channels[i];
+    }
+  }
+  c->number = Number;
+  c->count = 0;
+  c->last = 0;
+  return c;
+}
+
+int cGstZapHistory::Median(const tChannel *Channel, int Event)
+{
+  int values[GSTZAP_HISTORY];
+  int n = 0;
+  for (int i = 0; i < min(Channel->count, GSTZAP_HISTORY); i++) {
+    int ms = Channel->zaps[i].ms[Event];
+    if (ms < 0)
+      continue;
+    // Insertion sort, there are only a few values
+    int j = n++;
+    while (j > 0 && values[j - 1] > ms) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = ms;
+  }
+  return n ? values[n / 2] : -1;
+}
+
+void cGstZapHistory::Add(const tGstZap &Zap)
+{
+  cMutexLock lock(&mutex);
+
+  tChannel *c = GetChannel(Zap.channel, true);
+  c->zaps[c->count % GSTZAP_HISTORY] = Zap;
+  c->count++;
+  c->last = Zap.when;
+  total++;
+  last = Zap;
+}
+
+void cGstZapHistory::Clear(void)
+{
+  cMutexLock lock(&mutex);
+  numChannels = 0;
+}
+
+int cGstZapHistory::Total(void)
+{
+  cMutexLock lock(&mutex);
+  return total;
+}
+
+bool cGstZapHistory::Last(tGstZap &Zap)
+{
+  cMutexLock lock(&mutex);
+  Zap = last;
+  return total > 0;
+}
+
+cString cGstZapHistory::Report(int Channel, cString (*ChannelName)(int Number))
+{
+  cMutexLock lock(&mutex);
+
+  if (Channel) {
+    tChannel *c = GetChannel(Channel, false);
+    if (!c)
+      return cString::sprintf("No zaps to channel %d", Channel);
+    cString s = cString::sprintf("Channel %d%s%s, %d zaps", Channel, ChannelName ? " " : "", ChannelName ? *ChannelName(Channel) : "", c->count);
+    // Oldest first
+    int n = min(c->count, GSTZAP_HISTORY);
+    for (int i = 0; i < n; i++) {
+      const tGstZap &z = c->zaps[(c->count - n + i) % GSTZAP_HISTORY];
+      s = cString::sprintf("%s\n%s  %s", *s, *TimeString(z.when), *Format(z));
+    }
+    return s;
+  }
+
+  if (!numChannels)
+    return "No zaps recorded";
+
+  cString s = cString::sprintf("%5s %-20s %5s %7s %7s %7s %7s %7s  (median ms)", "chan", "name", "zaps",
+                               EventName(zeFirstByte), EventName(zeCaps), EventName(zeDecoded),
+                               EventName(zeFirstFrame), EventName(zeFirstAudio));
+  for (int i = 0; i < numChannels; i++) {
+    tChannel *c = &channels[i];
+    s = cString::sprintf("%s\n%5d %-20.20s %5d", *s, c->number, ChannelName ? *ChannelName(c->number) : "", c->count);
+    for (int e = zeFirstByte; e < zeCount; e++) {
+      int ms = Median(c, e);
+      s = ms >= 0 ? cString::sprintf("%s %7d", *s, ms) : cString::sprintf("%s %7s", *s, "-");
+    }
+  }
+  return s;
+}
@@ -0,0 +1,68 @@
+/*
+ * gstzap.h: Channel switch timeline for GStreamer output
+ */
+
+#ifndef __GSTZAP_H
+#define __GSTZAP_H
+
+#include <time.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+#define GSTZAP_CHANNELS 64  // channels with a history, least recently zapped is dropped
+#define GSTZAP_HISTORY  16  // zaps kept per channel
+
+// Timeline events, in milliseconds after the flush
+enum eGstZapEvent {
+  zeFlush,       // Clear()
+  zeFirstByte,   // first data accepted by either output
+  zeCaps,        // video caps negotiated at the sink
+  zeDecoded,     // first decoded video frame
+  zeFirstFrame,  // first video frame due for display
+  zeFirstAudio,  // first audio buffer due for playback
+  zeCount
+};
+
+struct tGstZap {
+  time_t when;
+  int channel;      // VDR channel number, 0 if unknown
+  int ms[zeCount];  // -1 if the event did not happen
+};
+
+// --- cGstZapHistory --------------------------------------------------------
+
+class cGstZapHistory {
+private:
+  struct tChannel {
+    int number;
+    int count;  // total zaps, the last GSTZAP_HISTORY are kept
+    time_t last;
+    tGstZap zaps[GSTZAP_HISTORY];
+  };
+  tChannel channels[GSTZAP_CHANNELS];
+  int numChannels;
+  int total;
+  tGstZap last;
+  cMutex mutex;
+
+  tChannel *GetChannel(int Number, bool Create);
+  static int Median(const tChannel *Channel, int Event);
+
+public:
+  cGstZapHistory(void);
+
+  void Add(const tGstZap &Zap);
+  void Clear(void);
+
+  // Zaps since start (not reset by Clear()) and the latest one
+  int Total(void);
+  bool Last(tGstZap &Zap);
+
+  // Summary of all channels, or every kept zap of one channel
+  cString Report(int Channel = 0, cString (*ChannelName)(int Number) = NULL);
+
+  static cString Format(const tGstZap &Zap);
+  static const char *EventName(int Event);
+};
+
+#endif // __GSTZAP_H